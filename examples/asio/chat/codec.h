@@ -60,6 +60,16 @@ class LengthHeaderCodec : muduo::noncopyable
     conn->send(&buf);
   }
 
+  // message with its length header, to be sent as is
+  static muduo::string frame(const muduo::StringPiece& message)
+  {
+    int32_t len = static_cast<int32_t>(message.size());
+    int32_t be32 = muduo::net::sockets::hostToNetwork32(len);
+    muduo::string framed(reinterpret_cast<const char*>(&be32), sizeof be32);
+    framed.append(message.data(), message.size());
+    return framed;
+  }
+
  private:
   StringMessageCallback messageCallback_;
   const static size_t kHeaderLen = sizeof(int32_t);
@@ -1,12 +1,14 @@
 #include "examples/asio/chat/codec.h"
 
 #include "muduo/base/Atomic.h"
+#include "muduo/base/Histogram.h"
 #include "muduo/base/Logging.h"
 #include "muduo/base/Mutex.h"
 #include "muduo/net/EventLoop.h"
 #include "muduo/net/EventLoopThreadPool.h"
 #include "muduo/net/TcpClient.h"
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <unistd.h>
 
@@ -14,12 +16,15 @@ using namespace muduo;
 using namespace muduo::net;
 
 int g_connections = 0;
+int g_rounds = 1;
 AtomicInt32 g_aliveConnections;
-AtomicInt32 g_messagesReceived;
+AtomicInt64 g_messagesReceived;
 Timestamp g_startTime;
-std::vector<Timestamp> g_receiveTime;
+// from sending to receiving, of every message by every client, in us
+ConcurrentHistogram g_latency;
 EventLoop* g_loop;
 std::function<void()> g_statistic;
+std::function<void()> g_nextRound;
 
 class ChatClient : noncopyable
 {
@@ -46,8 +51,6 @@ class ChatClient : noncopyable
     // client_.disconnect();
   }
 
-  Timestamp receiveTime() const { return receiveTime_; }
-
  private:
   void onConnection(const TcpConnectionPtr& conn)
   {
@@ -61,6 +64,9 @@ class ChatClient : noncopyable
       if (g_aliveConnections.incrementAndGet() == g_connections)
       {
         LOG_INFO << "all connected";
+        g_startTime = addTime(Timestamp::now(), 10.0);
+        g_nextRound = std::bind(&EventLoop::runInLoop, loop_,
+                                EventLoop::Functor(std::bind(&ChatClient::send, this)));
         loop_->runAfter(10.0, std::bind(&ChatClient::send, this));
       }
     }
@@ -70,30 +76,34 @@ class ChatClient : noncopyable
     }
   }
 
+  // the message is the time of sending
   void onStringMessage(const TcpConnectionPtr&,
                        const string& message,
                        Timestamp)
   {
     // printf("<<< %s\n", message.c_str());
-    receiveTime_ = loop_->pollReturnTime();
-    int received = g_messagesReceived.incrementAndGet();
-    if (received == g_connections)
+    int64_t sent = strtoll(message.c_str(), NULL, 10);
+    g_latency.record(loop_->pollReturnTime().microSecondsSinceEpoch() - sent);
+    int64_t received = g_messagesReceived.incrementAndGet();
+    if (received == static_cast<int64_t>(g_connections) * g_rounds)
     {
       Timestamp endTime = Timestamp::now();
-      LOG_INFO << "all received " << g_connections << " in "
+      LOG_INFO << "all received " << g_rounds << " x " << g_connections << " in "
                << timeDifference(endTime, g_startTime);
       g_loop->queueInLoop(g_statistic);
     }
-    else if (received % 1000 == 0)
+    else if (received % g_connections == 0)
     {
-      LOG_DEBUG << received;
+      // everyone has got it, the next one
+      g_loop->queueInLoop(g_nextRound);
     }
   }
 
   void send()
   {
-    g_startTime = Timestamp::now();
-    codec_.send(get_pointer(connection_), "hello");
+    char buf[32];
+    snprintf(buf, sizeof buf, "%" PRId64, Timestamp::now().microSecondsSinceEpoch());
+    codec_.send(get_pointer(connection_), buf);
     LOG_DEBUG << "sent";
   }
 
@@ -101,28 +111,22 @@ class ChatClient : noncopyable
   TcpClient client_;
   LengthHeaderCodec codec_;
   TcpConnectionPtr connection_;
-  Timestamp receiveTime_;
 };
 
 void statistic(const std::vector<std::unique_ptr<ChatClient>>& clients)
 {
   LOG_INFO << "statistic " << clients.size();
-  std::vector<double> seconds(clients.size());
-  for (size_t i = 0; i < clients.size(); ++i)
-  {
-    seconds[i] = timeDifference(clients[i]->receiveTime(), g_startTime);
-  }
-
-  std::sort(seconds.begin(), seconds.end());
-  for (size_t i = 0; i < clients.size(); i += std::max(static_cast<size_t>(1), clients.size()/20))
+  Histogram latency = g_latency.snapshot();
+  // seconds from sending to receiving
+  for (int percent = 0; percent < 100; percent += 5)
   {
-    printf("%6zd%% %.6f\n", i*100/clients.size(), seconds[i]);
+    printf("%6d%% %.6f\n", percent, static_cast<double>(latency.percentile(percent)) / 1e6);
   }
-  if (clients.size() >= 100)
-  {
-    printf("%6d%% %.6f\n", 99, seconds[clients.size() - clients.size()/100]);
-  }
-  printf("%6d%% %.6f\n", 100, seconds.back());
+  printf("%6d%% %.6f\n", 99, static_cast<double>(latency.percentile(99)) / 1e6);
+  printf("%6.1f%% %.6f\n", 99.9, static_cast<double>(latency.percentile(99.9)) / 1e6);
+  printf("%6d%% %.6f\n", 100, static_cast<double>(latency.max()) / 1e6);
+  printf("%d rounds to %zd clients, latency us %s\n",
+         g_rounds, clients.size(), latency.toString().c_str());
 }
 
 int main(int argc, char* argv[])
@@ -138,6 +142,10 @@ int main(int argc, char* argv[])
     {
       threads = atoi(argv[4]);
     }
+    if (argc > 5)
+    {
+      g_rounds = atoi(argv[5]);
+    }
 
     EventLoop loop;
     g_loop = &loop;
@@ -145,7 +153,6 @@ int main(int argc, char* argv[])
     loopPool.setThreadNum(threads);
     loopPool.start();
 
-    g_receiveTime.reserve(g_connections);
     std::vector<std::unique_ptr<ChatClient>> clients(g_connections);
     g_statistic = std::bind(statistic, std::ref(clients));
 
@@ -161,7 +168,7 @@ int main(int argc, char* argv[])
   }
   else
   {
-    printf("Usage: %s host_ip port connections [threads]\n", argv[0]);
+    printf("Usage: %s host_ip port connections [threads] [rounds]\n", argv[0]);
   }
 }
 
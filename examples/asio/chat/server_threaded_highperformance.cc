@@ -1,12 +1,10 @@
 #include "examples/asio/chat/codec.h"
 
 #include "muduo/base/Logging.h"
-#include "muduo/base/Mutex.h"
-#include "muduo/base/ThreadLocalSingleton.h"
+#include "muduo/net/Broadcaster.h"
 #include "muduo/net/EventLoop.h"
 #include "muduo/net/TcpServer.h"
 
-#include <set>
 #include <stdio.h>
 #include <unistd.h>
 
@@ -34,7 +32,6 @@ class ChatServer : noncopyable
 
   void start()
   {
-    server_.setThreadInitCallback(std::bind(&ChatServer::threadInit, this, _1));
     server_.start();
   }
 
@@ -47,60 +44,25 @@ class ChatServer : noncopyable
 
     if (conn->connected())
     {
-      LocalConnections::instance().insert(conn);
+      broadcaster_.add(conn);
     }
     else
     {
-      LocalConnections::instance().erase(conn);
+      broadcaster_.remove(conn);
     }
   }
 
+  // framed once, each loop writes it to its own connections
   void onStringMessage(const TcpConnectionPtr&,
                        const string& message,
                        Timestamp)
   {
-    EventLoop::Functor f = std::bind(&ChatServer::distributeMessage, this, message);
-    LOG_DEBUG;
-
-    MutexLockGuard lock(mutex_);
-    for (std::set<EventLoop*>::iterator it = loops_.begin();
-        it != loops_.end();
-        ++it)
-    {
-      (*it)->queueInLoop(f);
-    }
-    LOG_DEBUG;
-  }
-
-  typedef std::set<TcpConnectionPtr> ConnectionList;
-
-  void distributeMessage(const string& message)
-  {
-    LOG_DEBUG << "begin";
-    for (ConnectionList::iterator it = LocalConnections::instance().begin();
-        it != LocalConnections::instance().end();
-        ++it)
-    {
-      codec_.send(get_pointer(*it), message);
-    }
-    LOG_DEBUG << "end";
-  }
-
-  void threadInit(EventLoop* loop)
-  {
-    assert(LocalConnections::pointer() == NULL);
-    LocalConnections::instance();
-    assert(LocalConnections::pointer() != NULL);
-    MutexLockGuard lock(mutex_);
-    loops_.insert(loop);
+    broadcaster_.broadcast(LengthHeaderCodec::frame(message));
   }
 
+  Broadcaster broadcaster_;  // outlives the loops of server_
   TcpServer server_;
   LengthHeaderCodec codec_;
-  typedef ThreadLocalSingleton<ConnectionList> LocalConnections;
-
-  MutexLock mutex_;
-  std::set<EventLoop*> loops_ GUARDED_BY(mutex_);
 };
 
 int main(int argc, char* argv[])
@@ -0,0 +1,209 @@
+#include "examples/hub/pubsub.h"
+#include "muduo/base/Atomic.h"
+#include "muduo/base/Logging.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/EventLoopThreadPool.h"
+
+#include <memory>
+#include <vector>
+#include <stdio.h>
+
+using namespace muduo;
+using namespace muduo::net;
+using namespace pubsub;
+
+// Subscribers of some topics, and a publisher for each topic sending
+// messages to them through the hub, messages/sec x subscribers of a topic
+// is the fan-out rate.
+class FanoutBench : noncopyable
+{
+ public:
+  FanoutBench(EventLoop* loop, const InetAddress& hubAddr,
+              int subscribers, int messages, int size, int threads, int topics)
+    : loop_(loop),
+      hubAddr_(hubAddr),
+      numSubscribers_(subscribers),
+      messages_(messages),
+      content_(size, 'x'),
+      clientPool_(loop, "fanout_bench"),
+      connectedPublishers_(0),
+      warming_(true)
+  {
+    clientPool_.setThreadNum(threads);
+    for (int i = 0; i < topics; ++i)
+    {
+      Fmt f("fanout_bench_%d", i);
+      topics_.push_back(string(f.data(), f.length()));
+      publishers_.emplace_back(new PubSubClient(loop, hubAddr, "pub_" + topics_.back()));
+      publishers_.back()->setConnectionCallback(
+          std::bind(&FanoutBench::onPublisherConnection, this, _1));
+    }
+  }
+
+  void start()
+  {
+    clientPool_.start();
+    for (const auto& pub : publishers_)
+    {
+      pub->start();
+    }
+  }
+
+ private:
+  static const char kWarmUp[];
+
+  void onPublisherConnection(PubSubClient* client)
+  {
+    if (!client->connected())
+    {
+      loop_->quit();
+      return;
+    }
+    if (++connectedPublishers_ < publishers_.size())
+    {
+      return;
+    }
+    // a subscriber gets the last message when it subscribes,
+    // so it knows that the hub has its subscription.
+    publishAll(kWarmUp);
+    for (int i = 0; i < numSubscribers_; ++i)
+    {
+      Fmt f("sub%05d", i);
+      string name(f.data(), f.length());
+      subscribers_.emplace_back(
+          new PubSubClient(clientPool_.getNextLoop(), hubAddr_, name));
+      PubSubClient* sub = subscribers_.back().get();
+      sub->setConnectionCallback(
+          std::bind(&FanoutBench::onSubscriberConnection, this, _1, topics_[i % topics_.size()]));
+      sub->start();
+    }
+    loop_->runEvery(0.5, std::bind(&FanoutBench::warmUp, this));
+  }
+
+  void publishAll(const string& content)
+  {
+    for (size_t i = 0; i < publishers_.size(); ++i)
+    {
+      publishers_[i]->publish(topics_[i], content);
+    }
+  }
+
+  void onSubscriberConnection(PubSubClient* client, const string& topic)
+  {
+    if (client->connected())
+    {
+      client->subscribe(topic,
+                        std::bind(&FanoutBench::onMessage, this, _2));
+    }
+    else
+    {
+      // after TcpClient forgets the connection, then it is safe to destroy
+      EventLoop::getEventLoopOfCurrentThread()->queueInLoop(
+          std::bind(&FanoutBench::onSubscriberClosed, this));
+    }
+  }
+
+  void onSubscriberClosed()
+  {
+    if (disconnected_.incrementAndGet() == numSubscribers_)
+    {
+      loop_->queueInLoop(std::bind(&EventLoop::quit, loop_));
+    }
+  }
+
+  void onMessage(const string& content)
+  {
+    if (content == kWarmUp)
+    {
+      if (ready_.incrementAndGet() == numSubscribers_)
+      {
+        loop_->queueInLoop(std::bind(&FanoutBench::publish, this));
+      }
+    }
+    else if (received_.incrementAndGet() == static_cast<int64_t>(messages_) * numSubscribers_)
+    {
+      loop_->queueInLoop(std::bind(&FanoutBench::finish, this));
+    }
+  }
+
+  // in case a subscription reached the hub before the first message
+  void warmUp()
+  {
+    if (warming_)
+    {
+      printf("%d of %d subscribers ready\n", ready_.get(), numSubscribers_);
+      publishAll(kWarmUp);
+    }
+  }
+
+  void publish()
+  {
+    warming_ = false;
+    start_ = Timestamp::now();
+    for (int i = 0; i < messages_; ++i)
+    {
+      publishAll(content_);
+    }
+  }
+
+  void finish()
+  {
+    double seconds = timeDifference(Timestamp::now(), start_);
+    double deliveries = static_cast<double>(messages_) * numSubscribers_;
+    double messages = static_cast<double>(messages_) * static_cast<double>(topics_.size());
+    printf("%d subscribers of %zd topics, %.0f messages of %zd bytes in %.3f seconds\n",
+           numSubscribers_, topics_.size(), messages, content_.size(), seconds);
+    printf("%.0f messages/sec, %.0f deliveries/sec, %.1f MiB/s\n",
+           messages / seconds, deliveries / seconds,
+           deliveries * static_cast<double>(content_.size()) / seconds / 1024 / 1024);
+    for (const auto& sub : subscribers_)
+    {
+      sub->stop();
+    }
+  }
+
+  EventLoop* loop_;
+  const InetAddress hubAddr_;
+  const int numSubscribers_;
+  const int messages_;
+  const string content_;
+  EventLoopThreadPool clientPool_;
+  std::vector<string> topics_;
+  std::vector<std::unique_ptr<PubSubClient>> publishers_;  // one for each topic
+  size_t connectedPublishers_;
+  std::vector<std::unique_ptr<PubSubClient>> subscribers_;
+  AtomicInt32 ready_;
+  AtomicInt32 disconnected_;
+  AtomicInt64 received_;
+  bool warming_;
+  Timestamp start_;
+};
+
+const char FanoutBench::kWarmUp[] = "warm_up";
+
+int main(int argc, char* argv[])
+{
+  if (argc > 3)
+  {
+    string hostport = argv[1];
+    size_t colon = hostport.find(':');
+    if (colon != string::npos)
+    {
+      string hostip = hostport.substr(0, colon);
+      uint16_t port = static_cast<uint16_t>(atoi(hostport.c_str()+colon+1));
+      int subscribers = atoi(argv[2]);
+      int messages = atoi(argv[3]);
+      int size = argc > 4 ? atoi(argv[4]) : 100;
+      int threads = argc > 5 ? atoi(argv[5]) : 0;
+      int topics = argc > 6 ? atoi(argv[6]) : 1;
+
+      Logger::setLogLevel(Logger::WARN);
+      EventLoop loop;
+      FanoutBench bench(&loop, InetAddress(hostip, port), subscribers, messages, size, threads, topics);
+      bench.start();
+      loop.loop();
+      return 0;
+    }
+  }
+  printf("Usage: %s hub_ip:port subscribers messages [message_size] [threads] [topics]\n", argv[0]);
+}
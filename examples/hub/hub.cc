@@ -1,12 +1,16 @@
 #include "examples/hub/codec.h"
 
 #include "muduo/base/Logging.h"
+#include "muduo/base/Mutex.h"
 #include "muduo/net/EventLoop.h"
+#include "muduo/net/EventLoopThreadPool.h"
 #include "muduo/net/TcpServer.h"
 
 #include <map>
 #include <set>
+#include <vector>
 #include <stdio.h>
+#include <sys/uio.h>
 
 using namespace muduo;
 using namespace muduo::net;
@@ -16,6 +20,19 @@ namespace pubsub
 
 typedef std::set<string> ConnectionSubscription;
 
+// A framed "pub" message, encoded once and shared by the output queues of
+// all subscribers until written.  Never modified once made.
+typedef std::shared_ptr<const string> MessagePtr;
+
+void sendMessage(const TcpConnectionPtr& conn, const MessagePtr& message)
+{
+  struct iovec vec;
+  vec.iov_base = const_cast<char*>(message->data());
+  vec.iov_len = message->size();
+  conn->send(&vec, 1, std::const_pointer_cast<string>(message));
+}
+
+// Subscribers of a topic in one IO loop, used in that loop only.
 class Topic : public muduo::copyable
 {
  public:
@@ -27,9 +44,9 @@ class Topic : public muduo::copyable
   void add(const TcpConnectionPtr& conn)
   {
     audiences_.insert(conn);
-    if (lastPubTime_.valid())
+    if (message_)
     {
-      conn->send(makeMessage());
+      sendMessage(conn, message_);
     }
   }
 
@@ -38,29 +55,25 @@ class Topic : public muduo::copyable
     audiences_.erase(conn);
   }
 
-  void publish(const string& content, Timestamp time)
+  bool empty() const
   {
-    content_ = content;
-    lastPubTime_ = time;
-    string message = makeMessage();
+    return audiences_.empty();
+  }
+
+  void publish(const MessagePtr& message)
+  {
+    message_ = message;
     for (std::set<TcpConnectionPtr>::iterator it = audiences_.begin();
          it != audiences_.end();
          ++it)
     {
-      (*it)->send(message);
+      sendMessage(*it, message);
     }
   }
 
  private:
-
-  string makeMessage()
-  {
-    return "pub " + topic_ + "\r\n" + content_ + "\r\n";
-  }
-
   string topic_;
-  string content_;
-  Timestamp lastPubTime_;
+  MessagePtr message_;  // the last one
   std::set<TcpConnectionPtr> audiences_;
 };
 
@@ -79,12 +92,59 @@ class PubSubServer : noncopyable
     loop_->runEvery(1.0, std::bind(&PubSubServer::timePublish, this));
   }
 
+  void setThreadNum(int numThreads)
+  {
+    server_.setThreadNum(numThreads);
+  }
+
   void start()
   {
     server_.start();
+    // no connection yet, the base loop is not looping
+    std::shared_ptr<EventLoopThreadPool> pool = server_.threadPool();
+    std::vector<EventLoop*> loops = pool->getAllLoops();
+    for (EventLoop* ioLoop : loops)
+    {
+      shards_[ioLoop].reset(new Shard(ioLoop));
+    }
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+      owners_.push_back(shards_[pool->getLoopForHash(i)].get());
+    }
   }
 
  private:
+  struct Shard;
+
+  struct Delivery
+  {
+    string topic;
+    MessagePtr message;
+  };
+
+  struct OwnedTopic
+  {
+    MessagePtr message;  // the last one
+    std::set<Shard*> subscribers;  // loops having subscribers
+  };
+
+  // An IO loop, with the subscribers connected to it, and the topics
+  // hashed to it.  Used in that loop only, except the inbox.
+  struct Shard : noncopyable
+  {
+    explicit Shard(EventLoop* ioLoop)
+      : loop(ioLoop)
+    {
+    }
+
+    EventLoop* const loop;
+    std::map<string, Topic> audiences;
+    std::map<string, OwnedTopic> topics;
+    MutexLock mutex;
+    // messages from owners in other loops, sent by drain() in one go
+    std::vector<Delivery> inbox GUARDED_BY(mutex);
+  };
+
   void onConnection(const TcpConnectionPtr& conn)
   {
     if (conn->connected())
@@ -156,41 +216,145 @@ class PubSubServer : noncopyable
       = boost::any_cast<ConnectionSubscription>(conn->getMutableContext());
 
     connSub->insert(topic);
-    getTopic(topic).add(conn);
+    Shard* local = shardOf(conn->getLoop());
+    std::map<string, Topic>::iterator it = local->audiences.find(topic);
+    if (it == local->audiences.end())
+    {
+      // the first one in this loop, the owner sends the last message to all
+      it = local->audiences.insert(make_pair(topic, Topic(topic))).first;
+      Shard* owner = ownerOf(topic);
+      owner->loop->runInLoop(
+          std::bind(&PubSubServer::addSubscriberLoop, this, owner, topic, local));
+    }
+    it->second.add(conn);
   }
 
   void doUnsubscribe(const TcpConnectionPtr& conn,
                      const string& topic)
   {
     LOG_INFO << conn->name() << " unsubscribes " << topic;
-    getTopic(topic).remove(conn);
+    Shard* local = shardOf(conn->getLoop());
+    std::map<string, Topic>::iterator it = local->audiences.find(topic);
+    if (it != local->audiences.end())
+    {
+      it->second.remove(conn);
+      if (it->second.empty())
+      {
+        local->audiences.erase(it);
+        Shard* owner = ownerOf(topic);
+        owner->loop->runInLoop(
+            std::bind(&PubSubServer::removeSubscriberLoop, this, owner, topic, local));
+      }
+    }
     // topic could be the one to be destroyed, so don't use it after erasing.
     ConnectionSubscription* connSub
       = boost::any_cast<ConnectionSubscription>(conn->getMutableContext());
     connSub->erase(topic);
   }
 
+  // Encodes the message once, its owner passes it to the loops having
+  // subscribers, each of them sends it to its own subscribers.
   void doPublish(const string& source,
                  const string& topic,
                  const string& content,
                  Timestamp time)
   {
-    getTopic(topic).publish(content, time);
+    MessagePtr message(new string("pub " + topic + "\r\n" + content + "\r\n"));
+    Shard* owner = ownerOf(topic);
+    owner->loop->runInLoop(
+        std::bind(&PubSubServer::publishInOwner, this, owner, topic, message));
   }
 
-  Topic& getTopic(const string& topic)
+  void publishInOwner(Shard* owner, const string& topic, const MessagePtr& message)
   {
-    std::map<string, Topic>::iterator it = topics_.find(topic);
-    if (it == topics_.end())
+    owner->loop->assertInLoopThread();
+    OwnedTopic& owned = owner->topics[topic];
+    owned.message = message;
+    for (Shard* subscriber : owned.subscribers)
     {
-      it = topics_.insert(make_pair(topic, Topic(topic))).first;
+      deliver(subscriber, topic, message);
     }
-    return it->second;
+  }
+
+  void addSubscriberLoop(Shard* owner, const string& topic, Shard* subscriber)
+  {
+    owner->loop->assertInLoopThread();
+    OwnedTopic& owned = owner->topics[topic];
+    owned.subscribers.insert(subscriber);
+    if (owned.message)
+    {
+      deliver(subscriber, topic, owned.message);
+    }
+  }
+
+  void removeSubscriberLoop(Shard* owner, const string& topic, Shard* subscriber)
+  {
+    owner->loop->assertInLoopThread();
+    owner->topics[topic].subscribers.erase(subscriber);
+  }
+
+  // In the owner loop.  Messages of a topic reach a loop in the order
+  // the owner publishes them, either way.
+  void deliver(Shard* subscriber, const string& topic, const MessagePtr& message)
+  {
+    if (subscriber->loop->isInLoopThread())
+    {
+      deliverInLoop(subscriber, topic, message);
+      return;
+    }
+    bool wakeup = false;
+    {
+    MutexLockGuard lock(subscriber->mutex);
+    wakeup = subscriber->inbox.empty();
+    Delivery delivery = { topic, message };
+    subscriber->inbox.push_back(std::move(delivery));
+    }
+    if (wakeup)
+    {
+      subscriber->loop->queueInLoop(std::bind(&PubSubServer::drain, this, subscriber));
+    }
+  }
+
+  // all deliveries queued since the last drain, in one functor
+  void drain(Shard* subscriber)
+  {
+    std::vector<Delivery> inbox;
+    {
+    MutexLockGuard lock(subscriber->mutex);
+    inbox.swap(subscriber->inbox);
+    }
+    for (const Delivery& delivery : inbox)
+    {
+      deliverInLoop(subscriber, delivery.topic, delivery.message);
+    }
+  }
+
+  void deliverInLoop(Shard* subscriber, const string& topic, const MessagePtr& message)
+  {
+    subscriber->loop->assertInLoopThread();
+    std::map<string, Topic>::iterator it = subscriber->audiences.find(topic);
+    // all of them may have gone since
+    if (it != subscriber->audiences.end())
+    {
+      it->second.publish(message);
+    }
+  }
+
+  Shard* shardOf(EventLoop* ioLoop) const
+  {
+    return shards_.at(ioLoop).get();
+  }
+
+  Shard* ownerOf(const string& topic) const
+  {
+    return owners_[std::hash<string>()(topic) % owners_.size()];
   }
 
   EventLoop* loop_;
   TcpServer server_;
-  std::map<string, Topic> topics_;
+  // filled in start(), read-only then
+  std::map<EventLoop*, std::unique_ptr<Shard>> shards_;
+  std::vector<Shard*> owners_;  // by hash of topic
 };
 
 }  // namespace pubsub
@@ -206,12 +370,16 @@ int main(int argc, char* argv[])
       //int inspectPort = atoi(argv[2]);
     }
     pubsub::PubSubServer server(&loop, InetAddress(port));
+    if (argc > 3)
+    {
+      server.setThreadNum(atoi(argv[3]));
+    }
     server.start();
     loop.loop();
   }
   else
   {
-    printf("Usage: %s pubsub_port [inspect_port]\n", argv[0]);
+    printf("Usage: %s pubsub_port [inspect_port] [threads]\n", argv[0]);
   }
 }
 
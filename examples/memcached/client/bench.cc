@@ -1,5 +1,6 @@
 #include "muduo/base/CountDownLatch.h"
 #include "muduo/base/Logging.h"
+#include "muduo/net/Endian.h"
 #include "muduo/net/EventLoop.h"
 #include "muduo/net/EventLoopThreadPool.h"
 #include "muduo/net/TcpClient.h"
@@ -20,6 +21,7 @@ class Client : noncopyable
   {
     kGet,
     kSet,
+    kMixed,  // getPercent gets, the rest sets
   };
 
   Client(const string& name,
@@ -29,11 +31,17 @@ class Client : noncopyable
          int requests,
          int keys,
          int valuelen,
+         int getPercent,
+         int multiget,
+         bool binary,
          CountDownLatch* connected,
          CountDownLatch* finished)
     : name_(name),
       client_(loop, serverAddr, name),
       op_(op),
+      getPercent_(getPercent),
+      multiget_(multiget),
+      binary_(binary),
       sent_(0),
       acked_(0),
       requests_(requests),
@@ -43,7 +51,10 @@ class Client : noncopyable
       connected_(connected),
       finished_(finished)
   {
-    value_ += "\r\n";
+    if (!binary_)
+    {
+      value_ += "\r\n";
+    }
     client_.setConnectionCallback(std::bind(&Client::onConnection, this, _1));
     client_.setMessageCallback(std::bind(&Client::onMessage, this, _1, _2, _3));
     client_.connect();
@@ -72,62 +83,111 @@ class Client : noncopyable
     }
   }
 
+  enum Opcode
+  {
+    kBinaryGet = 0x00,
+    kBinarySet = 0x01,
+    kBinaryNoop = 0x0a,
+    kBinaryGetKQ = 0x0d,
+  };
+
   void onMessage(const TcpConnectionPtr& conn,
                  Buffer* buffer,
                  Timestamp receiveTime)
   {
-    if (op_ == kSet)
+    if (binary_)
+    {
+      onBinaryMessage(buffer);
+      return;
+    }
+    while (buffer->readableBytes() > 0)
     {
-      while (buffer->readableBytes() > 0)
+      const char* end = NULL;
+      if (isGet(acked_))
       {
-        const char* crlf = buffer->findCRLF();
-        if (crlf)
+        end = static_cast<const char*>(memmem(buffer->peek(),
+                                              buffer->readableBytes(),
+                                              "END\r\n", 5));
+        if (end)
         {
-          buffer->retrieveUntil(crlf+2);
-          ++acked_;
-          if (sent_ < requests_)
-          {
-            send();
-          }
+          end += 5;
         }
-        else
+      }
+      else
+      {
+        end = buffer->findCRLF();
+        if (end)
         {
-          break;
+          end += 2;
         }
       }
+      if (end)
+      {
+        buffer->retrieveUntil(end);
+        ack();
+      }
+      else
+      {
+        break;
+      }
     }
-    else
+  }
+
+  // a get is answered by its hits, then by the noop after them
+  void onBinaryMessage(Buffer* buffer)
+  {
+    const size_t kHeaderSize = 24;
+    while (buffer->readableBytes() >= kHeaderSize)
     {
-      while (buffer->readableBytes() > 0)
+      uint32_t bodylen = 0;
+      ::memcpy(&bodylen, buffer->peek() + 8, sizeof bodylen);
+      bodylen = sockets::networkToHost32(bodylen);
+      if (buffer->readableBytes() < kHeaderSize + bodylen)
       {
-        const char* end = static_cast<const char*>(memmem(buffer->peek(),
-                                                          buffer->readableBytes(),
-                                                          "END\r\n", 5));
-        if (end)
-        {
-          buffer->retrieveUntil(end+5);
-          ++acked_;
-          if (sent_ < requests_)
-          {
-            send();
-          }
-        }
-        else
-        {
-          break;
-        }
+        break;
+      }
+      const uint8_t opcode = static_cast<uint8_t>(buffer->peek()[1]);
+      buffer->retrieve(kHeaderSize + bodylen);
+      if (!isGet(acked_) || opcode == kBinaryNoop)
+      {
+        ack();
       }
     }
-    if (acked_ == requests_)
+  }
+
+  void ack()
+  {
+    ++acked_;
+    if (sent_ < requests_)
+    {
+      send();
+    }
+    else if (acked_ == requests_)
     {
       conn_->shutdown();
     }
   }
 
+  bool isGet(int request) const
+  {
+    if (op_ == kMixed)
+    {
+      // scrambled, so that every key is both got and set
+      return (static_cast<uint32_t>(request) * 2654435761u >> 16) % 100
+          < static_cast<uint32_t>(getPercent_);
+    }
+    return op_ == kGet;
+  }
+
   void fill(Buffer* buf)
   {
+    if (binary_)
+    {
+      fillBinary(buf);
+      return;
+    }
     char req[256];
-    if (op_ == kSet)
+    if (!isGet(sent_))
     {
       snprintf(req, sizeof req, "set %s%d 42 0 %d\r\n", name_.c_str(), sent_ % keys_, valuelen_);
       ++sent_;
@@ -136,16 +196,62 @@ class Client : noncopyable
     }
     else
     {
-      snprintf(req, sizeof req, "get %s%d\r\n", name_.c_str(), sent_ % keys_);
+      buf->append("get");
+      for (int i = 0; i < multiget_; ++i)
+      {
+        snprintf(req, sizeof req, " %s%d", name_.c_str(), (sent_ * multiget_ + i) % keys_);
+        buf->append(req);
+      }
+      buf->append("\r\n");
       ++sent_;
-      buf->append(req);
     }
   }
 
+  void fillBinary(Buffer* buf)
+  {
+    char key[256];
+    if (!isGet(sent_))
+    {
+      snprintf(key, sizeof key, "%s%d", name_.c_str(), sent_ % keys_);
+      char extras[8] = { 0, 0, 0, 42, 0, 0, 0, 0 };  // flags, exptime
+      appendBinary(buf, kBinarySet, key, StringPiece(extras, sizeof extras), value_);
+    }
+    else
+    {
+      for (int i = 0; i < multiget_; ++i)
+      {
+        snprintf(key, sizeof key, "%s%d", name_.c_str(), (sent_ * multiget_ + i) % keys_);
+        appendBinary(buf, kBinaryGetKQ, key, StringPiece(), StringPiece());
+      }
+      appendBinary(buf, kBinaryNoop, StringPiece(), StringPiece(), StringPiece());
+    }
+    ++sent_;
+  }
+
+  static void appendBinary(Buffer* buf, Opcode opcode,
+                           StringPiece key, StringPiece extras, StringPiece value)
+  {
+    buf->appendInt8(static_cast<int8_t>(0x80));
+    buf->appendInt8(static_cast<int8_t>(opcode));
+    buf->appendInt16(static_cast<int16_t>(key.size()));
+    buf->appendInt8(static_cast<int8_t>(extras.size()));
+    buf->appendInt8(0);  // data type
+    buf->appendInt16(0);  // vbucket
+    buf->appendInt32(key.size() + extras.size() + value.size());
+    buf->appendInt32(0);  // opaque
+    buf->appendInt64(0);  // cas
+    buf->append(extras.data(), extras.size());
+    buf->append(key.data(), key.size());
+    buf->append(value.data(), value.size());
+  }
+
   string name_;
   TcpClient client_;
   TcpConnectionPtr conn_;
   const Operation op_;
+  const int getPercent_;
+  const int multiget_;  // keys per get
+  const bool binary_;
   int sent_;
   int acked_;
   const int requests_;
@@ -167,6 +273,10 @@ int main(int argc, char* argv[])
   int requests = 100000;
   int keys = 10000;
   bool set = false;
+  int getPercent = -1;
+  int valuelen = 100;
+  int multiget = 1;
+  bool binary = false;
 
   po::options_description desc("Allowed options");
   desc.add_options()
@@ -178,6 +288,10 @@ int main(int argc, char* argv[])
       ("requests,r", po::value<int>(&requests), "Number of requests per clients")
       ("keys,k", po::value<int>(&keys), "Number of keys per clients")
       ("set,s", "Get or Set")
+      ("mixed,m", po::value<int>(&getPercent), "Percent of gets, the rest are sets")
+      ("valuelen,v", po::value<int>(&valuelen), "Length of values")
+      ("multiget,n", po::value<int>(&multiget), "Number of keys per get")
+      ("binary,b", "Binary protocol")
       ;
 
   po::variables_map vm;
@@ -190,6 +304,7 @@ int main(int argc, char* argv[])
     return 0;
   }
   set = vm.count("set");
+  binary = vm.count("binary");
 
   InetAddress serverAddr(hostIp, tcpport);
   LOG_WARN << "Connecting " << serverAddr.toIpPort();
@@ -197,8 +312,11 @@ int main(int argc, char* argv[])
   EventLoop loop;
   EventLoopThreadPool pool(&loop, "bench-memcache");
 
-  int valuelen = 100;
   Client::Operation op = set ? Client::kSet : Client::kGet;
+  if (getPercent >= 0)
+  {
+    op = Client::kMixed;
+  }
 
   double memoryMiB = 1.0 * clients * keys * (32+80+valuelen+8) / 1024 / 1024;
   LOG_WARN << "estimated memcached-debug memory usage " << int(memoryMiB) << " MiB";
@@ -220,6 +338,9 @@ int main(int argc, char* argv[])
                                 requests,
                                 keys,
                                 valuelen,
+                                getPercent,
+                                multiget,
+                                binary,
                                 &connected,
                                 &finished));
   }
@@ -236,4 +357,8 @@ int main(int argc, char* argv[])
   double seconds = timeDifference(end, start);
   LOG_WARN << seconds << " sec";
   LOG_WARN << 1.0 * clients * requests / seconds << " QPS";
+  if (multiget > 1 && op != Client::kSet)
+  {
+    LOG_WARN << 1.0 * clients * requests * multiget / seconds << " keys per second in gets";
+  }
 }
@@ -1,4 +1,5 @@
 #include "examples/memcached/server/Item.h"
+#include "examples/memcached/server/SlabAllocator.h"
 
 #include "muduo/base/LogStream.h"
 #include "muduo/net/Buffer.h"
@@ -11,37 +12,108 @@
 using namespace muduo;
 using namespace muduo::net;
 
-Item::Item(StringPiece keyArg,
+ItemPtr Item::makeItem(StringPiece keyArg,
+                       uint32_t flagsArg,
+                       int exptimeArg,
+                       int valuelen,
+                       uint64_t casArg)
+{
+  void* block = ::malloc(chunkSize(keyArg.size(), valuelen));
+  return ItemPtr(new (block) Item(NULL, 0, keyArg, flagsArg, exptimeArg, valuelen, casArg));
+}
+
+ItemPtr Item::makeItem(SlabAllocator* slab,
+                       int cls,
+                       void* chunk,
+                       StringPiece keyArg,
+                       uint32_t flagsArg,
+                       int exptimeArg,
+                       int valuelen,
+                       uint64_t casArg)
+{
+  assert(chunkSize(keyArg.size(), valuelen) <= slab->chunkSize(cls));
+  return ItemPtr(new (chunk) Item(slab, cls, keyArg, flagsArg, exptimeArg, valuelen, casArg));
+}
+
+Item::Item(SlabAllocator* slab,
+           int cls,
+           StringPiece keyArg,
            uint32_t flagsArg,
            int exptimeArg,
            int valuelen,
            uint64_t casArg)
-  : keylen_(keyArg.size()),
+  : refs_(0),
+    keylen_(keyArg.size()),
     flags_(flagsArg),
     rel_exptime_(exptimeArg),
     valuelen_(valuelen),
     receivedBytes_(0),
     cas_(casArg),
     hash_(boost::hash_range(keyArg.begin(), keyArg.end())),
-    data_(static_cast<char*>(::malloc(totalLen())))
+    slab_(slab),
+    slabClass_(static_cast<uint8_t>(cls)),
+    linked_(false),
+    referenced_(false)
 {
   assert(valuelen_ >= 2);
   assert(receivedBytes_ < totalLen());
   append(keyArg.data(), keylen_);
 }
 
-void Item::append(const char* data, size_t len)
+void intrusive_ptr_add_ref(const Item* item)
+{
+  item->refs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void intrusive_ptr_release(const Item* item)
+{
+  if (item->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    assert(!item->linked());
+    SlabAllocator* slab = item->slab_;
+    int cls = item->slabClass_;
+    Item* block = const_cast<Item*>(item);
+    block->~Item();
+    if (slab)
+    {
+      slab->deallocate(block, cls);
+    }
+    else
+    {
+      ::free(block);
+    }
+  }
+}
+
+bool Item::tryRetain() const
+{
+  int refs = refs_.load(std::memory_order_relaxed);
+  while (refs > 0)
+  {
+    if (refs_.compare_exchange_weak(refs, refs + 1, std::memory_order_relaxed))
+      return true;
+  }
+  return false;
+}
+
+void Item::append(const char* src, size_t len)
 {
   assert(len <= neededBytes());
-  memcpy(data_ + receivedBytes_, data, len);
+  memcpy(data() + receivedBytes_, src, len);
   receivedBytes_ += static_cast<int>(len);
   assert(receivedBytes_ <= totalLen());
 }
 
 void Item::output(Buffer* out, bool needCas) const
+{
+  outputHeader(out, needCas);
+  out->append(value(), valuelen_);
+}
+
+void Item::outputHeader(Buffer* out, bool needCas) const
 {
   out->append("VALUE ");
-  out->append(data_, keylen_);
+  out->append(data(), keylen_);
   LogStream buf;
   buf << ' ' << flags_ << ' ' << valuelen_-2;
   if (needCas)
@@ -50,7 +122,6 @@ void Item::output(Buffer* out, bool needCas) const
   }
   buf << "\r\n";
   out->append(buf.buffer().data(), buf.buffer().length());
-  out->append(value(), valuelen_);
 }
 
 void Item::resetKey(StringPiece k)
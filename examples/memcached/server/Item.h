@@ -5,7 +5,9 @@
 #include "muduo/base/StringPiece.h"
 #include "muduo/base/Types.h"
 
-#include <memory>
+#include <boost/intrusive_ptr.hpp>
+
+#include <atomic>
 
 namespace muduo
 {
@@ -16,10 +18,17 @@ class Buffer;
 }
 
 class Item;
-typedef std::shared_ptr<Item> ItemPtr;  // TODO: use unique_ptr
-typedef std::shared_ptr<const Item> ConstItemPtr;  // TODO: use unique_ptr
+class SlabAllocator;
+typedef boost::intrusive_ptr<Item> ItemPtr;
+typedef boost::intrusive_ptr<const Item> ConstItemPtr;
+
+void intrusive_ptr_add_ref(const Item* item);
+void intrusive_ptr_release(const Item* item);
 
 // Item is immutable once added into hash table
+//
+// Header, key and value are in one block, a chunk of SlabAllocator or
+// a malloc()ed one, which goes back when the last ItemPtr is gone.
 class Item : muduo::noncopyable
 {
  public:
@@ -34,30 +43,31 @@ class Item : muduo::noncopyable
     kCas,
   };
 
+  // on the heap, for lookups
   static ItemPtr makeItem(muduo::StringPiece keyArg,
                           uint32_t flagsArg,
                           int exptimeArg,
                           int valuelen,
-                          uint64_t casArg)
-  {
-    return std::make_shared<Item>(keyArg, flagsArg, exptimeArg, valuelen, casArg);
-    //return ItemPtr(new Item(keyArg, flagsArg, exptimeArg, valuelen, casArg));
-  }
+                          uint64_t casArg);
 
-  Item(muduo::StringPiece keyArg,
-       uint32_t flagsArg,
-       int exptimeArg,
-       int valuelen,
-       uint64_t casArg);
+  // in chunk of size class cls
+  static ItemPtr makeItem(SlabAllocator* slab,
+                          int cls,
+                          void* chunk,
+                          muduo::StringPiece keyArg,
+                          uint32_t flagsArg,
+                          int exptimeArg,
+                          int valuelen,
+                          uint64_t casArg);
 
-  ~Item()
+  static size_t chunkSize(size_t keylen, int valuelen)
   {
-    ::free(data_);
+    return sizeof(Item) + keylen + valuelen;
   }
 
   muduo::StringPiece key() const
   {
-    return muduo::StringPiece(data_, keylen_);
+    return muduo::StringPiece(data(), keylen_);
   }
 
   uint32_t flags() const
@@ -65,14 +75,20 @@ class Item : muduo::noncopyable
     return flags_;
   }
 
+  // seconds since start of server, 0 for never
   int rel_exptime() const
   {
     return rel_exptime_;
   }
 
+  bool expired(int now) const
+  {
+    return rel_exptime_ != 0 && rel_exptime_ <= now;
+  }
+
   const char* value() const
   {
-    return data_+keylen_;
+    return data()+keylen_;
   }
 
   size_t valueLength() const
@@ -100,22 +116,73 @@ class Item : muduo::noncopyable
     return totalLen() - receivedBytes_;
   }
 
-  void append(const char* data, size_t len);
+  void append(const char* src, size_t len);
+
+  // where the next neededBytes() go, for receiving in place
+  char* beginWrite()
+  {
+    return data() + receivedBytes_;
+  }
+
+  void hasWritten(size_t len)
+  {
+    assert(len <= neededBytes());
+    receivedBytes_ += static_cast<int>(len);
+  }
 
   bool endsWithCRLF() const
   {
     return receivedBytes_ == totalLen()
-        && data_[totalLen()-2] == '\r'
-        && data_[totalLen()-1] == '\n';
+        && data()[totalLen()-2] == '\r'
+        && data()[totalLen()-1] == '\n';
   }
 
   void output(muduo::net::Buffer* out, bool needCas = false) const;
+  // the "VALUE" line only
+  void outputHeader(muduo::net::Buffer* out, bool needCas) const;
 
   void resetKey(muduo::StringPiece k);
 
+  int slabClass() const { return slabClass_; }
+
+  // in the hash table, set and cleared with its lock held
+  bool linked() const { return linked_.load(std::memory_order_acquire); }
+  void setLinked(bool on) const { linked_.store(on, std::memory_order_release); }
+
+  // recently read, for CLOCK eviction
+  void touch() const
+  {
+    if (!referenced_.load(std::memory_order_relaxed))
+      referenced_.store(true, std::memory_order_relaxed);
+  }
+
+  // returns the old bit
+  bool clearReferenced() const
+  {
+    return referenced_.exchange(false, std::memory_order_relaxed);
+  }
+
+  // a new reference unless the last one is being dropped,
+  // for eviction which finds items by their chunks
+  bool tryRetain() const;
+
  private:
+  friend void intrusive_ptr_add_ref(const Item* item);
+  friend void intrusive_ptr_release(const Item* item);
+
+  Item(SlabAllocator* slab,
+       int cls,
+       muduo::StringPiece keyArg,
+       uint32_t flagsArg,
+       int exptimeArg,
+       int valuelen,
+       uint64_t casArg);
+
   int totalLen() const { return keylen_ + valuelen_; }
+  char* data() { return reinterpret_cast<char*>(this + 1); }
+  const char* data() const { return reinterpret_cast<const char*>(this + 1); }
 
+  mutable std::atomic<int> refs_;
   int            keylen_;
   const uint32_t flags_;
   const int      rel_exptime_;
@@ -123,7 +190,10 @@ class Item : muduo::noncopyable
   int            receivedBytes_;  // FIXME: remove this member
   uint64_t       cas_;
   size_t         hash_;
-  char*          data_;
+  SlabAllocator* const slab_;  // NULL if on the heap
+  const uint8_t  slabClass_;
+  mutable std::atomic<bool> linked_;
+  mutable std::atomic<bool> referenced_;
 };
 
 #endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_ITEM_H
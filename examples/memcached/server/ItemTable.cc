@@ -0,0 +1,444 @@
+#include "examples/memcached/server/ItemTable.h"
+
+#include "muduo/base/Atomic.h"
+#include "muduo/base/Logging.h"
+
+using namespace muduo;
+
+namespace
+{
+AtomicInt64 g_tableId;
+
+const size_t kInitialSlots = 8;
+char g_tombstone;
+const Item* const kTombstone = reinterpret_cast<const Item*>(&g_tombstone);
+
+struct CachedSlot
+{
+  int64_t tableId;
+  void* slot;
+};
+__thread CachedSlot t_cachedSlot;
+}
+
+struct ItemTable::Table
+{
+  explicit Table(size_t n)
+    : mask(n - 1),
+      shift(64 - __builtin_ctzll(n)),
+      slots(new std::atomic<const Item*>[n])
+  {
+    assert((n & mask) == 0);
+    for (size_t i = 0; i < n; ++i)
+    {
+      slots[i].store(NULL, std::memory_order_relaxed);
+    }
+  }
+
+  size_t capacity() const { return mask + 1; }
+
+  const size_t mask;
+  const int shift;
+  std::unique_ptr<std::atomic<const Item*>[]> slots;
+};
+
+// One per thread, written by the thread only, except retired lists
+// which ~ItemTable() drains.  Taken by another thread after it exits.
+struct ItemTable::ThreadSlot
+{
+  ThreadSlot()
+    : epoch(0),
+      hits(0),
+      misses(0)
+  {
+  }
+
+  char pad0[64];
+  std::atomic<uint64_t> epoch;  // 0 if not reading
+  std::atomic<int64_t> hits;
+  std::atomic<int64_t> misses;
+  char pad1[64];
+  std::vector<std::pair<uint64_t, const Item*>> retiredItems;
+  std::vector<std::pair<uint64_t, Table*>> retiredTables;
+};
+
+struct ItemTable::SlotOwner
+{
+  SlotOwner()
+    : table(NULL),
+      slot(NULL)
+  {
+  }
+
+  ~SlotOwner()
+  {
+    if (slot)
+    {
+      table->releaseSlot(slot);
+    }
+  }
+
+  ItemTable* table;
+  ThreadSlot* slot;
+};
+
+ItemTable::Shard::Shard()
+  : table(new Table(kInitialSlots)),
+    size(0),
+    used(0)
+{
+}
+
+ItemTable::ItemTable()
+  : id_(g_tableId.incrementAndGet()),
+    epoch_(1),
+    numSlots_(0),
+    orphans_(new ThreadSlot),
+    hasOrphans_(false)
+{
+  for (int i = 0; i < kMaxThreads; ++i)
+  {
+    slots_[i].store(NULL, std::memory_order_relaxed);
+  }
+}
+
+ItemTable::~ItemTable()
+{
+  // no one is reading
+  const uint64_t all = epoch_.load() + 2;
+  for (int i = 0; i < numSlots_.load(); ++i)
+  {
+    ThreadSlot* slot = slots_[i].load();
+    releaseRetired(slot, all);
+    delete slot;
+  }
+  {
+  MutexLockGuard lock(mutex_);
+  releaseRetired(orphans_.get(), all);
+  }
+  for (Shard& shard : shards_)
+  {
+    MutexLockGuard lock(shard.mutex);
+    Table* t = shard.table.load();
+    for (size_t i = 0; i < t->capacity(); ++i)
+    {
+      const Item* item = t->slots[i].load(std::memory_order_relaxed);
+      if (item && item != kTombstone)
+      {
+        item->setLinked(false);
+        intrusive_ptr_release(item);
+      }
+    }
+    delete t;
+  }
+}
+
+ItemTable::ReadGuard::ReadGuard(ItemTable* table)
+  : slot_(table->slot())
+{
+  // announces the epoch we read in before reading anything,
+  // tryAdvance() sees us or we see the latest epoch
+  uint64_t epoch = table->epoch_.load();
+  while (true)
+  {
+    slot_->epoch.store(epoch, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t now = table->epoch_.load();
+    if (now == epoch)
+      break;
+    epoch = now;
+  }
+}
+
+ItemTable::ReadGuard::~ReadGuard()
+{
+  slot_->epoch.store(0, std::memory_order_release);
+}
+
+ItemTable::ThreadSlot* ItemTable::slot()
+{
+  if (t_cachedSlot.tableId == id_)
+  {
+    return static_cast<ThreadSlot*>(t_cachedSlot.slot);
+  }
+  SlotOwner& owner = slotOwners_.value();
+  if (!owner.slot)
+  {
+    MutexLockGuard lock(mutex_);
+    if (!freeSlots_.empty())
+    {
+      owner.slot = freeSlots_.back();
+      freeSlots_.pop_back();
+    }
+    else
+    {
+      int n = numSlots_.load();
+      if (n == kMaxThreads)
+      {
+        LOG_FATAL << "ItemTable - more than " << kMaxThreads << " threads";
+      }
+      owner.slot = new ThreadSlot;
+      slots_[n].store(owner.slot, std::memory_order_release);
+      numSlots_.store(n + 1, std::memory_order_release);
+    }
+    owner.table = this;
+  }
+  t_cachedSlot.tableId = id_;
+  t_cachedSlot.slot = owner.slot;
+  return owner.slot;
+}
+
+void ItemTable::releaseSlot(ThreadSlot* s)
+{
+  assert(s->epoch.load() == 0);
+  reclaim(s);
+  MutexLockGuard lock(mutex_);
+  // still visible to readers, the next reclaim() of any thread releases them
+  ThreadSlot* orphans = orphans_.get();
+  orphans->retiredItems.insert(orphans->retiredItems.end(),
+                               s->retiredItems.begin(), s->retiredItems.end());
+  orphans->retiredTables.insert(orphans->retiredTables.end(),
+                                s->retiredTables.begin(), s->retiredTables.end());
+  s->retiredItems.clear();
+  s->retiredTables.clear();
+  hasOrphans_.store(!orphans->retiredItems.empty() || !orphans->retiredTables.empty());
+  // counters stay, the next thread adds to them
+  freeSlots_.push_back(s);
+}
+
+size_t ItemTable::probeStart(const Table& t, size_t hash)
+{
+  // low bits picked the shard, Fibonacci hashing mixes in the others
+  return (hash * 0x9E3779B97F4A7C15ULL) >> t.shift;
+}
+
+const Item* ItemTable::lookup(const Table& t, const Item& key)
+{
+  for (size_t i = probeStart(t, key.hash()); ; i = (i + 1) & t.mask)
+  {
+    const Item* item = t.slots[i].load(std::memory_order_acquire);
+    if (item == NULL)
+    {
+      return NULL;
+    }
+    if (item != kTombstone && item->hash() == key.hash() && item->key() == key.key())
+    {
+      return item;
+    }
+  }
+}
+
+const Item* ItemTable::find(const Item& key) const
+{
+  const Table* t = shardOf(key.hash()).table.load(std::memory_order_acquire);
+  return lookup(*t, key);
+}
+
+void ItemTable::countGet(bool hit)
+{
+  // single writer, no read-modify-write
+  ThreadSlot* s = slot();
+  std::atomic<int64_t>& counter = hit ? s->hits : s->misses;
+  counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void ItemTable::getStats(int64_t* hits, int64_t* misses) const
+{
+  *hits = *misses = 0;
+  for (int i = 0; i < numSlots_.load(std::memory_order_acquire); ++i)
+  {
+    ThreadSlot* slot = slots_[i].load(std::memory_order_acquire);
+    *hits += slot->hits.load(std::memory_order_relaxed);
+    *misses += slot->misses.load(std::memory_order_relaxed);
+  }
+}
+
+const Item* ItemTable::findLocked(const Item& key) const
+{
+  return find(key);
+}
+
+std::atomic<const Item*>* ItemTable::slotOf(Shard& shard, const Item* item)
+{
+  Table* t = shard.table.load(std::memory_order_relaxed);
+  for (size_t i = probeStart(*t, item->hash()); ; i = (i + 1) & t->mask)
+  {
+    const Item* x = t->slots[i].load(std::memory_order_relaxed);
+    if (x == item)
+    {
+      return &t->slots[i];
+    }
+    assert(x != NULL);
+  }
+}
+
+void ItemTable::insert(const ConstItemPtr& item)
+{
+  Shard& shard = shardOf(item->hash());
+  if ((shard.used + 1) * 2 > shard.table.load(std::memory_order_relaxed)->capacity())
+  {
+    grow(&shard);
+  }
+  Table* t = shard.table.load(std::memory_order_relaxed);
+  size_t i = probeStart(*t, item->hash());
+  const Item* x = t->slots[i].load(std::memory_order_relaxed);
+  while (x != NULL && x != kTombstone)
+  {
+    i = (i + 1) & t->mask;
+    x = t->slots[i].load(std::memory_order_relaxed);
+  }
+  if (x == NULL)
+  {
+    ++shard.used;
+  }
+  ++shard.size;
+  intrusive_ptr_add_ref(item.get());
+  item->setLinked(true);
+  // publishes the item, written before it
+  t->slots[i].store(item.get(), std::memory_order_release);
+}
+
+void ItemTable::replace(const Item* oldItem, const ConstItemPtr& item)
+{
+  assert(oldItem->key() == item->key());
+  std::atomic<const Item*>* slot = slotOf(shardOf(item->hash()), oldItem);
+  intrusive_ptr_add_ref(item.get());
+  item->setLinked(true);
+  slot->store(item.get(), std::memory_order_release);
+  oldItem->setLinked(false);
+  retire(oldItem, NULL);
+}
+
+void ItemTable::erase(const Item* item)
+{
+  Shard& shard = shardOf(item->hash());
+  slotOf(shard, item)->store(kTombstone, std::memory_order_release);
+  --shard.size;
+  item->setLinked(false);
+  retire(item, NULL);
+}
+
+void ItemTable::grow(Shard* shard)
+{
+  // also clears tombstones, may shrink
+  Table* old = shard->table.load(std::memory_order_relaxed);
+  size_t n = kInitialSlots;
+  while (n < shard->size * 4)
+  {
+    n *= 2;
+  }
+  Table* t = new Table(n);
+  for (size_t i = 0; i < old->capacity(); ++i)
+  {
+    const Item* item = old->slots[i].load(std::memory_order_relaxed);
+    if (item && item != kTombstone)
+    {
+      size_t j = probeStart(*t, item->hash());
+      while (t->slots[j].load(std::memory_order_relaxed) != NULL)
+      {
+        j = (j + 1) & t->mask;
+      }
+      t->slots[j].store(item, std::memory_order_relaxed);
+    }
+  }
+  shard->used = shard->size;
+  // readers in old one may go on
+  shard->table.store(t, std::memory_order_release);
+  retire(NULL, old);
+}
+
+void ItemTable::forEach(int shard, const std::function<void (const Item*)>& visit)
+{
+  Table* t = shards_[shard].table.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < t->capacity(); ++i)
+  {
+    const Item* item = t->slots[i].load(std::memory_order_relaxed);
+    if (item && item != kTombstone)
+    {
+      visit(item);
+    }
+  }
+}
+
+void ItemTable::retire(const Item* item, Table* table)
+{
+  ThreadSlot* s = slot();
+  // unpublished before reading the epoch, readers announcing it
+  // or a later one can't find it
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  uint64_t epoch = epoch_.load();
+  if (item)
+  {
+    s->retiredItems.push_back(std::make_pair(epoch, item));
+  }
+  if (table)
+  {
+    s->retiredTables.push_back(std::make_pair(epoch, table));
+  }
+  if (s->retiredItems.size() + s->retiredTables.size() >= kRetireBatch)
+  {
+    reclaim(s);
+  }
+}
+
+bool ItemTable::tryAdvance()
+{
+  uint64_t epoch = epoch_.load();
+  for (int i = 0; i < numSlots_.load(std::memory_order_acquire); ++i)
+  {
+    uint64_t e = slots_[i].load(std::memory_order_acquire)->epoch.load(std::memory_order_acquire);
+    if (e != 0 && e != epoch)
+    {
+      return false;
+    }
+  }
+  return epoch_.compare_exchange_strong(epoch, epoch + 1);
+}
+
+void ItemTable::reclaim(ThreadSlot* s)
+{
+  // twice for what is retired in the current epoch,
+  // succeeds if no one is reading
+  tryAdvance() && tryAdvance();
+  // readers are in this epoch or the previous one
+  const uint64_t safe = epoch_.load();
+  releaseRetired(s, safe);
+  if (hasOrphans_.load(std::memory_order_relaxed))
+  {
+    MutexLockGuard lock(mutex_);
+    ThreadSlot* orphans = orphans_.get();
+    releaseRetired(orphans, safe);
+    hasOrphans_.store(!orphans->retiredItems.empty() || !orphans->retiredTables.empty());
+  }
+}
+
+void ItemTable::releaseRetired(ThreadSlot* s, uint64_t safe)
+{
+  // retired in epoch order, except orphans of several threads
+  size_t kept = 0;
+  for (const auto& retired : s->retiredItems)
+  {
+    if (retired.first + 2 <= safe)
+    {
+      intrusive_ptr_release(retired.second);
+    }
+    else
+    {
+      s->retiredItems[kept++] = retired;
+    }
+  }
+  s->retiredItems.resize(kept);
+  kept = 0;
+  for (const auto& retired : s->retiredTables)
+  {
+    if (retired.first + 2 <= safe)
+    {
+      delete retired.second;
+    }
+    else
+    {
+      s->retiredTables[kept++] = retired;
+    }
+  }
+  s->retiredTables.resize(kept);
+}
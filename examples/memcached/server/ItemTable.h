@@ -0,0 +1,113 @@
+#ifndef MUDUO_EXAMPLES_MEMCACHED_SERVER_ITEMTABLE_H
+#define MUDUO_EXAMPLES_MEMCACHED_SERVER_ITEMTABLE_H
+
+#include "examples/memcached/server/Item.h"
+
+#include "muduo/base/Mutex.h"
+#include "muduo/base/ThreadLocal.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Items by key, lookups take no lock and write no shared memory.
+//
+// Shards of open addressing tables, updated with the lock of the shard
+// held.  Removed items and outgrown tables are retired to a list of the
+// updating thread and released once every reader that might see them
+// has left, i.e. epoch based reclamation.  A thread keeps at most
+// kRetireBatch items retired until its next update.  Slots of threads
+// are reused after they exit, at most kMaxThreads threads at a time.
+class ItemTable : muduo::noncopyable
+{
+  struct ThreadSlot;
+
+ public:
+  static const int kShards = 4096;
+
+  ItemTable();
+  ~ItemTable();
+
+  // Lookups go between construction and destruction of a ReadGuard,
+  // items found are valid until then.  Don't update in between.
+  class ReadGuard : muduo::noncopyable
+  {
+   public:
+    explicit ReadGuard(ItemTable* table);
+    ~ReadGuard();
+
+   private:
+    ThreadSlot* slot_;
+  };
+
+  const Item* find(const Item& key) const;
+
+  // counted per thread, sums are approximate
+  void countGet(bool hit);
+  void getStats(int64_t* hits, int64_t* misses) const;
+
+  // Updates, with mutexOf() of the key's hash locked
+  muduo::MutexLock& mutexOf(size_t hash) { return shardOf(hash).mutex; }
+  const Item* findLocked(const Item& key) const;
+  // key not in table
+  void insert(const ConstItemPtr& item);
+  void replace(const Item* oldItem, const ConstItemPtr& item);
+  void erase(const Item* item);
+
+  // items of shard, locked, visit may not update
+  void forEach(int shard, const std::function<void (const Item*)>& visit);
+
+  // Releases what this thread has retired and no reader can see,
+  // e.g. to get chunks of evicted items back.
+  void reclaim() { reclaim(slot()); }
+
+ private:
+  struct Table;
+
+  struct Shard
+  {
+    Shard();
+
+    mutable muduo::MutexLock mutex;
+    std::atomic<Table*> table;
+    size_t size GUARDED_BY(mutex);  // items
+    size_t used GUARDED_BY(mutex);  // items and tombstones
+  };
+
+  static size_t probeStart(const Table& t, size_t hash);
+  static const Item* lookup(const Table& t, const Item& key);
+  Shard& shardOf(size_t hash) { return shards_[hash % kShards]; }
+  const Shard& shardOf(size_t hash) const { return shards_[hash % kShards]; }
+  std::atomic<const Item*>* slotOf(Shard& shard, const Item* item);
+  void grow(Shard* shard);
+
+  // reclamation
+  struct SlotOwner;
+  ThreadSlot* slot();
+  void releaseSlot(ThreadSlot* slot);
+  void retire(const Item* item, Table* table);
+  void reclaim(ThreadSlot* slot);
+  static void releaseRetired(ThreadSlot* slot, uint64_t safe);
+  bool tryAdvance();
+
+  friend class ReadGuard;
+
+  static const int kMaxThreads = 256;
+  static const size_t kRetireBatch = 16;
+
+  const int64_t id_;  // tells tables apart in thread local caches
+  Shard shards_[kShards];
+  std::atomic<uint64_t> epoch_;
+  mutable muduo::MutexLock mutex_;  // for adding and releasing slots
+  std::atomic<ThreadSlot*> slots_[kMaxThreads];
+  std::atomic<int> numSlots_;
+  std::vector<ThreadSlot*> freeSlots_ GUARDED_BY(mutex_);
+  // left by exited threads, reclaimed by others
+  std::unique_ptr<ThreadSlot> orphans_ GUARDED_BY(mutex_);
+  std::atomic<bool> hasOrphans_;
+  // releases the slot when its thread exits
+  muduo::ThreadLocal<SlotOwner> slotOwners_;
+};
+
+#endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_ITEMTABLE_H
@@ -1,29 +1,60 @@
 #include "examples/memcached/server/MemcacheServer.h"
 
 #include "muduo/base/Atomic.h"
+#include "muduo/base/LogStream.h"
 #include "muduo/base/Logging.h"
+#include "muduo/base/Thread.h"
 #include "muduo/net/EventLoop.h"
 
+#include <sched.h>
+#include <unistd.h>
+
 using namespace muduo;
 using namespace muduo::net;
 
 muduo::AtomicInt64 g_cas;
 
+namespace
+{
+// largest value is 1MiB, see Session::doUpdate()
+const size_t kMaxItemSize = Item::chunkSize(250, 1024 * 1024 + 2);
+const int kEvictTries = 8;
+// loaded by threads of their own, each covers some shards
+const int kSnapshotSegments = 64;
+}
+
 MemcacheServer::Options::Options()
+  : tcpport(0),
+    udpport(0),
+    gperfport(0),
+    threads(0),
+    memoryMiB(64),
+    snapshotSeconds(0),
+    loadThreads(4)
 {
-  memZero(this, sizeof(*this));
 }
 
 struct MemcacheServer::Stats
 {
+  AtomicInt64 cmdSet;
+  AtomicInt64 currItems;
+  AtomicInt64 totalItems;
+  AtomicInt64 bytes;
+  AtomicInt64 evictions;
+  AtomicInt64 expired;
+  AtomicInt64 outOfMemory;
 };
 
 MemcacheServer::MemcacheServer(muduo::net::EventLoop* loop, const Options& options)
   : loop_(loop),
     options_(options),
     startTime_(::time(NULL)-1),
+    slab_(static_cast<size_t>(options.memoryMiB) * 1024 * 1024, kMaxItemSize),
+    expireCursor_(0),
     server_(loop, InetAddress(options.tcpport), "muduo-memcached"),
-    stats_(new Stats)
+    stats_(new Stats),
+    snapshotting_(false),
+    snapshotThread_("snapshot")
 {
   server_.setConnectionCallback(
       std::bind(&MemcacheServer::onConnection, this, _1));
@@ -34,6 +65,15 @@ MemcacheServer::~MemcacheServer() = default;
 void MemcacheServer::start()
 {
   server_.start();
+  loop_->runEvery(1.0, std::bind(&MemcacheServer::expireSome, this));
+  if (!options_.snapshotPath.empty() && options_.snapshotSeconds > 0)
+  {
+    snapshotThread_.start(1);
+    loop_->runEvery(options_.snapshotSeconds, [this] {
+      if (!snapshotting_)
+        snapshotThread_.run([this] { saveSnapshot(); });
+    });
+  }
 }
 
 void MemcacheServer::stop()
@@ -41,117 +81,450 @@ void MemcacheServer::stop()
   loop_->runAfter(3.0, std::bind(&EventLoop::quit, loop_));
 }
 
-bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy policy, bool* exists)
+ItemPtr MemcacheServer::newItem(StringPiece key,
+                                uint32_t flags,
+                                int rel_exptime,
+                                int valuelen,
+                                uint64_t cas)
 {
-  assert(item->neededBytes() == 0);
-  MutexLock& mutex = shards_[item->hash() % kShards].mutex;
-  ItemMap& items = shards_[item->hash() % kShards].items;
-  MutexLockGuard lock(mutex);
-  ItemMap::const_iterator it = items.find(item);
-  *exists = it != items.end();
-  if (policy == Item::kSet)
+  int cls = slab_.classOf(Item::chunkSize(key.size(), valuelen));
+  if (cls < 0)
   {
-    item->setCas(g_cas.incrementAndGet());
-    if (*exists)
+    return ItemPtr();
+  }
+  void* chunk = slab_.allocate(cls);
+  // an evicted item may still be read, its chunk comes back once
+  // readers have moved on, let a preempted one finish
+  for (int i = 0; chunk == NULL && i < kEvictTries; ++i)
+  {
+    if (i > 0)
     {
-      items.erase(it);
+      ::sched_yield();
     }
-    items.insert(item);
+    evict(cls);
+    items_.reclaim();
+    chunk = slab_.allocate(cls);
   }
-  else
+  if (chunk == NULL)
+  {
+    stats_->outOfMemory.increment();
+    return ItemPtr();
+  }
+  return Item::makeItem(&slab_, cls, chunk, key, flags, rel_exptime, valuelen, cas);
+}
+
+void MemcacheServer::evict(int cls)
+{
+  // CLOCK: an item read since the hand last passed gets another round
+  const int now = currentTime();
+  const Item* victim = NULL;
+  slab_.sweep(cls, [&victim, now](void* chunk) {
+    const Item* item = static_cast<const Item*>(chunk);
+    if (!item->linked())
+      return false;
+    if (!item->expired(now) && item->clearReferenced())
+      return false;
+    if (!item->tryRetain())
+      return false;
+    victim = item;
+    return true;
+  });
+  if (victim)
   {
-    if (policy == Item::kAdd)
+    ConstItemPtr item(victim, false);  // adopts the reference of tryRetain()
+    bool expired = item->expired(now);
+    if (unlinkItem(item))
     {
-      if (*exists)
+      if (expired)
       {
-        return false;
+        stats_->expired.increment();
       }
       else
       {
-        item->setCas(g_cas.incrementAndGet());
-        items.insert(item);
+        stats_->evictions.increment();
+        slab_.addEviction(cls);
       }
     }
-    else if (policy == Item::kReplace)
+  }
+}
+
+void MemcacheServer::linked(const Item* item)
+{
+  stats_->currItems.increment();
+  stats_->totalItems.increment();
+  stats_->bytes.add(static_cast<int64_t>(item->key().size() + item->valueLength()));
+}
+
+void MemcacheServer::unlinked(const Item* item)
+{
+  stats_->currItems.decrement();
+  stats_->bytes.add(-static_cast<int64_t>(item->key().size() + item->valueLength()));
+}
+
+bool MemcacheServer::unlinkItem(const ConstItemPtr& item)
+{
+  MutexLockGuard lock(items_.mutexOf(item->hash()));
+  if (items_.findLocked(*item) == item.get())
+  {
+    items_.erase(item.get());
+    unlinked(item.get());
+    return true;
+  }
+  return false;
+}
+
+bool MemcacheServer::storeItem(const ItemPtr& item, const Item::UpdatePolicy policy, bool* exists)
+{
+  assert(item->neededBytes() == 0);
+  stats_->cmdSet.increment();
+  if (policy == Item::kAppend || policy == Item::kPrepend)
+  {
+    // allocating may evict, which locks shards, so not with ours locked
+    ConstItemPtr oldItem = findItem(item);
+    *exists = oldItem.get() != NULL;
+    if (!oldItem)
     {
-      if (*exists)
-      {
-        item->setCas(g_cas.incrementAndGet());
-        items.erase(it);
-        items.insert(item);
-      }
-      else
-      {
-        return false;
-      }
+      return false;
     }
-    else if (policy == Item::kAppend || policy == Item::kPrepend)
+    int newLen = static_cast<int>(item->valueLength() + oldItem->valueLength() - 2);
+    ItemPtr newItem(this->newItem(item->key(),
+                                  oldItem->flags(),
+                                  oldItem->rel_exptime(),
+                                  newLen,
+                                  g_cas.incrementAndGet()));
+    if (!newItem)
     {
-      if (*exists)
-      {
-        const ConstItemPtr& oldItem = *it;
-        int newLen = static_cast<int>(item->valueLength() + oldItem->valueLength() - 2);
-        ItemPtr newItem(Item::makeItem(item->key(),
-                                       oldItem->flags(),
-                                       oldItem->rel_exptime(),
-                                       newLen,
-                                       g_cas.incrementAndGet()));
-        if (policy == Item::kAppend)
-        {
-          newItem->append(oldItem->value(), oldItem->valueLength() - 2);
-          newItem->append(item->value(), item->valueLength());
-        }
-        else
-        {
-          newItem->append(item->value(), item->valueLength() - 2);
-          newItem->append(oldItem->value(), oldItem->valueLength());
-        }
-        assert(newItem->neededBytes() == 0);
-        assert(newItem->endsWithCRLF());
-        items.erase(it);
-        items.insert(newItem);
-      }
-      else
-      {
-        return false;
-      }
+      return false;
     }
-    else if (policy == Item::kCas)
+    if (policy == Item::kAppend)
     {
-      if (*exists && (*it)->cas() == item->cas())
-      {
-        item->setCas(g_cas.incrementAndGet());
-        items.erase(it);
-        items.insert(item);
-      }
-      else
-      {
-        return false;
-      }
+      newItem->append(oldItem->value(), oldItem->valueLength() - 2);
+      newItem->append(item->value(), item->valueLength());
     }
     else
     {
-      assert(false);
+      newItem->append(item->value(), item->valueLength() - 2);
+      newItem->append(oldItem->value(), oldItem->valueLength());
+    }
+    assert(newItem->neededBytes() == 0);
+    assert(newItem->endsWithCRLF());
+
+    MutexLockGuard lock(items_.mutexOf(item->hash()));
+    // lost to another update meanwhile, as if it came later
+    if (items_.findLocked(*item) != oldItem.get())
+    {
+      return false;
+    }
+    items_.replace(oldItem.get(), newItem);
+    unlinked(oldItem.get());
+    linked(newItem.get());
+    return true;
+  }
+
+  MutexLockGuard lock(items_.mutexOf(item->hash()));
+  const Item* old = items_.findLocked(*item);
+  if (old && old->expired(currentTime()))
+  {
+    items_.erase(old);
+    unlinked(old);
+    stats_->expired.increment();
+    old = NULL;
+  }
+  *exists = old != NULL;
+  if (policy == Item::kSet)
+  {
+    item->setCas(g_cas.incrementAndGet());
+  }
+  else if (policy == Item::kAdd)
+  {
+    if (*exists)
+    {
+      return false;
+    }
+    item->setCas(g_cas.incrementAndGet());
+  }
+  else if (policy == Item::kReplace)
+  {
+    if (!*exists)
+    {
+      return false;
+    }
+    item->setCas(g_cas.incrementAndGet());
+  }
+  else if (policy == Item::kCas)
+  {
+    if (!*exists || old->cas() != item->cas())
+    {
+      return false;
     }
+    item->setCas(g_cas.incrementAndGet());
   }
+  else
+  {
+    assert(false);
+  }
+
+  if (old)
+  {
+    items_.replace(old, item);
+    unlinked(old);
+  }
+  else
+  {
+    items_.insert(item);
+  }
+  linked(item.get());
   return true;
 }
 
-ConstItemPtr MemcacheServer::getItem(const ConstItemPtr& key) const
+ConstItemPtr MemcacheServer::getItem(const ConstItemPtr& key)
+{
+  ItemTable::ReadGuard guard(&items_);
+  const Item* item = items_.find(*key);
+  bool hit = item && !item->expired(currentTime());
+  items_.countGet(hit);
+  if (hit)
+  {
+    item->touch();
+    // retired ones are not released before the guard goes
+    return ConstItemPtr(item);
+  }
+  return ConstItemPtr();
+}
+
+ConstItemPtr MemcacheServer::findItem(const ConstItemPtr& key)
 {
-  MutexLock& mutex = shards_[key->hash() % kShards].mutex;
-  const ItemMap& items = shards_[key->hash() % kShards].items;
-  MutexLockGuard lock(mutex);
-  ItemMap::const_iterator it = items.find(key);
-  return it != items.end() ? *it : ConstItemPtr();
+  ItemTable::ReadGuard guard(&items_);
+  const Item* item = items_.find(*key);
+  return item && !item->expired(currentTime()) ? ConstItemPtr(item) : ConstItemPtr();
 }
 
 bool MemcacheServer::deleteItem(const ConstItemPtr& key)
 {
-  MutexLock& mutex = shards_[key->hash() % kShards].mutex;
-  ItemMap& items = shards_[key->hash() % kShards].items;
-  MutexLockGuard lock(mutex);
-  return items.erase(key) == 1;
+  MutexLockGuard lock(items_.mutexOf(key->hash()));
+  const Item* item = items_.findLocked(*key);
+  if (item == NULL)
+  {
+    return false;
+  }
+  items_.erase(item);
+  unlinked(item);
+  return true;
+}
+
+void MemcacheServer::expireSome()
+{
+  // all shards in 16 seconds, the rest are found by store and eviction
+  const int kShardsPerRun = ItemTable::kShards / 16;
+  const int now = currentTime();
+  std::vector<const Item*> expired;
+  for (int i = 0; i < kShardsPerRun; ++i)
+  {
+    int shard = expireCursor_;
+    expireCursor_ = (expireCursor_ + 1) % ItemTable::kShards;
+    expired.clear();
+    // shard i holds hashes of i modulo kShards
+    MutexLockGuard lock(items_.mutexOf(shard));
+    items_.forEach(shard, [&expired, now](const Item* item) {
+      if (item->expired(now))
+        expired.push_back(item);
+    });
+    for (const Item* item : expired)
+    {
+      items_.erase(item);
+      unlinked(item);
+      stats_->expired.increment();
+    }
+  }
+}
+
+bool MemcacheServer::saveSnapshot()
+{
+  if (options_.snapshotPath.empty())
+  {
+    return false;
+  }
+  MutexLockGuard saving(snapshotMutex_);
+  snapshotting_ = true;
+  Timestamp start(Timestamp::now());
+  const int kShardsPerSegment = ItemTable::kShards / kSnapshotSegments;
+  const int now = currentTime();
+  SnapshotWriter writer(options_.snapshotPath);
+  std::vector<ConstItemPtr> items;
+  for (int shard = 0; shard < ItemTable::kShards; ++shard)
+  {
+    if (shard % kShardsPerSegment == 0)
+    {
+      writer.beginSegment();
+    }
+    {
+      MutexLockGuard lock(items_.mutexOf(shard));
+      items_.forEach(shard, [&items, now](const Item* item) {
+        if (!item->expired(now))
+          items.push_back(ConstItemPtr(item));
+      });
+    }
+    for (const ConstItemPtr& item : items)
+    {
+      writer.add(*item, item->rel_exptime() == 0 ? 0 : startTime_ + item->rel_exptime());
+    }
+    items.clear();
+  }
+  bool ok = writer.finish();
+  if (ok)
+  {
+    LOG_INFO << "saved " << writer.items() << " items, "
+             << writer.bytes() / (1024 * 1024) << " MiB to " << options_.snapshotPath
+             << " in " << timeDifference(Timestamp::now(), start) << " seconds";
+  }
+  snapshotting_ = false;
+  return ok;
+}
+
+bool MemcacheServer::loadSnapshot()
+{
+  Timestamp start(Timestamp::now());
+  SnapshotReader reader(options_.snapshotPath);
+  if (!reader.valid())
+  {
+    return false;
+  }
+  // segments cover shards of their own, so threads hardly share a lock
+  AtomicInt32 nextSegment;
+  AtomicInt64 restored;
+  std::atomic<uint64_t> maxCas(0);
+  auto load = [&] {
+    int64_t n = 0;
+    uint64_t cas = 0;
+    for (int segment = nextSegment.getAndAdd(1); segment < reader.segments();
+         segment = nextSegment.getAndAdd(1))
+    {
+      reader.forEach(segment, [this, &n, &cas](const SnapshotRecord& record,
+                                               StringPiece key,
+                                               StringPiece value) {
+        restoreItem(record, key, value, &n);
+        cas = std::max(cas, record.cas);
+      });
+    }
+    restored.add(n);
+    uint64_t old = maxCas;
+    while (old < cas && !maxCas.compare_exchange_weak(old, cas))
+    {
+    }
+  };
+  std::vector<std::unique_ptr<Thread>> threads;
+  for (int i = 1; i < options_.loadThreads; ++i)
+  {
+    threads.emplace_back(new Thread(load, "snapshot-load"));
+    threads.back()->start();
+  }
+  load();
+  for (const auto& thr : threads)
+  {
+    thr->join();
+  }
+  if (static_cast<uint64_t>(g_cas.get()) < maxCas)
+  {
+    g_cas.getAndSet(static_cast<int64_t>(maxCas.load()));
+  }
+
+  double seconds = timeDifference(Timestamp::now(), start);
+  double GiB = static_cast<double>(reader.fileSize()) / (1024 * 1024 * 1024);
+  LOG_INFO << "loaded " << restored.get() << " of " << reader.items() << " items, "
+           << reader.fileSize() / (1024 * 1024) << " MiB from " << options_.snapshotPath
+           << " in " << seconds << " seconds, " << seconds / GiB << " seconds per GiB, "
+           << std::max(options_.loadThreads, 1) << " threads";
+  return true;
+}
+
+void MemcacheServer::restoreItem(const SnapshotRecord& record,
+                                 StringPiece key,
+                                 StringPiece value,
+                                 int64_t* restored)
+{
+  int rel_exptime = 0;
+  if (record.exptime != 0)
+  {
+    if (record.exptime <= ::time(NULL))
+    {
+      return;
+    }
+    rel_exptime = static_cast<int>(std::max<time_t>(record.exptime - startTime_, 1));
+  }
+  // evicts older ones if memory is smaller than before
+  ItemPtr item(newItem(key, record.flags, rel_exptime, value.size() + 2, record.cas));
+  if (!item)
+  {
+    return;
+  }
+  item->append(value.data(), value.size());
+  item->append("\r\n", 2);
+  assert(item->neededBytes() == 0);
+
+  MutexLockGuard lock(items_.mutexOf(item->hash()));
+  if (items_.findLocked(*item) == NULL)
+  {
+    items_.insert(item);
+    linked(item.get());
+    ++*restored;
+  }
+}
+
+void MemcacheServer::stats(StringPiece arg, Buffer* out) const
+{
+  LogStream buf;
+  if (arg == "slabs")
+  {
+    int active = 0;
+    for (int cls = 0; cls < slab_.numClasses(); ++cls)
+    {
+      SlabAllocator::ClassStats s = slab_.stats(cls);
+      if (s.pages == 0)
+        continue;
+      ++active;
+      buf << "STAT " << cls << ":chunk_size " << s.chunkSize << "\r\n"
+          << "STAT " << cls << ":total_pages " << s.pages << "\r\n"
+          << "STAT " << cls << ":total_chunks " << s.chunks << "\r\n"
+          << "STAT " << cls << ":used_chunks " << s.usedChunks << "\r\n"
+          << "STAT " << cls << ":free_chunks " << s.chunks - s.usedChunks << "\r\n"
+          << "STAT " << cls << ":evicted " << s.evicted << "\r\n";
+      out->append(buf.buffer().data(), buf.buffer().length());
+      buf.resetBuffer();
+    }
+    buf << "STAT active_slabs " << active << "\r\n"
+        << "STAT total_malloced " << slab_.allocatedBytes() << "\r\n";
+  }
+  else
+  {
+    size_t connections = 0;
+    {
+      MutexLockGuard lock(mutex_);
+      connections = sessions_.size();
+    }
+    int64_t hits = 0, misses = 0;
+    items_.getStats(&hits, &misses);
+    buf << "STAT pid " << ::getpid() << "\r\n"
+        << "STAT uptime " << currentTime() << "\r\n"
+        << "STAT time " << static_cast<int64_t>(::time(NULL)) << "\r\n"
+        << "STAT curr_connections " << connections << "\r\n"
+        << "STAT cmd_get " << hits + misses << "\r\n"
+        << "STAT cmd_set " << stats_->cmdSet.get() << "\r\n"
+        << "STAT get_hits " << hits << "\r\n"
+        << "STAT get_misses " << misses << "\r\n";
+    out->append(buf.buffer().data(), buf.buffer().length());
+    buf.resetBuffer();
+    buf << "STAT curr_items " << stats_->currItems.get() << "\r\n"
+        << "STAT total_items " << stats_->totalItems.get() << "\r\n"
+        << "STAT bytes " << stats_->bytes.get() << "\r\n"
+        << "STAT limit_maxbytes " << slab_.memoryLimit() << "\r\n"
+        << "STAT total_malloced " << slab_.allocatedBytes() << "\r\n"
+        << "STAT evictions " << stats_->evictions.get() << "\r\n"
+        << "STAT expired " << stats_->expired.get() << "\r\n"
+        << "STAT outofmemory " << stats_->outOfMemory.get() << "\r\n"
+        << "STAT threads " << options_.threads << "\r\n";
+  }
+  buf << "END\r\n";
+  out->append(buf.buffer().data(), buf.buffer().length());
 }
 
 void MemcacheServer::onConnection(const TcpConnectionPtr& conn)
@@ -2,15 +2,18 @@
 #define MUDUO_EXAMPLES_MEMCACHED_SERVER_MEMCACHESERVER_H
 
 #include "examples/memcached/server/Item.h"
+#include "examples/memcached/server/ItemTable.h"
 #include "examples/memcached/server/Session.h"
+#include "examples/memcached/server/Snapshot.h"
+#include "examples/memcached/server/SlabAllocator.h"
 
 #include "muduo/base/Mutex.h"
+#include "muduo/base/ThreadPool.h"
 #include "muduo/net/TcpServer.h"
 #include "examples/wordcount/hash.h"
 
-#include <array>
+#include <atomic>
 #include <unordered_map>
-#include <unordered_set>
 
 class MemcacheServer : muduo::noncopyable
 {
@@ -22,6 +25,10 @@ class MemcacheServer : muduo::noncopyable
     uint16_t udpport;
     uint16_t gperfport;
     int threads;
+    int memoryMiB;  // for items, 64 by default
+    string snapshotPath;  // none by default
+    int snapshotSeconds;  // between snapshots, 0 for only on exit
+    int loadThreads;  // to load the snapshot, 4 by default
   };
 
   MemcacheServer(muduo::net::EventLoop* loop, const Options&);
@@ -31,57 +38,94 @@ class MemcacheServer : muduo::noncopyable
   void start();
   void stop();
 
+  // Writes items to options.snapshotPath, shard by shard, while gets and
+  // updates go on.  Items of a shard are taken with the shard locked and
+  // written unlocked.  One at a time, false on error.
+  bool saveSnapshot();
+  // Reads options.snapshotPath with options.loadThreads threads,
+  // before start().  false if there is no valid snapshot.
+  bool loadSnapshot();
+
   time_t startTime() const { return startTime_; }
+  // seconds since startTime(), what Item::rel_exptime() counts
+  int currentTime() const { return static_cast<int>(::time(NULL) - startTime_); }
+
+  // Allocates from the slab of its size, evicting if memory is full.
+  // NULL if the item is too large or nothing can be evicted.
+  ItemPtr newItem(muduo::StringPiece key,
+                  uint32_t flags,
+                  int rel_exptime,
+                  int valuelen,
+                  uint64_t cas);
 
   bool storeItem(const ItemPtr& item, Item::UpdatePolicy policy, bool* exists);
-  ConstItemPtr getItem(const ConstItemPtr& key) const;
+  // lock free
+  ConstItemPtr getItem(const ConstItemPtr& key);
+  // calls f(item) if key is there, lock free,
+  // item is valid until f returns unless f takes a reference
+  template <typename Function>
+  bool getItem(const ConstItemPtr& key, Function f)
+  {
+    ItemTable::ReadGuard guard(&items_);
+    const Item* item = items_.find(*key);
+    bool hit = item && !item->expired(currentTime());
+    items_.countGet(hit);
+    if (hit)
+    {
+      item->touch();
+      f(item);
+    }
+    return hit;
+  }
   bool deleteItem(const ConstItemPtr& key);
 
+  // "stats" and "stats slabs" of memcached
+  void stats(muduo::StringPiece arg, muduo::net::Buffer* out) const;
+
  private:
   void onConnection(const muduo::net::TcpConnectionPtr& conn);
 
+  // without stats and touch()
+  ConstItemPtr findItem(const ConstItemPtr& key);
+  // removes items in the chunk of cls under the CLOCK hand
+  void evict(int cls);
+  // removes item if it is still the one in the table
+  bool unlinkItem(const ConstItemPtr& item);
+  // reclaims expired items of some shards, runs every second
+  void expireSome();
+  // stats of items going in and out of items_
+  void linked(const Item* item);
+  void unlinked(const Item* item);
+  // without counting a set, as if the item never went away
+  void restoreItem(const SnapshotRecord& record,
+                   muduo::StringPiece key,
+                   muduo::StringPiece value,
+                   int64_t* restored);
+
   struct Stats;
 
   muduo::net::EventLoop* loop_;  // not own
   Options options_;
   const time_t startTime_;
 
+  // outlive every item, those in items_, and those held by sessions_
+  // and by the output queues of their connections
+  SlabAllocator slab_;
+  ItemTable items_;
+  int expireCursor_;  // in loop_
+
   mutable muduo::MutexLock mutex_;
   std::unordered_map<string, SessionPtr> sessions_ GUARDED_BY(mutex_);
 
-  // a complicated solution to save memory
-  struct Hash
-  {
-    size_t operator()(const ConstItemPtr& x) const
-    {
-      return x->hash();
-    }
-  };
-
-  struct Equal
-  {
-    bool operator()(const ConstItemPtr& x, const ConstItemPtr& y) const
-    {
-      return x->key() == y->key();
-    }
-  };
-
-  typedef std::unordered_set<ConstItemPtr, Hash, Equal> ItemMap;
-
-  struct MapWithLock
-  {
-    ItemMap items;
-    mutable muduo::MutexLock mutex;
-  };
-
-  const static int kShards = 4096;
-
-  std::array<MapWithLock, kShards> shards_;
-
   // NOT guarded by mutex_, but here because server_ has to destructs before
   // sessions_
   muduo::net::TcpServer server_;
   std::unique_ptr<Stats> stats_ PT_GUARDED_BY(mutex_);
+
+  muduo::MutexLock snapshotMutex_;  // held while saving
+  std::atomic<bool> snapshotting_;  // skips a periodic one meanwhile
+  // destructs first, it reads items_
+  muduo::ThreadPool snapshotThread_;
 };
 
 #endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_MEMCACHESERVER_H
@@ -1,6 +1,8 @@
 #include "examples/memcached/server/Session.h"
 #include "examples/memcached/server/MemcacheServer.h"
 
+#include "muduo/net/Endian.h"
+
 #ifdef HAVE_TCMALLOC
 #include <gperftools/malloc_extension.h>
 #endif
@@ -8,66 +10,162 @@
 using namespace muduo;
 using namespace muduo::net;
 
-static bool isBinaryProtocol(uint8_t firstByte)
+namespace
+{
+
+const uint8_t kRequestMagic = 0x80;
+const uint8_t kResponseMagic = 0x81;
+const size_t kBinaryHeaderSize = 24;
+
+// opcodes of the binary protocol
+enum Opcode
+{
+  kGet = 0x00,
+  kSet = 0x01,
+  kAdd = 0x02,
+  kReplace = 0x03,
+  kDelete = 0x04,
+  kQuit = 0x07,
+  kGetQ = 0x09,
+  kNoop = 0x0a,
+  kVersion = 0x0b,
+  kGetK = 0x0c,
+  kGetKQ = 0x0d,
+  kAppend = 0x0e,
+  kPrepend = 0x0f,
+  kStat = 0x10,
+  kSetQ = 0x11,
+  kAddQ = 0x12,
+  kReplaceQ = 0x13,
+  kDeleteQ = 0x14,
+  kQuitQ = 0x17,
+  kAppendQ = 0x19,
+  kPrependQ = 0x1a,
+};
+
+// response status of the binary protocol
+enum Status
+{
+  kSuccess = 0x00,
+  kKeyNotFound = 0x01,
+  kKeyExists = 0x02,
+  kValueTooLarge = 0x03,
+  kInvalidArguments = 0x04,
+  kNotStored = 0x05,
+  kUnknownCommand = 0x81,
+  kOutOfMemory = 0x82,
+};
+
+const size_t kMaxLineLength = 1024;  // but get and gets
+const size_t kMaxValueLength = 1024 * 1024;
+// copied into outputBuf_, a larger value is sent from its item
+const size_t kCopyLimit = 1024;
+// the rest of a value is read into its item if longer than this
+const size_t kReadIntoItem = 4096;
+
+bool isBinaryProtocol(uint8_t firstByte)
+{
+  return firstByte == kRequestMagic;
+}
+
+template<typename T>
+T load(const char* p)
 {
-  return firstByte == 0x80;
+  T x;
+  ::memcpy(&x, p, sizeof x);
+  return x;
 }
 
+}  // namespace
+
 const int kLongestKeySize = 250;
 string Session::kLongestKey(kLongestKeySize, 'x');
 
-template <typename InputIterator, typename Token>
-bool Session::SpaceSeparator::operator()(InputIterator& next, InputIterator end, Token& tok)
+// Splits a request line at spaces, in one pass.
+class Session::Tokenizer
 {
-  while (next != end && *next == ' ')
-    ++next;
-  if (next == end)
-  {
-    tok.clear();
-    return false;
-  }
-  InputIterator start(next);
-  const char* sp = static_cast<const char*>(memchr(start, ' ', end - start));
-  if (sp)
-  {
-    tok.set(start, static_cast<int>(sp - start));
-    next = sp;
-  }
-  else
+ public:
+  explicit Tokenizer(StringPiece line)
+    : next_(line.begin()),
+      end_(line.end())
   {
-    tok.set(start, static_cast<int>(end - next));
-    next = end;
   }
-  return true;
-}
 
-struct Session::Reader
-{
-  Reader(Tokenizer::iterator& beg, Tokenizer::iterator end)
-      : first_(beg),
-        last_(end)
+  bool next(StringPiece* token)
   {
+    while (next_ != end_ && *next_ == ' ')
+      ++next_;
+    if (next_ == end_)
+      return false;
+    const char* start = next_;
+    while (next_ != end_ && *next_ != ' ')
+      ++next_;
+    token->set(start, static_cast<int>(next_ - start));
+    return true;
   }
 
+  // decimal digits, with an optional '-'
   template<typename T>
-  bool read(T* val)
+  bool readNumber(T* val)
   {
-    if (first_ == last_)
+    StringPiece token;
+    if (!next(&token))
       return false;
-    char* end = NULL;
-    uint64_t x = strtoull((*first_).data(), &end, 10);
-    if (end == (*first_).end())
+    const char* p = token.begin();
+    const bool negative = *p == '-';
+    if (negative)
+      ++p;
+    if (p == token.end() || token.end() - p > 20)
+      return false;
+    uint64_t x = 0;
+    for (; p != token.end(); ++p)
     {
-      *val = static_cast<T>(x);
-      ++first_;
-      return true;
+      if (*p < '0' || *p > '9')
+        return false;
+      x = x * 10 + static_cast<uint64_t>(*p - '0');
     }
-    return false;
+    *val = static_cast<T>(negative ? 0 - x : x);
+    return true;
   }
 
  private:
-  Tokenizer::iterator first_;
-  Tokenizer::iterator last_;;
+  const char* next_;
+  const char* const end_;
+};
+
+Session::BinaryHeader Session::parseBinaryHeader(const char* p)
+{
+  BinaryHeader header;
+  header.magic = static_cast<uint8_t>(p[0]);
+  header.opcode = static_cast<uint8_t>(p[1]);
+  header.keylen = sockets::networkToHost16(load<uint16_t>(p + 2));
+  header.extlen = static_cast<uint8_t>(p[4]);
+  header.bodylen = sockets::networkToHost32(load<uint32_t>(p + 8));
+  header.opaque = load<uint32_t>(p + 12);
+  header.cas = sockets::networkToHost64(load<uint64_t>(p + 16));
+  return header;
+}
+
+bool Session::isBinaryUpdate(uint8_t opcode)
+{
+  switch (opcode)
+  {
+    case kSet: case kSetQ:
+    case kAdd: case kAddQ:
+    case kReplace: case kReplaceQ:
+    case kAppend: case kAppendQ:
+    case kPrepend: case kPrependQ:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// outputBuf_ and the items of its values, until written
+struct Session::Reply
+{
+  Buffer text;
+  std::vector<ConstItemPtr> items;
 };
 
 void Session::onMessage(const muduo::net::TcpConnectionPtr& conn,
@@ -76,6 +174,11 @@ void Session::onMessage(const muduo::net::TcpConnectionPtr& conn,
 
 {
   const size_t initialReadable = buf->readableBytes();
+  if (state_ == kReceiveValue && initialReadable == 0)
+  {
+    // all went into currItem_
+    receiveValue(buf);
+  }
 
   while (buf->readableBytes() > 0)
   {
@@ -90,7 +193,44 @@ void Session::onMessage(const muduo::net::TcpConnectionPtr& conn,
       assert(protocol_ == kAscii || protocol_ == kBinary);
       if (protocol_ == kBinary)
       {
-        // FIXME
+        if (buf->readableBytes() < kBinaryHeaderSize)
+        {
+          break;
+        }
+        BinaryHeader header = parseBinaryHeader(buf->peek());
+        if (header.magic != kRequestMagic)
+        {
+          conn_->shutdown();
+          break;
+        }
+        const size_t head = static_cast<size_t>(header.extlen) + header.keylen;
+        if (isBinaryUpdate(header.opcode) && head <= header.bodylen)
+        {
+          // the value is received as it comes
+          if (buf->readableBytes() < kBinaryHeaderSize + head)
+          {
+            break;
+          }
+          processBinary(header, buf->peek() + kBinaryHeaderSize);
+          buf->retrieve(kBinaryHeaderSize + head);
+        }
+        else if (header.bodylen > kMaxValueLength + kLongestKeySize + 8)
+        {
+          ++requestsProcessed_;
+          binaryReply(header, kValueTooLarge, "", "Too large.");
+          buf->retrieve(kBinaryHeaderSize);
+          bytesToDiscard_ = header.bodylen;
+          state_ = kDiscardValue;
+        }
+        else if (buf->readableBytes() >= kBinaryHeaderSize + header.bodylen)
+        {
+          processBinary(header, buf->peek() + kBinaryHeaderSize);
+          buf->retrieve(kBinaryHeaderSize + header.bodylen);
+        }
+        else
+        {
+          break;
+        }
       }
       else  // ASCII protocol
       {
@@ -107,9 +247,19 @@ void Session::onMessage(const muduo::net::TcpConnectionPtr& conn,
         }
         else
         {
-          if (buf->readableBytes() > 1024)
+          if (buf->readableBytes() > kMaxLineLength)
           {
-            // FIXME: check for 'get' and 'gets'
+            // a multiget is served as its keys arrive
+            StringPiece line(buf->peek(), static_cast<int>(buf->readableBytes()));
+            if (line.starts_with("get ") || line.starts_with("gets "))
+            {
+              ++requestsProcessed_;
+              command_ = line.starts_with("get ") ? "get" : "gets";
+              buf->retrieve(command_.size() + 1);
+              state_ = kGetKeys;
+              continue;
+            }
+            flush();
             conn_->shutdown();
             // buf->retrieveAll() ???
           }
@@ -125,11 +275,19 @@ void Session::onMessage(const muduo::net::TcpConnectionPtr& conn,
     {
       discardValue(buf);
     }
+    else if (state_ == kGetKeys)
+    {
+      if (!getKeys(buf))
+      {
+        break;
+      }
+    }
     else
     {
       assert(false);
     }
   }
+  flush();
   bytesRead_ += initialReadable - buf->readableBytes();
 }
 
@@ -137,13 +295,58 @@ void Session::receiveValue(muduo::net::Buffer* buf)
 {
   assert(currItem_.get());
   assert(state_ == kReceiveValue);
-  // if (protocol_ == kBinary)
 
-  const size_t avail = std::min(buf->readableBytes(), currItem_->neededBytes());
-  assert(currItem_.unique());
+  // read into the item since last time, they come before buf
+  currItem_->hasWritten(conn_->readTargetFilled());
+  conn_->setReadTarget(NULL, 0);
+
+  // "\r\n" is not sent after values in the binary protocol
+  size_t wanted = currItem_->neededBytes() - (protocol_ == kBinary ? 2 : 0);
+  const size_t avail = std::min(buf->readableBytes(), wanted);
   currItem_->append(buf->peek(), avail);
   buf->retrieve(avail);
-  if (currItem_->neededBytes() == 0)
+  wanted -= avail;
+  if (wanted == 0)
+  {
+    finishUpdate();
+  }
+  else if (wanted > kReadIntoItem)
+  {
+    assert(buf->readableBytes() == 0);
+    conn_->setReadTarget(currItem_->beginWrite(), wanted);
+  }
+}
+
+void Session::finishUpdate()
+{
+  if (protocol_ == kBinary)
+  {
+    currItem_->append("\r\n", 2);
+    const BinaryHeader& request = binaryRequest_;
+    const bool quiet = request.opcode >= kSetQ;  // kSetQ and on are quiet
+    bool exists = false;
+    if (owner_->storeItem(currItem_, policy_, &exists))
+    {
+      if (!quiet)
+      {
+        const bool concat = policy_ == Item::kAppend || policy_ == Item::kPrepend;
+        binaryReply(request, kSuccess, "", "", concat ? 0 : currItem_->cas());
+      }
+    }
+    else if (policy_ == Item::kAdd || (policy_ == Item::kCas && exists))
+    {
+      binaryReply(request, kKeyExists, "", "Data exists for key.");
+    }
+    else if (policy_ == Item::kReplace || policy_ == Item::kCas)
+    {
+      binaryReply(request, kKeyNotFound, "", "Not found");
+    }
+    else
+    {
+      binaryReply(request, kNotStored, "", "Not stored.");
+    }
+  }
+  else
   {
     if (currItem_->endsWithCRLF())
     {
@@ -175,9 +378,9 @@ void Session::receiveValue(muduo::net::Buffer* buf)
     {
       reply("CLIENT_ERROR bad data chunk\r\n");
     }
-    resetRequest();
-    state_ = kNewCommand;
   }
+  resetRequest();
+  state_ = kNewCommand;
 }
 
 void Session::discardValue(muduo::net::Buffer* buf)
@@ -198,6 +401,64 @@ void Session::discardValue(muduo::net::Buffer* buf)
   }
 }
 
+bool Session::getKeys(muduo::net::Buffer* buf)
+{
+  assert(state_ == kGetKeys);
+  const char* crlf = buf->findCRLF();
+  const char* end = crlf;
+  if (!end)
+  {
+    // keys before the last space are complete
+    end = static_cast<const char*>(::memrchr(buf->peek(), ' ', buf->readableBytes()));
+    if (!end)
+    {
+      if (buf->readableBytes() > kLongestKeySize + 1)
+      {
+        reply("CLIENT_ERROR bad command line format\r\n");
+        flush();
+        conn_->shutdown();
+        buf->retrieveAll();
+        resetRequest();
+        state_ = kNewCommand;
+      }
+      return false;
+    }
+  }
+
+  const bool cas = command_ == "gets";
+  Tokenizer tok(StringPiece(buf->peek(), static_cast<int>(end - buf->peek())));
+  StringPiece key;
+  while (tok.next(&key))
+  {
+    if (key.size() > kLongestKeySize)
+    {
+      reply("CLIENT_ERROR bad command line format\r\n");
+      flush();
+      conn_->shutdown();
+      buf->retrieveAll();
+      resetRequest();
+      state_ = kNewCommand;
+      return false;
+    }
+    doGet(key, cas);
+  }
+
+  if (crlf)
+  {
+    outputBuf_.append("END\r\n");
+    buf->retrieveUntil(crlf + 2);
+    resetRequest();
+    state_ = kNewCommand;
+  }
+  else
+  {
+    buf->retrieveUntil(end + 1);
+    // what is found so far, while the rest of the line is coming
+    flush();
+  }
+  return true;
+}
+
 bool Session::processRequest(StringPiece request)
 {
   assert(command_.empty());
@@ -218,58 +479,49 @@ bool Session::processRequest(StringPiece request)
     }
   }
 
-  SpaceSeparator sep;
-  Tokenizer tok(request.begin(), request.end(), sep);
-  Tokenizer::iterator beg = tok.begin();
-  if (beg == tok.end())
+  Tokenizer tok(request);
+  StringPiece command;
+  if (!tok.next(&command))
   {
     reply("ERROR\r\n");
     return true;
   }
-  (*beg).CopyToString(&command_);
-  ++beg;
+  command.CopyToString(&command_);
   if (command_ == "set" || command_ == "add" || command_ == "replace"
       || command_ == "append" || command_ == "prepend" || command_ == "cas")
   {
     // this normally returns false
-    return doUpdate(beg, tok.end());
+    return doUpdate(&tok);
   }
   else if (command_ == "get" || command_ == "gets")
   {
     bool cas = command_ == "gets";
 
-    // FIXME: send multiple chunks with write complete callback.
-    while (beg != tok.end())
+    StringPiece key;
+    while (tok.next(&key))
     {
-      StringPiece key = *beg;
       bool good = key.size() <= kLongestKeySize;
       if (!good)
       {
         reply("CLIENT_ERROR bad command line format\r\n");
         return true;
       }
-
-      needle_->resetKey(key);
-      ConstItemPtr item = owner_->getItem(needle_);
-      ++beg;
-      if (item)
-      {
-        item->output(&outputBuf_, cas);
-      }
+      doGet(key, cas);
     }
     outputBuf_.append("END\r\n");
-
-    if (conn_->outputBuffer()->writableBytes() > 65536 + outputBuf_.readableBytes())
-    {
-      LOG_DEBUG << "shrink output buffer from " << conn_->outputBuffer()->internalCapacity();
-      conn_->outputBuffer()->shrink(65536 + outputBuf_.readableBytes());
-    }
-
-    conn_->send(&outputBuf_);
   }
   else if (command_ == "delete")
   {
-    doDelete(beg, tok.end());
+    doDelete(&tok);
+  }
+  else if (command_ == "stats")
+  {
+    if (!noreply_)
+    {
+      StringPiece arg;
+      tok.next(&arg);
+      owner_->stats(arg, &outputBuf_);
+    }
   }
   else if (command_ == "version")
   {
@@ -289,11 +541,13 @@ bool Session::processRequest(StringPiece request)
 #endif
   else if (command_ == "quit")
   {
+    flush();
     conn_->shutdown();
   }
   else if (command_ == "shutdown")
   {
     // "ERROR: shutdown not enabled"
+    flush();
     conn_->shutdown();
     owner_->stop();
   }
@@ -318,11 +572,34 @@ void Session::reply(muduo::StringPiece msg)
 {
   if (!noreply_)
   {
-    conn_->send(msg.data(), msg.size());
+    outputBuf_.append(msg.data(), msg.size());
+  }
+}
+
+int Session::relativeExptime(time_t exptime) const
+{
+  int rel_exptime = 0;
+  if (exptime > 60*60*24*30)
+  {
+    rel_exptime = static_cast<int>(exptime - owner_->startTime());
+    if (rel_exptime < 1)
+    {
+      rel_exptime = 1;  // in the past
+    }
+  }
+  else if (exptime != 0)
+  {
+    // negative expires at once
+    rel_exptime = static_cast<int>(exptime) + owner_->currentTime();
+    if (rel_exptime == 0)
+    {
+      rel_exptime = -1;
+    }
   }
+  return rel_exptime;
 }
 
-bool Session::doUpdate(Session::Tokenizer::iterator& beg, Session::Tokenizer::iterator end)
+bool Session::doUpdate(Tokenizer* tok)
 {
   if (command_ == "set")
     policy_ = Item::kSet;
@@ -339,36 +616,20 @@ bool Session::doUpdate(Session::Tokenizer::iterator& beg, Session::Tokenizer::it
   else
     assert(false);
 
-  // FIXME: check (beg != end)
-  StringPiece key = (*beg);
-  ++beg;
-  bool good = key.size() <= kLongestKeySize;
+  StringPiece key;
+  bool good = tok->next(&key) && key.size() <= kLongestKeySize;
 
   uint32_t flags = 0;
   time_t exptime = 1;
   int bytes = -1;
   uint64_t cas = 0;
 
-  Reader r(beg, end);
-  good = good && r.read(&flags) && r.read(&exptime) && r.read(&bytes);
-
-  int rel_exptime = static_cast<int>(exptime);
-  if (exptime > 60*60*24*30)
-  {
-    rel_exptime = static_cast<int>(exptime - owner_->startTime());
-    if (rel_exptime < 1)
-    {
-      rel_exptime = 1;
-    }
-  }
-  else
-  {
-    // rel_exptime = exptime + currentTime;
-  }
+  good = good && tok->readNumber(&flags) && tok->readNumber(&exptime)
+      && tok->readNumber(&bytes) && bytes >= 0;
 
   if (good && policy_ == Item::kCas)
   {
-    good = r.read(&cas);
+    good = tok->readNumber(&cas);
   }
 
   if (!good)
@@ -376,7 +637,7 @@ bool Session::doUpdate(Session::Tokenizer::iterator& beg, Session::Tokenizer::it
     reply("CLIENT_ERROR bad command line format\r\n");
     return true;
   }
-  if (bytes > 1024*1024)
+  if (static_cast<size_t>(bytes) > kMaxValueLength)
   {
     reply("SERVER_ERROR object too large for cache\r\n");
     needle_->resetKey(key);
@@ -385,26 +646,30 @@ bool Session::doUpdate(Session::Tokenizer::iterator& beg, Session::Tokenizer::it
     state_ = kDiscardValue;
     return false;
   }
-  else
+
+  currItem_ = owner_->newItem(key, flags, relativeExptime(exptime), bytes + 2, cas);
+  if (!currItem_)
   {
-    currItem_ = Item::makeItem(key, flags, rel_exptime, bytes + 2, cas);
-    state_ = kReceiveValue;
+    reply("SERVER_ERROR out of memory storing object\r\n");
+    bytesToDiscard_ = bytes + 2;
+    state_ = kDiscardValue;
     return false;
   }
+  state_ = kReceiveValue;
+  return false;
 }
 
-void Session::doDelete(Session::Tokenizer::iterator& beg, Session::Tokenizer::iterator end)
+void Session::doDelete(Tokenizer* tok)
 {
   assert(command_ == "delete");
-  // FIXME: check (beg != end)
-  StringPiece key = *beg;
-  bool good = key.size() <= kLongestKeySize;
-  ++beg;
+  StringPiece key;
+  bool good = tok->next(&key) && key.size() <= kLongestKeySize;
+  StringPiece time;
   if (!good)
   {
     reply("CLIENT_ERROR bad command line format\r\n");
   }
-  else if (beg != end && *beg != "0") // issue 108, old protocol
+  else if (tok->next(&time) && time != "0") // issue 108, old protocol
   {
     reply("CLIENT_ERROR bad command line format.  Usage: delete <key> [noreply]\r\n");
   }
@@ -421,3 +686,285 @@ void Session::doDelete(Session::Tokenizer::iterator& beg, Session::Tokenizer::it
     }
   }
 }
+
+void Session::doGet(StringPiece key, bool needCas)
+{
+  needle_->resetKey(key);
+  owner_->getItem(needle_, [this, needCas](const Item* item) {
+    item->outputHeader(&outputBuf_, needCas);
+    appendValue(item, item->valueLength());
+  });
+}
+
+void Session::processBinary(const BinaryHeader& request, const char* body)
+{
+  ++requestsProcessed_;
+  if (static_cast<size_t>(request.extlen) + request.keylen > request.bodylen)
+  {
+    binaryReply(request, kInvalidArguments, "", "Invalid arguments");
+    return;
+  }
+  StringPiece extras(body, request.extlen);
+  StringPiece key(body + request.extlen, request.keylen);
+  if (isBinaryUpdate(request.opcode))
+  {
+    binaryUpdate(request, extras, key, request.bodylen - request.extlen - request.keylen);
+    return;
+  }
+  if (key.size() > kLongestKeySize)
+  {
+    binaryReply(request, kInvalidArguments, "", "Invalid arguments");
+    return;
+  }
+
+  switch (request.opcode)
+  {
+    case kGet:
+    case kGetQ:
+    case kGetK:
+    case kGetKQ:
+      binaryGet(request, key);
+      break;
+    case kDelete:
+    case kDeleteQ:
+      if (request.extlen != 0 || key.empty())
+      {
+        binaryReply(request, kInvalidArguments, "", "Invalid arguments");
+        break;
+      }
+      needle_->resetKey(key);
+      if (!owner_->deleteItem(needle_))
+      {
+        binaryReply(request, kKeyNotFound, "", "Not found");
+      }
+      else if (request.opcode == kDelete)
+      {
+        binaryReply(request, kSuccess, "", "");
+      }
+      break;
+    case kNoop:
+      binaryReply(request, kSuccess, "", "");
+      break;
+    case kVersion:
+      binaryReply(request, kSuccess, "", "0.01 muduo");
+      break;
+    case kStat:
+      binaryStats(request, key);
+      break;
+    case kQuit:
+    case kQuitQ:
+      if (request.opcode == kQuit)
+      {
+        binaryReply(request, kSuccess, "", "");
+      }
+      flush();
+      conn_->shutdown();
+      break;
+    default:
+      binaryReply(request, kUnknownCommand, "", "Unknown command");
+      break;
+  }
+}
+
+void Session::binaryGet(const BinaryHeader& request, StringPiece key)
+{
+  if (request.extlen != 0 || key.empty())
+  {
+    binaryReply(request, kInvalidArguments, "", "Invalid arguments");
+    return;
+  }
+  const bool withKey = request.opcode == kGetK || request.opcode == kGetKQ;
+  const bool quiet = request.opcode == kGetQ || request.opcode == kGetKQ;
+  needle_->resetKey(key);
+  bool hit = owner_->getItem(needle_, [&](const Item* item) {
+    const size_t keylen = withKey ? key.size() : 0;
+    const size_t valuelen = item->valueLength() - 2;
+    binaryResponse(request, kSuccess, 4, keylen, 4 + keylen + valuelen, item->cas());
+    uint32_t flags = sockets::hostToNetwork32(item->flags());
+    outputBuf_.append(&flags, sizeof flags);
+    outputBuf_.append(key.data(), keylen);
+    appendValue(item, valuelen);
+  });
+  if (!hit && !quiet)
+  {
+    binaryReply(request, kKeyNotFound, withKey ? key : StringPiece(), "Not found");
+  }
+}
+
+void Session::binaryUpdate(const BinaryHeader& request, StringPiece extras,
+                           StringPiece key, size_t valuelen)
+{
+  Item::UpdatePolicy policy = Item::kInvalid;
+  switch (request.opcode)
+  {
+    case kSet: case kSetQ:
+      policy = request.cas ? Item::kCas : Item::kSet;
+      break;
+    case kAdd: case kAddQ:
+      policy = Item::kAdd;
+      break;
+    case kReplace: case kReplaceQ:
+      policy = request.cas ? Item::kCas : Item::kReplace;
+      break;
+    case kAppend: case kAppendQ:
+      policy = Item::kAppend;
+      break;
+    case kPrepend: case kPrependQ:
+      policy = Item::kPrepend;
+      break;
+    default:
+      assert(false);
+  }
+
+  // on error, the value is discarded as it comes
+  bytesToDiscard_ = valuelen;
+  state_ = valuelen > 0 ? kDiscardValue : kNewCommand;
+
+  const bool concat = policy == Item::kAppend || policy == Item::kPrepend;
+  if (key.empty() || key.size() > kLongestKeySize
+      || extras.size() != (concat ? 0 : 8)
+      || (policy == Item::kAdd && request.cas))
+  {
+    binaryReply(request, kInvalidArguments, "", "Invalid arguments");
+    return;
+  }
+  uint32_t flags = 0;
+  int32_t exptime = 0;
+  if (!concat)
+  {
+    flags = sockets::networkToHost32(load<uint32_t>(extras.data()));
+    exptime = static_cast<int32_t>(sockets::networkToHost32(load<uint32_t>(extras.data() + 4)));
+  }
+  if (valuelen > kMaxValueLength)
+  {
+    needle_->resetKey(key);
+    owner_->deleteItem(needle_);
+    binaryReply(request, kValueTooLarge, "", "Too large.");
+    return;
+  }
+
+  currItem_ = owner_->newItem(key, flags, relativeExptime(exptime),
+                              static_cast<int>(valuelen) + 2, request.cas);
+  if (!currItem_)
+  {
+    binaryReply(request, kOutOfMemory, "", "Out of memory");
+    return;
+  }
+  bytesToDiscard_ = 0;
+  policy_ = policy;
+  binaryRequest_ = request;
+  state_ = kReceiveValue;
+  if (valuelen == 0)
+  {
+    finishUpdate();
+  }
+}
+
+void Session::binaryStats(const BinaryHeader& request, StringPiece key)
+{
+  // a response of each "STAT name value" line, and an empty one
+  Buffer text;
+  owner_->stats(key, &text);
+  const char* crlf = NULL;
+  while ((crlf = text.findCRLF()) != NULL)
+  {
+    StringPiece line(text.peek(), static_cast<int>(crlf - text.peek()));
+    if (line.starts_with("STAT "))
+    {
+      line.remove_prefix(5);
+      const char* space = static_cast<const char*>(::memchr(line.data(), ' ', line.size()));
+      if (space)
+      {
+        binaryReply(request, kSuccess,
+                    StringPiece(line.data(), static_cast<int>(space - line.data())),
+                    StringPiece(space + 1, static_cast<int>(line.end() - space - 1)));
+      }
+    }
+    text.retrieveUntil(crlf + 2);
+  }
+  binaryReply(request, kSuccess, "", "");
+}
+
+void Session::binaryResponse(const BinaryHeader& request, uint16_t status,
+                             uint8_t extlen, size_t keylen, size_t bodylen, uint64_t cas)
+{
+  char header[kBinaryHeaderSize] = { 0 };
+  header[0] = static_cast<char>(kResponseMagic);
+  header[1] = static_cast<char>(request.opcode);
+  uint16_t be16 = sockets::hostToNetwork16(static_cast<uint16_t>(keylen));
+  ::memcpy(header + 2, &be16, sizeof be16);
+  header[4] = static_cast<char>(extlen);
+  be16 = sockets::hostToNetwork16(status);
+  ::memcpy(header + 6, &be16, sizeof be16);
+  uint32_t be32 = sockets::hostToNetwork32(static_cast<uint32_t>(bodylen));
+  ::memcpy(header + 8, &be32, sizeof be32);
+  ::memcpy(header + 12, &request.opaque, sizeof request.opaque);
+  uint64_t be64 = sockets::hostToNetwork64(cas);
+  ::memcpy(header + 16, &be64, sizeof be64);
+  outputBuf_.append(header, sizeof header);
+}
+
+void Session::binaryReply(const BinaryHeader& request, uint16_t status,
+                          StringPiece key, StringPiece value, uint64_t cas)
+{
+  binaryResponse(request, status, 0, key.size(), key.size() + value.size(), cas);
+  outputBuf_.append(key.data(), key.size());
+  outputBuf_.append(value.data(), value.size());
+}
+
+void Session::appendValue(const Item* item, size_t len)
+{
+  if (len <= kCopyLimit)
+  {
+    outputBuf_.append(item->value(), len);
+  }
+  else
+  {
+    Value v = { outputBuf_.readableBytes(), ConstItemPtr(item), len };
+    values_.push_back(v);
+  }
+}
+
+void Session::flush()
+{
+  if (values_.empty())
+  {
+    if (outputBuf_.readableBytes() > 0)
+    {
+      if (conn_->outputBuffer()->writableBytes() > 65536 + outputBuf_.readableBytes())
+      {
+        LOG_DEBUG << "shrink output buffer from " << conn_->outputBuffer()->internalCapacity();
+        conn_->outputBuffer()->shrink(65536 + outputBuf_.readableBytes());
+      }
+      conn_->send(&outputBuf_);
+    }
+    return;
+  }
+
+  // text in between values, which stay in their items
+  std::shared_ptr<Reply> reply(new Reply);
+  reply->text.swap(outputBuf_);
+  reply->items.reserve(values_.size());
+  const char* text = reply->text.peek();
+  size_t offset = 0;
+  iov_.clear();
+  for (Value& v : values_)
+  {
+    if (v.offset > offset)
+    {
+      struct iovec vec = { const_cast<char*>(text + offset), v.offset - offset };
+      iov_.push_back(vec);
+    }
+    struct iovec vec = { const_cast<char*>(v.item->value()), v.len };
+    iov_.push_back(vec);
+    offset = v.offset;
+    reply->items.push_back(std::move(v.item));
+  }
+  if (reply->text.readableBytes() > offset)
+  {
+    struct iovec vec = { const_cast<char*>(text + offset), reply->text.readableBytes() - offset };
+    iov_.push_back(vec);
+  }
+  values_.clear();
+  conn_->send(iov_.data(), static_cast<int>(iov_.size()), reply);
+}
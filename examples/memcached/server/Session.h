@@ -7,7 +7,9 @@
 
 #include "muduo/net/TcpConnection.h"
 
-#include <boost/tokenizer.hpp>
+#include <vector>
+
+#include <sys/uio.h>
 
 using muduo::string;
 
@@ -21,9 +23,10 @@ class Session : public std::enable_shared_from_this<Session>,
     : owner_(owner),
       conn_(conn),
       state_(kNewCommand),
-      protocol_(kAscii), // FIXME
+      protocol_(kAuto),
       noreply_(false),
       policy_(Item::kInvalid),
+      binaryRequest_(),
       bytesToDiscard_(0),
       needle_(Item::makeItem(kLongestKey, 0, 0, 2, 0)),
       bytesRead_(0),
@@ -50,6 +53,7 @@ class Session : public std::enable_shared_from_this<Session>,
     kNewCommand,
     kReceiveValue,
     kDiscardValue,
+    kGetKeys,  // the rest of a get line too long to wait for
   };
 
   enum Protocol
@@ -63,8 +67,12 @@ class Session : public std::enable_shared_from_this<Session>,
                  muduo::net::Buffer* buf,
                  muduo::Timestamp);
   void onWriteComplete(const muduo::net::TcpConnectionPtr& conn);
+  // large values are read into their items, see setReadTarget()
   void receiveValue(muduo::net::Buffer* buf);
+  void finishUpdate();
   void discardValue(muduo::net::Buffer* buf);
+  // returns false if it needs more data
+  bool getKeys(muduo::net::Buffer* buf);
   // TODO: highWaterMark
   // TODO: onWriteComplete
 
@@ -73,19 +81,47 @@ class Session : public std::enable_shared_from_this<Session>,
   void resetRequest();
   void reply(muduo::StringPiece msg);
 
-  struct SpaceSeparator
+  class Tokenizer;
+  bool doUpdate(Tokenizer* tok);
+  void doDelete(Tokenizer* tok);
+  void doGet(muduo::StringPiece key, bool needCas);
+  int relativeExptime(time_t exptime) const;
+
+  struct BinaryHeader
   {
-    void reset() {}
-    template <typename InputIterator, typename Token>
-    bool operator()(InputIterator& next, InputIterator end, Token& tok);
+    uint8_t magic;
+    uint8_t opcode;
+    uint16_t keylen;
+    uint8_t extlen;
+    uint32_t bodylen;
+    uint32_t opaque;  // as is
+    uint64_t cas;
   };
-
-  typedef boost::tokenizer<SpaceSeparator,
-      const char*,
-      muduo::StringPiece> Tokenizer;
-  struct Reader;
-  bool doUpdate(Tokenizer::iterator& beg, Tokenizer::iterator end);
-  void doDelete(Tokenizer::iterator& beg, Tokenizer::iterator end);
+  static BinaryHeader parseBinaryHeader(const char* p);
+  static bool isBinaryUpdate(uint8_t opcode);
+  void processBinary(const BinaryHeader& request, const char* body);
+  void binaryGet(const BinaryHeader& request, muduo::StringPiece key);
+  // the value follows, as in the ASCII protocol
+  void binaryUpdate(const BinaryHeader& request, muduo::StringPiece extras,
+                    muduo::StringPiece key, size_t valuelen);
+  void binaryStats(const BinaryHeader& request, muduo::StringPiece key);
+  void binaryResponse(const BinaryHeader& request, uint16_t status,
+                      uint8_t extlen, size_t keylen, size_t bodylen, uint64_t cas);
+  void binaryReply(const BinaryHeader& request, uint16_t status,
+                   muduo::StringPiece key, muduo::StringPiece value, uint64_t cas = 0);
+
+  // Replies go to outputBuf_ until flush(), values larger than
+  // kCopyLimit are sent from their items.
+  void appendValue(const Item* item, size_t len);
+  void flush();
+
+  struct Value
+  {
+    size_t offset;  // in outputBuf_
+    ConstItemPtr item;
+    size_t len;
+  };
+  struct Reply;
 
   MemcacheServer* owner_;
   muduo::net::TcpConnectionPtr conn_;
@@ -97,10 +133,13 @@ class Session : public std::enable_shared_from_this<Session>,
   bool noreply_;
   Item::UpdatePolicy policy_;
   ItemPtr currItem_;
+  BinaryHeader binaryRequest_;  // of currItem_
   size_t bytesToDiscard_;
   // cached
   ItemPtr needle_;
   muduo::net::Buffer outputBuf_;
+  std::vector<Value> values_;
+  std::vector<struct iovec> iov_;
 
   // per session stats
   size_t bytesRead_;
@@ -0,0 +1,115 @@
+#include "examples/memcached/server/SlabAllocator.h"
+
+#include <assert.h>
+
+using namespace muduo;
+
+const size_t SlabAllocator::kMinChunkSize;
+const size_t SlabAllocator::kPageSize;
+
+SlabAllocator::Class::Class(size_t size)
+  : chunkSize(size),
+    perPage(size < kPageSize ? kPageSize / size : 1),
+    used(0),
+    hand(0)
+{
+}
+
+SlabAllocator::SlabAllocator(size_t memoryLimit, size_t maxChunkSize)
+  : memoryLimit_(memoryLimit)
+{
+  size_t size = kMinChunkSize;
+  while (size < maxChunkSize)
+  {
+    classes_.emplace_back(new Class(size));
+    size = (size * 5 / 4 + 7) & ~size_t(7);
+  }
+  classes_.emplace_back(new Class(maxChunkSize));
+}
+
+SlabAllocator::~SlabAllocator() = default;
+
+int SlabAllocator::classOf(size_t bytes) const
+{
+  // binary search, a few dozen classes
+  int lo = 0, hi = numClasses();
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (classes_[mid]->chunkSize < bytes)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < numClasses() ? lo : -1;
+}
+
+bool SlabAllocator::newPage(Class* c)
+{
+  const size_t bytes = c->chunkSize * c->perPage;
+  if (allocated_.addAndGet(static_cast<int64_t>(bytes)) > static_cast<int64_t>(memoryLimit_))
+  {
+    allocated_.add(-static_cast<int64_t>(bytes));
+    return false;
+  }
+  char* page = new char[bytes]();
+  c->pages.emplace_back(page);
+  // hands out chunks in address order
+  for (size_t i = c->perPage; i > 0; --i)
+  {
+    c->freeList.push_back(page + (i - 1) * c->chunkSize);
+  }
+  return true;
+}
+
+void* SlabAllocator::allocate(int cls)
+{
+  Class* c = classes_[cls].get();
+  MutexLockGuard lock(c->mutex);
+  if (c->freeList.empty() && !newPage(c))
+  {
+    return NULL;
+  }
+  void* chunk = c->freeList.back();
+  c->freeList.pop_back();
+  ++c->used;
+  return chunk;
+}
+
+void SlabAllocator::deallocate(void* chunk, int cls)
+{
+  Class* c = classes_[cls].get();
+  MutexLockGuard lock(c->mutex);
+  assert(c->used > 0);
+  --c->used;
+  c->freeList.push_back(chunk);
+}
+
+void SlabAllocator::sweep(int cls, const Visitor& visit)
+{
+  Class* c = classes_[cls].get();
+  MutexLockGuard lock(c->mutex);
+  const size_t total = c->pages.size() * c->perPage;
+  for (size_t i = 0; i < 2 * total; ++i)
+  {
+    if (c->hand >= total)
+    {
+      c->hand = 0;
+    }
+    size_t hand = c->hand++;
+    char* chunk = c->pages[hand / c->perPage].get() + (hand % c->perPage) * c->chunkSize;
+    if (visit(chunk))
+    {
+      break;
+    }
+  }
+}
+
+SlabAllocator::ClassStats SlabAllocator::stats(int cls) const
+{
+  const Class& c = *classes_[cls];
+  MutexLockGuard lock(c.mutex);
+  ClassStats s = { c.chunkSize, c.pages.size(), c.pages.size() * c.perPage,
+                   c.used, c.evicted.get() };
+  return s;
+}
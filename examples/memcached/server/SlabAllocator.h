@@ -0,0 +1,80 @@
+#ifndef MUDUO_EXAMPLES_MEMCACHED_SERVER_SLABALLOCATOR_H
+#define MUDUO_EXAMPLES_MEMCACHED_SERVER_SLABALLOCATOR_H
+
+#include "muduo/base/Atomic.h"
+#include "muduo/base/Mutex.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Chunks of size classes, carved from pages under a memory limit,
+// as in memcached's slabs.c.
+//
+// Sizes grow by a factor of 1.25 from kMinChunkSize up to the largest
+// item.  A page of a class holds about kPageSize bytes of its chunks, or
+// a single chunk if that's larger.  Pages are never returned, once the
+// limit is reached a class gets chunks only by evicting, see sweep().
+class SlabAllocator : muduo::noncopyable
+{
+ public:
+  static const size_t kMinChunkSize = 96;
+  static const size_t kPageSize = 1024 * 1024;
+
+  struct ClassStats
+  {
+    size_t chunkSize;
+    size_t pages;
+    size_t chunks;
+    size_t usedChunks;
+    int64_t evicted;
+  };
+
+  SlabAllocator(size_t memoryLimit, size_t maxChunkSize);
+  ~SlabAllocator();
+
+  // -1 if bytes is larger than the largest chunk
+  int classOf(size_t bytes) const;
+  size_t chunkSize(int cls) const { return classes_[cls]->chunkSize; }
+  int numClasses() const { return static_cast<int>(classes_.size()); }
+
+  // NULL if the class has no free chunk and no page fits under the limit.
+  // Chunks of new pages are zero filled, freed ones keep their bytes.
+  void* allocate(int cls);
+  void deallocate(void* chunk, int cls);
+
+  // CLOCK hand of cls goes over its chunks, free ones included, for at
+  // most two rounds until visit returns true.  Runs with the class locked,
+  // visit must not allocate or deallocate in the same class.
+  typedef std::function<bool (void* chunk)> Visitor;
+  void sweep(int cls, const Visitor& visit);
+
+  void addEviction(int cls) { classes_[cls]->evicted.increment(); }
+
+  size_t memoryLimit() const { return memoryLimit_; }
+  size_t allocatedBytes() const { return static_cast<size_t>(allocated_.get()); }
+  ClassStats stats(int cls) const;
+
+ private:
+  struct Class
+  {
+    explicit Class(size_t size);
+
+    const size_t chunkSize;
+    const size_t perPage;
+    mutable muduo::MutexLock mutex;
+    std::vector<std::unique_ptr<char[]>> pages GUARDED_BY(mutex);
+    std::vector<void*> freeList GUARDED_BY(mutex);
+    size_t used GUARDED_BY(mutex);
+    size_t hand GUARDED_BY(mutex);  // index of chunk in pages
+    mutable muduo::AtomicInt64 evicted;
+  };
+
+  bool newPage(Class* c) REQUIRES(c->mutex);
+
+  const size_t memoryLimit_;
+  mutable muduo::AtomicInt64 allocated_;
+  std::vector<std::unique_ptr<Class>> classes_;
+};
+
+#endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_SLABALLOCATOR_H
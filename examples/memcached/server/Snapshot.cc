@@ -0,0 +1,207 @@
+#include "examples/memcached/server/Snapshot.h"
+
+#include "muduo/base/Logging.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace muduo;
+
+namespace
+{
+const char kMagic[8] = { 'M', 'C', 'S', 'N', 'A', 'P', '0', '1' };
+const size_t kMaxKeyLength = 250;
+const size_t kMaxValueLength = 1024 * 1024;
+
+size_t padded(size_t len)
+{
+  return (len + 7) & ~static_cast<size_t>(7);
+}
+}
+
+SnapshotWriter::SnapshotWriter(const string& path)
+  : path_(path),
+    tmpPath_(path + ".tmp"),
+    fp_(::fopen(tmpPath_.c_str(), "we")),
+    failed_(fp_ == NULL),
+    offset_(0),
+    items_(0)
+{
+  if (fp_)
+  {
+    ::setvbuf(fp_, NULL, _IOFBF, 1024 * 1024);
+  }
+  else
+  {
+    LOG_SYSERR << "SnapshotWriter " << tmpPath_;
+  }
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+  if (fp_)
+  {
+    ::fclose(fp_);
+    ::unlink(tmpPath_.c_str());
+  }
+}
+
+void SnapshotWriter::beginSegment()
+{
+  segments_.push_back(offset_);
+}
+
+void SnapshotWriter::add(const Item& item, time_t exptime)
+{
+  assert(!segments_.empty());
+  SnapshotRecord record;
+  memZero(&record, sizeof record);
+  record.cas = item.cas();
+  record.exptime = exptime;
+  record.flags = item.flags();
+  record.keylen = static_cast<uint32_t>(item.key().size());
+  record.valuelen = static_cast<uint32_t>(item.valueLength() - 2);
+  write(&record, sizeof record);
+  write(item.key().data(), record.keylen);
+  write(item.value(), record.valuelen);
+  const char zeros[8] = { 0 };
+  write(zeros, padded(offset_) - offset_);
+  ++items_;
+}
+
+void SnapshotWriter::write(const void* data, size_t len)
+{
+  if (!failed_ && ::fwrite_unlocked(data, 1, len, fp_) != len)
+  {
+    LOG_SYSERR << "SnapshotWriter " << tmpPath_;
+    failed_ = true;
+  }
+  offset_ += len;
+}
+
+bool SnapshotWriter::finish()
+{
+  SnapshotFooter footer;
+  memZero(&footer, sizeof footer);
+  ::memcpy(footer.magic, kMagic, sizeof kMagic);
+  footer.items = static_cast<uint64_t>(items_);
+  footer.segments = segments_.size();
+  footer.tableOffset = offset_;
+  segments_.push_back(offset_);
+  write(segments_.data(), segments_.size() * sizeof segments_[0]);
+  write(&footer, sizeof footer);
+
+  if (fp_ && (::fflush(fp_) != 0 || ::fsync(::fileno(fp_)) != 0))
+  {
+    LOG_SYSERR << "SnapshotWriter " << tmpPath_;
+    failed_ = true;
+  }
+  if (!failed_ && ::rename(tmpPath_.c_str(), path_.c_str()) != 0)
+  {
+    LOG_SYSERR << "SnapshotWriter rename to " << path_;
+    failed_ = true;
+  }
+  if (fp_)
+  {
+    ::fclose(fp_);
+    fp_ = NULL;
+  }
+  if (failed_)
+  {
+    ::unlink(tmpPath_.c_str());
+  }
+  return !failed_;
+}
+
+SnapshotReader::SnapshotReader(const string& path)
+  : data_(NULL),
+    size_(0),
+    footer_(NULL),
+    table_(NULL)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(SnapshotFooter))
+  {
+    size_ = static_cast<size_t>(st.st_size);
+    void* addr = ::mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED)
+    {
+      data_ = static_cast<const char*>(addr);
+      ::madvise(addr, size_, MADV_WILLNEED);
+    }
+    else
+    {
+      LOG_SYSERR << "SnapshotReader mmap " << path;
+    }
+  }
+  ::close(fd);
+  if (data_ == NULL)
+  {
+    return;
+  }
+
+  const SnapshotFooter* footer =
+      reinterpret_cast<const SnapshotFooter*>(data_ + size_ - sizeof(SnapshotFooter));
+  bool good = ::memcmp(footer->magic, kMagic, sizeof kMagic) == 0
+      && footer->tableOffset % 8 == 0
+      && footer->segments < size_
+      && footer->tableOffset + (footer->segments + 1) * sizeof(uint64_t)
+             + sizeof(SnapshotFooter) == size_;
+  if (good)
+  {
+    table_ = reinterpret_cast<const uint64_t*>(data_ + footer->tableOffset);
+    for (uint64_t i = 0; good && i < footer->segments; ++i)
+    {
+      good = table_[i] % 8 == 0 && table_[i] <= table_[i + 1];
+    }
+    good = good && table_[footer->segments] == footer->tableOffset;
+  }
+  if (good)
+  {
+    footer_ = footer;
+  }
+  else
+  {
+    LOG_ERROR << "SnapshotReader " << path << " is not a snapshot";
+  }
+}
+
+SnapshotReader::~SnapshotReader()
+{
+  if (data_)
+  {
+    ::munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+bool SnapshotReader::forEach(int segment, const Visitor& visit) const
+{
+  assert(valid());
+  const char* p = data_ + table_[segment];
+  const char* const end = data_ + table_[segment + 1];
+  while (p < end)
+  {
+    const SnapshotRecord* record = reinterpret_cast<const SnapshotRecord*>(p);
+    if (static_cast<size_t>(end - p) < sizeof(SnapshotRecord)
+        || record->keylen > kMaxKeyLength
+        || record->valuelen > kMaxValueLength
+        || static_cast<size_t>(end - p) < sizeof(SnapshotRecord) + record->keylen + record->valuelen)
+    {
+      LOG_ERROR << "SnapshotReader broken record in segment " << segment;
+      return false;
+    }
+    const char* key = p + sizeof(SnapshotRecord);
+    visit(*record,
+          StringPiece(key, static_cast<int>(record->keylen)),
+          StringPiece(key + record->keylen, static_cast<int>(record->valuelen)));
+    p += padded(sizeof(SnapshotRecord) + record->keylen + record->valuelen);
+  }
+  return true;
+}
@@ -0,0 +1,88 @@
+#ifndef MUDUO_EXAMPLES_MEMCACHED_SERVER_SNAPSHOT_H
+#define MUDUO_EXAMPLES_MEMCACHED_SERVER_SNAPSHOT_H
+
+#include "examples/memcached/server/Item.h"
+
+#include <functional>
+#include <vector>
+
+#include <stdio.h>
+
+// Items saved for a warm restart, in the byte order of the host.
+//
+// The file is segments of records, the offsets of segments, and a
+// SnapshotFooter.  A record is a SnapshotRecord, its key and its value
+// without "\r\n", padded to 8 bytes, so that an mmap()ed file is read in
+// place and segments are loaded by threads of their own.
+struct SnapshotRecord
+{
+  uint64_t cas;
+  int64_t exptime;  // unix time, 0 for never
+  uint32_t flags;
+  uint32_t keylen;
+  uint32_t valuelen;
+  uint32_t reserved;
+};
+
+struct SnapshotFooter
+{
+  char magic[8];
+  uint64_t items;
+  uint64_t segments;
+  uint64_t tableOffset;  // segments+1 offsets, the last one is tableOffset
+};
+
+class SnapshotWriter : muduo::noncopyable
+{
+ public:
+  // writes path.tmp, which finish() renames to path
+  explicit SnapshotWriter(const muduo::string& path);
+  ~SnapshotWriter();
+
+  void beginSegment();
+  void add(const Item& item, time_t exptime);
+  // false if writing failed, an old file at path stays then
+  bool finish();
+
+  int64_t items() const { return items_; }
+  int64_t bytes() const { return static_cast<int64_t>(offset_); }
+
+ private:
+  void write(const void* data, size_t len);
+
+  const muduo::string path_;
+  const muduo::string tmpPath_;
+  FILE* fp_;
+  bool failed_;
+  uint64_t offset_;
+  int64_t items_;
+  std::vector<uint64_t> segments_;
+};
+
+class SnapshotReader : muduo::noncopyable
+{
+ public:
+  // mmap()s path, check valid()
+  explicit SnapshotReader(const muduo::string& path);
+  ~SnapshotReader();
+
+  bool valid() const { return footer_ != NULL; }
+  int segments() const { return static_cast<int>(footer_->segments); }
+  int64_t items() const { return static_cast<int64_t>(footer_->items); }
+  size_t fileSize() const { return size_; }
+
+  // key, value without "\r\n"
+  typedef std::function<void (const SnapshotRecord&,
+                              muduo::StringPiece key,
+                              muduo::StringPiece value)> Visitor;
+  // stops at a broken record, returns false then
+  bool forEach(int segment, const Visitor& visit) const;
+
+ private:
+  const char* data_;
+  size_t size_;
+  const SnapshotFooter* footer_;  // NULL if not valid
+  const uint64_t* table_;
+};
+
+#endif  // MUDUO_EXAMPLES_MEMCACHED_SERVER_SNAPSHOT_H
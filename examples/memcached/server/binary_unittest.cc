@@ -0,0 +1,217 @@
+#include "examples/memcached/server/MemcacheServer.h"
+
+#include "muduo/base/Thread.h"
+#include "muduo/net/EventLoop.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+const uint16_t kPort = 11311;
+
+// opcodes and status of the binary protocol
+const uint8_t kGet = 0x00;
+const uint8_t kSet = 0x01;
+const uint8_t kDelete = 0x04;
+const uint8_t kQuit = 0x07;
+const uint8_t kGetQ = 0x09;
+const uint8_t kNoop = 0x0a;
+const uint8_t kGetK = 0x0c;
+const uint16_t kSuccess = 0x00;
+const uint16_t kKeyNotFound = 0x01;
+
+struct Response
+{
+  uint8_t magic;
+  uint8_t opcode;
+  uint16_t status;
+  uint32_t opaque;
+  uint64_t cas;
+  string extras;
+  string key;
+  string value;
+};
+
+void appendRequest(string* out, uint8_t opcode, uint32_t opaque,
+                   const string& extras, const string& key, const string& value)
+{
+  char header[24] = { 0 };
+  header[0] = static_cast<char>(0x80);
+  header[1] = static_cast<char>(opcode);
+  uint16_t keylen = htons(static_cast<uint16_t>(key.size()));
+  memcpy(header + 2, &keylen, sizeof keylen);
+  header[4] = static_cast<char>(extras.size());
+  uint32_t bodylen = htonl(static_cast<uint32_t>(extras.size() + key.size() + value.size()));
+  memcpy(header + 8, &bodylen, sizeof bodylen);
+  memcpy(header + 12, &opaque, sizeof opaque);
+  out->append(header, sizeof header);
+  out->append(extras);
+  out->append(key);
+  out->append(value);
+}
+
+string setExtras(uint32_t flags)
+{
+  uint32_t be[2] = { htonl(flags), 0 };  // never expires
+  return string(reinterpret_cast<const char*>(be), sizeof be);
+}
+
+// Boost.Test checks are for the main thread, the client aborts instead
+void readFully(int sockfd, char* buf, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t n = ::read(sockfd, buf, len);
+    if (n <= 0)
+    {
+      fprintf(stderr, "readFully: %zd\n", n);
+      abort();
+    }
+    buf += n;
+    len -= static_cast<size_t>(n);
+  }
+}
+
+Response readResponse(int sockfd)
+{
+  char header[24];
+  readFully(sockfd, header, sizeof header);
+  Response r;
+  r.magic = static_cast<uint8_t>(header[0]);
+  r.opcode = static_cast<uint8_t>(header[1]);
+  uint16_t keylen = 0;
+  memcpy(&keylen, header + 2, sizeof keylen);
+  keylen = ntohs(keylen);
+  uint8_t extlen = static_cast<uint8_t>(header[4]);
+  memcpy(&r.status, header + 6, sizeof r.status);
+  r.status = ntohs(r.status);
+  uint32_t bodylen = 0;
+  memcpy(&bodylen, header + 8, sizeof bodylen);
+  bodylen = ntohl(bodylen);
+  memcpy(&r.opaque, header + 12, sizeof r.opaque);
+  memcpy(&r.cas, header + 16, sizeof r.cas);
+  string body(bodylen, '\0');
+  if (bodylen > 0)
+  {
+    readFully(sockfd, &body[0], bodylen);
+  }
+  r.extras = body.substr(0, extlen);
+  r.key = body.substr(extlen, keylen);
+  r.value = body.substr(extlen + keylen);
+  return r;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(testBinaryRoundTrip)
+{
+  EventLoop loop;
+  MemcacheServer::Options options;
+  options.tcpport = kPort;
+  MemcacheServer server(&loop, options);
+  server.start();
+
+  // larger than what is copied into the reply, sent from the item
+  string large(100 * 1000, '\0');
+  for (size_t i = 0; i < large.size(); ++i)
+  {
+    large[i] = static_cast<char>(i * 131 + (i >> 12));
+  }
+
+  std::vector<Response> responses;
+  bool closed = false;
+  Thread client([&] {
+    int sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memZero(&addr, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (sockfd < 0 || ::connect(sockfd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+    {
+      perror("connect");
+      abort();
+    }
+    // all pipelined in one write
+    string requests;
+    appendRequest(&requests, kSet, 1, setExtras(0xdeadbeef), "small", "hello");
+    appendRequest(&requests, kSet, 2, setExtras(7), "large", large);
+    appendRequest(&requests, kGetK, 3, "", "small", "");
+    appendRequest(&requests, kGet, 4, "", "large", "");
+    appendRequest(&requests, kGetQ, 5, "", "missing", "");  // no reply
+    appendRequest(&requests, kNoop, 6, "", "", "");
+    appendRequest(&requests, kDelete, 7, "", "small", "");
+    appendRequest(&requests, kGet, 8, "", "small", "");
+    appendRequest(&requests, kQuit, 9, "", "", "");
+    for (size_t sent = 0; sent < requests.size(); )
+    {
+      ssize_t n = ::write(sockfd, requests.data() + sent, requests.size() - sent);
+      if (n <= 0)
+      {
+        perror("write");
+        abort();
+      }
+      sent += static_cast<size_t>(n);
+    }
+    for (int i = 0; i < 8; ++i)
+    {
+      responses.push_back(readResponse(sockfd));
+    }
+    char c;
+    closed = ::read(sockfd, &c, 1) == 0;
+    ::close(sockfd);
+    loop.quit();
+  }, "client");
+  client.start();
+  loop.loop();
+  client.join();
+
+  BOOST_REQUIRE_EQUAL(responses.size(), 8);
+  const uint32_t opaques[] = { 1, 2, 3, 4, 6, 7, 8, 9 };
+  const uint8_t opcodes[] = { kSet, kSet, kGetK, kGet, kNoop, kDelete, kGet, kQuit };
+  for (size_t i = 0; i < responses.size(); ++i)
+  {
+    BOOST_CHECK_EQUAL(responses[i].magic, 0x81);
+    BOOST_CHECK_EQUAL(responses[i].opaque, opaques[i]);
+    BOOST_CHECK_EQUAL(responses[i].opcode, opcodes[i]);
+  }
+
+  const Response& setSmall = responses[0];
+  BOOST_CHECK_EQUAL(setSmall.status, kSuccess);
+  BOOST_CHECK_NE(setSmall.cas, 0);
+  BOOST_CHECK_EQUAL(responses[1].status, kSuccess);
+
+  const Response& getSmall = responses[2];
+  BOOST_CHECK_EQUAL(getSmall.status, kSuccess);
+  BOOST_CHECK_EQUAL(getSmall.extras, setExtras(0xdeadbeef).substr(0, 4));
+  BOOST_CHECK_EQUAL(getSmall.key, "small");
+  BOOST_CHECK_EQUAL(getSmall.value, "hello");
+  BOOST_CHECK_EQUAL(getSmall.cas, setSmall.cas);
+
+  const Response& getLarge = responses[3];
+  BOOST_CHECK_EQUAL(getLarge.status, kSuccess);
+  BOOST_CHECK(getLarge.key.empty());
+  BOOST_CHECK_EQUAL(getLarge.value.size(), large.size());
+  BOOST_CHECK(getLarge.value == large);
+
+  BOOST_CHECK_EQUAL(responses[4].status, kSuccess);
+  BOOST_CHECK_EQUAL(responses[5].status, kSuccess);
+  BOOST_CHECK_EQUAL(responses[6].status, kKeyNotFound);
+  BOOST_CHECK_EQUAL(responses[7].status, kSuccess);
+  BOOST_CHECK(closed);
+}
@@ -20,17 +20,26 @@ int main(int argc, char* argv[])
   int valuelen = argc > 3 ? atoi(argv[3]) : 100;
   EventLoop loop;
   MemcacheServer::Options options;
+  if (argc > 4)
+  {
+    options.memoryMiB = atoi(argv[4]);
+  }
+  if (argc > 5)
+  {
+    options.snapshotPath = argv[5];
+  }
   MemcacheServer server(&loop, options);
 
-  printf("sizeof(Item) = %zd\npid = %d\nitems = %d\nkeylen = %d\nvaluelen = %d\n",
-         sizeof(Item), getpid(), items, keylen, valuelen);
+  printf("sizeof(Item) = %zd\npid = %d\nitems = %d\nkeylen = %d\nvaluelen = %d\nmemory = %d MiB\n",
+         sizeof(Item), getpid(), items, keylen, valuelen, options.memoryMiB);
   char key[256] = { 0 };
   string value;
   for (int i = 0; i < items; ++i)
   {
     snprintf(key, sizeof key, "%0*d", keylen, i);
     value.assign(valuelen, "0123456789"[i % 10]);
-    ItemPtr item(Item::makeItem(key, 0, 0, valuelen+2, 1));
+    ItemPtr item(server.newItem(key, 0, 0, valuelen+2, 1));
+    assert(item);
     item->append(value.data(), value.size());
     item->append("\r\n", 2);
     assert(item->endsWithCRLF());
@@ -39,11 +48,53 @@ int main(int argc, char* argv[])
     assert(stored); (void) stored;
     assert(!exists);
   }
+  // items beyond the memory limit evict older ones
+  Buffer stats;
+  server.stats("", &stats);
+  server.stats("slabs", &stats);
+  printf("==========\n%s", stats.retrieveAllAsString().c_str());
   Inspector::ArgList arg;
   printf("==========\n%s\n",
          ProcessInspector::overview(HttpRequest::kGet, arg).c_str());
   // TODO: print bytes per item, overhead percent
   fflush(stdout);
+
+  if (!options.snapshotPath.empty())
+  {
+    // a warm restart gets what the last snapshot had
+    bool saved = server.saveSnapshot();
+    assert(saved); (void) saved;
+    // one table at a time, threads cache the slot of the last one
+    std::vector<ConstItemPtr> before;
+    for (int i = 0; i < items; ++i)
+    {
+      snprintf(key, sizeof key, "%0*d", keylen, i);
+      before.push_back(server.getItem(Item::makeItem(key, 0, 0, 2, 0)));
+    }
+    MemcacheServer restarted(&loop, options);
+    bool loaded = restarted.loadSnapshot();
+    assert(loaded); (void) loaded;
+    int hits = 0, mismatches = 0;
+    for (int i = 0; i < items; ++i)
+    {
+      snprintf(key, sizeof key, "%0*d", keylen, i);
+      ConstItemPtr after(restarted.getItem(Item::makeItem(key, 0, 0, 2, 0)));
+      const ConstItemPtr& old = before[i];
+      if (after)
+      {
+        ++hits;
+      }
+      if (!old != !after
+          || (after && (after->valueLength() != old->valueLength()
+                        || memcmp(after->value(), old->value(), after->valueLength()) != 0
+                        || after->cas() != old->cas())))
+      {
+        ++mismatches;
+      }
+    }
+    printf("==========\n%d items after restart, %d mismatches\n", hits, mismatches);
+    assert(mismatches == 0);
+  }
 #ifdef HAVE_TCMALLOC
   char buf[8192];
   MallocExtension::instance()->GetStats(buf, sizeof buf);
@@ -14,6 +14,7 @@ bool parseCommandLine(int argc, char* argv[], MemcacheServer::Options* options)
   options->tcpport = 11211;
   options->gperfport = 11212;
   options->threads = 4;
+  options->memoryMiB = 64;
 
   po::options_description desc("Allowed options");
   desc.add_options()
@@ -22,6 +23,12 @@ bool parseCommandLine(int argc, char* argv[], MemcacheServer::Options* options)
       ("udpport,U", po::value<uint16_t>(&options->udpport), "UDP port")
       ("gperf,g", po::value<uint16_t>(&options->gperfport), "port for gperftools")
       ("threads,t", po::value<int>(&options->threads), "Number of worker threads")
+      ("memory,m", po::value<int>(&options->memoryMiB), "Item memory in MiB")
+      ("snapshot,S", po::value<string>(&options->snapshotPath),
+       "Snapshot file, loaded on start and saved on exit")
+      ("snapshot-interval,I", po::value<int>(&options->snapshotSeconds),
+       "Seconds between snapshots, 0 for only on exit")
+      ("load-threads", po::value<int>(&options->loadThreads), "Threads to load the snapshot")
       ;
 
   po::variables_map vm;
@@ -48,8 +55,13 @@ int main(int argc, char* argv[])
 
     MemcacheServer server(&loop, options);
     server.setThreadNum(options.threads);
+    if (!options.snapshotPath.empty())
+    {
+      server.loadSnapshot();
+    }
     server.start();
     loop.loop();
+    server.saveSnapshot();
   }
 }
 
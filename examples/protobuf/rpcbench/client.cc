@@ -8,6 +8,7 @@
 #include "muduo/net/TcpClient.h"
 #include "muduo/net/TcpConnection.h"
 #include "muduo/net/protorpc/RpcChannel.h"
+#include "muduo/net/protorpc/RpcChannelPool.h"
 
 #include <stdio.h>
 #include <unistd.h>
@@ -16,6 +17,10 @@ using namespace muduo;
 using namespace muduo::net;
 
 static const int kRequests = 50000;
+static int g_outstanding = 1;  // calls in flight per client
+static double g_timeout = 0;  // deadline per call in seconds
+static bool g_batching = false;
+static int g_connections = 0;  // connections of a RpcChannelPool per client, 0 for none
 
 class RpcClient : noncopyable
 {
@@ -28,31 +33,65 @@ class RpcClient : noncopyable
     : // loop_(loop),
       client_(loop, serverAddr, "RpcClient"),
       channel_(new RpcChannel),
-      stub_(get_pointer(channel_)),
+      pool_(g_connections > 0 ? new RpcChannelPool(loop, serverAddr, "RpcClient", g_connections) : NULL),
+      stub_(pool_ ? static_cast<google::protobuf::RpcChannel*>(get_pointer(pool_))
+                  : get_pointer(channel_)),
       allConnected_(allConnected),
       allFinished_(allFinished),
-      count_(0)
+      sent_(0),
+      count_(0),
+      failed_(0)
   {
+    channel_->setTimeout(g_timeout);
+    channel_->setBatching(g_batching);
     client_.setConnectionCallback(
         std::bind(&RpcClient::onConnection, this, _1));
     client_.setMessageCallback(
         std::bind(&RpcChannel::onMessage, get_pointer(channel_), _1, _2, _3));
     // client_.enableRetry();
+    if (pool_)
+    {
+      pool_->setTimeout(g_timeout);
+      pool_->setBatching(g_batching);
+      pool_->setConnectionCallback(
+          std::bind(&RpcClient::onPoolConnection, this, _1));
+    }
   }
 
   void connect()
   {
-    client_.connect();
+    if (pool_)
+    {
+      pool_->connect();
+    }
+    else
+    {
+      client_.connect();
+    }
+  }
+
+  void start()
+  {
+    for (int i = 0; i < g_outstanding; ++i)
+    {
+      sendRequest();
+    }
   }
 
   void sendRequest()
   {
+    ++sent_;
     echo::EchoRequest request;
     request.set_payload("001010");
     echo::EchoResponse* response = new echo::EchoResponse;
-    stub_.Echo(NULL, &request, response, NewCallback(this, &RpcClient::replied, response));
+    // deadline of the channel, controller only reports failures
+    RpcController* controller = g_timeout > 0 ? new RpcController : NULL;
+    stub_.Echo(controller, &request, response,
+               NewCallback(this, &RpcClient::replied, response, controller));
   }
 
+  int failed() const { return failed_; }
+
  private:
   void onConnection(const TcpConnectionPtr& conn)
   {
@@ -65,16 +104,32 @@ class RpcClient : noncopyable
     }
   }
 
-  void replied(echo::EchoResponse* resp)
+  void onPoolConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected() && pool_->connectedCount() == pool_->size())
+    {
+      allConnected_->countDown();
+    }
+  }
+
+  void replied(echo::EchoResponse* resp, RpcController* controller)
   {
     // LOG_INFO << "replied:\n" << resp->DebugString();
     // loop_->quit();
+    if (controller)
+    {
+      if (controller->Failed())
+      {
+        ++failed_;
+      }
+      delete controller;
+    }
     ++count_;
-    if (count_ < kRequests)
+    if (sent_ < kRequests)
     {
       sendRequest();
     }
-    else
+    else if (count_ == kRequests)
     {
       LOG_INFO << "RpcClient " << this << " finished";
       allFinished_->countDown();
@@ -84,10 +139,13 @@ class RpcClient : noncopyable
   // EventLoop* loop_;
   TcpClient client_;
   RpcChannelPtr channel_;
+  std::unique_ptr<RpcChannelPool> pool_;
   echo::EchoService::Stub stub_;
   CountDownLatch* allConnected_;
   CountDownLatch* allFinished_;
+  int sent_;
   int count_;
+  int failed_;
 };
 
 int main(int argc, char* argv[])
@@ -109,6 +167,26 @@ int main(int argc, char* argv[])
       nThreads = atoi(argv[3]);
     }
 
+    if (argc > 4)
+    {
+      g_outstanding = atoi(argv[4]);
+    }
+
+    if (argc > 5)
+    {
+      g_timeout = atof(argv[5]);
+    }
+
+    if (argc > 6)
+    {
+      g_batching = atoi(argv[6]) != 0;
+    }
+
+    if (argc > 7)
+    {
+      g_connections = atoi(argv[7]);
+    }
+
     CountDownLatch allConnected(nClients);
     CountDownLatch allFinished(nClients);
 
@@ -129,7 +207,7 @@ int main(int argc, char* argv[])
     LOG_INFO << "all connected";
     for (int i = 0; i < nClients; ++i)
     {
-      clients[i]->sendRequest();
+      clients[i]->start();
     }
     allFinished.wait();
     Timestamp end(Timestamp::now());
@@ -137,12 +215,21 @@ int main(int argc, char* argv[])
     double seconds = timeDifference(end, start);
     printf("%f seconds\n", seconds);
     printf("%.1f calls per second\n", nClients * kRequests / seconds);
+    if (g_timeout > 0)
+    {
+      int failed = 0;
+      for (const auto& client : clients)
+      {
+        failed += client->failed();
+      }
+      printf("%d calls failed or timed out in %.3f seconds\n", failed, g_timeout);
+    }
 
     exit(0);
   }
   else
   {
-    printf("Usage: %s host_ip numClients [numThreads]\n", argv[0]);
+    printf("Usage: %s host_ip numClients [numThreads [outstandingPerClient [timeoutSeconds [batching [connectionsPerClient]]]]]\n", argv[0]);
   }
 }
 
@@ -0,0 +1,209 @@
+#include "examples/protobuf/rpcbench/echo.pb.h"
+
+#include "muduo/base/Clock.h"
+#include "muduo/base/CountDownLatch.h"
+#include "muduo/base/Logging.h"
+#include "muduo/base/ThreadPool.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/EventLoopThread.h"
+#include "muduo/net/TcpClient.h"
+#include "muduo/net/TcpConnection.h"
+#include "muduo/net/protorpc/RpcChannel.h"
+#include "muduo/net/protorpc/RpcServer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Usage: protobuf_rpc_hol_bench [slowMicros [seconds]]
+//
+// Head of line blocking: one connection calls Slow (spins slowMicros)
+// back to back, another calls Echo back to back, both to a server of one
+// IO thread.  Prints latency of Echo with Slow run inline, in a pool
+// shared by the whole service, and in a pool dedicated to Slow.
+
+int g_slowMicros = 5000;
+double g_seconds = 2.0;
+
+class EchoServiceImpl : public echo::EchoService
+{
+ public:
+  void Echo(::google::protobuf::RpcController* controller,
+            const ::echo::EchoRequest* request,
+            ::echo::EchoResponse* response,
+            ::google::protobuf::Closure* done) override
+  {
+    response->set_payload(request->payload());
+    done->Run();
+  }
+
+  void Slow(::google::protobuf::RpcController* controller,
+            const ::echo::EchoRequest* request,
+            ::echo::EchoResponse* response,
+            ::google::protobuf::Closure* done) override
+  {
+    int64_t end = Clock::monotonicMicros() + atoi(request->payload().c_str());
+    while (Clock::monotonicMicros() < end)
+    {
+    }
+    response->set_payload(request->payload());
+    done->Run();
+  }
+};
+
+// calls one method back to back until stopped
+class Caller : noncopyable
+{
+ public:
+  Caller(EventLoop* loop, const InetAddress& serverAddr, bool slow, CountDownLatch* connected)
+    : client_(loop, serverAddr, slow ? "Slow" : "Echo"),
+      channel_(new RpcChannel),
+      stub_(get_pointer(channel_)),
+      slow_(slow),
+      connected_(connected),
+      stopped_(false),
+      start_(0)
+  {
+    client_.setConnectionCallback(std::bind(&Caller::onConnection, this, _1));
+    client_.setMessageCallback(
+        std::bind(&RpcChannel::onMessage, get_pointer(channel_), _1, _2, _3));
+    client_.connect();
+  }
+
+  void start() { client_.connection()->getLoop()->runInLoop(std::bind(&Caller::call, this)); }
+  void stop() { stopped_ = true; }
+  std::vector<int>& latencies() { return latencies_; }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->setTcpNoDelay(true);
+      channel_->setConnection(conn);
+      connected_->countDown();
+    }
+  }
+
+  void call()
+  {
+    if (stopped_)
+    {
+      return;
+    }
+    echo::EchoRequest request;
+    request.set_payload(slow_ ? std::to_string(g_slowMicros) : "001010");
+    echo::EchoResponse* response = new echo::EchoResponse;
+    start_ = Clock::monotonicMicros();
+    if (slow_)
+    {
+      stub_.Slow(NULL, &request, response, google::protobuf::NewCallback(this, &Caller::replied));
+    }
+    else
+    {
+      stub_.Echo(NULL, &request, response, google::protobuf::NewCallback(this, &Caller::replied));
+    }
+  }
+
+  void replied()
+  {
+    latencies_.push_back(static_cast<int>(Clock::monotonicMicros() - start_));
+    call();
+  }
+
+  TcpClient client_;
+  RpcChannelPtr channel_;
+  echo::EchoService::Stub stub_;
+  const bool slow_;
+  CountDownLatch* connected_;
+  std::atomic<bool> stopped_;
+  int64_t start_;
+  std::vector<int> latencies_;
+};
+
+enum Mode { kInline, kShared, kDedicated };
+
+void bench(Mode mode, uint16_t port)
+{
+  const char* names[] = { "inline", "shared pool", "dedicated pool" };
+  EventLoopThread serverThread;
+  EventLoop* serverLoop = serverThread.startLoop();
+  EchoServiceImpl impl;
+  ThreadPool shared("shared");
+  shared.start(2);
+  std::unique_ptr<RpcServer> server(new RpcServer(serverLoop, InetAddress(port)));
+  server->registerService(&impl);
+  if (mode == kShared)
+  {
+    server->setExecutor("echo.EchoService", &shared);
+  }
+  else if (mode == kDedicated)
+  {
+    server->setDedicatedExecutor("echo.EchoService.Slow", 1);
+  }
+  serverLoop->runInLoop(std::bind(&RpcServer::start, get_pointer(server)));
+
+  EventLoopThread clientThread;
+  EventLoop* clientLoop = clientThread.startLoop();
+  CountDownLatch connected(2);
+  InetAddress serverAddr("127.0.0.1", port);
+  std::unique_ptr<Caller> slow(new Caller(clientLoop, serverAddr, true, &connected));
+  std::unique_ptr<Caller> fast(new Caller(clientLoop, serverAddr, false, &connected));
+  connected.wait();
+  slow->start();
+  fast->start();
+  usleep(static_cast<useconds_t>(g_seconds * 1e6));
+  slow->stop();
+  fast->stop();
+  usleep(100 * 1000);  // for calls in flight
+
+  // destroys callers and server in their loops
+  std::vector<int> d, slowLatencies;
+  CountDownLatch destroyed(1);
+  clientLoop->runInLoop([&] {
+    d.swap(fast->latencies());
+    slowLatencies.swap(slow->latencies());
+    slow.reset();
+    fast.reset();
+    destroyed.countDown();
+  });
+  destroyed.wait();
+  string stats;
+  CountDownLatch stopped(1);
+  serverLoop->runInLoop([&] {
+    stats = server->executorStats();
+    server.reset();
+    stopped.countDown();
+  });
+  stopped.wait();
+
+  std::sort(d.begin(), d.end());
+  printf("%-15s echo %7zd calls  latency us p50 %6d p99 %6d max %6d  slow %5zd calls\n",
+         names[mode], d.size(), d[d.size() / 2], d[d.size() * 99 / 100], d.back(),
+         slowLatencies.size());
+  printf("%s", stats.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc > 1)
+  {
+    g_slowMicros = atoi(argv[1]);
+  }
+  if (argc > 2)
+  {
+    g_seconds = atof(argv[2]);
+  }
+  Logger::setLogLevel(Logger::WARN);
+  printf("Slow spins %d us, %.1f seconds each\n", g_slowMicros, g_seconds);
+  bench(kInline, 18871);
+  bench(kShared, 18872);
+  bench(kDedicated, 18873);
+  google::protobuf::ShutdownProtobufLibrary();
+}
@@ -0,0 +1,836 @@
+#include "examples/protobuf/rpcbench/echo.pb.h"
+
+#include "muduo/base/Mutex.h"
+#include "muduo/base/Thread.h"
+#include "muduo/base/ThreadPool.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/InetAddress.h"
+#include "muduo/net/TcpClient.h"
+#include "muduo/net/TcpConnection.h"
+#include "muduo/net/TcpServer.h"
+#include "muduo/net/protorpc/RpcChannel.h"
+#include "muduo/net/protorpc/RpcChannelPool.h"
+#include "muduo/net/protorpc/RpcCodec.h"
+#include "muduo/net/protorpc/RpcController.h"
+#include "muduo/net/protorpc/RpcMethodTable.h"
+#include "muduo/net/protorpc/RpcServer.h"
+#include "muduo/net/protorpc/rpc.pb.h"
+
+#include <vector>
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+const uint16_t kPort = 2320;
+const uint16_t kFakePort = 2321;  // of a server speaking the wire format by hand
+
+class FunctionClosure : public google::protobuf::Closure
+{
+ public:
+  explicit FunctionClosure(std::function<void ()> func)
+    : func_(std::move(func))
+  {
+  }
+
+  void Run() override
+  {
+    func_();
+    delete this;
+  }
+
+ private:
+  std::function<void ()> func_;
+};
+
+// Remembers the threads that served each method.
+class EchoServiceImpl : public echo::EchoService
+{
+ public:
+  void Echo(::google::protobuf::RpcController* controller,
+            const ::echo::EchoRequest* request,
+            ::echo::EchoResponse* response,
+            ::google::protobuf::Closure* done) override
+  {
+    served(&echoThreads_);
+    response->set_payload(request->payload());
+    done->Run();
+  }
+
+  // answers after payload milliseconds, without blocking the IO thread
+  void Slow(::google::protobuf::RpcController* controller,
+            const ::echo::EchoRequest* request,
+            ::echo::EchoResponse* response,
+            ::google::protobuf::Closure* done) override
+  {
+    served(&slowThreads_);
+    string payload = request->payload();
+    EventLoop* loop = EventLoop::getEventLoopOfCurrentThread();
+    assert(loop);
+    loop->runAfter(atoi(payload.c_str()) / 1000.0, [response, done, payload] {
+      response->set_payload(payload);
+      done->Run();
+    });
+  }
+
+  std::vector<int> echoThreads() const
+  {
+    MutexLockGuard lock(mutex_);
+    return echoThreads_;
+  }
+
+  std::vector<int> slowThreads() const
+  {
+    MutexLockGuard lock(mutex_);
+    return slowThreads_;
+  }
+
+ private:
+  void served(std::vector<int>* threads)
+  {
+    MutexLockGuard lock(mutex_);
+    threads->push_back(CurrentThread::tid());
+  }
+
+  mutable MutexLock mutex_;
+  std::vector<int> echoThreads_ GUARDED_BY(mutex_);
+  std::vector<int> slowThreads_ GUARDED_BY(mutex_);
+};
+
+typedef std::function<void (echo::EchoResponse* response)> EchoCallback;
+
+/// method is "Echo" or "Slow", the response is valid in done only
+void callEcho(echo::EchoService::Stub* stub,
+              const string& method, const string& payload,
+              RpcController* controller, const EchoCallback& done)
+{
+  echo::EchoRequest request;
+  request.set_payload(payload);
+  echo::EchoResponse* response = new echo::EchoResponse;
+  google::protobuf::Closure* closure = new FunctionClosure([response, done] {
+    done(response);
+  });
+  if (method == "Echo")
+  {
+    stub->Echo(controller, &request, response, closure);
+  }
+  else
+  {
+    stub->Slow(controller, &request, response, closure);
+  }
+}
+
+// A server and a client channel to it in the loop of the test.
+// Checks in callbacks run in the main thread, as Boost.Test wants.
+class RpcTest : noncopyable
+{
+ public:
+  /// The client connects to the RpcServer, or to a server of port in loop().
+  explicit RpcTest(uint16_t port = kPort)
+    : server_(&loop_, InetAddress(kPort)),
+      channel_(new RpcChannel),
+      stub_(get_pointer(channel_)),
+      client_(&loop_, InetAddress("127.0.0.1", port), "RpcTest")
+  {
+    server_.registerService(&service_);
+    client_.setConnectionCallback(std::bind(&RpcTest::onConnection, this, _1));
+    client_.setMessageCallback(
+        std::bind(&RpcChannel::onMessage, get_pointer(channel_), _1, _2, _3));
+  }
+
+  EventLoop* loop() { return &loop_; }
+  EchoServiceImpl& service() { return service_; }
+  RpcServer& server() { return server_; }
+  RpcChannel& channel() { return *channel_; }
+
+  /// Runs body once connected, until finish().
+  void run(const std::function<void ()>& body)
+  {
+    body_ = body;
+    server_.start();
+    client_.connect();
+    loop_.runAfter(10.0, [] {
+      fprintf(stderr, "RpcTest timed out\n");
+      abort();
+    });
+    loop_.loop();
+  }
+
+  /// The loop quits once the connection is closed.
+  void finish()
+  {
+    client_.disconnect();
+  }
+
+  /// See callEcho()
+  void call(const string& method, const string& payload,
+            RpcController* controller, const EchoCallback& done)
+  {
+    callEcho(&stub_, method, payload, controller, done);
+  }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->setTcpNoDelay(true);
+      channel_->setConnection(conn);
+      body_();
+    }
+    else
+    {
+      channel_->onDisconnected();
+      loop_.quit();
+    }
+  }
+
+  EventLoop loop_;
+  EchoServiceImpl service_;
+  RpcServer server_;
+  RpcChannelPtr channel_;
+  echo::EchoService::Stub stub_;
+  TcpClient client_;  // goes first, uses channel_
+  std::function<void ()> body_;
+};
+
+echo::EchoRequest makeRequest(const string& payload)
+{
+  echo::EchoRequest request;
+  request.set_payload(payload);
+  return request;
+}
+
+// RpcMessages with request or response inline, as they are on the wire
+class RawConnection : noncopyable
+{
+ public:
+  typedef std::function<void (const TcpConnectionPtr&, const RpcMessage&)> MessageCallback;
+
+  explicit RawConnection(const MessageCallback& cb)
+    : messageCallback_(cb),
+      codec_(std::bind(&RawConnection::onRpcMessage, this, _1, _2, _3))
+  {
+  }
+
+  void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp receiveTime)
+  {
+    codec_.onMessage(conn, buf, receiveTime);
+  }
+
+  void send(const TcpConnectionPtr& conn, const RpcMessage& message)
+  {
+    codec_.send(conn, message);
+  }
+
+ private:
+  void onRpcMessage(const TcpConnectionPtr& conn, const RpcMessagePtr& message, Timestamp)
+  {
+    messageCallback_(conn, *message);
+  }
+
+  MessageCallback messageCallback_;
+  RpcCodec codec_;
+};
+
+// Streaming methods go to handlers of the server.
+class BulkServiceImpl : public echo::BulkService
+{
+};
+
+// Writes numbered chunks while the stream is writable,
+// remembers how many went in each go.
+class ChunkWriter : noncopyable
+{
+ public:
+  explicit ChunkWriter(int chunks)
+    : stream_(NULL),
+      left_(chunks),
+      next_(0),
+      bytes_(0)
+  {
+  }
+
+  // stream keeps a pointer to this
+  void start(RpcStream* stream)
+  {
+    stream_ = stream;
+    stream_->setWritableCallback(std::bind(&ChunkWriter::pump, this));
+    pump();
+  }
+
+  const std::vector<int>& bursts() const { return bursts_; }
+  int64_t bytes() const { return bytes_; }
+
+ private:
+  void pump()
+  {
+    int written = 0;
+    while (left_ > 0 && stream_->writable())
+    {
+      echo::Chunk chunk;
+      chunk.set_data(std::to_string(next_++));
+      stream_->write(chunk);
+      bytes_ += static_cast<int64_t>(chunk.data().size());
+      --left_;
+      ++written;
+    }
+    bursts_.push_back(written);
+    if (left_ == 0 && !stream_->finished())
+    {
+      stream_->finish();
+    }
+  }
+
+  RpcStream* stream_;
+  int left_;
+  int next_;
+  int64_t bytes_;
+  std::vector<int> bursts_;
+};
+
+int sum(const std::vector<int>& values)
+{
+  int total = 0;
+  for (int v : values)
+  {
+    total += v;
+  }
+  return total;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(testDeadline)
+{
+  RpcTest test;
+  test.channel().setTimeout(0.1);
+  RpcController perCall;
+  perCall.setTimeout(0.02);
+  RpcController byChannel;
+  int perCallDone = 0;
+  int byChannelDone = 0;
+  double perCallSeconds = 0;
+  double byChannelSeconds = 0;
+  size_t outstandings = 1;
+  string echoed;
+  Timestamp start;
+  test.run([&] {
+    start = Timestamp::now();
+    test.call("Slow", "300", &perCall, [&](echo::EchoResponse*) {
+      ++perCallDone;
+      perCallSeconds = timeDifference(Timestamp::now(), start);
+    });
+    test.call("Slow", "300", &byChannel, [&](echo::EchoResponse*) {
+      ++byChannelDone;
+      byChannelSeconds = timeDifference(Timestamp::now(), start);
+    });
+    // the answers come after the deadlines, and are dropped
+    test.loop()->runAfter(0.4, [&] {
+      outstandings = test.channel().outstandings();
+      test.call("Echo", "after", NULL, [&](echo::EchoResponse* response) {
+        echoed = response->payload();
+        test.finish();
+      });
+    });
+  });
+
+  BOOST_CHECK_EQUAL(perCallDone, 1);
+  BOOST_CHECK_EQUAL(perCall.errorCode(), TIMEOUT);
+  BOOST_CHECK_GE(perCallSeconds, 0.02 * 0.9);
+  BOOST_CHECK_LT(perCallSeconds, 0.1);
+  BOOST_CHECK_EQUAL(byChannelDone, 1);
+  BOOST_CHECK_EQUAL(byChannel.errorCode(), TIMEOUT);
+  BOOST_CHECK_GE(byChannelSeconds, 0.1 * 0.9);
+  BOOST_CHECK_LT(byChannelSeconds, 0.3);
+  BOOST_CHECK_EQUAL(outstandings, 0);
+  BOOST_CHECK_EQUAL(echoed, "after");
+}
+
+BOOST_AUTO_TEST_CASE(testCancel)
+{
+  RpcTest test;
+  RpcController slow;
+  RpcController fast;
+  int slowDone = 0;
+  int fastDone = 0;
+  bool inLoopThread = false;
+  double slowSeconds = 0;
+  string echoed;
+  Timestamp start;
+  // from another thread, done still runs in the IO thread
+  Thread canceller([&slow] {
+    ::usleep(20 * 1000);
+    slow.StartCancel();
+  }, "canceller");
+  test.run([&] {
+    start = Timestamp::now();
+    test.call("Slow", "300", &slow, [&](echo::EchoResponse*) {
+      ++slowDone;
+      inLoopThread = test.loop()->isInLoopThread();
+      slowSeconds = timeDifference(Timestamp::now(), start);
+    });
+    canceller.start();
+    test.call("Echo", "fast", &fast, [&](echo::EchoResponse* response) {
+      ++fastDone;
+      echoed = response->payload();
+      // completed already, nothing to cancel
+      fast.StartCancel();
+    });
+    // after the answer of the canceled call
+    test.loop()->runAfter(0.4, [&] { test.finish(); });
+  });
+  canceller.join();
+
+  BOOST_CHECK_EQUAL(slowDone, 1);
+  BOOST_CHECK_EQUAL(slow.errorCode(), CANCELED);
+  BOOST_CHECK(inLoopThread);
+  BOOST_CHECK_LT(slowSeconds, 0.3);
+  BOOST_CHECK_EQUAL(fastDone, 1);
+  BOOST_CHECK(!fast.Failed());
+  BOOST_CHECK_EQUAL(echoed, "fast");
+  BOOST_CHECK_EQUAL(test.channel().outstandings(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(testMethodTable)
+{
+  EventLoop loop;
+  EchoServiceImpl first;
+  EchoServiceImpl second;
+  RpcMethodTable table;
+  table.registerService(&first);
+  BOOST_REQUIRE_EQUAL(table.size(), 2);
+
+  bool serviceFound = false;
+  const RpcMethodTable::Method* echo = table.find("echo.EchoService", "Echo", &serviceFound);
+  BOOST_REQUIRE(echo);
+  BOOST_CHECK(serviceFound);
+  BOOST_CHECK(table.find("echo.EchoService", "Nope", &serviceFound) == NULL);
+  BOOST_CHECK(serviceFound);
+  BOOST_CHECK(table.find("echo.Nope", "Echo", &serviceFound) == NULL);
+  BOOST_CHECK(!serviceFound);
+
+  const uint32_t wireId = echo->wireId;
+  BOOST_CHECK(table.find(wireId) == echo);
+  // same index, other tag: an id of another server
+  BOOST_CHECK(table.find(wireId ^ RpcMethodTable::kMaxMethods) == NULL);
+  BOOST_CHECK(table.find(wireId + 2) == NULL);
+
+  // same descriptor, the methods and their ids stay
+  table.setExecutor("echo.EchoService", NULL);
+  table.registerService(&second);
+  BOOST_CHECK_EQUAL(table.size(), 2);
+  BOOST_REQUIRE(table.find(wireId));
+  BOOST_CHECK(table.find(wireId)->service == &second);
+  BOOST_CHECK_EQUAL(table.setExecutor("echo.EchoService", NULL), 2);
+}
+
+BOOST_AUTO_TEST_CASE(testClientCachesMethodIds)
+{
+  // the fake server gives an id to the first call, says it is stale
+  // on the second, then answers by name again
+  const uint32_t kMethodId = 12345;
+  RpcTest test(kFakePort);
+  std::vector<RpcMessage> requests;
+  RawConnection* fake = NULL;
+  RawConnection raw([&](const TcpConnectionPtr& conn, const RpcMessage& request) {
+    requests.push_back(request);
+    RpcMessage response;
+    response.set_type(RESPONSE);
+    response.set_id(request.id());
+    if (requests.size() == 2)
+    {
+      response.set_error(NO_METHOD);
+    }
+    else
+    {
+      echo::EchoResponse echoed;
+      echoed.set_payload("echoed");
+      response.set_response(echoed.SerializeAsString());
+      if (requests.size() == 1)
+      {
+        response.set_method_id(kMethodId);
+      }
+    }
+    fake->send(conn, response);
+  });
+  fake = &raw;
+  TcpServer server(test.loop(), InetAddress(kFakePort), "FakeServer");
+  server.setMessageCallback(std::bind(&RawConnection::onMessage, &raw, _1, _2, _3));
+  server.start();
+
+  RpcController controllers[3];
+  std::vector<string> echoed;
+  test.run([&] {
+    test.call("Echo", "1", &controllers[0], [&](echo::EchoResponse* r1) {
+      echoed.push_back(r1->payload());
+      test.call("Echo", "2", &controllers[1], [&](echo::EchoResponse*) {
+        test.call("Echo", "3", &controllers[2], [&](echo::EchoResponse* r3) {
+          echoed.push_back(r3->payload());
+          test.finish();
+        });
+      });
+    });
+  });
+
+  BOOST_REQUIRE_EQUAL(requests.size(), 3);
+  BOOST_CHECK(!requests[0].has_method_id());
+  BOOST_CHECK_EQUAL(requests[0].service(), "echo.EchoService");
+  BOOST_CHECK_EQUAL(requests[0].method(), "Echo");
+  BOOST_CHECK_EQUAL(requests[1].method_id(), kMethodId);
+  BOOST_CHECK(!requests[1].has_service() && !requests[1].has_method());
+  // stale, names next time
+  BOOST_CHECK_EQUAL(controllers[1].errorCode(), NO_METHOD);
+  BOOST_CHECK(!requests[2].has_method_id());
+  BOOST_CHECK_EQUAL(requests[2].method(), "Echo");
+  BOOST_CHECK(!controllers[0].Failed());
+  BOOST_CHECK(!controllers[2].Failed());
+  BOOST_CHECK_EQUAL(echoed.size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(testServerRejectsStaleMethodIds)
+{
+  RpcTest test;
+  std::vector<RpcMessage> responses;
+  RawConnection* raw = NULL;
+  RawConnection connection([&](const TcpConnectionPtr& conn, const RpcMessage& response) {
+    responses.push_back(response);
+    RpcMessage request;
+    request.set_type(REQUEST);
+    request.set_request(makeRequest("by id").SerializeAsString());
+    if (responses.size() == 1)
+    {
+      // the stale id, then by name
+      request.set_id(2);
+      request.set_service("echo.EchoService");
+      request.set_method("Echo");
+      raw->send(conn, request);
+    }
+    else if (responses.size() == 2)
+    {
+      request.set_id(3);
+      request.set_method_id(response.method_id());
+      raw->send(conn, request);
+    }
+    else
+    {
+      conn->shutdown();
+    }
+  });
+  raw = &connection;
+  TcpClient client(test.loop(), InetAddress("127.0.0.1", kPort), "RawClient");
+  client.setMessageCallback(std::bind(&RawConnection::onMessage, &connection, _1, _2, _3));
+  client.setConnectionCallback([&](const TcpConnectionPtr& conn) {
+    if (conn->connected())
+    {
+      RpcMessage request;
+      request.set_type(REQUEST);
+      request.set_id(1);
+      request.set_method_id(0xdead0000 | 1);
+      request.set_request(makeRequest("stale").SerializeAsString());
+      connection.send(conn, request);
+    }
+    else
+    {
+      test.finish();
+    }
+  });
+  test.run([&] { client.connect(); });
+
+  BOOST_REQUIRE_EQUAL(responses.size(), 3);
+  BOOST_CHECK_EQUAL(responses[0].id(), 1);
+  BOOST_CHECK_EQUAL(responses[0].error(), NO_METHOD);
+  BOOST_CHECK_EQUAL(responses[1].id(), 2);
+  BOOST_CHECK(responses[1].has_method_id());
+  BOOST_CHECK_EQUAL(responses[2].id(), 3);
+  BOOST_CHECK(!responses[2].has_error() || responses[2].error() == NO_ERROR);
+  echo::EchoResponse echoed;
+  BOOST_CHECK(echoed.ParseFromString(responses[2].response()));
+  BOOST_CHECK_EQUAL(echoed.payload(), "by id");
+}
+
+BOOST_AUTO_TEST_CASE(testBatching)
+{
+  const int kCalls = 10;
+  RpcTest test;
+  test.channel().setBatching(true);
+  std::vector<string> echoed;
+  size_t queued = 0;
+  test.run([&] {
+    // one frame for all, written once the loop is back
+    for (int i = 0; i < kCalls; ++i)
+    {
+      test.call("Echo", std::to_string(i), NULL, [&](echo::EchoResponse* response) {
+        echoed.push_back(response->payload());
+        if (echoed.size() == kCalls)
+        {
+          test.finish();
+        }
+      });
+    }
+    queued = test.channel().outstandings();
+  });
+
+  BOOST_CHECK_EQUAL(queued, kCalls);
+  BOOST_REQUIRE_EQUAL(echoed.size(), kCalls);
+  for (int i = 0; i < kCalls; ++i)
+  {
+    BOOST_CHECK_EQUAL(echoed[i], std::to_string(i));
+  }
+  BOOST_CHECK_EQUAL(test.service().echoThreads().size(), kCalls);
+}
+
+BOOST_AUTO_TEST_CASE(testChannelPool)
+{
+  const int kEchoes = 4;
+  EventLoop loop;
+  EchoServiceImpl service;
+  RpcServer server(&loop, InetAddress(kPort));
+  server.setThreadNum(2);  // a thread for each connection, tells them apart
+  server.registerService(&service);
+  server.start();
+
+  RpcChannelPool pool(&loop, InetAddress("127.0.0.1", kPort), "RpcPool", 2);
+  pool.setBatching(true);
+  echo::EchoService::Stub stub(&pool);
+  RpcController slow;
+  RpcController afterwards;
+  int slowDone = 0;
+  int afterwardsDone = 0;
+  int echoes = 0;
+  size_t outstandings = 0;
+  bool started = false;
+  std::function<void ()> nextEcho;
+  loop.runAfter(10.0, [] {
+    fprintf(stderr, "testChannelPool timed out\n");
+    abort();
+  });
+  pool.setConnectionCallback([&](const TcpConnectionPtr& conn) {
+    if (conn->connected() && pool.connectedCount() == 2 && !started)
+    {
+      started = true;
+      // holds one connection, echoes go to the other
+      callEcho(&stub, "Slow", "5000", &slow, [&](echo::EchoResponse*) { ++slowDone; });
+      nextEcho = [&] {
+        callEcho(&stub, "Echo", "echo", NULL, [&](echo::EchoResponse*) {
+          if (++echoes < kEchoes)
+          {
+            nextEcho();
+          }
+          else
+          {
+            outstandings = pool.outstandings();
+            // the slow call fails
+            pool.disconnect();
+          }
+        });
+      };
+      nextEcho();
+    }
+    else if (!conn->connected() && pool.connectedCount() == 0)
+    {
+      callEcho(&stub, "Echo", "nowhere", &afterwards, [&](echo::EchoResponse*) {
+        ++afterwardsDone;
+      });
+      loop.quit();
+    }
+  });
+  pool.connect();
+  loop.loop();
+
+  BOOST_CHECK_EQUAL(echoes, kEchoes);
+  BOOST_CHECK_EQUAL(outstandings, 1);
+  BOOST_CHECK_EQUAL(slowDone, 1);
+  BOOST_CHECK_EQUAL(slow.errorCode(), NO_CONNECTION);
+  BOOST_CHECK_EQUAL(afterwardsDone, 1);
+  BOOST_CHECK_EQUAL(afterwards.errorCode(), NO_CONNECTION);
+  BOOST_CHECK_EQUAL(pool.outstandings(), 0);
+
+  std::vector<int> echoThreads = service.echoThreads();
+  std::vector<int> slowThreads = service.slowThreads();
+  BOOST_REQUIRE_EQUAL(slowThreads.size(), 1);
+  BOOST_REQUIRE_EQUAL(echoThreads.size(), kEchoes);
+  for (int tid : echoThreads)
+  {
+    BOOST_CHECK_NE(tid, slowThreads[0]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testExecutor)
+{
+  const int kCalls = 3;
+  RpcTest test;
+  test.server().setDedicatedExecutor("echo.EchoService.Echo", 2);
+  int echoed = 0;
+  test.run([&] {
+    for (int i = 0; i < kCalls; ++i)
+    {
+      test.call("Echo", "pooled", NULL, [&](echo::EchoResponse* response) {
+        BOOST_CHECK(test.loop()->isInLoopThread());
+        BOOST_CHECK_EQUAL(response->payload(), "pooled");
+        if (++echoed == kCalls)
+        {
+          test.finish();
+        }
+      });
+    }
+  });
+
+  BOOST_CHECK_EQUAL(echoed, kCalls);
+  std::vector<int> echoThreads = test.service().echoThreads();
+  BOOST_REQUIRE_EQUAL(echoThreads.size(), kCalls);
+  for (int tid : echoThreads)
+  {
+    BOOST_CHECK_NE(tid, CurrentThread::tid());
+  }
+  // counted once the method returns, which may be after the answer is back
+  string stats;
+  for (int i = 0; i < 1000; ++i)
+  {
+    stats = test.server().executorStats();
+    if (stats.find("completed 3") != string::npos)
+    {
+      break;
+    }
+    ::usleep(1000);
+  }
+  BOOST_CHECK(stats.find("echo.EchoService.Echo") == 0);
+  BOOST_CHECK(stats.find("queued 0 running 0 completed 3") != string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(testStoppedExecutor)
+{
+  ThreadPool pool("stopped");
+  pool.start(1);
+  pool.stop();
+  RpcTest test;
+  test.server().setExecutor("echo.EchoService.Slow", &pool);
+  RpcController slow;
+  RpcController inIoThread;
+  test.run([&] {
+    test.call("Slow", "1", &slow, [&](echo::EchoResponse*) {
+      // methods without the executor still run in the IO thread
+      test.call("Echo", "inline", &inIoThread, [&](echo::EchoResponse*) {
+        test.finish();
+      });
+    });
+  });
+
+  BOOST_CHECK_EQUAL(slow.errorCode(), NO_SERVICE);
+  BOOST_CHECK(!inIoThread.Failed());
+  BOOST_CHECK(test.service().slowThreads().empty());
+  BOOST_CHECK_EQUAL(test.service().echoThreads().size(), 1);
+  BOOST_CHECK(test.server().executorStats().find("queued 0 running 0 completed 0") != string::npos);
+}
+
+// Bidirectional streams are not implemented, a call streams one way.
+BOOST_AUTO_TEST_CASE(testServerStream)
+{
+  const int kChunks = 40;
+  const int kWindow = 4;
+  RpcTest test;
+  BulkServiceImpl bulk;
+  ChunkWriter writer(kChunks);
+  int requestedChunks = 0;
+  test.server().registerService(&bulk);
+  test.server().setServerStreamHandler("echo.BulkService.Fetch",
+      [&](const MessagePtr& request, const RpcStreamPtr& stream) {
+    requestedChunks = static_cast<const echo::FetchRequest&>(*request).chunks();
+    writer.start(get_pointer(stream));
+  });
+
+  std::vector<string> received;
+  int ends = 0;
+  ErrorCode endError = CANCELED;
+  test.run([&] {
+    echo::FetchRequest request;
+    request.set_chunks(kChunks);
+    request.set_chunk_size(0);  // chunks are numbered instead
+    RpcStreamPtr stream = test.channel().callServerStream(
+        echo::BulkService::descriptor()->FindMethodByName("Fetch"), request, kWindow);
+    stream->setMessageCallback([&](const google::protobuf::Message& message) {
+      received.push_back(static_cast<const echo::Chunk&>(message).data());
+    });
+    stream->setEndCallback([&](ErrorCode error) {
+      ++ends;
+      endError = error;
+      test.finish();
+    });
+  });
+
+  BOOST_CHECK_EQUAL(requestedChunks, kChunks);
+  BOOST_CHECK_EQUAL(ends, 1);
+  BOOST_CHECK_EQUAL(endError, NO_ERROR);
+  BOOST_REQUIRE_EQUAL(received.size(), kChunks);
+  for (int i = 0; i < kChunks; ++i)
+  {
+    BOOST_CHECK_EQUAL(received[i], std::to_string(i));
+  }
+  // never more than the window on the way
+  const std::vector<int>& bursts = writer.bursts();
+  BOOST_CHECK_EQUAL(sum(bursts), kChunks);
+  BOOST_CHECK_EQUAL(bursts.front(), kWindow);
+  BOOST_CHECK_GE(bursts.size(), kChunks / kWindow);
+  for (int n : bursts)
+  {
+    BOOST_CHECK_LE(n, kWindow);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testClientStream)
+{
+  const int kChunks = 50;
+  RpcTest test;
+  BulkServiceImpl bulk;
+  int64_t serverBytes = 0;
+  int serverChunks = 0;
+  test.server().registerService(&bulk);
+  test.server().setClientStreamHandler("echo.BulkService.Upload",
+      [&](const RpcStreamPtr& stream,
+          google::protobuf::Message* response,
+          google::protobuf::Closure* done) {
+    stream->setMessageCallback([&](const google::protobuf::Message& message) {
+      ++serverChunks;
+      serverBytes += static_cast<int64_t>(static_cast<const echo::Chunk&>(message).data().size());
+    });
+    stream->setEndCallback([&, response, done](ErrorCode) {
+      static_cast<echo::Received*>(response)->set_bytes(serverBytes);
+      done->Run();
+    });
+  });
+
+  ChunkWriter writer(kChunks);
+  RpcController controller;
+  int64_t uploaded = -1;
+  test.run([&] {
+    echo::Received* response = new echo::Received;
+    RpcStreamPtr stream = test.channel().callClientStream(
+        echo::BulkService::descriptor()->FindMethodByName("Upload"), &controller, response,
+        new FunctionClosure([&, response] {
+          uploaded = response->bytes();
+          test.finish();
+        }));
+    writer.start(get_pointer(stream));
+  });
+
+  BOOST_CHECK(!controller.Failed());
+  BOOST_CHECK_EQUAL(serverChunks, kChunks);
+  BOOST_CHECK_EQUAL(uploaded, writer.bytes());
+  const std::vector<int>& bursts = writer.bursts();
+  BOOST_CHECK_EQUAL(sum(bursts), kChunks);
+  BOOST_CHECK_EQUAL(bursts.front(), RpcStream::kDefaultWindow);
+  for (int n : bursts)
+  {
+    BOOST_CHECK_LE(n, RpcStream::kDefaultWindow);
+  }
+}
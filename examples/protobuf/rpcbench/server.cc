@@ -1,5 +1,6 @@
 #include "examples/protobuf/rpcbench/echo.pb.h"
 
+#include "muduo/base/Clock.h"
 #include "muduo/base/Logging.h"
 #include "muduo/net/EventLoop.h"
 #include "muduo/net/protorpc/RpcServer.h"
@@ -24,6 +25,25 @@ class EchoServiceImpl : public EchoService
     response->set_payload(request->payload());
     done->Run();
   }
+
+  virtual void Slow(::google::protobuf::RpcController* controller,
+                    const ::echo::EchoRequest* request,
+                    ::echo::EchoResponse* response,
+                    ::google::protobuf::Closure* done)
+  {
+    spin(atoi(request->payload().c_str()));
+    response->set_payload(request->payload());
+    done->Run();
+  }
+
+  // busy, like solving a hard sudoku
+  static void spin(int micros)
+  {
+    int64_t end = Clock::monotonicMicros() + micros;
+    while (Clock::monotonicMicros() < end)
+    {
+    }
+  }
 };
 
 }  // namespace echo
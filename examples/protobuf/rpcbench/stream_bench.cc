@@ -0,0 +1,332 @@
+#include "examples/protobuf/rpcbench/echo.pb.h"
+
+#include "muduo/base/Clock.h"
+#include "muduo/base/CountDownLatch.h"
+#include "muduo/base/Logging.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/EventLoopThread.h"
+#include "muduo/net/TcpClient.h"
+#include "muduo/net/TcpConnection.h"
+#include "muduo/net/protorpc/RpcChannel.h"
+#include "muduo/net/protorpc/RpcServer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Usage: protobuf_rpc_stream_bench unary|stream|upload [chunks [chunkSize]]
+//
+// Moves chunks * chunkSize bytes over loopback, as one FetchAll response,
+// as a server stream of Fetch, or as a client stream of Upload.
+// Prints time to the first byte, total time and peak RSS of the process,
+// run each mode in a process of its own.
+
+int g_chunks = 1000;
+int g_chunkSize = 32 * 1024;
+
+long peakRssKb()
+{
+  long kb = 0;
+  FILE* fp = ::fopen("/proc/self/status", "r");
+  if (fp)
+  {
+    char line[256];
+    while (::fgets(line, sizeof line, fp))
+    {
+      if (::strncmp(line, "VmHWM:", 6) == 0)
+      {
+        kb = ::atol(line + 6);
+        break;
+      }
+    }
+    ::fclose(fp);
+  }
+  return kb;
+}
+
+// writes n copies of chunk to a stream, as fast as credits allow
+class ChunkWriter : noncopyable
+{
+ public:
+  ChunkWriter(RpcStream* stream, int n, int chunkSize)
+    : stream_(stream),
+      left_(n)
+  {
+    chunk_.set_data(string(chunkSize, 'x'));
+  }
+
+  void pump()
+  {
+    while (left_ > 0 && stream_->writable())
+    {
+      stream_->write(chunk_);
+      --left_;
+    }
+    if (left_ == 0)
+    {
+      stream_->finish();
+    }
+  }
+
+  static void start(RpcStream* stream, int n, int chunkSize)
+  {
+    std::shared_ptr<ChunkWriter> writer(new ChunkWriter(stream, n, chunkSize));
+    // the stream keeps the writer, until it is done
+    stream->setWritableCallback(std::bind(&ChunkWriter::pump, writer));
+    writer->pump();
+  }
+
+ private:
+  RpcStream* stream_;
+  int left_;
+  echo::Chunk chunk_;
+};
+
+class BulkServiceImpl : public echo::BulkService
+{
+ public:
+  void FetchAll(::google::protobuf::RpcController* controller,
+                const ::echo::FetchRequest* request,
+                ::echo::Chunks* response,
+                ::google::protobuf::Closure* done) override
+  {
+    string data(request->chunk_size(), 'x');
+    for (int i = 0; i < request->chunks(); ++i)
+    {
+      response->add_chunk()->set_data(data);
+    }
+    done->Run();
+  }
+
+  void Fetch(::google::protobuf::RpcController* controller,
+             const ::echo::FetchRequest* request,
+             ::echo::Chunk* response,
+             ::google::protobuf::Closure* done) override
+  {
+    response->set_data(string(request->chunk_size(), 'x'));
+    done->Run();
+  }
+
+  void Upload(::google::protobuf::RpcController* controller,
+              const ::echo::Chunk* request,
+              ::echo::Received* response,
+              ::google::protobuf::Closure* done) override
+  {
+    response->set_bytes(static_cast<int64_t>(request->data().size()));
+    done->Run();
+  }
+
+  static void fetch(const MessagePtr& request, const RpcStreamPtr& stream)
+  {
+    const echo::FetchRequest& fetch = static_cast<const echo::FetchRequest&>(*request);
+    ChunkWriter::start(get_pointer(stream), fetch.chunks(), fetch.chunk_size());
+  }
+
+  static void upload(const RpcStreamPtr& stream,
+                     ::google::protobuf::Message* response,
+                     ::google::protobuf::Closure* done)
+  {
+    std::shared_ptr<int64_t> bytes(new int64_t(0));
+    stream->setMessageCallback([bytes](const ::google::protobuf::Message& message) {
+      *bytes += static_cast<const echo::Chunk&>(message).data().size();
+    });
+    stream->setEndCallback([bytes, response, done](ErrorCode) {
+      static_cast<echo::Received*>(response)->set_bytes(*bytes);
+      done->Run();
+    });
+  }
+};
+
+class Client : noncopyable
+{
+ public:
+  Client(EventLoop* loop, const InetAddress& serverAddr,
+         CountDownLatch* connected, CountDownLatch* finished)
+    : client_(loop, serverAddr, "StreamBench"),
+      channel_(new RpcChannel),
+      stub_(get_pointer(channel_)),
+      connected_(connected),
+      finished_(finished),
+      disconnected_(NULL),
+      start_(0),
+      firstByte_(0),
+      end_(0),
+      bytes_(0)
+  {
+    client_.setConnectionCallback(std::bind(&Client::onConnection, this, _1));
+    client_.setMessageCallback(
+        std::bind(&RpcChannel::onMessage, get_pointer(channel_), _1, _2, _3));
+    client_.connect();
+  }
+
+  void start(const string& mode)
+  {
+    client_.connection()->getLoop()->runInLoop(std::bind(&Client::run, this, mode));
+  }
+
+  // counts down once the connection is closed and disconnected
+  void disconnect(CountDownLatch* disconnected)
+  {
+    client_.connection()->getLoop()->runInLoop([this, disconnected] {
+      disconnected_ = disconnected;
+      client_.disconnect();
+    });
+  }
+
+  int64_t firstByteMicros() const { return firstByte_ - start_; }
+  int64_t totalMicros() const { return end_ - start_; }
+  int64_t bytes() const { return bytes_; }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->setTcpNoDelay(true);
+      channel_->setConnection(conn);
+      connected_->countDown();
+    }
+    else if (disconnected_)
+    {
+      disconnected_->countDown();
+    }
+  }
+
+  void run(const string& mode)
+  {
+    const google::protobuf::ServiceDescriptor* service = echo::BulkService::descriptor();
+    echo::FetchRequest request;
+    request.set_chunks(g_chunks);
+    request.set_chunk_size(g_chunkSize);
+    start_ = Clock::monotonicMicros();
+    if (mode == "unary")
+    {
+      // the channel deletes response after done
+      echo::Chunks* response = new echo::Chunks;
+      stub_.FetchAll(NULL, &request, response,
+                     google::protobuf::NewCallback(this, &Client::fetchedAll, response));
+    }
+    else if (mode == "stream")
+    {
+      RpcStreamPtr stream = channel_->callServerStream(
+          service->FindMethodByName("Fetch"), request);
+      stream->setMessageCallback(std::bind(&Client::onChunk, this, _1));
+      stream->setEndCallback(std::bind(&Client::onEnd, this, _1));
+    }
+    else
+    {
+      echo::Received* response = new echo::Received;
+      RpcStreamPtr stream = channel_->callClientStream(
+          service->FindMethodByName("Upload"), NULL, response,
+          google::protobuf::NewCallback(this, &Client::uploaded, response));
+      ChunkWriter::start(get_pointer(stream), g_chunks, g_chunkSize);
+    }
+  }
+
+  void fetchedAll(echo::Chunks* response)
+  {
+    firstByte_ = end_ = Clock::monotonicMicros();
+    for (const echo::Chunk& chunk : response->chunk())
+    {
+      bytes_ += chunk.data().size();
+    }
+    finished_->countDown();
+  }
+
+  void onChunk(const google::protobuf::Message& message)
+  {
+    if (bytes_ == 0)
+    {
+      firstByte_ = Clock::monotonicMicros();
+    }
+    bytes_ += static_cast<const echo::Chunk&>(message).data().size();
+  }
+
+  void onEnd(ErrorCode error)
+  {
+    end_ = Clock::monotonicMicros();
+    if (error != NO_ERROR)
+    {
+      LOG_ERROR << "stream ended with " << ErrorCode_Name(error);
+    }
+    finished_->countDown();
+  }
+
+  void uploaded(echo::Received* response)
+  {
+    firstByte_ = end_ = Clock::monotonicMicros();
+    bytes_ = response->bytes();
+    finished_->countDown();
+  }
+
+  TcpClient client_;
+  RpcChannelPtr channel_;
+  echo::BulkService::Stub stub_;
+  CountDownLatch* connected_;
+  CountDownLatch* finished_;
+  CountDownLatch* disconnected_;
+  int64_t start_;
+  int64_t firstByte_;
+  int64_t end_;
+  int64_t bytes_;
+};
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    printf("Usage: %s unary|stream|upload [chunks [chunkSize]]\n", argv[0]);
+    return 0;
+  }
+  string mode = argv[1];
+  if (argc > 2)
+  {
+    g_chunks = atoi(argv[2]);
+  }
+  if (argc > 3)
+  {
+    g_chunkSize = atoi(argv[3]);
+  }
+  Logger::setLogLevel(Logger::WARN);
+
+  EventLoopThread serverThread;
+  EventLoop* serverLoop = serverThread.startLoop();
+  BulkServiceImpl impl;
+  std::unique_ptr<RpcServer> server(new RpcServer(serverLoop, InetAddress(18874)));
+  server->registerService(&impl);
+  server->setServerStreamHandler("echo.BulkService.Fetch", &BulkServiceImpl::fetch);
+  server->setClientStreamHandler("echo.BulkService.Upload", &BulkServiceImpl::upload);
+  serverLoop->runInLoop(std::bind(&RpcServer::start, get_pointer(server)));
+
+  EventLoopThread clientThread;
+  EventLoop* clientLoop = clientThread.startLoop();
+  CountDownLatch connected(1);
+  CountDownLatch finished(1);
+  std::unique_ptr<Client> client(
+      new Client(clientLoop, InetAddress("127.0.0.1", 18874), &connected, &finished));
+  connected.wait();
+  client->start(mode);
+  finished.wait();
+
+  printf("%-6s %d x %d bytes, received %.1f MiB  first byte %8.3f ms  total %8.3f ms"
+         "  peak RSS %ld KiB\n",
+         mode.c_str(), g_chunks, g_chunkSize,
+         static_cast<double>(client->bytes()) / (1024 * 1024),
+         static_cast<double>(client->firstByteMicros()) / 1000,
+         static_cast<double>(client->totalMicros()) / 1000,
+         peakRssKb());
+
+  // a connection must not be destroyed before it is closed in its loop
+  CountDownLatch disconnected(1);
+  client->disconnect(&disconnected);
+  disconnected.wait();
+
+  // destroys client and server in their loops
+  CountDownLatch destroyed(2);
+  clientLoop->runInLoop([&] { client.reset(); destroyed.countDown(); });
+  serverLoop->runInLoop([&] { server.reset(); destroyed.countDown(); });
+  destroyed.wait();
+  google::protobuf::ShutdownProtobufLibrary();
+}
@@ -0,0 +1,154 @@
+#include "muduo/base/Logging.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/TcpClient.h"
+#include "muduo/net/TcpServer.h"
+
+#include <memory>
+#include <vector>
+#include <stdio.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Clients send through a relay, eg. tcprelay, to the sink of this process,
+// which counts the bytes, so the throughput of the relay is measured:
+//   tcprelay 127.0.0.1 2008 2007 [splice]
+//   relay_bench 127.0.0.1:2007 2008
+class RelayBench : noncopyable
+{
+ public:
+  RelayBench(EventLoop* loop, const InetAddress& relayAddr, uint16_t sinkPort,
+             int connections, int64_t bytesPerConnection, int blockSize)
+    : loop_(loop),
+      sink_(loop, InetAddress(sinkPort), "RelaySink"),
+      block_(blockSize, 'x'),
+      bytesPerConnection_(bytesPerConnection),
+      received_(0),
+      connected_(0),
+      disconnected_(0)
+  {
+    sink_.setMessageCallback(
+        std::bind(&RelayBench::onSinkMessage, this, _1, _2));
+    for (int i = 0; i < connections; ++i)
+    {
+      Fmt f("RelayBench%d", i);
+      clients_.emplace_back(new TcpClient(loop, relayAddr, string(f.data(), f.length())));
+      TcpClient* client = clients_.back().get();
+      client->setConnectionCallback(
+          std::bind(&RelayBench::onConnection, this, _1));
+      client->setWriteCompleteCallback(
+          std::bind(&RelayBench::onWriteComplete, this, _1));
+    }
+  }
+
+  void start()
+  {
+    sink_.start();
+    for (const auto& client : clients_)
+    {
+      client->connect();
+    }
+  }
+
+ private:
+  int64_t totalBytes() const
+  {
+    return bytesPerConnection_ * static_cast<int64_t>(clients_.size());
+  }
+
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      conn->setTcpNoDelay(true);
+      conn->setContext(static_cast<int64_t>(0));
+      if (++connected_ == clients_.size())
+      {
+        start_ = Timestamp::now();
+        for (const auto& client : clients_)
+        {
+          onWriteComplete(client->connection());
+        }
+      }
+    }
+    else if (++disconnected_ == clients_.size())
+    {
+      // after TcpClient forgets the connection, then it is safe to destroy
+      loop_->queueInLoop(std::bind(&EventLoop::quit, loop_));
+    }
+  }
+
+  // one block at a time, the next one when it is written to the socket
+  void onWriteComplete(const TcpConnectionPtr& conn)
+  {
+    int64_t* sent = boost::any_cast<int64_t>(conn->getMutableContext());
+    if (*sent < bytesPerConnection_)
+    {
+      size_t len = static_cast<size_t>(
+          std::min<int64_t>(bytesPerConnection_ - *sent, static_cast<int64_t>(block_.size())));
+      *sent += static_cast<int64_t>(len);
+      conn->send(block_.data(), static_cast<int>(len));
+    }
+  }
+
+  void onSinkMessage(const TcpConnectionPtr&, Buffer* buf)
+  {
+    received_ += static_cast<int64_t>(buf->readableBytes());
+    buf->retrieveAll();
+    if (received_ == totalBytes())
+    {
+      finish();
+    }
+  }
+
+  void finish()
+  {
+    double seconds = timeDifference(Timestamp::now(), start_);
+    double bytes = static_cast<double>(received_);
+    printf("%zd connections, %.0f bytes in blocks of %zd in %.3f seconds\n",
+           clients_.size(), bytes, block_.size(), seconds);
+    printf("%.1f MiB/s, %.3f Gbit/s\n",
+           bytes / seconds / 1024 / 1024, bytes * 8 / seconds / 1e9);
+    for (const auto& client : clients_)
+    {
+      client->disconnect();
+    }
+  }
+
+  EventLoop* loop_;
+  TcpServer sink_;
+  std::vector<std::unique_ptr<TcpClient>> clients_;
+  const string block_;
+  const int64_t bytesPerConnection_;
+  int64_t received_;
+  size_t connected_;
+  size_t disconnected_;
+  Timestamp start_;
+};
+
+int main(int argc, char* argv[])
+{
+  if (argc > 2)
+  {
+    string hostport = argv[1];
+    size_t colon = hostport.find(':');
+    if (colon != string::npos)
+    {
+      string hostip = hostport.substr(0, colon);
+      uint16_t port = static_cast<uint16_t>(atoi(hostport.c_str()+colon+1));
+      uint16_t sinkPort = static_cast<uint16_t>(atoi(argv[2]));
+      int64_t megabytes = argc > 3 ? atoi(argv[3]) : 1024;
+      int connections = argc > 4 ? atoi(argv[4]) : 1;
+      int blockSize = argc > 5 ? atoi(argv[5]) : 64*1024;
+
+      Logger::setLogLevel(Logger::WARN);
+      EventLoop loop;
+      RelayBench bench(&loop, InetAddress(hostip, port), sinkPort,
+                       connections, megabytes * 1024 * 1024 / connections, blockSize);
+      bench.start();
+      loop.loop();
+      return 0;
+    }
+  }
+  printf("Usage: %s relay_ip:port sink_port [total_MiB] [connections] [block_size]\n", argv[0]);
+}
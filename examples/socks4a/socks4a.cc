@@ -10,6 +10,7 @@ using namespace muduo::net;
 
 EventLoop* g_eventLoop;
 std::map<string, TunnelPtr> g_tunnels;
+bool g_splice = false;
 
 void onServerConnection(const TcpConnectionPtr& conn)
 {
@@ -86,7 +87,7 @@ void onServerMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
         InetAddress serverAddr(addr);
         if (ver == 4 && cmd == 1 && okay)
         {
-          TunnelPtr tunnel(new Tunnel(g_eventLoop, serverAddr, conn));
+          TunnelPtr tunnel(new Tunnel(g_eventLoop, serverAddr, conn, g_splice));
           tunnel->setup();
           tunnel->connect();
           g_tunnels[conn->name()] = tunnel;
@@ -117,7 +118,7 @@ int main(int argc, char* argv[])
 {
   if (argc < 2)
   {
-    fprintf(stderr, "Usage: %s <listen_port>\n", argv[0]);
+    fprintf(stderr, "Usage: %s <listen_port> [splice]\n", argv[0]);
   }
   else
   {
@@ -125,6 +126,7 @@ int main(int argc, char* argv[])
 
     uint16_t port = static_cast<uint16_t>(atoi(argv[1]));
     InetAddress listenAddr(port);
+    g_splice = argc > 2 && strcmp(argv[2], "splice") == 0;
 
     EventLoop loop;
     g_eventLoop = &loop;
@@ -10,6 +10,7 @@ using namespace muduo::net;
 
 EventLoop* g_eventLoop;
 InetAddress* g_serverAddr;
+bool g_splice = false;
 std::map<string, TunnelPtr> g_tunnels;
 
 void onServerConnection(const TcpConnectionPtr& conn)
@@ -19,7 +20,7 @@ void onServerConnection(const TcpConnectionPtr& conn)
   {
     conn->setTcpNoDelay(true);
     conn->stopRead();
-    TunnelPtr tunnel(new Tunnel(g_eventLoop, *g_serverAddr, conn));
+    TunnelPtr tunnel(new Tunnel(g_eventLoop, *g_serverAddr, conn, g_splice));
     tunnel->setup();
     tunnel->connect();
     g_tunnels[conn->name()] = tunnel;
@@ -52,7 +53,7 @@ int main(int argc, char* argv[])
 {
   if (argc < 4)
   {
-    fprintf(stderr, "Usage: %s <host_ip> <port> <listen_port>\n", argv[0]);
+    fprintf(stderr, "Usage: %s <host_ip> <port> <listen_port> [splice]\n", argv[0]);
   }
   else
   {
@@ -70,6 +71,7 @@ int main(int argc, char* argv[])
 
     uint16_t acceptPort = static_cast<uint16_t>(atoi(argv[3]));
     InetAddress listenAddr(acceptPort);
+    g_splice = argc > 4 && strcmp(argv[4], "splice") == 0;
 
     EventLoop loop;
     g_eventLoop = &loop;
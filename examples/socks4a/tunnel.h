@@ -7,15 +7,20 @@
 #include "muduo/net/TcpClient.h"
 #include "muduo/net/TcpServer.h"
 
+// Relays bytes between the two connections, copying them through the
+// Buffers of TcpConnection, or with splice(2) without copying them to
+// user space.  Either way reading stops when the other side is slow.
 class Tunnel : public std::enable_shared_from_this<Tunnel>,
                muduo::noncopyable
 {
  public:
   Tunnel(muduo::net::EventLoop* loop,
          const muduo::net::InetAddress& serverAddr,
-         const muduo::net::TcpConnectionPtr& serverConn)
+         const muduo::net::TcpConnectionPtr& serverConn,
+         bool splice = false)
     : client_(loop, serverAddr, serverConn->name()),
-      serverConn_(serverConn)
+      serverConn_(serverConn),
+      splice_(splice)
   {
     LOG_INFO << "Tunnel " << serverConn->peerAddress().toIpPort()
              << " <-> " << serverAddr.toIpPort();
@@ -39,7 +44,7 @@ class Tunnel : public std::enable_shared_from_this<Tunnel>,
     serverConn_->setHighWaterMarkCallback(
         std::bind(&Tunnel::onHighWaterMarkWeak,
                   std::weak_ptr<Tunnel>(shared_from_this()), kServer, _1, _2),
-        1024*1024);
+        kHighWaterMark);
   }
 
   void connect()
@@ -78,7 +83,7 @@ class Tunnel : public std::enable_shared_from_this<Tunnel>,
       conn->setHighWaterMarkCallback(
           std::bind(&Tunnel::onHighWaterMarkWeak,
                     std::weak_ptr<Tunnel>(shared_from_this()), kClient, _1, _2),
-          1024*1024);
+          kHighWaterMark);
       serverConn_->setContext(conn);
       serverConn_->startRead();
       clientConn_ = conn;
@@ -86,6 +91,12 @@ class Tunnel : public std::enable_shared_from_this<Tunnel>,
       {
         conn->send(serverConn_->inputBuffer());
       }
+      if (splice_)
+      {
+        // the pipes hold as much as the output buffers before high water
+        serverConn_->spliceTo(conn, kHighWaterMark);
+        conn->spliceTo(serverConn_, kHighWaterMark);
+      }
     }
     else
     {
@@ -114,6 +125,8 @@ class Tunnel : public std::enable_shared_from_this<Tunnel>,
     kServer, kClient
   };
 
+  static const int kHighWaterMark = 1024*1024;
+
   void onHighWaterMark(ServerClient which,
                        const muduo::net::TcpConnectionPtr& conn,
                        size_t bytesToSent)
@@ -189,6 +202,7 @@ class Tunnel : public std::enable_shared_from_this<Tunnel>,
   muduo::net::TcpClient client_;
   muduo::net::TcpConnectionPtr serverConn_;
   muduo::net::TcpConnectionPtr clientConn_;
+  const bool splice_;
 };
 typedef std::shared_ptr<Tunnel> TunnelPtr;
 
@@ -16,42 +16,78 @@ bool verify(const string& result)
   return true;
 }
 
-void runLocal(std::istream& in)
+typedef std::vector<string> Input;
+typedef std::shared_ptr<Input> InputPtr;
+
+InputPtr readInput(std::istream& in)
 {
-  Timestamp start(Timestamp::now());
+  InputPtr input(new Input);
   std::string line;
-  int count = 0;
-  int succeed = 0;
   while (getline(in, line))
   {
     if (line.size() == implicit_cast<size_t>(kCells))
     {
-      ++count;
-      if (verify(solveSudoku(line)))
-      {
-        ++succeed;
-      }
+      input->push_back(line.c_str());
     }
   }
-  double elapsed = timeDifference(Timestamp::now(), start);
-  printf("%.3f sec, %.3f us per sudoku.\n", elapsed, 1000 * 1000 * elapsed / count);
+  return input;
 }
 
-typedef std::vector<string> Input;
-typedef std::shared_ptr<Input> InputPtr;
+// result fills in the blanks of puzzle and breaks no rule
+bool verify(const string& puzzle, const string& result)
+{
+  if (result.size() != implicit_cast<size_t>(kCells))
+  {
+    return false;
+  }
+  int rows[9] = { 0 }, cols[9] = { 0 }, boxes[9] = { 0 };
+  for (int i = 0; i < kCells; ++i)
+  {
+    int digit = result[i] - '0';
+    if (digit < 1 || digit > 9 || (puzzle[i] != '0' && puzzle[i] != result[i]))
+    {
+      return false;
+    }
+    int row = i / 9, col = i % 9, box = row/3*3 + col/3;
+    rows[row] |= 1 << digit;
+    cols[col] |= 1 << digit;
+    boxes[box] |= 1 << digit;
+  }
+  for (int i = 0; i < 9; ++i)
+  {
+    if (rows[i] != 0x3FE || cols[i] != 0x3FE || boxes[i] != 0x3FE)
+    {
+      return false;
+    }
+  }
+  return true;
+}
 
-InputPtr readInput(std::istream& in)
+// every solver on one core, all puzzles in one batch
+void runLocal(std::istream& in)
 {
-  InputPtr input(new Input);
-  std::string line;
-  while (getline(in, line))
+  InputPtr input(readInput(in));
+  const SudokuAlgorithm algorithms[] = { kDancingLinks, kBitmask };
+  for (SudokuAlgorithm algorithm : algorithms)
   {
-    if (line.size() == implicit_cast<size_t>(kCells))
+    Timestamp start(Timestamp::now());
+    std::vector<string> results;
+    solveSudokus(*input, &results, algorithm);
+    double elapsed = timeDifference(Timestamp::now(), start);
+    double count = static_cast<double>(results.size());
+    size_t succeed = 0;
+    for (size_t i = 0; i < results.size(); ++i)
     {
-      input->push_back(line.c_str());
+      if (verify((*input)[i], results[i]))
+      {
+        ++succeed;
+      }
     }
+    printf("%-13s %.3f sec, %.3f us per sudoku, %.0f sudokus per second per core, "
+           "%zd of %zd solved.\n",
+           sudokuAlgorithmName(algorithm), elapsed, 1000 * 1000 * elapsed / count,
+           count / elapsed, succeed, results.size());
   }
-  return input;
 }
 
 typedef std::function<void(const string&, double, int)> DoneCallback;
@@ -0,0 +1,132 @@
+// This is not a standalone header
+
+// Results of recent puzzles, and requests waiting for a puzzle being solved.
+// Sharded by the hash of the puzzle, each shard is an LRU list of its own.
+class SudokuCache : noncopyable
+{
+ public:
+  // result is empty if the puzzle was abandoned
+  typedef std::function<void (const string& result)> Callback;
+
+  enum Lookup
+  {
+    kHit,  // result is set
+    kWaiting,  // done will be called by finish() or abandon()
+    kMiss,  // the caller solves it, then calls finish() or abandon()
+  };
+
+  explicit SudokuCache(size_t capacity, int numShards = 16)
+    : shards_(numShards)
+  {
+    assert(numShards > 0);
+    for (Shard& shard : shards_)
+    {
+      shard.capacity = (capacity + numShards - 1) / numShards;
+    }
+  }
+
+  // *costUs is the CPU time of solving it, when result is set
+  Lookup lookup(const string& puzzle, string* result, int64_t* costUs, const Callback& done)
+  {
+    Shard& shard = shardOf(puzzle);
+    MutexLockGuard lock(shard.mutex);
+    auto it = shard.index.find(puzzle);
+    if (it != shard.index.end())
+    {
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+      *result = it->second->result;
+      *costUs = it->second->costUs;
+      return kHit;
+    }
+    auto waiting = shard.inflight.find(puzzle);
+    if (waiting != shard.inflight.end())
+    {
+      waiting->second.push_back(done);
+      return kWaiting;
+    }
+    shard.inflight[puzzle];
+    return kMiss;
+  }
+
+  // Stores result and calls those waiting for it, returns how many.
+  int finish(const string& puzzle, const string& result, int64_t costUs)
+  {
+    std::vector<Callback> waiting = take(puzzle, result, costUs);
+    for (const Callback& done : waiting)
+    {
+      done(result);
+    }
+    return static_cast<int>(waiting.size());
+  }
+
+  // Not solved, those waiting get an empty result.
+  void abandon(const string& puzzle)
+  {
+    std::vector<Callback> waiting = take(puzzle, string(), 0);
+    for (const Callback& done : waiting)
+    {
+      done(string());
+    }
+  }
+
+  size_t size() const
+  {
+    size_t n = 0;
+    for (const Shard& shard : shards_)
+    {
+      MutexLockGuard lock(shard.mutex);
+      n += shard.index.size();
+    }
+    return n;
+  }
+
+ private:
+  struct Entry
+  {
+    string puzzle;
+    string result;
+    int64_t costUs;
+  };
+
+  struct Shard
+  {
+    Shard() : capacity(0) { }
+
+    mutable MutexLock mutex;
+    size_t capacity;
+    std::list<Entry> lru GUARDED_BY(mutex);  // most recent first
+    std::unordered_map<string, std::list<Entry>::iterator> index GUARDED_BY(mutex);
+    std::unordered_map<string, std::vector<Callback>> inflight GUARDED_BY(mutex);
+  };
+
+  Shard& shardOf(const string& puzzle)
+  {
+    return shards_[std::hash<string>()(puzzle) % shards_.size()];
+  }
+
+  std::vector<Callback> take(const string& puzzle, const string& result, int64_t costUs)
+  {
+    std::vector<Callback> waiting;
+    Shard& shard = shardOf(puzzle);
+    MutexLockGuard lock(shard.mutex);
+    auto it = shard.inflight.find(puzzle);
+    if (it != shard.inflight.end())
+    {
+      waiting.swap(it->second);
+      shard.inflight.erase(it);
+    }
+    if (!result.empty() && shard.capacity > 0 && shard.index.find(puzzle) == shard.index.end())
+    {
+      shard.lru.push_front(Entry{ puzzle, result, costUs });
+      shard.index[puzzle] = shard.lru.begin();
+      if (shard.lru.size() > shard.capacity)
+      {
+        shard.index.erase(shard.lru.back().puzzle);
+        shard.lru.pop_back();
+      }
+    }
+    return waiting;
+  }
+
+  std::vector<Shard> shards_;
+};
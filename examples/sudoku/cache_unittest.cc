@@ -0,0 +1,80 @@
+#include "muduo/base/Mutex.h"
+
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+using namespace muduo;
+
+#include "examples/sudoku/cache.h"
+
+BOOST_AUTO_TEST_CASE(testSudokuCacheHit)
+{
+  SudokuCache c(10, 1);
+  string result;
+  int64_t cost = 0;
+  BOOST_CHECK_EQUAL(c.lookup("a", &result, &cost, SudokuCache::Callback()), SudokuCache::kMiss);
+  BOOST_CHECK_EQUAL(c.finish("a", "A", 42), 0);
+  BOOST_CHECK_EQUAL(c.lookup("a", &result, &cost, SudokuCache::Callback()), SudokuCache::kHit);
+  BOOST_CHECK_EQUAL(result, "A");
+  BOOST_CHECK_EQUAL(cost, 42);
+  BOOST_CHECK_EQUAL(c.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(testSudokuCacheEvictsLeastRecent)
+{
+  SudokuCache c(2, 1);
+  string result;
+  int64_t cost = 0;
+  c.lookup("a", &result, &cost, SudokuCache::Callback());
+  c.finish("a", "A", 1);
+  c.lookup("b", &result, &cost, SudokuCache::Callback());
+  c.finish("b", "B", 1);
+  // a is used after b
+  BOOST_CHECK_EQUAL(c.lookup("a", &result, &cost, SudokuCache::Callback()), SudokuCache::kHit);
+  c.lookup("c", &result, &cost, SudokuCache::Callback());
+  c.finish("c", "C", 1);
+  BOOST_CHECK_EQUAL(c.size(), 2);
+  BOOST_CHECK_EQUAL(c.lookup("a", &result, &cost, SudokuCache::Callback()), SudokuCache::kHit);
+  BOOST_CHECK_EQUAL(c.lookup("c", &result, &cost, SudokuCache::Callback()), SudokuCache::kHit);
+  BOOST_CHECK_EQUAL(c.lookup("b", &result, &cost, SudokuCache::Callback()), SudokuCache::kMiss);
+}
+
+BOOST_AUTO_TEST_CASE(testSudokuCacheCoalesces)
+{
+  SudokuCache c(10);
+  std::vector<string> results;
+  SudokuCache::Callback done = [&results](const string& result) { results.push_back(result); };
+  string result;
+  int64_t cost = 0;
+  BOOST_CHECK_EQUAL(c.lookup("a", &result, &cost, done), SudokuCache::kMiss);
+  BOOST_CHECK_EQUAL(c.lookup("a", &result, &cost, done), SudokuCache::kWaiting);
+  BOOST_CHECK_EQUAL(c.lookup("a", &result, &cost, done), SudokuCache::kWaiting);
+  BOOST_CHECK_EQUAL(c.finish("a", "A", 1), 2);
+  BOOST_CHECK_EQUAL(results.size(), 2);
+  BOOST_CHECK_EQUAL(results[0], "A");
+  BOOST_CHECK_EQUAL(results[1], "A");
+}
+
+BOOST_AUTO_TEST_CASE(testSudokuCacheAbandon)
+{
+  SudokuCache c(0);
+  std::vector<string> results;
+  SudokuCache::Callback done = [&results](const string& result) { results.push_back(result); };
+  string result;
+  int64_t cost = 0;
+  BOOST_CHECK_EQUAL(c.lookup("a", &result, &cost, done), SudokuCache::kMiss);
+  BOOST_CHECK_EQUAL(c.lookup("a", &result, &cost, done), SudokuCache::kWaiting);
+  c.abandon("a");
+  BOOST_CHECK_EQUAL(results.size(), 1);
+  BOOST_CHECK(results[0].empty());
+  // nothing cached without capacity, the next one solves again
+  BOOST_CHECK_EQUAL(c.lookup("a", &result, &cost, done), SudokuCache::kMiss);
+  BOOST_CHECK_EQUAL(c.finish("a", "A", 1), 0);
+  BOOST_CHECK_EQUAL(c.lookup("a", &result, &cost, done), SudokuCache::kMiss);
+}
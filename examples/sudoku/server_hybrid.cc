@@ -1,6 +1,7 @@
 #include "examples/sudoku/sudoku.h"
 
 #include "muduo/base/Atomic.h"
+#include "muduo/base/Histogram.h"
 #include "muduo/base/Logging.h"
 #include "muduo/base/Thread.h"
 #include "muduo/base/ThreadPool.h"
@@ -10,7 +11,7 @@
 #include "muduo/net/TcpServer.h"
 #include "muduo/net/inspect/Inspector.h"
 
-#include <boost/circular_buffer.hpp>
+#include <atomic>
 
 //#include <stdio.h>
 //#include <unistd.h>
@@ -1,6 +1,8 @@
 #include "examples/sudoku/sudoku.h"
 
 #include "muduo/base/Atomic.h"
+#include "muduo/base/Clock.h"
+#include "muduo/base/Histogram.h"
 #include "muduo/base/Logging.h"
 #include "muduo/base/Thread.h"
 #include "muduo/base/ThreadPool.h"
@@ -10,14 +12,18 @@
 #include "muduo/net/TcpServer.h"
 #include "muduo/net/inspect/Inspector.h"
 
-#include <boost/circular_buffer.hpp>
+#include <atomic>
+#include <list>
+#include <unordered_map>
 
 //#include <stdio.h>
 //#include <unistd.h>
+#include <time.h>
 
 using namespace muduo;
 using namespace muduo::net;
 
+#include "examples/sudoku/cache.h"
 #include "examples/sudoku/stat.h"
 
 class SudokuServer : noncopyable
@@ -27,18 +33,24 @@ class SudokuServer : noncopyable
                const InetAddress& listenAddr,
                int numEventLoops,
                int numThreads,
-               bool nodelay)
+               bool nodelay,
+               int cacheEntries)
     : server_(loop, listenAddr, "SudokuServer"),
       threadPool_(),
       numThreads_(numThreads),
       tcpNoDelay_(nodelay),
       startTime_(Timestamp::now()),
+      cache_(cacheEntries >= 0 ? new SudokuCache(static_cast<size_t>(cacheEntries)) : NULL),
       stat_(threadPool_),
       inspectThread_(),
       inspector_(inspectThread_.startLoop(), InetAddress(9982), "sudoku-solver")
   {
     LOG_INFO << "Use " << numEventLoops << " IO threads.";
     LOG_INFO << "TCP no delay " << nodelay;
+    if (cache_)
+    {
+      LOG_INFO << "Cache " << cacheEntries << " results";
+    }
 
     server_.setConnectionCallback(
         std::bind(&SudokuServer::onConnection, this, _1));
@@ -48,8 +60,14 @@ class SudokuServer : noncopyable
 
     inspector_.add("sudoku", "stats", std::bind(&SudokuStat::report, &stat_),
                    "statistics of sudoku solver");
+    inspector_.add("sudoku", "latency", std::bind(&SudokuStat::latency, &stat_),
+                   "latency histogram of sudoku solver");
     inspector_.add("sudoku", "reset", std::bind(&SudokuStat::reset, &stat_),
                    "reset statistics of sudoku solver");
+    inspector_.add("sudoku", "queue", std::bind(&ThreadPool::report, &threadPool_),
+                   "task queue wait histogram of sudoku solver");
+    threadPool_.setPriorityLevels(kPriorities);
+    threadPool_.setWaitStats(true);
   }
 
   void start()
@@ -170,30 +188,62 @@ class SudokuServer : noncopyable
       bool throttle = boost::any_cast<bool>(conn->getContext());
       if (threadPool_.queueSize() < 1000 * 1000 && !throttle)
       {
-        threadPool_.run(std::bind(&SudokuServer::solve, this, conn, req));
+        if (!cache_ || !fromCache(conn, req))
+        {
+          // no one is waiting for a stale answer
+          threadPool_.run(std::bind(&SudokuServer::solve, this, conn, req),
+                          priorityOf(req.puzzle),
+                          addTime(Clock::monotonic(), kRequestTimeout),
+                          std::bind(&SudokuServer::expire, this, conn, req));
+        }
       }
       else
       {
-        if (req.id.empty())
-        {
-          conn->send("ServerTooBusy\r\n");
-        }
-        else
-        {
-          conn->send(req.id + ":ServerTooBusy\r\n");
-        }
-        stat_.recordDroppedRequest();
+        tooBusy(conn, req.id);
       }
       return true;
     }
     return false;
   }
 
+  // true if answered, or waiting for the same puzzle being solved
+  bool fromCache(const TcpConnectionPtr& conn, const Request& req)
+  {
+    string result;
+    int64_t costUs = 0;
+    SudokuCache::Lookup found =
+        cache_->lookup(req.puzzle, &result, &costUs,
+                       std::bind(&SudokuServer::respond, this, conn, req, _1));
+    if (found == SudokuCache::kHit)
+    {
+      stat_.recordCacheHit(costUs);
+      respond(conn, req, result);
+    }
+    return found != SudokuCache::kMiss;
+  }
+
   void solve(const TcpConnectionPtr& conn, const Request& req)
   {
     LOG_DEBUG << conn->name();
+    int64_t start = threadCpuMicroseconds();
     string result = solveSudoku(req.puzzle);
-    if (req.id.empty())
+    int64_t costUs = threadCpuMicroseconds() - start;
+    respond(conn, req, result);
+    if (cache_)
+    {
+      int waiting = cache_->finish(req.puzzle, result, costUs);
+      stat_.recordSolve(costUs, waiting);
+    }
+  }
+
+  // result is empty if no one solved it in time
+  void respond(const TcpConnectionPtr& conn, const Request& req, const string& result)
+  {
+    if (result.empty())
+    {
+      tooBusy(conn, req.id);
+    }
+    else if (req.id.empty())
     {
       conn->send(result + "\r\n");
     }
@@ -201,27 +251,81 @@ class SudokuServer : noncopyable
     {
       conn->send(req.id + ":" + result + "\r\n");
     }
-    stat_.recordResponse(Timestamp::now(), req.receiveTime, result != kNoSolution);
+    if (!result.empty())
+    {
+      stat_.recordResponse(Timestamp::now(), req.receiveTime, result != kNoSolution);
+    }
   }
 
+  void expire(const TcpConnectionPtr& conn, const Request& req)
+  {
+    tooBusy(conn, req.id);
+    if (cache_)
+    {
+      cache_->abandon(req.puzzle);
+    }
+  }
+
+  void tooBusy(const TcpConnectionPtr& conn, const string& id)
+  {
+    if (id.empty())
+    {
+      conn->send("ServerTooBusy\r\n");
+    }
+    else
+    {
+      conn->send(id + ":ServerTooBusy\r\n");
+    }
+    stat_.recordDroppedRequest();
+  }
+
+  static int64_t threadCpuMicroseconds()
+  {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 + ts.tv_nsec / 1000;
+  }
+
+  // The more givens, the less searching.  Easy puzzles go first, so they
+  // don't wait behind hard ones, which the deadline keeps from starving.
+  static int priorityOf(const string& puzzle)
+  {
+    int givens = 0;
+    for (char c : puzzle)
+    {
+      if (c >= '1' && c <= '9')
+        ++givens;
+    }
+    return givens >= kEasyGivens ? kEasy : kHard;
+  }
+
+  static const double kRequestTimeout;
+  static const int kEasyGivens = 30;
+  enum Priority { kHard, kEasy, kPriorities };
+
   TcpServer server_;
   ThreadPool threadPool_;
   const int numThreads_;
   const bool tcpNoDelay_;
   const Timestamp startTime_;
+  std::unique_ptr<SudokuCache> cache_;  // NULL if not caching
 
   SudokuStat stat_;
   EventLoopThread inspectThread_;
   Inspector inspector_;
 };
 
+const double SudokuServer::kRequestTimeout = 1.0;  // seconds
+
 int main(int argc, char* argv[])
 {
-  LOG_INFO << argv[0] << " [number of IO threads] [number of worker threads] [-n]";
+  LOG_INFO << argv[0] << " [number of IO threads] [number of worker threads] [-n] [-c cache_entries]";
   LOG_INFO << "pid = " << getpid() << ", tid = " << CurrentThread::tid();
+  LOG_INFO << "Solving with " << sudokuAlgorithmName(defaultSudokuAlgorithm());
   int numEventLoops = 0;
   int numThreads = 0;
   bool nodelay = false;
+  int cacheEntries = -1;
   if (argc > 1)
   {
     numEventLoops = atoi(argv[1]);
@@ -230,14 +334,22 @@ int main(int argc, char* argv[])
   {
     numThreads = atoi(argv[2]);
   }
-  if (argc > 3 && string(argv[3]) == "-n")
+  for (int i = 3; i < argc; ++i)
   {
-    nodelay = true;
+    if (string(argv[i]) == "-n")
+    {
+      nodelay = true;
+    }
+    else if (string(argv[i]) == "-c" && i + 1 < argc)
+    {
+      // 0 for coalescing only
+      cacheEntries = atoi(argv[++i]);
+    }
   }
 
   EventLoop loop;
   InetAddress listenAddr(9981);
-  SudokuServer server(&loop, listenAddr, numEventLoops, numThreads, nodelay);
+  SudokuServer server(&loop, listenAddr, numEventLoops, numThreads, nodelay, cacheEntries);
 
   server.start();
 
@@ -4,18 +4,9 @@ class SudokuStat : muduo::noncopyable
 {
  public:
   SudokuStat(const ThreadPool& pool)
-    : pool_(pool),
-      lastSecond_(0),
-      requests_(kSeconds),
-      latencies_(kSeconds),
-      totalRequests_(0),
-      totalResponses_(0),
-      totalSolved_(0),
-      badRequests_(0),
-      droppedRequests_(0),
-      totalLatency_(0),
-      badLatency_(0)
+    : pool_(pool)
   {
+    reset();
   }
 
   string report() const
@@ -24,70 +15,115 @@ class SudokuStat : muduo::noncopyable
     size_t queueSize = pool_.queueSize();
     result << "task_queue_size " << queueSize << '\n';
 
+    result << "total_requests " << totalRequests_.load() << '\n';
+    const int64_t totalResponses = totalResponses_.load();
+    result << "total_responses " << totalResponses << '\n';
+    result << "total_solved " << totalSolved_.load() << '\n';
+    result << "bad_requests " << badRequests_.load() << '\n';
+    result << "dropped_requests " << droppedRequests_.load() << '\n';
+    const int64_t totalLatency = totalLatency_.load();
+    result << "latency_sum_us " << totalLatency << '\n';
+    if (badLatency_.load() > 0)
     {
-    MutexLockGuard lock(mutex_);
-    result << "total_requests " << totalRequests_ << '\n';
-    result << "total_responses " << totalResponses_ << '\n';
-    result << "total_solved " << totalSolved_ << '\n';
-    result << "bad_requests " << badRequests_ << '\n';
-    result << "dropped_requests " << droppedRequests_ << '\n';
-    result << "latency_sum_us " << totalLatency_ << '\n';
-    if (badLatency_ > 0)
-    {
-      result << "bad_latency" << badLatency_ << '\n';
+      result << "bad_latency " << badLatency_.load() << '\n';
     }
 
-    result << "last_second " << lastSecond_ << '\n';
+    const int64_t lastSecond = lastSecond_.load();
+    result << "last_second " << lastSecond << '\n';
     int64_t requests = 0;
+    int64_t latency = 0;
+    LogStream latencies;
     result << "requests_per_second";
-    for (size_t i = 0; i < requests_.size(); ++i)
+    latencies << "latency_sum_us_per_second";
+    if (lastSecond > 0)
     {
-      requests += requests_[i];
-      result << ' ' << requests_[i];
+      for (int64_t second = std::max(firstSecond_.load(), lastSecond - kSeconds + 1);
+           second <= lastSecond; ++second)
+      {
+        const Second& slot = seconds_[second % kSlots];
+        int64_t n = 0, us = 0;
+        if (slot.second.load() == second)
+        {
+          n = slot.requests.load();
+          us = slot.latency.load();
+        }
+        requests += n;
+        latency += us;
+        result << ' ' << n;
+        latencies << ' ' << us;
+      }
     }
     result << '\n';
     result << "requests_60s " << requests << '\n';
 
-    int64_t latency = 0;
-    result << "latency_sum_us_per_second";
-    for (size_t i = 0; i < latencies_.size(); ++i)
-    {
-      latency += latencies_[i];
-      result << ' ' << latencies_[i];
-    }
-    result << '\n';
+    result << latencies.buffer().toString() << '\n';
     result << "latency_sum_us_60s " << latency << '\n';
     int64_t latencyAvg60s = requests == 0 ? 0 : latency / requests;
     result << "latency_us_60s " << latencyAvg60s << '\n';
-    int64_t latencyAvg = totalResponses_ == 0 ? 0 : totalLatency_ / totalResponses_;
+    int64_t latencyAvg = totalResponses == 0 ? 0 : totalLatency / totalResponses;
     result << "latency_us_avg " << latencyAvg << '\n';
+
+    Histogram histogram = latency_.snapshot();
+    result << "latency_us_p50 " << histogram.percentile(50) << '\n';
+    result << "latency_us_p90 " << histogram.percentile(90) << '\n';
+    result << "latency_us_p99 " << histogram.percentile(99) << '\n';
+    result << "latency_us_p999 " << histogram.percentile(99.9) << '\n';
+    result << "latency_us_max " << histogram.max() << '\n';
+
+    const int64_t cacheHits = cacheHits_.load();
+    const int64_t cacheCoalesced = cacheCoalesced_.load();
+    const int64_t cacheMisses = cacheMisses_.load();
+    int64_t lookups = cacheHits + cacheCoalesced + cacheMisses;
+    if (lookups > 0)
+    {
+      result << "cache_hits " << cacheHits << '\n';
+      result << "cache_coalesced " << cacheCoalesced << '\n';
+      result << "cache_misses " << cacheMisses << '\n';
+      double hitRatio = static_cast<double>(cacheHits + cacheCoalesced) / static_cast<double>(lookups);
+      result << "cache_hit_ratio " << hitRatio << '\n';
+      result << "solve_cpu_us " << solveCpuUs_.load() << '\n';
+      result << "saved_cpu_us " << savedCpuUs_.load() << '\n';
     }
     return result.buffer().toString();
   }
 
+  // <largest latency us of bucket> <count> <cumulative percent>, since reset
+  string latency() const
+  {
+    return latency_.snapshot().distribution();
+  }
+
+  // Not atomic, responses in flight may survive.
   string reset()
   {
-    {
-    MutexLockGuard lock(mutex_);
+    firstSecond_ = 0;
     lastSecond_ = 0;
-    requests_.clear();
-    latencies_.clear();
+    for (Second& slot : seconds_)
+    {
+      slot.second = 0;
+      slot.requests = 0;
+      slot.latency = 0;
+    }
     totalRequests_ = 0;
     totalResponses_ = 0;
     totalSolved_ = 0;
     badRequests_ = 0;
+    droppedRequests_ = 0;
     totalLatency_ = 0;
     badLatency_ = 0;
-    }
+    cacheHits_ = 0;
+    cacheCoalesced_ = 0;
+    cacheMisses_ = 0;
+    solveCpuUs_ = 0;
+    savedCpuUs_ = 0;
+    latency_.reset();
     return "reset done.";
   }
 
   void recordResponse(Timestamp now, Timestamp receive, bool solved)
   {
-    const time_t second = now.secondsSinceEpoch();
+    const int64_t second = now.secondsSinceEpoch();
     const int64_t elapsed_us = now.microSecondsSinceEpoch() - receive.microSecondsSinceEpoch();
-    MutexLockGuard lock(mutex_);
-    assert(requests_.size() == latencies_.size());
     ++totalResponses_;
     if (solved)
       ++totalSolved_;
@@ -97,99 +133,99 @@ class SudokuStat : muduo::noncopyable
       return;
     }
     totalLatency_ += elapsed_us;
+    latency_.record(elapsed_us);
 
-    const time_t firstSecond = lastSecond_ - static_cast<ssize_t>(requests_.size()) + 1;
-    if (lastSecond_ == second)
-    {
-      // the most common case
-      ++requests_.back();
-      latencies_.back() += elapsed_us;
-    }
-    else if (lastSecond_ + 1 == second || lastSecond_ == 0)
+    int64_t first = firstSecond_.load();
+    while ((first == 0 || second < first) && !firstSecond_.compare_exchange_weak(first, second))
     {
-      // next second
-      lastSecond_ = second;
-      requests_.push_back(0);
-      latencies_.push_back(0);
-      ++requests_.back();
-      latencies_.back() += elapsed_us;
     }
-    else if (second > lastSecond_)
+    int64_t last = lastSecond_.load();
+    while (second > last && !lastSecond_.compare_exchange_weak(last, second))
     {
-      // jump ahead
-      if (second < lastSecond_ + kSeconds)
-      {
-        // eg. lastSecond_ == 100, second < 160
-        while (lastSecond_ < second)
-        {
-          requests_.push_back(0);
-          latencies_.push_back(0);
-          ++lastSecond_;
-        }
-      }
-      else
-      {
-        // eg. lastSecond_ == 100, second >= 160
-        requests_.clear();
-        latencies_.clear();
-        lastSecond_ = second;
-        requests_.push_back(0);
-        latencies_.push_back(0);
-      }
-      ++requests_.back();
-      latencies_.back() += elapsed_us;
     }
-    else if (second >= firstSecond)
+    if (second <= last - kSeconds)
     {
-      // jump backwards
-      // eg. lastSecond_ = 150, size = 10, second > 140
-      // FIXME: if second > lastSecond_ - kSeconds, push_front()
-
-      size_t idx = second - firstSecond;
-      assert(idx < requests_.size());
-      ++requests_[idx];
-      latencies_[idx] += elapsed_us;
+      // discard
+      // eg. lastSecond_ = 150, second <= 90
+      return;
     }
-    else
+
+    Second& slot = seconds_[second % kSlots];
+    claim(slot, second);
+    // Clears the slot for the next second ahead of time, it holds one out
+    // of the window.  Only after a second without responses is a slot
+    // cleared while in use, which may lose a few of them.
+    claim(seconds_[(second + 1) % kSlots], second + 1);
+    if (slot.second.load() == second)
     {
-      assert(second < firstSecond);
-      // discard
-      // eg. lastSecond_ = 150, size = 10, second <= 140
+      ++slot.requests;
+      slot.latency += elapsed_us;
     }
-    assert(requests_.size() == latencies_.size());
   }
 
   void recordRequest()
   {
-    MutexLockGuard lock(mutex_);
     ++totalRequests_;
   }
 
   void recordBadRequest()
   {
-    MutexLockGuard lock(mutex_);
     ++badRequests_;
   }
 
   void recordDroppedRequest()
   {
-    MutexLockGuard lock(mutex_);
     ++droppedRequests_;
   }
 
+  // costUs is CPU time of solving the puzzle once
+  void recordCacheHit(int64_t costUs)
+  {
+    ++cacheHits_;
+    savedCpuUs_ += costUs;
+  }
+
+  // solved for one, and for waiting ones with the same puzzle
+  void recordSolve(int64_t costUs, int waiting)
+  {
+    ++cacheMisses_;
+    cacheCoalesced_ += waiting;
+    solveCpuUs_ += costUs;
+    savedCpuUs_ += costUs * waiting;
+  }
+
  private:
-  const ThreadPool& pool_;  // only for ThreadPool::queueSize()
-  mutable MutexLock mutex_;
-  // invariant:
-  // 0. requests_.size() == latencies_.size()
-  // 1. if lastSecond_ > 0, requests_.back() is for that second
-  // 2. requests_.front() is for second (last second - size() + 1)
-  time_t lastSecond_;
-  boost::circular_buffer<int64_t> requests_;
-  boost::circular_buffer<int64_t> latencies_;
-  int64_t totalRequests_, totalResponses_, totalSolved_, badRequests_, droppedRequests_, totalLatency_, badLatency_;
-  // FIXME int128_t for totalLatency_;
+  struct Second
+  {
+    std::atomic<int64_t> second;
+    std::atomic<int64_t> requests;
+    std::atomic<int64_t> latency;
+  };
+
+  // stamps and clears slot if it is older than second
+  static void claim(Second& slot, int64_t second)
+  {
+    int64_t stamp = slot.second.load();
+    while (stamp < second)
+    {
+      if (slot.second.compare_exchange_weak(stamp, second))
+      {
+        slot.requests = 0;
+        slot.latency = 0;
+        break;
+      }
+    }
+  }
 
   static const int kSeconds = 60;
-};
+  static const int kSlots = kSeconds + 1;
 
+  const ThreadPool& pool_;  // only for ThreadPool::queueSize()
+  // Counts of the last kSeconds seconds, in slots of second % kSlots.
+  // A slot belongs to the second it is stamped with.
+  Second seconds_[kSlots];
+  std::atomic<int64_t> firstSecond_, lastSecond_;
+  std::atomic<int64_t> totalRequests_, totalResponses_, totalSolved_, badRequests_, droppedRequests_, totalLatency_, badLatency_;
+  std::atomic<int64_t> cacheHits_, cacheCoalesced_, cacheMisses_, solveCpuUs_, savedCpuUs_;
+  ConcurrentHistogram latency_;
+};
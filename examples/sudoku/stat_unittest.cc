@@ -1,12 +1,14 @@
+#include "muduo/base/Histogram.h"
 #include "muduo/base/Logging.h"
 #include "muduo/base/Thread.h"
 #include "muduo/base/ThreadPool.h"
 
-#include <boost/circular_buffer.hpp>
 #define BOOST_TEST_MAIN
 #define BOOST_TEST_DYN_LINK
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
+
 using namespace muduo;
 
 #include "examples/sudoku/stat.h"
@@ -132,3 +134,36 @@ BOOST_AUTO_TEST_CASE(testSudokuStatJumpBack3)
   printf("jump back 3 seconds:\n%s\n", s.report().c_str());
 }
 
+
+BOOST_AUTO_TEST_CASE(testSudokuStatConcurrent)
+{
+  ThreadPool p;
+  SudokuStat s(p);
+
+  const int kThreads = 4;
+  const int kResponses = 10000;
+  time_t start = 1234567890;
+  std::vector<std::unique_ptr<Thread>> threads;
+  for (int t = 0; t < kThreads; ++t)
+  {
+    threads.emplace_back(new Thread([&s, start] {
+      for (int i = 0; i < kResponses; ++i)
+      {
+        Timestamp recv = Timestamp::fromUnixTime(start, 0);
+        Timestamp send = Timestamp::fromUnixTime(start + i / 5000, 100 + i % 100);
+        s.recordResponse(send, recv, true);
+      }
+    }));
+    threads.back()->start();
+  }
+  for (auto& thr : threads)
+  {
+    thr->join();
+  }
+  string report = s.report();
+  printf("concurrent:\n%s\n", report.c_str());
+  BOOST_CHECK(report.find("total_responses 40000\n") != string::npos);
+  BOOST_CHECK(report.find("requests_per_second 20000 20000\n") != string::npos);
+  BOOST_CHECK(report.find("latency_us_max 1000199\n") != string::npos);
+  printf("%s\n", s.latency().c_str());
+}
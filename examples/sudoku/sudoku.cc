@@ -1,7 +1,11 @@
 #include "examples/sudoku/sudoku.h"
 
+#include "muduo/base/noncopyable.h"
+
+#include <memory>
 #include <vector>
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 using namespace muduo;
@@ -30,11 +34,26 @@ extern const char kNoSolution[] = "NoSolution";
 class SudokuSolver
 {
  public:
-    SudokuSolver(int board[kCells])
-      : inout_(board),
+    SudokuSolver()
+      : root_(NULL),
+        inout_(NULL),
         cur_node_(0)
     {
         stack_.reserve(100);
+    }
+
+    explicit SudokuSolver(int board[kCells])
+      : SudokuSolver()
+    {
+        reset(board);
+    }
+
+    // reuses nodes for another board
+    void reset(int board[kCells])
+    {
+        inout_ = board;
+        cur_node_ = 0;
+        stack_.clear();
 
         root_ = new_column();
         root_->left = root_->right = root_;
@@ -260,33 +279,369 @@ class SudokuSolver
     }
 };
 
-string solveSudoku(const StringPiece& puzzle)
+// Bitmask solver: bit d-1 of a cell is set if digit d is a candidate.
+// Cells are held 8 to a vector, so placing a digit takes it from all peers,
+// and all cells are checked for singles, in a few SIMD instructions.
+// Grids are copied on branching, there is nothing to undo.
+
+namespace
 {
-  assert(puzzle.size() == kCells);
+typedef int16_t Lanes __attribute__((vector_size(16)));
+const int kLanes = 8;
+const int kVectors = (kCells + kLanes - 1) / kLanes;
+const int16_t kAllDigits = 0x1FF;
+const int16_t kPadding = 0x200;  // in done of lanes past the last cell
 
-  string result = kNoSolution;
+bool anyLane(Lanes v)
+{
+  uint64_t words[2];
+  memcpy(words, &v, sizeof words);
+  return (words[0] | words[1]) != 0;
+}
 
-  int board[kCells] = { 0 };
+struct BitmaskTables
+{
+  BitmaskTables()
+  {
+    memZero(peers, sizeof peers);
+    for (int i = 0; i < 9; ++i)
+    {
+      for (int j = 0; j < 9; ++j)
+      {
+        units[i][j] = static_cast<int8_t>(i*9 + j);  // rows
+        units[9+i][j] = static_cast<int8_t>(j*9 + i);  // columns
+        units[18+i][j] = static_cast<int8_t>((i/3*3 + j/3)*9 + i%3*3 + j%3);  // boxes
+      }
+    }
+    for (int u = 0; u < kUnits; ++u)
+    {
+      for (int a = 0; a < 9; ++a)
+      {
+        for (int b = 0; b < 9; ++b)
+        {
+          if (a != b)
+          {
+            int cell = units[u][a], peer = units[u][b];
+            peers[cell][peer / kLanes][peer % kLanes] = kAllDigits;
+          }
+        }
+      }
+    }
+  }
+
+  static const int kUnits = 27;
+  Lanes peers[kCells][kVectors];  // kAllDigits in the lanes of peers
+  int8_t units[kUnits][9];  // rows, columns, boxes
+};
+
+class BitmaskSolver : muduo::noncopyable
+{
+ public:
+  BitmaskSolver()
+    : tables_(getTables())
+  {
+  }
+
+  bool solve(int board[kCells])
+  {
+    Grid grid;
+    for (int v = 0; v < kVectors; ++v)
+    {
+      grid.cand[v] = Lanes{} + kAllDigits;
+      grid.done[v] = Lanes{};
+    }
+    for (int i = kCells; i < kVectors * kLanes; ++i)
+    {
+      grid.cand[i / kLanes][i % kLanes] = 0;
+      grid.done[i / kLanes][i % kLanes] = kPadding;
+    }
+    grid.unsolved = kCells;
+
+    for (int i = 0; i < kCells; ++i)
+    {
+      if (board[i] != 0)
+      {
+        if ((get(grid, i) & bitOf(board[i])) == 0)
+        {
+          return false;
+        }
+        place(&grid, i, board[i]);
+      }
+    }
+    if (!search(&grid))
+    {
+      return false;
+    }
+    for (int i = 0; i < kCells; ++i)
+    {
+      board[i] = __builtin_ctz(grid.done[i / kLanes][i % kLanes]) + 1;
+    }
+    return true;
+  }
+
+ private:
+  // a cell has candidates until its digit is placed, then done has it
+  struct Grid
+  {
+    Lanes cand[kVectors];
+    Lanes done[kVectors];
+    int unsolved;
+  };
+
+  static const BitmaskTables& getTables()
+  {
+    static BitmaskTables tables;
+    return tables;
+  }
+
+  static int16_t get(const Grid& grid, int cell)
+  {
+    return grid.cand[cell / kLanes][cell % kLanes];
+  }
+
+  static int16_t bitOf(int digit)
+  {
+    return static_cast<int16_t>(1 << (digit - 1));
+  }
+
+  void place(Grid* grid, int cell, int digit) const
+  {
+    const Lanes* peers = tables_.peers[cell];
+    const int16_t bit = bitOf(digit);
+    for (int v = 0; v < kVectors; ++v)
+    {
+      grid->cand[v] &= ~(peers[v] & bit);
+    }
+    grid->cand[cell / kLanes][cell % kLanes] = 0;
+    grid->done[cell / kLanes][cell % kLanes] = bit;
+    --grid->unsolved;
+  }
+
+  // places singles until there are none, false on a contradiction
+  bool propagate(Grid* grid) const
+  {
+    while (grid->unsolved > 0)
+    {
+      // a cell without candidates, or with one
+      Lanes empty = {};
+      Lanes singles[kVectors];
+      for (int v = 0; v < kVectors; ++v)
+      {
+        const Lanes c = grid->cand[v];
+        empty |= (c | grid->done[v]) == 0;
+        singles[v] = ((c & (c - 1)) == 0) & (c != 0);
+      }
+      if (anyLane(empty))
+      {
+        return false;
+      }
+      bool placed = false;
+      for (int v = 0; v < kVectors; ++v)
+      {
+        if (!anyLane(singles[v]))
+          continue;
+        for (int i = 0; i < kLanes; ++i)
+        {
+          if (singles[v][i] == 0)
+            continue;
+          const int16_t c = grid->cand[v][i];
+          if (c == 0)
+            return false;  // taken by a single placed just now
+          place(grid, v * kLanes + i, __builtin_ctz(c) + 1);
+          placed = true;
+        }
+      }
+      if (placed)
+        continue;
+
+      // a digit with one place left in a unit,
+      // placed digits count as twice, they are no hidden singles
+      int16_t cand[kVectors * kLanes];
+      int16_t done[kVectors * kLanes];
+      memcpy(cand, grid->cand, sizeof cand);
+      memcpy(done, grid->done, sizeof done);
+      int once[BitmaskTables::kUnits] = { 0 };
+      int twice[BitmaskTables::kUnits] = { 0 };
+      for (int row = 0; row < 9; ++row)
+      {
+        for (int col = 0; col < 9; ++col)
+        {
+          const int i = row * 9 + col;
+          const int d = cand[i] | done[i];
+          const int units[3] = { row, 9 + col, 18 + row / 3 * 3 + col / 3 };
+          for (int u : units)
+          {
+            twice[u] |= (once[u] & d) | done[i];
+            once[u] |= d;
+          }
+        }
+      }
+      for (int u = 0; u < BitmaskTables::kUnits; ++u)
+      {
+        if (once[u] != kAllDigits)
+        {
+          return false;
+        }
+        int hidden = once[u] & ~twice[u];
+        while (hidden)
+        {
+          const int digit = __builtin_ctz(hidden) + 1;
+          hidden &= hidden - 1;
+          const int8_t* unit = tables_.units[u];
+          for (int k = 0; k < 9; ++k)
+          {
+            if (get(*grid, unit[k]) & bitOf(digit))
+            {
+              place(grid, unit[k], digit);
+              placed = true;
+              break;
+            }
+          }
+        }
+      }
+      if (!placed)
+        break;
+    }
+    return true;
+  }
+
+  bool search(Grid* grid) const
+  {
+    if (!propagate(grid))
+    {
+      return false;
+    }
+    if (grid->unsolved == 0)
+    {
+      return true;
+    }
+    // branch on the cell with fewest candidates
+    int best = -1;
+    int fewest = 10;
+    for (int i = 0; i < kCells && fewest > 2; ++i)
+    {
+      const int16_t c = get(*grid, i);
+      if (c != 0 && __builtin_popcount(c) < fewest)
+      {
+        best = i;
+        fewest = __builtin_popcount(c);
+      }
+    }
+    int cand = get(*grid, best);
+    while (cand)
+    {
+      const int digit = __builtin_ctz(cand) + 1;
+      cand &= cand - 1;
+      Grid next = *grid;
+      place(&next, best, digit);
+      if (search(&next))
+      {
+        *grid = next;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const BitmaskTables& tables_;
+};
+
+SudokuAlgorithm initDefaultAlgorithm()
+{
+  const char* name = ::getenv("MUDUO_SUDOKU_SOLVER");
+  return name && strcmp(name, "bitmask") == 0 ? kBitmask : kDancingLinks;
+}
+
+const SudokuAlgorithm g_defaultAlgorithm = initDefaultAlgorithm();
+
+bool parsePuzzle(const StringPiece& puzzle, int board[kCells])
+{
   bool valid = true;
   for (int i = 0; i < kCells; ++i)
   {
     board[i] = puzzle[i] - '0';
     valid = valid && (0 <= board[i] && board[i] <= 9);
   }
+  return valid;
+}
+
+string formatBoard(const int board[kCells])
+{
+  string result(kCells, '0');
+  for (int i = 0; i < kCells; ++i)
+  {
+    result[i] = static_cast<char>(board[i] + '0');
+  }
+  return result;
+}
+}  // namespace
+
+SudokuAlgorithm defaultSudokuAlgorithm()
+{
+  return g_defaultAlgorithm;
+}
 
-  if (valid)
+const char* sudokuAlgorithmName(SudokuAlgorithm algorithm)
+{
+  return algorithm == kBitmask ? "bitmask" : "dancing links";
+}
+
+string solveSudoku(const StringPiece& puzzle)
+{
+  return solveSudoku(puzzle, g_defaultAlgorithm);
+}
+
+string solveSudoku(const StringPiece& puzzle, SudokuAlgorithm algorithm)
+{
+  assert(puzzle.size() == kCells);
+
+  int board[kCells] = { 0 };
+  bool solved = false;
+  if (parsePuzzle(puzzle, board))
+  {
+    if (algorithm == kBitmask)
+    {
+      BitmaskSolver s;
+      solved = s.solve(board);
+    }
+    else
+    {
+      SudokuSolver s(board);
+      solved = s.solve();
+    }
+  }
+  return solved ? formatBoard(board) : kNoSolution;
+}
+
+void solveSudokus(const std::vector<string>& puzzles,
+                  std::vector<string>* results,
+                  SudokuAlgorithm algorithm)
+{
+  results->clear();
+  results->reserve(puzzles.size());
+  BitmaskSolver bitmask;
+  std::unique_ptr<SudokuSolver> dancingLinks;
+  if (algorithm == kDancingLinks)
+  {
+    dancingLinks.reset(new SudokuSolver);
+  }
+  int board[kCells] = { 0 };
+  for (const string& puzzle : puzzles)
   {
-    SudokuSolver s(board);
-    if (s.solve())
+    assert(puzzle.size() == kCells);
+    bool solved = false;
+    if (parsePuzzle(puzzle, board))
     {
-      result.clear();
-      result.resize(kCells);
-      for (int i = 0; i < kCells; ++i)
+      if (dancingLinks)
       {
-        result[i] = static_cast<char>(board[i] + '0');
+        dancingLinks->reset(board);
+        solved = dancingLinks->solve();
+      }
+      else
+      {
+        solved = bitmask.solve(board);
       }
     }
+    results->push_back(solved ? formatBoard(board) : kNoSolution);
   }
-  return result;
 }
-
@@ -5,7 +5,24 @@
 #include "muduo/base/Types.h"
 #include "muduo/base/StringPiece.h"
 
+#include <vector>
+
+enum SudokuAlgorithm
+{
+  kDancingLinks,  // Knuth's algorithm X
+  kBitmask,  // constraint propagation over candidate bitmasks, 8 cells at a time
+};
+
+// kDancingLinks, or kBitmask if MUDUO_SUDOKU_SOLVER=bitmask
+SudokuAlgorithm defaultSudokuAlgorithm();
+const char* sudokuAlgorithmName(SudokuAlgorithm algorithm);
+
 muduo::string solveSudoku(const muduo::StringPiece& puzzle);
+muduo::string solveSudoku(const muduo::StringPiece& puzzle, SudokuAlgorithm algorithm);
+// Solves puzzles into results, setting the solver up once for all of them.
+void solveSudokus(const std::vector<muduo::string>& puzzles,
+                  std::vector<muduo::string>* results,
+                  SudokuAlgorithm algorithm);
 const int kCells = 81;
 extern const char kNoSolution[];
 
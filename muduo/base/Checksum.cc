@@ -0,0 +1,174 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include "muduo/base/Checksum.h"
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define MUDUO_HAVE_SSE42_CRC32 1
+#endif
+
+using namespace muduo;
+
+namespace
+{
+
+// reversed Castagnoli polynomial
+const uint32_t kCrc32cPoly = 0x82F63B78;
+
+struct Crc32cTable
+{
+  Crc32cTable()
+  {
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+      uint32_t crc = i;
+      for (int j = 0; j < 8; ++j)
+      {
+        crc = (crc >> 1) ^ ((crc & 1) ? kCrc32cPoly : 0);
+      }
+      table[i] = crc;
+    }
+  }
+
+  uint32_t table[256];
+};
+
+const Crc32cTable g_crc32cTable;
+
+uint32_t crc32cSoftware(const uint8_t* p, size_t len, uint32_t crc)
+{
+  for (size_t i = 0; i < len; ++i)
+  {
+    crc = g_crc32cTable.table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#ifdef MUDUO_HAVE_SSE42_CRC32
+__attribute__((target("sse4.2")))
+uint32_t crc32cHardware(const uint8_t* p, size_t len, uint32_t crc)
+{
+  uint64_t crc64 = crc;
+  while (len >= 8)
+  {
+    uint64_t word;
+    ::memcpy(&word, p, sizeof word);
+    crc64 = _mm_crc32_u64(crc64, word);
+    p += 8;
+    len -= 8;
+  }
+  uint32_t crc32 = static_cast<uint32_t>(crc64);
+  while (len > 0)
+  {
+    crc32 = _mm_crc32_u8(crc32, *p);
+    ++p;
+    --len;
+  }
+  return crc32;
+}
+
+const bool g_hasSse42 = __builtin_cpu_supports("sse4.2");
+#else
+const bool g_hasSse42 = false;
+#endif
+
+const uint32_t kPrime1 = 2654435761U;
+const uint32_t kPrime2 = 2246822519U;
+const uint32_t kPrime3 = 3266489917U;
+const uint32_t kPrime4 =  668265263U;
+const uint32_t kPrime5 =  374761393U;
+
+inline uint32_t rotl(uint32_t x, int r)
+{
+  return (x << r) | (x >> (32 - r));
+}
+
+inline uint32_t read32(const uint8_t* p)
+{
+  uint32_t x;
+  ::memcpy(&x, p, sizeof x);  // little endian only
+  return x;
+}
+
+inline uint32_t xxround(uint32_t acc, uint32_t input)
+{
+  acc += input * kPrime2;
+  acc = rotl(acc, 13);
+  return acc * kPrime1;
+}
+
+}  // namespace
+
+uint32_t Checksum::crc32c(const void* data, size_t len, uint32_t crc)
+{
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  crc = ~crc;
+#ifdef MUDUO_HAVE_SSE42_CRC32
+  if (g_hasSse42)
+  {
+    return ~crc32cHardware(p, len, crc);
+  }
+#endif
+  return ~crc32cSoftware(p, len, crc);
+}
+
+bool Checksum::hasCrc32cInstruction()
+{
+  return g_hasSse42;
+}
+
+uint32_t Checksum::xxhash32(const void* data, size_t len, uint32_t seed)
+{
+  static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "read32");
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  const uint8_t* const end = p + len;
+  uint32_t h;
+
+  if (len >= 16)
+  {
+    const uint8_t* const limit = end - 16;
+    uint32_t v1 = seed + kPrime1 + kPrime2;
+    uint32_t v2 = seed + kPrime2;
+    uint32_t v3 = seed;
+    uint32_t v4 = seed - kPrime1;
+    do
+    {
+      v1 = xxround(v1, read32(p));
+      v2 = xxround(v2, read32(p + 4));
+      v3 = xxround(v3, read32(p + 8));
+      v4 = xxround(v4, read32(p + 12));
+      p += 16;
+    } while (p <= limit);
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+  }
+  else
+  {
+    h = seed + kPrime5;
+  }
+
+  h += static_cast<uint32_t>(len);
+  while (p + 4 <= end)
+  {
+    h += read32(p) * kPrime3;
+    h = rotl(h, 17) * kPrime4;
+    p += 4;
+  }
+  while (p < end)
+  {
+    h += *p * kPrime5;
+    h = rotl(h, 11) * kPrime1;
+    ++p;
+  }
+
+  h ^= h >> 15;
+  h *= kPrime2;
+  h ^= h >> 13;
+  h *= kPrime3;
+  h ^= h >> 16;
+  return h;
+}
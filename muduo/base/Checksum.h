@@ -0,0 +1,35 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#ifndef MUDUO_BASE_CHECKSUM_H
+#define MUDUO_BASE_CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace muduo
+{
+
+///
+/// Checksums faster than zlib's adler32/crc32.
+///
+class Checksum
+{
+ public:
+  /// CRC-32C (Castagnoli), as in iSCSI and ext4.
+  /// Uses the SSE4.2 crc32 instruction if the CPU has it.
+  /// Pass the previous result as crc to checksum data in pieces.
+  static uint32_t crc32c(const void* data, size_t len, uint32_t crc = 0);
+
+  /// true if crc32c() runs on the crc32 instruction
+  static bool hasCrc32cInstruction();
+
+  /// xxHash32 by Yann Collet, not for pieces.
+  static uint32_t xxhash32(const void* data, size_t len, uint32_t seed = 0);
+};
+
+}  // namespace muduo
+
+#endif  // MUDUO_BASE_CHECKSUM_H
@@ -0,0 +1,116 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include "muduo/base/Clock.h"
+
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define MUDUO_HAVE_TSC 1
+#endif
+
+using namespace muduo;
+
+namespace
+{
+
+int64_t readClock(clockid_t clock)
+{
+  struct timespec ts = { 0, 0 };
+  ::clock_gettime(clock, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+bool hasInvariantTsc()
+{
+#ifdef MUDUO_HAVE_TSC
+  unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+  {
+    return (edx & (1u << 8)) != 0;
+  }
+#endif
+  return false;
+}
+
+// written once by calibrateTsc()
+double g_nanosPerTick = 0;
+uint64_t g_baseTsc = 0;
+int64_t g_baseNanos = 0;
+
+}  // namespace
+
+int64_t Clock::monotonicNanos()
+{
+  return readClock(CLOCK_MONOTONIC);
+}
+
+int64_t Clock::coarseMonotonicNanos()
+{
+  return readClock(CLOCK_MONOTONIC_COARSE);
+}
+
+Timestamp Clock::coarseNow()
+{
+  return Timestamp(readClock(CLOCK_REALTIME_COARSE) / 1000);
+}
+
+uint64_t Clock::rdtsc()
+{
+#ifdef MUDUO_HAVE_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+bool Clock::calibrateTsc(double seconds)
+{
+  if (!hasInvariantTsc())
+  {
+    return false;
+  }
+  const int64_t duration = static_cast<int64_t>(seconds * 1e9);
+  int64_t startNanos = monotonicNanos();
+  uint64_t startTsc = rdtsc();
+  int64_t endNanos = startNanos;
+  while (endNanos - startNanos < duration)
+  {
+    endNanos = monotonicNanos();
+  }
+  uint64_t endTsc = rdtsc();
+  if (endTsc <= startTsc)
+  {
+    return false;
+  }
+  g_nanosPerTick = static_cast<double>(endNanos - startNanos)
+                   / static_cast<double>(endTsc - startTsc);
+  g_baseTsc = endTsc;
+  g_baseNanos = endNanos;
+  return true;
+}
+
+bool Clock::tscCalibrated()
+{
+  return g_nanosPerTick > 0;
+}
+
+double Clock::tscGhz()
+{
+  return g_nanosPerTick > 0 ? 1.0 / g_nanosPerTick : 0;
+}
+
+int64_t Clock::tscNanos()
+{
+  if (g_nanosPerTick > 0)
+  {
+    // signed, TSCs of different cores may be a few ticks apart
+    int64_t ticks = static_cast<int64_t>(rdtsc() - g_baseTsc);
+    return g_baseNanos + static_cast<int64_t>(static_cast<double>(ticks) * g_nanosPerTick);
+  }
+  return monotonicNanos();
+}
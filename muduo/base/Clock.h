@@ -0,0 +1,65 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#ifndef MUDUO_BASE_CLOCK_H
+#define MUDUO_BASE_CLOCK_H
+
+#include "muduo/base/Timestamp.h"
+
+#include <stdint.h>
+
+namespace muduo
+{
+
+///
+/// Time sources besides Timestamp::now(), which is wall clock.
+///
+/// Monotonic time doesn't jump with NTP or settimeofday(),
+/// use it for timers and for measuring latency.
+/// Values are since an unspecified point (boot), not since the Epoch,
+/// only differences between them make sense.
+///
+/// 单调时钟，不受系统时间调整影响
+///
+class Clock
+{
+ public:
+  /// CLOCK_MONOTONIC, same clock as timerfd.
+  static int64_t monotonicNanos();
+  static int64_t monotonicMicros() { return monotonicNanos() / 1000; }
+
+  /// CLOCK_MONOTONIC in a Timestamp, for TimerQueue.
+  static Timestamp monotonic()
+  { return Timestamp(monotonicMicros()); }
+
+  /// CLOCK_MONOTONIC_COARSE, cheaper but only one tick (1-4ms) resolution.
+  static int64_t coarseMonotonicNanos();
+
+  /// CLOCK_REALTIME_COARSE, a cheaper Timestamp::now() of tick resolution.
+  static Timestamp coarseNow();
+
+  ///
+  /// Calibrates the time stamp counter against CLOCK_MONOTONIC,
+  /// busy waiting for @c seconds.
+  /// Returns false if the CPU has no invariant TSC, tscNanos() then
+  /// falls back to monotonicNanos().
+  /// Not thread safe, call it once at startup.
+  ///
+  static bool calibrateTsc(double seconds = 0.01);
+  static bool tscCalibrated();
+  /// ticks per nanosecond, 0 if not calibrated
+  static double tscGhz();
+
+  /// raw rdtsc, 0 on other CPUs
+  static uint64_t rdtsc();
+
+  /// rdtsc converted to CLOCK_MONOTONIC nanoseconds.
+  /// Drifts slowly from monotonicNanos(), fine for latency within a process.
+  static int64_t tscNanos();
+};
+
+}  // namespace muduo
+
+#endif  // MUDUO_BASE_CLOCK_H
@@ -35,6 +35,14 @@ class GzipFile : noncopyable
     return *this;
   }
 
+  // flushes the tail, return Z_OK on success, when the data is on disk
+  int close()
+  {
+    gzFile file = file_;
+    file_ = NULL;
+    return file ? ::gzclose(file) : Z_STREAM_ERROR;
+  }
+
   bool valid() const { return file_ != NULL; }
   void swap(GzipFile& rhs) { std::swap(file_, rhs.file_); }
 #if ZLIB_VERNUM >= 0x1240
@@ -55,6 +63,9 @@ class GzipFile : noncopyable
   off_t offset() const { return ::gzoffset(file_); }
 #endif
 
+  // level 0-9, strategy Z_DEFAULT_STRATEGY etc., call before writing
+  bool setParams(int level, int strategy) { return ::gzsetparams(file_, level, strategy) == Z_OK; }
+
   // int flush(int f) { return ::gzflush(file_, f); }
 
   static GzipFile openForRead(StringArg filename)
@@ -0,0 +1,223 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include "muduo/base/Histogram.h"
+
+#include "muduo/base/CurrentThread.h"
+#include "muduo/base/LogStream.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+using namespace muduo;
+
+const int64_t Histogram::kMaxValue;
+
+Histogram::Histogram()
+{
+  reset();
+}
+
+void Histogram::record(int64_t value, int64_t count)
+{
+  if (value < 0)
+  {
+    value = 0;
+  }
+  else if (value > kMaxValue)
+  {
+    value = kMaxValue;
+  }
+  if (count_ == 0 || value < min_)
+  {
+    min_ = value;
+  }
+  if (value > max_)
+  {
+    max_ = value;
+  }
+  count_ += count;
+  sum_ += value * count;
+  counts_[bucketOf(value)] += count;
+}
+
+void Histogram::merge(const Histogram& rhs)
+{
+  if (rhs.count_ == 0)
+  {
+    return;
+  }
+  min_ = count_ == 0 ? rhs.min_ : std::min(min_, rhs.min_);
+  max_ = std::max(max_, rhs.max_);
+  count_ += rhs.count_;
+  sum_ += rhs.sum_;
+  for (int i = 0; i < kBuckets; ++i)
+  {
+    counts_[i] += rhs.counts_[i];
+  }
+}
+
+void Histogram::reset()
+{
+  count_ = 0;
+  sum_ = 0;
+  min_ = 0;
+  max_ = 0;
+  memZero(counts_, sizeof counts_);
+}
+
+int64_t Histogram::bucketLow(int bucket)
+{
+  assert(0 <= bucket && bucket < kBuckets);
+  if (bucket < 2 * kSubBuckets)
+  {
+    return bucket;
+  }
+  const int shift = bucket / kSubBuckets - 1;
+  return static_cast<int64_t>(bucket % kSubBuckets + kSubBuckets) << shift;
+}
+
+int64_t Histogram::bucketHigh(int bucket)
+{
+  return bucket + 1 < kBuckets ? bucketLow(bucket + 1) - 1 : kMaxValue;
+}
+
+int64_t Histogram::percentile(double percent) const
+{
+  if (count_ == 0)
+  {
+    return 0;
+  }
+  int64_t rank = static_cast<int64_t>(std::ceil(static_cast<double>(count_) * percent / 100));
+  rank = std::max<int64_t>(1, std::min(rank, count_));
+  int64_t seen = 0;
+  for (int i = 0; i < kBuckets; ++i)
+  {
+    seen += counts_[i];
+    if (seen >= rank)
+    {
+      return std::max(min_, std::min(bucketHigh(i), max_));
+    }
+  }
+  return max_;
+}
+
+string Histogram::toString() const
+{
+  LogStream os;
+  os << "count " << count_
+     << " min " << min()
+     << " mean " << mean()
+     << " p50 " << percentile(50)
+     << " p90 " << percentile(90)
+     << " p99 " << percentile(99)
+     << " p999 " << percentile(99.9)
+     << " max " << max_;
+  return os.buffer().toString();
+}
+
+string Histogram::distribution() const
+{
+  string result;
+  int64_t seen = 0;
+  char buf[64];
+  for (int i = 0; i < kBuckets; ++i)
+  {
+    if (counts_[i] > 0)
+    {
+      seen += counts_[i];
+      int n = snprintf(buf, sizeof buf, "%" PRId64 " %" PRId64 " %.3f\n",
+                       std::min(bucketHigh(i), max_), counts_[i],
+                       100.0 * static_cast<double>(seen) / static_cast<double>(count_));
+      result.append(buf, n);
+    }
+  }
+  return result;
+}
+
+struct ConcurrentHistogram::Stripe
+{
+  std::atomic<int64_t> counts[Histogram::kBuckets];
+  std::atomic<int64_t> sum;
+  std::atomic<int64_t> min;
+  std::atomic<int64_t> max;
+  char padding[64];  // keeps hot ends of neighbours apart
+};
+
+ConcurrentHistogram::ConcurrentHistogram(int stripes)
+  : numStripes_(stripes),
+    stripes_(new Stripe[stripes])
+{
+  assert(stripes > 0);
+  reset();
+}
+
+ConcurrentHistogram::~ConcurrentHistogram() = default;
+
+void ConcurrentHistogram::record(int64_t value)
+{
+  if (value < 0)
+  {
+    value = 0;
+  }
+  else if (value > Histogram::kMaxValue)
+  {
+    value = Histogram::kMaxValue;
+  }
+  Stripe& stripe = stripes_[CurrentThread::tid() % numStripes_];
+  stripe.counts[Histogram::bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+  stripe.sum.fetch_add(value, std::memory_order_relaxed);
+  int64_t min = stripe.min.load(std::memory_order_relaxed);
+  while (value < min && !stripe.min.compare_exchange_weak(min, value, std::memory_order_relaxed))
+  {
+  }
+  int64_t max = stripe.max.load(std::memory_order_relaxed);
+  while (value > max && !stripe.max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+  {
+  }
+}
+
+Histogram ConcurrentHistogram::snapshot() const
+{
+  Histogram result;
+  result.min_ = Histogram::kMaxValue;
+  for (int s = 0; s < numStripes_; ++s)
+  {
+    const Stripe& stripe = stripes_[s];
+    for (int i = 0; i < Histogram::kBuckets; ++i)
+    {
+      int64_t n = stripe.counts[i].load(std::memory_order_relaxed);
+      result.counts_[i] += n;
+      result.count_ += n;
+    }
+    result.sum_ += stripe.sum.load(std::memory_order_relaxed);
+    result.min_ = std::min(result.min_, stripe.min.load(std::memory_order_relaxed));
+    result.max_ = std::max(result.max_, stripe.max.load(std::memory_order_relaxed));
+  }
+  if (result.count_ == 0)
+  {
+    result.reset();
+  }
+  return result;
+}
+
+void ConcurrentHistogram::reset()
+{
+  for (int s = 0; s < numStripes_; ++s)
+  {
+    Stripe& stripe = stripes_[s];
+    for (int i = 0; i < Histogram::kBuckets; ++i)
+    {
+      stripe.counts[i].store(0, std::memory_order_relaxed);
+    }
+    stripe.sum.store(0, std::memory_order_relaxed);
+    stripe.min.store(Histogram::kMaxValue, std::memory_order_relaxed);
+    stripe.max.store(0, std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,122 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#ifndef MUDUO_BASE_HISTOGRAM_H
+#define MUDUO_BASE_HISTOGRAM_H
+
+#include "muduo/base/copyable.h"
+#include "muduo/base/noncopyable.h"
+#include "muduo/base/Types.h"
+
+#include <atomic>
+#include <memory>
+
+#include <stdint.h>
+
+namespace muduo
+{
+
+///
+/// Counts of non-negative values in log-linear buckets, as HdrHistogram does.
+/// Values below 64 have buckets of their own, every power of two above is
+/// split into 32 buckets, so a percentile is off by at most 1/32 of itself.
+/// Memory is constant, about 9KiB, whatever the number of values.
+///
+/// Not thread safe, see ConcurrentHistogram.
+///
+class Histogram : public muduo::copyable
+{
+ public:
+  static const int kSubBucketBits = 5;
+  static const int kSubBuckets = 1 << kSubBucketBits;
+  static const int kMaxValueBits = 40;
+  static const int kBuckets = (kMaxValueBits - kSubBucketBits + 1) * kSubBuckets;
+  /// larger values are counted as kMaxValue, negative ones as 0
+  static const int64_t kMaxValue = (static_cast<int64_t>(1) << kMaxValueBits) - 1;
+
+  Histogram();
+
+  void record(int64_t value)
+  {
+    record(value, 1);
+  }
+
+  void record(int64_t value, int64_t count);
+  void merge(const Histogram& rhs);
+  void reset();
+
+  int64_t count() const { return count_; }
+  int64_t sum() const { return sum_; }
+  /// 0 if empty
+  int64_t min() const { return count_ > 0 ? min_ : 0; }
+  int64_t max() const { return max_; }
+  int64_t mean() const { return count_ > 0 ? sum_ / count_ : 0; }
+
+  /// The nearest rank, eg. 99.9 for p999.
+  /// Returns the largest value of its bucket, but no more than max().
+  int64_t percentile(double percent) const;
+
+  /// "count 100 min 3 mean 9 p50 8 p90 15 p99 31 p999 33 max 33"
+  string toString() const;
+
+  /// one line per non-empty bucket:
+  /// <largest value of bucket> <count> <cumulative percent>
+  string distribution() const;
+
+  static int bucketOf(int64_t value)
+  {
+    if (value < 2 * kSubBuckets)
+    {
+      return value > 0 ? static_cast<int>(value) : 0;
+    }
+    if (value > kMaxValue)
+    {
+      value = kMaxValue;
+    }
+    const int shift = 63 - __builtin_clzll(static_cast<uint64_t>(value)) - kSubBucketBits;
+    return (shift + 1) * kSubBuckets + static_cast<int>(value >> shift) - kSubBuckets;
+  }
+
+  static int64_t bucketLow(int bucket);
+  static int64_t bucketHigh(int bucket);
+
+ private:
+  friend class ConcurrentHistogram;
+
+  int64_t count_;
+  int64_t sum_;
+  int64_t min_;
+  int64_t max_;
+  int64_t counts_[kBuckets];
+};
+
+///
+/// A Histogram recorded by many threads without locking.
+///
+/// Threads record into stripes of their own, picked by thread id, with relaxed
+/// atomic adds, so that they seldom share a cache line.  snapshot() sums up
+/// the stripes, also without locking; records in flight may be missed.
+///
+class ConcurrentHistogram : noncopyable
+{
+ public:
+  explicit ConcurrentHistogram(int stripes = 8);
+  ~ConcurrentHistogram();
+
+  void record(int64_t value);
+  Histogram snapshot() const;
+  /// records in flight may survive
+  void reset();
+
+ private:
+  struct Stripe;
+
+  const int numStripes_;
+  std::unique_ptr<Stripe[]> stripes_;
+};
+
+}  // namespace muduo
+
+#endif  // MUDUO_BASE_HISTOGRAM_H
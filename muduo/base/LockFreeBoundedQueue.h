@@ -0,0 +1,300 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#ifndef MUDUO_BASE_LOCKFREEBOUNDEDQUEUE_H
+#define MUDUO_BASE_LOCKFREEBOUNDEDQUEUE_H
+
+#include "muduo/base/noncopyable.h"
+
+#include <atomic>
+#include <memory>
+
+#include <assert.h>
+#include <linux/futex.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace muduo
+{
+
+namespace detail
+{
+
+inline void futexWait(std::atomic<int>* addr, int expected)
+{
+  ::syscall(SYS_futex, reinterpret_cast<int*>(addr), FUTEX_WAIT_PRIVATE,
+            expected, NULL, NULL, 0);
+}
+
+inline void futexWake(std::atomic<int>* addr, int count)
+{
+  ::syscall(SYS_futex, reinterpret_cast<int*>(addr), FUTEX_WAKE_PRIVATE,
+            count, NULL, NULL, 0);
+}
+
+// Lets threads sleep until notified, costs one load when no one sleeps.
+//
+// Low 32 bits of state_ count waiters, high 32 bits are the epoch
+// threads sleep on.  notify() bumps the epoch, clears the count and
+// wakes everyone, so following notify()s are free until someone
+// waits again.
+class EventCount : noncopyable
+{
+ public:
+  EventCount()
+    : state_(0)
+  {
+  }
+
+  // call after making the condition true
+  void notify()
+  {
+    // pairs with prepareWait(): either we see the waiter,
+    // or it sees the condition.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t state = state_.load(std::memory_order_relaxed);
+    while ((state & kWaiterMask) != 0)
+    {
+      uint64_t next = (state & ~kWaiterMask) + kEpochIncrement;
+      if (state_.compare_exchange_weak(state, next))
+      {
+        futexWake(epoch(), INT32_MAX);
+        break;
+      }
+    }
+  }
+
+  // 1. key = prepareWait()
+  // 2. check the condition again, cancelWait(key) if true
+  // 3. wait(key)
+  int prepareWait()
+  {
+    uint64_t state = state_.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return static_cast<int>(state >> 32);
+  }
+
+  void cancelWait(int key)
+  {
+    uint64_t state = state_.load(std::memory_order_relaxed);
+    // a notify() in between has cleared our count already
+    while (static_cast<int>(state >> 32) == key && (state & kWaiterMask) != 0)
+    {
+      if (state_.compare_exchange_weak(state, state - 1))
+        break;
+    }
+  }
+
+  void wait(int key)
+  {
+    // returns at once if notify() has bumped the epoch since prepareWait()
+    futexWait(epoch(), key);
+  }
+
+ private:
+  static const uint64_t kWaiterMask = 0xffffffff;
+  static const uint64_t kEpochIncrement = uint64_t(1) << 32;
+
+  std::atomic<int>* epoch()
+  {
+    static_assert(sizeof(std::atomic<int>) == sizeof(int), "futex word");
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return reinterpret_cast<std::atomic<int>*>(&state_) + 1;
+#else
+    return reinterpret_cast<std::atomic<int>*>(&state_);
+#endif
+  }
+
+  std::atomic<uint64_t> state_;
+};
+
+}  // namespace detail
+
+///
+/// Bounded multi-producer multi-consumer queue, after Dmitry Vyukov's
+/// "Bounded MPMC queue".
+///
+/// Same put()/take() as BoundedBlockingQueue, no mutex on the fast path,
+/// threads sleep on a futex only when the queue is full or empty.
+/// Capacity is rounded up to a power of 2.
+/// T must be default constructible.
+///
+template<typename T>
+class LockFreeBoundedQueue : noncopyable
+{
+ public:
+  explicit LockFreeBoundedQueue(int maxSize)
+    : mask_(roundUp(maxSize) - 1),
+      buffer_(new Cell[mask_ + 1]),
+      enqueuePos_(0),
+      dequeuePos_(0)
+  {
+    for (size_t i = 0; i <= mask_; ++i)
+    {
+      buffer_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  void put(const T& x)
+  {
+    T copy(x);
+    put(std::move(copy));
+  }
+
+  void put(T&& x)
+  {
+    for (int i = 0; i < kSpins; ++i)
+    {
+      if (tryPut(std::move(x)))
+        return;
+    }
+    while (true)
+    {
+      int key = notFull_.prepareWait();
+      if (tryPut(std::move(x)))
+      {
+        notFull_.cancelWait(key);
+        return;
+      }
+      notFull_.wait(key);
+      if (tryPut(std::move(x)))
+        return;
+    }
+  }
+
+  T take()
+  {
+    T x;
+    for (int i = 0; i < kSpins; ++i)
+    {
+      if (tryTake(&x))
+        return x;
+    }
+    while (true)
+    {
+      int key = notEmpty_.prepareWait();
+      if (tryTake(&x))
+      {
+        notEmpty_.cancelWait(key);
+        return x;
+      }
+      notEmpty_.wait(key);
+      if (tryTake(&x))
+        return x;
+    }
+  }
+
+  // returns false if full, x is untouched then
+  bool tryPut(T&& x)
+  {
+    Cell* cell = NULL;
+    size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      cell = &buffer_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0)
+      {
+        if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = std::move(x);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    notEmpty_.notify();
+    return true;
+  }
+
+  // returns false if empty
+  bool tryTake(T* x)
+  {
+    Cell* cell = NULL;
+    size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      cell = &buffer_[pos & mask_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0)
+      {
+        if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = dequeuePos_.load(std::memory_order_relaxed);
+      }
+    }
+    *x = std::move(cell->data);
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    notFull_.notify();
+    return true;
+  }
+
+  // approximate if other threads are working on it
+  size_t size() const
+  {
+    size_t tail = enqueuePos_.load(std::memory_order_relaxed);
+    size_t head = dequeuePos_.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+
+  bool empty() const { return size() == 0; }
+  bool full() const { return size() >= capacity(); }
+  size_t capacity() const { return mask_ + 1; }
+
+ private:
+  static const int kSpins = 64;
+  static const size_t kCacheLine = 64;
+
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  static size_t roundUp(int n)
+  {
+    assert(n > 0);
+    size_t size = 2;
+    while (size < static_cast<size_t>(n))
+    {
+      size *= 2;
+    }
+    return size;
+  }
+
+  // each counter on its own cache line, producers and consumers
+  // don't bounce each other's.
+  char pad0_[kCacheLine];
+  const size_t mask_;
+  const std::unique_ptr<Cell[]> buffer_;
+  char pad1_[kCacheLine];
+  std::atomic<size_t> enqueuePos_;
+  char pad2_[kCacheLine];
+  std::atomic<size_t> dequeuePos_;
+  char pad3_[kCacheLine];
+  detail::EventCount notEmpty_;
+  char pad4_[kCacheLine];
+  detail::EventCount notFull_;
+};
+
+}  // namespace muduo
+
+#endif  // MUDUO_BASE_LOCKFREEBOUNDEDQUEUE_H
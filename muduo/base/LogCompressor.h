@@ -0,0 +1,247 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#ifndef MUDUO_BASE_LOGCOMPRESSOR_H
+#define MUDUO_BASE_LOGCOMPRESSOR_H
+
+#include "muduo/base/BlockingQueue.h"
+#include "muduo/base/GzipFile.h"
+#include "muduo/base/Logging.h"
+#include "muduo/base/Mutex.h"
+#include "muduo/base/Thread.h"
+
+#include <atomic>
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace muduo
+{
+
+///
+/// Gzips completed log files in a low-priority background thread,
+/// then removes the originals.
+///
+/// Header only like GzipFile.h, link with -lz.
+///
+///   LogCompressor compressor;
+///   compressor.start();
+///   logFile.setRollCallback(
+///       std::bind(&LogCompressor::compress, &compressor, _1));
+///
+class LogCompressor : noncopyable
+{
+ public:
+  struct Stats
+  {
+    int64_t files;
+    int64_t inputBytes;
+    int64_t outputBytes;
+    double cpuSeconds;   // spent compressing
+    double wallSeconds;  // including throttling
+
+    Stats()
+      : files(0), inputBytes(0), outputBytes(0),
+        cpuSeconds(0), wallSeconds(0)
+    {
+    }
+  };
+
+  /// @param level zlib compression level, 1 (fast) to 9 (best)
+  /// @param cpuBudget fraction of one core to use, in (0, 1]
+  /// @param niceness of the compressing thread, 19 is the lowest priority
+  explicit LogCompressor(int level = 6,
+                         double cpuBudget = 0.25,
+                         int niceness = 19)
+    : level_(level),
+      cpuBudget_(cpuBudget),
+      niceness_(niceness),
+      running_(false),
+      thread_(std::bind(&LogCompressor::threadFunc, this), "LogCompressor")
+  {
+    assert(0 < cpuBudget_ && cpuBudget_ <= 1.0);
+  }
+
+  ~LogCompressor()
+  {
+    if (running_)
+    {
+      stop();
+    }
+  }
+
+  void start()
+  {
+    assert(!running_);
+    running_ = true;
+    thread_.start();
+  }
+
+  /// Compresses all queued files before returning.
+  void stop()
+  {
+    assert(running_);
+    running_ = false;
+    queue_.put(string());  // poison pill
+    thread_.join();
+  }
+
+  /// Thread safe, returns immediately.
+  void compress(const string& filename)
+  {
+    assert(!filename.empty());
+    queue_.put(filename);
+  }
+
+  size_t pending() const { return queue_.size(); }
+
+  Stats stats() const
+  {
+    MutexLockGuard lock(mutex_);
+    return stats_;
+  }
+
+  /// Compresses filename to filename.gz in the calling thread,
+  /// sleeping between chunks so that it uses at most cpuBudget of a core.
+  /// Removes filename only after filename.gz is closed and holds all of it.
+  static bool compressFile(const string& filename,
+                           int level,
+                           double cpuBudget,
+                           Stats* stats)
+  {
+    FILE* in = ::fopen(filename.c_str(), "rbe");
+    if (in == NULL)
+    {
+      LOG_SYSERR << "LogCompressor open " << filename;
+      return false;
+    }
+    const string gzname = filename + ".gz";
+    GzipFile out = GzipFile::openForWriteExclusive(gzname);
+    if (!out.valid())
+    {
+      LOG_SYSERR << "LogCompressor open " << gzname;
+      ::fclose(in);
+      return false;
+    }
+#if ZLIB_VERNUM >= 0x1240
+    out.setBuffer(kChunkSize);
+#endif
+    out.setParams(level, Z_DEFAULT_STRATEGY);
+
+    const double wallStart = nowSeconds(CLOCK_MONOTONIC);
+    double cpuSeconds = 0;
+    int64_t inputBytes = 0;
+    bool ok = true;
+    std::unique_ptr<char[]> buf(new char[kChunkSize]);
+    size_t n = 0;
+    while (ok && (n = ::fread(buf.get(), 1, kChunkSize, in)) > 0)
+    {
+      double cpuStart = nowSeconds(CLOCK_THREAD_CPUTIME_ID);
+      ok = out.write(StringPiece(buf.get(), static_cast<int>(n))) == static_cast<int>(n);
+      double cpu = nowSeconds(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+      cpuSeconds += cpu;
+      inputBytes += n;
+      if (cpuBudget < 1.0)
+      {
+        // idle long enough that cpu / (cpu + idle) == cpuBudget
+        double idle = cpu * (1.0 - cpuBudget) / cpuBudget;
+        ::usleep(static_cast<useconds_t>(idle * 1000 * 1000));
+      }
+    }
+    ok = ok && !::ferror(in);
+    // everything read from the file went into the gzip stream
+    struct stat st;
+    ok = ok && ::fstat(::fileno(in), &st) == 0 && st.st_size == inputBytes
+            && out.tell() == inputBytes;
+    ::fclose(in);
+    // gzclose() writes the tail, eg. ENOSPC shows up here
+    const int closed = out.close();
+    if (closed != Z_OK)
+    {
+      LOG_ERROR << "LogCompressor gzclose " << gzname << " " << closed;
+      ok = false;
+    }
+
+    if (ok && ::stat(gzname.c_str(), &st) == 0)
+    {
+      ::unlink(filename.c_str());
+      double wallSeconds = nowSeconds(CLOCK_MONOTONIC) - wallStart;
+      LOG_INFO << "LogCompressor " << filename << " " << inputBytes
+               << " -> " << st.st_size << " bytes, ratio "
+               << (st.st_size > 0 ? static_cast<double>(inputBytes) / static_cast<double>(st.st_size) : 0)
+               << ", " << (cpuSeconds > 0 ? static_cast<double>(inputBytes) / cpuSeconds / 1e6 : 0)
+               << " MB/s cpu, " << wallSeconds << " s wall";
+      if (stats)
+      {
+        stats->files += 1;
+        stats->inputBytes += inputBytes;
+        stats->outputBytes += st.st_size;
+        stats->cpuSeconds += cpuSeconds;
+        stats->wallSeconds += wallSeconds;
+      }
+      return true;
+    }
+    else
+    {
+      LOG_ERROR << "LogCompressor failed on " << filename << ", keep it";
+      ::unlink(gzname.c_str());
+      return false;
+    }
+  }
+
+  static const int kChunkSize = 64*1024;
+
+ private:
+  static double nowSeconds(clockid_t clock)
+  {
+    struct timespec ts = { 0, 0 };
+    ::clock_gettime(clock, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+  }
+
+  void threadFunc()
+  {
+    // on Linux, nice value is per thread
+    if (::setpriority(PRIO_PROCESS, CurrentThread::tid(), niceness_) < 0)
+    {
+      LOG_SYSERR << "LogCompressor setpriority " << niceness_;
+    }
+    while (true)
+    {
+      string filename = queue_.take();
+      if (filename.empty())
+      {
+        break;
+      }
+      Stats stats;
+      if (compressFile(filename, level_, cpuBudget_, &stats))
+      {
+        MutexLockGuard lock(mutex_);
+        stats_.files += stats.files;
+        stats_.inputBytes += stats.inputBytes;
+        stats_.outputBytes += stats.outputBytes;
+        stats_.cpuSeconds += stats.cpuSeconds;
+        stats_.wallSeconds += stats.wallSeconds;
+      }
+    }
+  }
+
+  const int level_;
+  const double cpuBudget_;
+  const int niceness_;
+  std::atomic<bool> running_;
+  BlockingQueue<string> queue_;
+  Thread thread_;
+  mutable MutexLock mutex_;
+  Stats stats_ GUARDED_BY(mutex_);
+};
+
+}  // namespace muduo
+
+#endif  // MUDUO_BASE_LOGCOMPRESSOR_H
@@ -11,6 +11,7 @@
 // 类型
 #include "muduo/base/Types.h"
 
+#include <functional>
 #include <memory>
 
 namespace muduo
@@ -24,6 +25,9 @@ class AppendFile;
 class LogFile : noncopyable
 {
  public:
+  // called with the name of the completed file, after it has been closed.
+  typedef std::function<void (const string& filename)> RollCallback;
+
   LogFile(const string& basename,
           off_t rollSize,
           bool threadSafe = true,
@@ -35,6 +39,11 @@ class LogFile : noncopyable
   void flush();
   bool rollFile();
 
+  /// Not thread safe, set it before appending.
+  /// Eg. hand completed files to a LogCompressor.
+  void setRollCallback(const RollCallback& cb)
+  { rollCallback_ = cb; }
+
  private:
   void append_unlocked(const char* logline, int len);
 
@@ -52,6 +61,8 @@ class LogFile : noncopyable
   time_t lastRoll_;
   time_t lastFlush_;
   std::unique_ptr<FileUtil::AppendFile> file_;
+  string filename_;  // 当前正在写的文件
+  RollCallback rollCallback_;
 
   const static int kRollPerSeconds_ = 60*60*24;
 };
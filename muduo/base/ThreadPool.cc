@@ -5,7 +5,9 @@
 
 #include "muduo/base/ThreadPool.h"
 
+#include "muduo/base/Clock.h"
 #include "muduo/base/Exception.h"
+#include "muduo/base/LogStream.h"
 
 #include <assert.h>
 #include <stdio.h>
@@ -17,9 +19,12 @@ ThreadPool::ThreadPool(const string& nameArg)
     notEmpty_(mutex_),
     notFull_(mutex_),
     name_(nameArg),
+    queued_(0),
     maxQueueSize_(0),
+    waitStats_(false),
     running_(false)
 {
+  setPriorityLevels(1);
 }
 
 ThreadPool::~ThreadPool()
@@ -30,6 +35,16 @@ ThreadPool::~ThreadPool()
   }
 }
 
+void ThreadPool::setPriorityLevels(int levels)
+{
+  assert(levels > 0);
+  assert(threads_.empty());
+  MutexLockGuard lock(mutex_);
+  assert(queued_ == 0);
+  queues_.resize(levels);
+  stats_.reset(new Stats[levels]);
+}
+
 void ThreadPool::start(int numThreads)
 {
   assert(threads_.empty());
@@ -66,10 +81,15 @@ void ThreadPool::stop()
 size_t ThreadPool::queueSize() const
 {
   MutexLockGuard lock(mutex_);
-  return queue_.size();
+  return queued_;
+}
+
+bool ThreadPool::run(Task task)
+{
+  return run(std::move(task), 0);
 }
 
-void ThreadPool::run(Task task)
+bool ThreadPool::run(Task task, int priority, Timestamp deadline, Task onExpired)
 {
   if (threads_.empty())
   {
@@ -77,44 +97,133 @@ void ThreadPool::run(Task task)
   }
   else
   {
+    Entry entry;
+    entry.task = std::move(task);
+    entry.onExpired = std::move(onExpired);
+    if (waitStats_)
+    {
+      entry.enqueued = Clock::monotonic();
+    }
+    entry.deadline = deadline;
+
     MutexLockGuard lock(mutex_);
+    assert(0 <= priority && static_cast<size_t>(priority) < queues_.size());
     while (isFull() && running_)
     {
       notFull_.wait();
     }
-    if (!running_) return;
+    if (!running_) return false;
     assert(!isFull());
 
-    queue_.push_back(std::move(task));
+    queues_[priority].push_back(std::move(entry));
+    ++queued_;
     notEmpty_.notify();
   }
+  return true;
 }
 
 ThreadPool::Task ThreadPool::take()
 {
-  MutexLockGuard lock(mutex_);
-  // always use a while-loop, due to spurious wakeup
-  while (queue_.empty() && running_)
+  while (true)
   {
-    notEmpty_.wait();
-  }
-  Task task;
-  if (!queue_.empty())
-  {
-    task = queue_.front();
-    queue_.pop_front();
+    Entry entry;
+    size_t priority = 0;
+    {
+    MutexLockGuard lock(mutex_);
+    // always use a while-loop, due to spurious wakeup
+    while (queued_ == 0 && running_)
+    {
+      notEmpty_.wait();
+    }
+    if (queued_ == 0)
+    {
+      return Task();
+    }
+
+    priority = queues_.size() - 1;
+    while (queues_[priority].empty())
+    {
+      --priority;
+    }
+    std::deque<Entry>& queue = queues_[priority];
+    entry = std::move(queue.front());
+    queue.pop_front();
+    --queued_;
     if (maxQueueSize_ > 0)
     {
       notFull_.notify();
     }
+    }
+
+    // not holding the lock
+    Stats& stats = stats_[priority];
+    Timestamp now;
+    if (entry.deadline.valid() || waitStats_)
+    {
+      now = Clock::monotonic();
+    }
+    if (entry.deadline.valid() && entry.deadline < now)
+    {
+      stats.expired.increment();
+      if (entry.onExpired)
+      {
+        entry.onExpired();
+      }
+      continue;
+    }
+    if (waitStats_)
+    {
+      int64_t waitUs = now.microSecondsSinceEpoch() - entry.enqueued.microSecondsSinceEpoch();
+      int bucket = 0;
+      while (bucket < kWaitBuckets - 1 && waitUs >= (int64_t(1) << bucket))
+      {
+        ++bucket;
+      }
+      stats.waitHistogram[bucket].increment();
+      stats.waitSumUs.add(waitUs);
+    }
+    stats.run.increment();
+    return std::move(entry.task);
   }
-  return task;
 }
 
 bool ThreadPool::isFull() const
 {
   mutex_.assertLocked();
-  return maxQueueSize_ > 0 && queue_.size() >= maxQueueSize_;
+  return maxQueueSize_ > 0 && queued_ >= maxQueueSize_;
+}
+
+string ThreadPool::report() const
+{
+  LogStream result;
+  MutexLockGuard lock(mutex_);
+  result << "task_queue_size " << queued_ << '\n';
+  for (size_t p = 0; p < queues_.size(); ++p)
+  {
+    Stats& stats = stats_[p];
+    int64_t run = stats.run.get();
+    result << "priority_" << p << "_queued " << queues_[p].size() << '\n';
+    result << "priority_" << p << "_run " << run << '\n';
+    result << "priority_" << p << "_expired " << stats.expired.get() << '\n';
+    if (!waitStats_)
+    {
+      continue;
+    }
+    result << "priority_" << p << "_wait_us_avg "
+           << (run == 0 ? 0 : stats.waitSumUs.get() / run) << '\n';
+    // <upper bound in us>:<count>, non-empty buckets only
+    result << "priority_" << p << "_wait_us_histogram";
+    for (int i = 0; i < kWaitBuckets; ++i)
+    {
+      int64_t count = stats.waitHistogram[i].get();
+      if (count > 0)
+      {
+        result << ' ' << (int64_t(1) << i) << ':' << count;
+      }
+    }
+    result << '\n';
+  }
+  return result.buffer().toString();
 }
 
 void ThreadPool::runInThread()
@@ -6,12 +6,15 @@
 #ifndef MUDUO_BASE_THREADPOOL_H
 #define MUDUO_BASE_THREADPOOL_H
 
+#include "muduo/base/Atomic.h"
 #include "muduo/base/Condition.h"
 #include "muduo/base/Mutex.h"
 #include "muduo/base/Thread.h"
+#include "muduo/base/Timestamp.h"
 #include "muduo/base/Types.h"
 
 #include <deque>
+#include <memory>
 #include <vector>
 
 namespace muduo
@@ -29,6 +32,14 @@ class ThreadPool : noncopyable
   void setMaxQueueSize(int maxSize) { maxQueueSize_ = maxSize; }
   void setThreadInitCallback(const Task& cb)
   { threadInitCallback_ = cb; }
+  // Must be called before start().
+  // Tasks of higher priority are taken first, FIFO within one priority.
+  // Low priorities could starve, give them deadlines.
+  void setPriorityLevels(int levels);
+  // Must be called before start().
+  // Measures how long tasks wait in the queue, for report(),
+  // at the cost of reading the clock twice per task.
+  void setWaitStats(bool on) { waitStats_ = on; }
 
   void start(int numThreads);
   void stop();
@@ -39,14 +50,46 @@ class ThreadPool : noncopyable
   size_t queueSize() const;
 
   // Could block if maxQueueSize > 0
-  // Call after stop() will return immediately.
+  // Call after stop() will return false immediately, f is dropped.
   // There is no move-only version of std::function in C++ as of C++14.
   // So we don't need to overload a const& and an && versions
   // as we do in (Bounded)BlockingQueue.
   // https://stackoverflow.com/a/25408989
-  void run(Task f);
+  bool run(Task f);
+
+  // priority in [0, levels), 0 is the lowest, run(f) uses 0.
+  // If still queued after deadline, f is dropped and onExpired is run instead.
+  // deadline is in Clock::monotonic() time.
+  bool run(Task f,
+           int priority,
+           Timestamp deadline = Timestamp::invalid(),
+           Task onExpired = Task());
+
+  // text of per-priority counters and queue wait histogram if
+  // setWaitStats(), eg. for Inspector.
+  string report() const;
+
+  // bucket i counts waits in [2^(i-1), 2^i) microseconds, bucket 0 for < 1us
+  static const int kWaitBuckets = 32;
 
  private:
+  struct Entry
+  {
+    Task task;
+    Task onExpired;
+    Timestamp enqueued;  // valid if waitStats_
+    Timestamp deadline;
+  };
+
+  // counted by workers outside of mutex_
+  struct Stats
+  {
+    AtomicInt64 run;
+    AtomicInt64 expired;
+    AtomicInt64 waitSumUs;
+    AtomicInt64 waitHistogram[kWaitBuckets];
+  };
+
   bool isFull() const REQUIRES(mutex_);
   void runInThread();
   Task take();
@@ -57,8 +100,12 @@ class ThreadPool : noncopyable
   string name_;
   Task threadInitCallback_;
   std::vector<std::unique_ptr<muduo::Thread>> threads_;
-  std::deque<Task> queue_ GUARDED_BY(mutex_);
+  // one queue per priority
+  std::vector<std::deque<Entry>> queues_ GUARDED_BY(mutex_);
+  std::unique_ptr<Stats[]> stats_;  // one per priority
+  size_t queued_ GUARDED_BY(mutex_);
   size_t maxQueueSize_;
+  bool waitStats_;
   bool running_;
 };
 
@@ -0,0 +1,498 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include "muduo/base/WorkStealingThreadPool.h"
+
+#include "muduo/base/Exception.h"
+
+#include <algorithm>
+
+#include <assert.h>
+#include <sched.h>
+#include <stdio.h>
+
+using namespace muduo;
+
+namespace
+{
+
+// which pool and worker the current thread belongs to
+__thread const WorkStealingThreadPool* t_pool = NULL;
+__thread int t_workerIndex = -1;
+
+const int kSpinsBeforePark = 16;
+const size_t kInjectBatch = 32;
+
+}  // namespace
+
+// Bounded Chase-Lev deque, after
+// "Correct and Efficient Work-Stealing for Weak Memory Models", PPoPP'13.
+// When full, the owner falls back to its injection queue,
+// so the array never grows and needs no memory reclamation.
+class WorkStealingThreadPool::Deque : noncopyable
+{
+ public:
+  Deque()
+    : top_(0),
+      bottom_(0)
+  {
+    for (auto& slot : slots_)
+    {
+      slot.store(NULL, std::memory_order_relaxed);
+    }
+  }
+
+  // owner only
+  bool push(Task* task)
+  {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_acquire);
+    if (b - t >= kCapacity)
+    {
+      return false;
+    }
+    slots_[b & kMask].store(task, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // owner only, LIFO
+  Task* pop()
+  {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    Task* task = NULL;
+    if (t <= b)
+    {
+      task = slots_[b & kMask].load(std::memory_order_relaxed);
+      if (t == b)
+      {
+        // the last one, race against thieves
+        if (!top_.compare_exchange_strong(t, t + 1,
+                                          std::memory_order_seq_cst,
+                                          std::memory_order_relaxed))
+        {
+          task = NULL;
+        }
+        bottom_.store(b + 1, std::memory_order_relaxed);
+      }
+    }
+    else
+    {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+  }
+
+  // any thread, FIFO
+  Task* steal()
+  {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t < b)
+    {
+      Task* task = slots_[t & kMask].load(std::memory_order_relaxed);
+      if (top_.compare_exchange_strong(t, t + 1,
+                                       std::memory_order_seq_cst,
+                                       std::memory_order_relaxed))
+      {
+        return task;
+      }
+    }
+    return NULL;
+  }
+
+ private:
+  static const int64_t kCapacity = 1024;
+  static const int64_t kMask = kCapacity - 1;
+
+  // top_ is written by thieves, bottom_ by the owner
+  std::atomic<int64_t> top_;
+  char pad_[64];
+  std::atomic<int64_t> bottom_;
+  std::atomic<Task*> slots_[kCapacity];
+};
+
+struct WorkStealingThreadPool::Worker : noncopyable
+{
+  explicit Worker(int idx)
+    : injectedSize(0),
+      index(idx)
+  {
+  }
+
+  // only after all threads are joined
+  ~Worker()
+  {
+    while (Task* task = deque.pop())
+    {
+      delete task;
+    }
+    for (Task* task : injected)
+    {
+      delete task;
+    }
+  }
+
+  Deque deque;
+  MutexLock mutex;
+  std::deque<Task*> injected GUARDED_BY(mutex);
+  // skips empty injection queues without locking
+  std::atomic<size_t> injectedSize;
+  const int index;
+};
+
+WorkStealingThreadPool::WorkStealingThreadPool(const string& nameArg)
+  : name_(nameArg),
+    maxQueueSize_(0),
+    running_(false),
+    pending_(0),
+    nextWorker_(0),
+    steals_(0),
+    idleMutex_(),
+    notEmpty_(idleMutex_),
+    sleepers_(0),
+    fullMutex_(),
+    notFull_(fullMutex_),
+    waiters_(0)
+{
+}
+
+WorkStealingThreadPool::~WorkStealingThreadPool()
+{
+  if (running_)
+  {
+    stop();
+  }
+}
+
+void WorkStealingThreadPool::start(int numThreads)
+{
+  assert(threads_.empty());
+  running_ = true;
+  // all workers must exist before any thread starts stealing
+  workers_.reserve(numThreads);
+  for (int i = 0; i < numThreads; ++i)
+  {
+    workers_.emplace_back(new Worker(i));
+  }
+  threads_.reserve(numThreads);
+  for (int i = 0; i < numThreads; ++i)
+  {
+    char id[32];
+    snprintf(id, sizeof id, "%d", i+1);
+    threads_.emplace_back(new muduo::Thread(
+          std::bind(&WorkStealingThreadPool::runInThread, this, workers_[i].get()), name_+id));
+    threads_[i]->start();
+  }
+  if (numThreads == 0 && threadInitCallback_)
+  {
+    threadInitCallback_();
+  }
+}
+
+void WorkStealingThreadPool::stop()
+{
+  running_ = false;
+  {
+  MutexLockGuard lock(idleMutex_);
+  notEmpty_.notifyAll();
+  }
+  {
+  MutexLockGuard lock(fullMutex_);
+  notFull_.notifyAll();
+  }
+  for (auto& thr : threads_)
+  {
+    thr->join();
+  }
+}
+
+void WorkStealingThreadPool::run(Task task)
+{
+  if (workers_.empty())
+  {
+    task();
+  }
+  else if (reserve(1) > 0)
+  {
+    Task* p = new Task(std::move(task));
+    submit(&p, 1, -1);
+  }
+}
+
+void WorkStealingThreadPool::run(Task task, int affinity)
+{
+  assert(affinity >= 0);
+  if (workers_.empty())
+  {
+    task();
+  }
+  else if (reserve(1) > 0)
+  {
+    Task* p = new Task(std::move(task));
+    submit(&p, 1, affinity);
+  }
+}
+
+void WorkStealingThreadPool::runAll(std::vector<Task> tasks)
+{
+  if (workers_.empty())
+  {
+    for (auto& task : tasks)
+    {
+      task();
+    }
+    return;
+  }
+
+  std::vector<Task*> batch;
+  size_t i = 0;
+  while (i < tasks.size())
+  {
+    size_t n = reserve(tasks.size() - i);
+    if (n == 0)
+    {
+      return;
+    }
+    batch.clear();
+    for (size_t end = i + n; i < end; ++i)
+    {
+      batch.push_back(new Task(std::move(tasks[i])));
+    }
+    submit(batch.data(), n, -1);
+  }
+}
+
+size_t WorkStealingThreadPool::reserve(size_t n)
+{
+  if (!running_)
+  {
+    return 0;
+  }
+  if (maxQueueSize_ == 0)
+  {
+    pending_.fetch_add(n);
+    return n;
+  }
+
+  size_t pending = pending_.load();
+  while (true)
+  {
+    if (pending < maxQueueSize_)
+    {
+      size_t granted = std::min(n, maxQueueSize_ - pending);
+      if (pending_.compare_exchange_weak(pending, pending + granted))
+      {
+        return granted;
+      }
+    }
+    else
+    {
+      MutexLockGuard lock(fullMutex_);
+      // pairs with release(): either it sees us waiting,
+      // or we see the slot it freed.
+      ++waiters_;
+      while ((pending = pending_.load()) >= maxQueueSize_ && running_)
+      {
+        notFull_.wait();
+      }
+      --waiters_;
+      if (!running_)
+      {
+        return 0;
+      }
+    }
+  }
+}
+
+void WorkStealingThreadPool::release()
+{
+  pending_.fetch_sub(1);
+  if (maxQueueSize_ > 0 && waiters_.load() > 0)
+  {
+    MutexLockGuard lock(fullMutex_);
+    notFull_.notify();
+  }
+}
+
+void WorkStealingThreadPool::submit(Task* tasks[], size_t n, int affinity)
+{
+  const size_t numWorkers = workers_.size();
+  if (affinity >= 0)
+  {
+    inject(workers_[affinity % numWorkers].get(), tasks, n);
+  }
+  else if (t_pool == this)
+  {
+    // spawned by a task, keep it local
+    Worker* self = workers_[t_workerIndex].get();
+    size_t i = 0;
+    while (i < n && self->deque.push(tasks[i]))
+    {
+      ++i;
+    }
+    if (i < n)
+    {
+      inject(self, tasks + i, n - i);
+    }
+  }
+  else
+  {
+    size_t chunk = (n + numWorkers - 1) / numWorkers;
+    for (size_t i = 0; i < n; i += chunk)
+    {
+      size_t next = nextWorker_.fetch_add(1, std::memory_order_relaxed);
+      inject(workers_[next % numWorkers].get(), tasks + i, std::min(chunk, n - i));
+    }
+  }
+  wakeup(n);
+}
+
+void WorkStealingThreadPool::inject(Worker* target, Task* tasks[], size_t n)
+{
+  MutexLockGuard lock(target->mutex);
+  target->injected.insert(target->injected.end(), tasks, tasks + n);
+  target->injectedSize.store(target->injected.size(), std::memory_order_relaxed);
+}
+
+void WorkStealingThreadPool::wakeup(size_t n)
+{
+  // pairs with take(): either we see the sleeper,
+  // or it sees pending_ we've increased in reserve().
+  if (sleepers_.load() > 0)
+  {
+    MutexLockGuard lock(idleMutex_);
+    if (n > 1)
+    {
+      notEmpty_.notifyAll();
+    }
+    else
+    {
+      notEmpty_.notify();
+    }
+  }
+}
+
+WorkStealingThreadPool::Task* WorkStealingThreadPool::take(Worker* worker)
+{
+  int spins = 0;
+  while (running_)
+  {
+    Task* task = findTask(worker);
+    if (task)
+    {
+      return task;
+    }
+    if (++spins < kSpinsBeforePark)
+    {
+      ::sched_yield();
+      continue;
+    }
+    spins = 0;
+    MutexLockGuard lock(idleMutex_);
+    ++sleepers_;
+    while (pending_.load() == 0 && running_)
+    {
+      notEmpty_.wait();
+    }
+    --sleepers_;
+  }
+  return NULL;
+}
+
+WorkStealingThreadPool::Task* WorkStealingThreadPool::findTask(Worker* worker)
+{
+  Task* task = worker->deque.pop();
+  if (task == NULL)
+  {
+    task = grabInjected(worker, worker);
+  }
+  const size_t numWorkers = workers_.size();
+  for (size_t i = 1; task == NULL && i < numWorkers; ++i)
+  {
+    Worker* victim = workers_[(worker->index + i) % numWorkers].get();
+    task = victim->deque.steal();
+    if (task == NULL)
+    {
+      task = grabInjected(victim, worker);
+    }
+    if (task)
+    {
+      steals_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  return task;
+}
+
+// Takes one task from from's injection queue, and moves a batch
+// into to's deque so that following takes need no lock.
+WorkStealingThreadPool::Task* WorkStealingThreadPool::grabInjected(Worker* from, Worker* to)
+{
+  if (from->injectedSize.load(std::memory_order_relaxed) == 0)
+  {
+    return NULL;
+  }
+  MutexLockGuard lock(from->mutex);
+  if (from->injected.empty())
+  {
+    return NULL;
+  }
+  Task* task = from->injected.front();
+  from->injected.pop_front();
+  // leave half of a victim's queue to its owner
+  size_t batch = std::min(from == to ? from->injected.size() : from->injected.size() / 2,
+                          kInjectBatch);
+  while (batch-- > 0 && to->deque.push(from->injected.front()))
+  {
+    from->injected.pop_front();
+  }
+  from->injectedSize.store(from->injected.size(), std::memory_order_relaxed);
+  return task;
+}
+
+void WorkStealingThreadPool::runInThread(Worker* worker)
+{
+  t_pool = this;
+  t_workerIndex = worker->index;
+  try
+  {
+    if (threadInitCallback_)
+    {
+      threadInitCallback_();
+    }
+    while (running_)
+    {
+      std::unique_ptr<Task> task(take(worker));
+      if (task)
+      {
+        release();
+        (*task)();
+      }
+    }
+  }
+  catch (const Exception& ex)
+  {
+    fprintf(stderr, "exception caught in WorkStealingThreadPool %s\n", name_.c_str());
+    fprintf(stderr, "reason: %s\n", ex.what());
+    fprintf(stderr, "stack trace: %s\n", ex.stackTrace());
+    abort();
+  }
+  catch (const std::exception& ex)
+  {
+    fprintf(stderr, "exception caught in WorkStealingThreadPool %s\n", name_.c_str());
+    fprintf(stderr, "reason: %s\n", ex.what());
+    abort();
+  }
+  catch (...)
+  {
+    fprintf(stderr, "unknown exception caught in WorkStealingThreadPool %s\n", name_.c_str());
+    throw; // rethrow
+  }
+}
@@ -0,0 +1,108 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#ifndef MUDUO_BASE_WORKSTEALINGTHREADPOOL_H
+#define MUDUO_BASE_WORKSTEALINGTHREADPOOL_H
+
+#include "muduo/base/Condition.h"
+#include "muduo/base/Mutex.h"
+#include "muduo/base/Thread.h"
+#include "muduo/base/Types.h"
+
+#include <atomic>
+#include <deque>
+#include <vector>
+
+namespace muduo
+{
+
+///
+/// Drop-in alternative to ThreadPool for many small tasks.
+///
+/// Each worker owns a Chase-Lev deque, only it pushes and pops at the bottom,
+/// idle workers steal from the top.  Tasks submitted from outside the pool
+/// go to per-worker injection queues, picked round-robin or by affinity hint,
+/// so producers don't serialize on one lock.  Tasks submitted by a task
+/// go to the current worker's own deque.
+///
+/// Same backpressure as ThreadPool: with setMaxQueueSize(n), run() blocks
+/// while n tasks are pending.
+///
+class WorkStealingThreadPool : noncopyable
+{
+ public:
+  typedef std::function<void ()> Task;
+
+  explicit WorkStealingThreadPool(const string& nameArg = string("WorkStealingThreadPool"));
+  ~WorkStealingThreadPool();
+
+  // Must be called before start().
+  void setMaxQueueSize(int maxSize) { maxQueueSize_ = maxSize; }
+  void setThreadInitCallback(const Task& cb)
+  { threadInitCallback_ = cb; }
+
+  void start(int numThreads);
+  void stop();
+
+  const string& name() const
+  { return name_; }
+
+  // number of tasks submitted but not yet started
+  size_t queueSize() const { return pending_.load(); }
+
+  // Could block if maxQueueSize > 0
+  // Call after stop() will return immediately.
+  void run(Task f);
+
+  // Prefers worker (affinity % numThreads), other workers may still steal it.
+  void run(Task f, int affinity);
+
+  // Submits a batch, taking each injection queue lock at most once
+  // when unbounded.
+  void runAll(std::vector<Task> tasks);
+
+  // for tests and benchmarks
+  int64_t numSteals() const { return steals_.load(std::memory_order_relaxed); }
+
+ private:
+  class Deque;
+  struct Worker;
+
+  void runInThread(Worker* worker);
+  Task* take(Worker* worker);
+  Task* findTask(Worker* worker);
+  Task* grabInjected(Worker* from, Worker* to);
+  // reserves up to n slots of the bounded queue, blocking for at least one.
+  // returns 0 if stopped.
+  size_t reserve(size_t n);
+  void release();
+  void submit(Task* tasks[], size_t n, int affinity);
+  void inject(Worker* target, Task* tasks[], size_t n);
+  void wakeup(size_t n);
+
+  string name_;
+  Task threadInitCallback_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::unique_ptr<muduo::Thread>> threads_;
+  size_t maxQueueSize_;
+  std::atomic<bool> running_;
+  std::atomic<size_t> pending_;
+  std::atomic<unsigned> nextWorker_;
+  std::atomic<int64_t> steals_;
+
+  // idle workers park here
+  MutexLock idleMutex_;
+  Condition notEmpty_ GUARDED_BY(idleMutex_);
+  std::atomic<int> sleepers_;
+
+  // producers blocked by maxQueueSize_ park here
+  MutexLock fullMutex_;
+  Condition notFull_ GUARDED_BY(fullMutex_);
+  std::atomic<int> waiters_;
+};
+
+}  // namespace muduo
+
+#endif  // MUDUO_BASE_WORKSTEALINGTHREADPOOL_H
@@ -0,0 +1,105 @@
+#include "muduo/base/BoundedBlockingQueue.h"
+#include "muduo/base/LockFreeBoundedQueue.h"
+#include "muduo/base/CountDownLatch.h"
+#include "muduo/base/Thread.h"
+#include "muduo/base/Timestamp.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+
+// Usage: boundedqueue_bench [items_per_producer] [capacity]
+//
+// Throughput, and handoff latency from put() to take(),
+// of BoundedBlockingQueue and LockFreeBoundedQueue,
+// for 1 to 8 producers and consumers.
+
+template<typename Queue>
+void bench(const char* name, int numProducers, int numConsumers, int items, int capacity)
+{
+  Queue queue(capacity);
+  CountDownLatch ready(numProducers + numConsumers);
+  CountDownLatch go(1);
+  std::vector<std::vector<int>> delays(numConsumers);
+  std::vector<std::unique_ptr<Thread>> threads;
+
+  for (int i = 0; i < numConsumers; ++i)
+  {
+    std::vector<int>* delay = &delays[i];
+    delay->reserve(items * numProducers / numConsumers + 1);
+    threads.emplace_back(new Thread([&queue, &ready, &go, delay] {
+      ready.countDown();
+      go.wait();
+      while (true)
+      {
+        Timestamp t(queue.take());
+        if (!t.valid())
+          break;
+        delay->push_back(static_cast<int>(
+            Timestamp::now().microSecondsSinceEpoch() - t.microSecondsSinceEpoch()));
+      }
+    }));
+  }
+  for (int i = 0; i < numProducers; ++i)
+  {
+    threads.emplace_back(new Thread([&queue, &ready, &go, items] {
+      ready.countDown();
+      go.wait();
+      for (int j = 0; j < items; ++j)
+      {
+        queue.put(Timestamp::now());
+      }
+    }));
+  }
+  for (auto& thr : threads)
+  {
+    thr->start();
+  }
+  ready.wait();
+  Timestamp start(Timestamp::now());
+  go.countDown();
+  for (int i = 0; i < numProducers; ++i)
+  {
+    threads[numConsumers + i]->join();
+  }
+  for (int i = 0; i < numConsumers; ++i)
+  {
+    queue.put(Timestamp::invalid());
+  }
+  for (int i = 0; i < numConsumers; ++i)
+  {
+    threads[i]->join();
+  }
+  double seconds = timeDifference(Timestamp::now(), start);
+
+  std::vector<int> all;
+  for (const auto& d : delays)
+  {
+    all.insert(all.end(), d.begin(), d.end());
+  }
+  std::sort(all.begin(), all.end());
+  printf("%-9s P %d C %d  %10.0f items/s  handoff us p50 %5d p99 %6d max %7d\n",
+         name, numProducers, numConsumers,
+         static_cast<double>(all.size()) / seconds,
+         all[all.size() / 2], all[all.size() * 99 / 100], all.back());
+}
+
+int main(int argc, char* argv[])
+{
+  int items = argc > 1 ? atoi(argv[1]) : 200*1000;
+  int capacity = argc > 2 ? atoi(argv[2]) : 1024;
+  printf("%d items per producer, capacity %d\n", items, capacity);
+  const int counts[] = { 1, 2, 4, 8 };
+  for (int p : counts)
+  {
+    for (int c : counts)
+    {
+      bench<BoundedBlockingQueue<Timestamp>>("mutex", p, c, items, capacity);
+      bench<LockFreeBoundedQueue<Timestamp>>("lockfree", p, c, items, capacity);
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#undef NDEBUG
+#include "muduo/base/Checksum.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+using muduo::Checksum;
+
+int main()
+{
+  printf("crc32 instruction %s\n", Checksum::hasCrc32cInstruction() ? "yes" : "no");
+
+  const char* check = "123456789";
+  assert(Checksum::crc32c(check, 9) == 0xE3069283);
+  assert(Checksum::crc32c("", 0) == 0);
+  // in pieces
+  uint32_t crc = Checksum::crc32c(check, 4);
+  assert(Checksum::crc32c(check + 4, 5, crc) == 0xE3069283);
+
+  // 32 bytes of zeros, from RFC 3720 B.4
+  char zeros[32] = { 0 };
+  assert(Checksum::crc32c(zeros, sizeof zeros) == 0x8A9136AA);
+  char ones[32];
+  memset(ones, 0xff, sizeof ones);
+  assert(Checksum::crc32c(ones, sizeof ones) == 0x62A8AB43);
+
+  // long input, all tails
+  std::string s;
+  for (int i = 0; i < 1000; ++i)
+  {
+    s.push_back(static_cast<char>(i * 7));
+  }
+  for (size_t len = 0; len < 40; ++len)
+  {
+    uint32_t whole = Checksum::crc32c(s.data(), len);
+    uint32_t parts = Checksum::crc32c(s.data() + len / 3, len - len / 3,
+                                      Checksum::crc32c(s.data(), len / 3));
+    assert(whole == parts);
+  }
+
+  // reference values of xxHash32
+  assert(Checksum::xxhash32("", 0) == 0x02CC5D05);
+  assert(Checksum::xxhash32("a", 1) == 0x550D7456);
+  assert(Checksum::xxhash32("abc", 3) == 0x32D153FF);
+  const char* fox = "Nobody inspects the spammish repetition";
+  assert(Checksum::xxhash32(fox, strlen(fox)) == 0xE2293B2F);
+
+  printf("All tests passed.\n");
+}
@@ -0,0 +1,100 @@
+#include "muduo/base/Clock.h"
+#include "muduo/base/Timestamp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+
+using namespace muduo;
+
+// Usage: clock_bench [calls]
+//
+// Prints ns per call of each time source, and its resolution as seen
+// by back-to-back calls.
+
+int g_calls = 10*1000*1000;
+volatile int64_t g_sink;
+
+int64_t readTimespec(clockid_t clock)
+{
+  struct timespec ts;
+  ::clock_gettime(clock, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+int64_t gettimeofdayNanos()
+{
+  struct timeval tv;
+  ::gettimeofday(&tv, NULL);
+  return (static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec) * 1000;
+}
+
+int64_t timestampNow() { return Timestamp::now().microSecondsSinceEpoch() * 1000; }
+int64_t realtime() { return readTimespec(CLOCK_REALTIME); }
+int64_t realtimeCoarse() { return Clock::coarseNow().microSecondsSinceEpoch() * 1000; }
+int64_t monotonic() { return Clock::monotonicNanos(); }
+int64_t monotonicCoarse() { return Clock::coarseMonotonicNanos(); }
+int64_t monotonicRaw() { return readTimespec(CLOCK_MONOTONIC_RAW); }
+int64_t rdtsc() { return static_cast<int64_t>(Clock::rdtsc()); }
+int64_t tsc() { return Clock::tscNanos(); }
+
+void bench(const char* name, int64_t (*func)())
+{
+  int64_t start = Clock::monotonicNanos();
+  int64_t x = 0;
+  for (int i = 0; i < g_calls; ++i)
+  {
+    x += func();
+  }
+  int64_t elapsed = Clock::monotonicNanos() - start;
+  g_sink = x;
+
+  // smallest non-zero step between consecutive calls
+  int64_t step = 0;
+  int64_t last = func();
+  for (int i = 0; i < 1000*1000; ++i)
+  {
+    int64_t now = func();
+    if (now != last && (step == 0 || now - last < step))
+    {
+      step = now - last;
+    }
+    last = now;
+  }
+  printf("%-24s %6.1f ns/call  step %ld\n", name,
+         static_cast<double>(elapsed) / g_calls, step);
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc > 1)
+  {
+    g_calls = atoi(argv[1]);
+  }
+  bool tscOk = Clock::calibrateTsc(0.1);
+  if (tscOk)
+  {
+    printf("TSC %.3f GHz\n", Clock::tscGhz());
+  }
+  else
+  {
+    printf("no invariant TSC, tscNanos() falls back to CLOCK_MONOTONIC\n");
+  }
+
+  bench("gettimeofday", gettimeofdayNanos);
+  bench("Timestamp::now", timestampNow);
+  bench("CLOCK_REALTIME", realtime);
+  bench("CLOCK_REALTIME_COARSE", realtimeCoarse);
+  bench("CLOCK_MONOTONIC", monotonic);
+  bench("CLOCK_MONOTONIC_COARSE", monotonicCoarse);
+  bench("CLOCK_MONOTONIC_RAW", monotonicRaw);
+  bench("rdtsc (ticks)", rdtsc);
+  bench("Clock::tscNanos", tsc);
+
+  if (tscOk)
+  {
+    int64_t drift = Clock::tscNanos() - Clock::monotonicNanos();
+    printf("tscNanos - monotonicNanos = %ld ns\n", drift);
+  }
+}
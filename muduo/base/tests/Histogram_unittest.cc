@@ -0,0 +1,154 @@
+#undef NDEBUG
+#include "muduo/base/Histogram.h"
+#include "muduo/base/Thread.h"
+
+#include <memory>
+#include <vector>
+
+#include <assert.h>
+#include <stdio.h>
+
+using muduo::ConcurrentHistogram;
+using muduo::Histogram;
+
+void testBuckets()
+{
+  // every value falls into the bucket whose range covers it
+  for (int64_t v = 0; v < 100000; ++v)
+  {
+    int b = Histogram::bucketOf(v);
+    assert(Histogram::bucketLow(b) <= v && v <= Histogram::bucketHigh(b));
+  }
+  for (int bits = 0; bits <= Histogram::kMaxValueBits; ++bits)
+  {
+    int64_t v = (static_cast<int64_t>(1) << bits) - 1;
+    int b = Histogram::bucketOf(v);
+    assert(0 <= b && b < Histogram::kBuckets);
+    assert(Histogram::bucketLow(b) <= v && v <= Histogram::bucketHigh(b));
+  }
+  // buckets are contiguous and at most 1/32 wide
+  for (int b = 1; b < Histogram::kBuckets; ++b)
+  {
+    assert(Histogram::bucketLow(b) == Histogram::bucketHigh(b - 1) + 1);
+    int64_t width = Histogram::bucketHigh(b) - Histogram::bucketLow(b) + 1;
+    assert(width * Histogram::kSubBuckets <= Histogram::bucketLow(b) || width == 1);
+  }
+  assert(Histogram::bucketHigh(Histogram::kBuckets - 1) == Histogram::kMaxValue);
+  assert(Histogram::bucketOf(-1) == 0);
+  assert(Histogram::bucketOf(Histogram::kMaxValue + 1) == Histogram::kBuckets - 1);
+}
+
+void testPercentile()
+{
+  Histogram h;
+  assert(h.count() == 0 && h.min() == 0 && h.max() == 0 && h.percentile(50) == 0);
+
+  for (int64_t v = 1; v <= 100; ++v)
+  {
+    h.record(v);
+  }
+  assert(h.count() == 100);
+  assert(h.sum() == 5050);
+  assert(h.min() == 1);
+  assert(h.max() == 100);
+  assert(h.mean() == 50);
+  assert(h.percentile(0) == 1);
+  assert(h.percentile(50) == 50);
+  assert(h.percentile(63) == 63);
+  // 90 is in bucket [90, 91]
+  assert(h.percentile(90) == 91);
+  assert(h.percentile(100) == 100);
+  printf("%s\n", h.toString().c_str());
+
+  // within 1/32 of the exact value
+  Histogram big;
+  for (int64_t v = 1; v <= 1000000; ++v)
+  {
+    big.record(v);
+  }
+  for (int p = 1; p <= 100; ++p)
+  {
+    int64_t exact = 10000 * p;
+    int64_t got = big.percentile(p);
+    assert(exact <= got && got - exact <= exact / 32);
+  }
+  printf("%s\n", big.toString().c_str());
+}
+
+void testMerge()
+{
+  Histogram a, b, all;
+  for (int64_t v = 0; v < 5000; v += 3)
+  {
+    a.record(v);
+    all.record(v);
+  }
+  b.record(7, 1000);
+  all.record(7, 1000);
+  a.merge(b);
+  assert(a.count() == all.count());
+  assert(a.sum() == all.sum());
+  assert(a.min() == 0 && a.max() == 4998);
+  for (int p = 0; p <= 100; p += 5)
+  {
+    assert(a.percentile(p) == all.percentile(p));
+  }
+  assert(a.distribution() == all.distribution());
+
+  Histogram empty;
+  empty.merge(b);
+  assert(empty.min() == 7 && empty.max() == 7 && empty.count() == 1000);
+  a.reset();
+  assert(a.count() == 0 && a.distribution().empty());
+}
+
+void testConcurrent()
+{
+  ConcurrentHistogram h(4);
+  const int kThreads = 8;
+  const int kValues = 100000;
+  std::vector<std::unique_ptr<muduo::Thread>> threads;
+  for (int t = 0; t < kThreads; ++t)
+  {
+    threads.emplace_back(new muduo::Thread([&h, t] {
+      for (int v = 0; v < kValues; ++v)
+      {
+        h.record(v + t);
+      }
+    }));
+    threads.back()->start();
+  }
+  for (auto& thr : threads)
+  {
+    thr->join();
+  }
+
+  Histogram expected;
+  for (int t = 0; t < kThreads; ++t)
+  {
+    for (int v = 0; v < kValues; ++v)
+    {
+      expected.record(v + t);
+    }
+  }
+  Histogram got = h.snapshot();
+  assert(got.count() == expected.count());
+  assert(got.sum() == expected.sum());
+  assert(got.min() == 0);
+  assert(got.max() == kValues - 1 + kThreads - 1);
+  assert(got.distribution() == expected.distribution());
+  printf("%s\n", got.toString().c_str());
+
+  h.reset();
+  assert(h.snapshot().count() == 0);
+  assert(h.snapshot().min() == 0);
+}
+
+int main()
+{
+  testBuckets();
+  testPercentile();
+  testMerge();
+  testConcurrent();
+  printf("All pass!!!\n");
+}
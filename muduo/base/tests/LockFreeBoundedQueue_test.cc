@@ -0,0 +1,110 @@
+#include "muduo/base/LockFreeBoundedQueue.h"
+#include "muduo/base/CountDownLatch.h"
+#include "muduo/base/Thread.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <unistd.h>
+
+void check(bool ok, const char* msg)
+{
+  if (!ok)
+  {
+    printf("FAILED %s\n", msg);
+    abort();
+  }
+}
+
+void testMove()
+{
+  muduo::LockFreeBoundedQueue<std::unique_ptr<int>> queue(10);
+  check(queue.capacity() == 16, "capacity");
+  queue.put(std::unique_ptr<int>(new int(42)));
+  std::unique_ptr<int> x = queue.take();
+  printf("took %d\n", *x);
+  *x = 123;
+  queue.put(std::move(x));
+  std::unique_ptr<int> y;
+  y = queue.take();
+  printf("took %d\n", *y);
+  check(*y == 123 && queue.empty(), "move");
+}
+
+void testFull()
+{
+  muduo::LockFreeBoundedQueue<std::string> queue(4);
+  for (int i = 0; i < 4; ++i)
+  {
+    check(queue.tryPut(std::to_string(i)), "tryPut");
+  }
+  std::string s("full");
+  check(queue.full() && !queue.tryPut(std::move(s)) && s == "full", "full");
+  std::string d;
+  check(queue.tryTake(&d) && d == "0", "fifo");
+}
+
+// every producer puts 1..kItems, consumers sum up
+void testMpmc(int numProducers, int numConsumers, int capacity)
+{
+  const int64_t kItems = 100000;
+  muduo::LockFreeBoundedQueue<int64_t> queue(capacity);
+  std::atomic<int64_t> sum(0);
+  std::atomic<int64_t> count(0);
+  std::vector<std::unique_ptr<muduo::Thread>> threads;
+  for (int i = 0; i < numConsumers; ++i)
+  {
+    threads.emplace_back(new muduo::Thread([&] {
+      int64_t x = 0;
+      while ((x = queue.take()) > 0)
+      {
+        sum += x;
+        ++count;
+      }
+    }));
+  }
+  for (int i = 0; i < numProducers; ++i)
+  {
+    threads.emplace_back(new muduo::Thread([&] {
+      for (int64_t x = 1; x <= kItems; ++x)
+      {
+        queue.put(x);
+      }
+    }));
+  }
+  for (auto& thr : threads)
+  {
+    thr->start();
+  }
+  for (int i = 0; i < numProducers; ++i)
+  {
+    threads[numConsumers + i]->join();
+  }
+  for (int i = 0; i < numConsumers; ++i)
+  {
+    queue.put(0);  // stop
+  }
+  for (int i = 0; i < numConsumers; ++i)
+  {
+    threads[i]->join();
+  }
+  printf("producers %d consumers %d capacity %d: count %ld\n",
+         numProducers, numConsumers, capacity, count.load());
+  check(count == kItems * numProducers, "count");
+  check(sum == kItems * (kItems + 1) / 2 * numProducers, "sum");
+  check(queue.empty(), "empty");
+}
+
+int main()
+{
+  printf("pid=%d, tid=%d\n", ::getpid(), muduo::CurrentThread::tid());
+  testMove();
+  testFull();
+  testMpmc(1, 1, 1);
+  testMpmc(1, 4, 4);
+  testMpmc(4, 1, 4);
+  testMpmc(4, 4, 1024);
+  printf("PASSED\n");
+}
@@ -0,0 +1,200 @@
+#include "muduo/base/LogCompressor.h"
+#include "muduo/base/LogFile.h"
+#include "muduo/base/Timestamp.h"
+
+#include <vector>
+
+#include <glob.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace muduo;
+using std::placeholders::_1;
+
+// writes a log-like file, returns its content
+string writeFile(const string& filename, int lines)
+{
+  string content;
+  char buf[256];
+  for (int i = 0; i < lines; ++i)
+  {
+    snprintf(buf, sizeof buf,
+             "20200101 12:34:56.%06d %5d INFO request %d from 10.0.%d.%d handled in %d us - Server.cc:%d\n",
+             i % 1000000, 1234 + i % 7, i, i % 256, i % 13, i % 997, 100 + i % 50);
+    content += buf;
+  }
+  FILE* fp = ::fopen(filename.c_str(), "we");
+  ::fwrite(content.data(), 1, content.size(), fp);
+  ::fclose(fp);
+  return content;
+}
+
+string readGzip(const string& filename)
+{
+  string content;
+  GzipFile reader = GzipFile::openForRead(filename);
+  char buf[64*1024];
+  int nr = 0;
+  while (reader.valid() && (nr = reader.read(buf, sizeof buf)) > 0)
+  {
+    content.append(buf, nr);
+  }
+  return content;
+}
+
+void check(const string& filename, const string& expected)
+{
+  if (::access(filename.c_str(), F_OK) == 0 || readGzip(filename + ".gz") != expected)
+  {
+    printf("FAILED %s\n", filename.c_str());
+    abort();
+  }
+  ::unlink((filename + ".gz").c_str());
+}
+
+void printStats(const char* msg, const LogCompressor::Stats& stats)
+{
+  printf("%-12s %2" PRId64 " files %9" PRId64 " -> %8" PRId64 " bytes, ratio %5.2f, "
+         "%6.1f MB/s cpu, %6.3f s cpu, %6.3f s wall\n",
+         msg, stats.files, stats.inputBytes, stats.outputBytes,
+         static_cast<double>(stats.inputBytes) / static_cast<double>(stats.outputBytes),
+         static_cast<double>(stats.inputBytes) / stats.cpuSeconds / 1e6,
+         stats.cpuSeconds, stats.wallSeconds);
+}
+
+int main(int argc, char* argv[])
+{
+  const int kLines = argc > 1 ? atoi(argv[1]) : 100*1000;
+  Logger::setLogLevel(Logger::WARN);
+
+  // synchronous, level and cpu budget
+  const int levels[] = { 1, 6, 9 };
+  for (int level : levels)
+  {
+    string filename = "/tmp/logcompressor_test.level.log";
+    string content = writeFile(filename, kLines);
+    LogCompressor::Stats stats;
+    if (!LogCompressor::compressFile(filename, level, 1.0, &stats))
+    {
+      printf("FAILED compressFile\n");
+      abort();
+    }
+    check(filename, content);
+    char msg[32];
+    snprintf(msg, sizeof msg, "level %d", level);
+    printStats(msg, stats);
+  }
+
+  {
+    string filename = "/tmp/logcompressor_test.budget.log";
+    string content = writeFile(filename, kLines);
+    LogCompressor::Stats stats;
+    LogCompressor::compressFile(filename, 6, 0.5, &stats);
+    check(filename, content);
+    printStats("budget 0.5", stats);
+  }
+
+  // the tail written by gzclose() fails, the original is kept
+  {
+    string filename = "/tmp/logcompressor_test.full.log";
+    string content = writeFile(filename, 1000);  // compresses to less than a chunk
+    struct rlimit old;
+    ::getrlimit(RLIMIT_FSIZE, &old);
+    struct rlimit limit = old;
+    limit.rlim_cur = 1024;
+    ::signal(SIGXFSZ, SIG_IGN);  // EFBIG instead
+    ::setrlimit(RLIMIT_FSIZE, &limit);
+    bool ok = LogCompressor::compressFile(filename, 6, 1.0, NULL);
+    ::setrlimit(RLIMIT_FSIZE, &old);
+    if (ok || ::access((filename + ".gz").c_str(), F_OK) == 0
+        || ::access(filename.c_str(), F_OK) != 0)
+    {
+      printf("FAILED short write\n");
+      abort();
+    }
+    ::unlink(filename.c_str());
+  }
+
+  // background thread, fed by LogFile rolling
+  {
+    LogCompressor compressor(6, 1.0);
+    compressor.start();
+    std::vector<string> files;
+    std::vector<string> contents;
+    for (int i = 0; i < 3; ++i)
+    {
+      char name[64];
+      snprintf(name, sizeof name, "/tmp/logcompressor_test.bg%d.log", i);
+      files.push_back(name);
+      contents.push_back(writeFile(name, kLines / 10));
+      compressor.compress(name);
+    }
+    compressor.stop();
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+      check(files[i], contents[i]);
+    }
+    printStats("background", compressor.stats());
+  }
+
+  {
+    // LogFile takes a bare basename, roll in a directory of our own
+    char dir[] = "/tmp/logcompressor_test.XXXXXX";
+    char cwd[PATH_MAX];
+    if (::mkdtemp(dir) == NULL || ::getcwd(cwd, sizeof cwd) == NULL || ::chdir(dir) < 0)
+    {
+      perror("FAILED mkdtemp");
+      abort();
+    }
+    LogCompressor compressor;
+    compressor.start();
+    {
+    LogFile logFile("logcompressor_test", 1000);
+    logFile.setRollCallback(std::bind(&LogCompressor::compress, &compressor, _1));
+    string line(200, 'x');
+    line += '\n';
+    logFile.append(line.data(), static_cast<int>(line.size()));
+    // file names have one-second resolution, wait for the next second
+    // (half a second on average) instead of appending past the roll size,
+    // plus a few ms as time(2) reads a coarser clock than gettimeofday(2)
+    struct timeval tv;
+    ::gettimeofday(&tv, NULL);
+    ::usleep(static_cast<useconds_t>(1000 * 1000 - tv.tv_usec + 20 * 1000));
+    if (!logFile.rollFile())
+    {
+      printf("FAILED rollFile\n");
+      abort();
+    }
+    logFile.append(line.data(), static_cast<int>(line.size()));
+    }
+    compressor.stop();
+    if (compressor.stats().files != 1)
+    {
+      printf("FAILED roll callback\n");
+      abort();
+    }
+    printStats("rolled", compressor.stats());
+
+    // the compressed file and the one still open when LogFile was destroyed
+    glob_t files;
+    if (::glob("logcompressor_test.*", 0, NULL, &files) == 0)
+    {
+      for (size_t i = 0; i < files.gl_pathc; ++i)
+      {
+        ::unlink(files.gl_pathv[i]);
+      }
+      ::globfree(&files);
+    }
+    if (::chdir(cwd) < 0 || ::rmdir(dir) < 0)
+    {
+      perror("FAILED rmdir");
+      abort();
+    }
+  }
+  printf("PASSED\n");
+}
@@ -0,0 +1,159 @@
+#include "muduo/base/CountDownLatch.h"
+#include "muduo/base/Thread.h"
+#include "muduo/base/ThreadPool.h"
+#include "muduo/base/Timestamp.h"
+#include "muduo/base/WorkStealingThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+
+// Usage: threadpool_bench [tasks_per_round] [num_producers]
+//
+// For 1 to 64 threads, prints tasks/sec and submit-to-start latency
+// of ThreadPool, WorkStealingThreadPool and WorkStealingThreadPool::runAll,
+// with tiny (empty) and medium (~5us) tasks.
+
+int g_numTasks = 200*1000;
+int g_numProducers = 1;
+
+int64_t nowMicros()
+{
+  return Timestamp::now().microSecondsSinceEpoch();
+}
+
+volatile double g_sink;
+
+void mediumWork()
+{
+  double x = 1.0;
+  for (int i = 0; i < 2000; ++i)
+  {
+    x = x * 1.000001 + 0.000001;
+  }
+  g_sink = x;
+}
+
+struct Round
+{
+  explicit Round(int numTasks, bool medium)
+    : latch(numTasks),
+      delays(numTasks),
+      isMedium(medium)
+  {
+  }
+
+  void task(int i, int64_t submitted)
+  {
+    delays[i] = static_cast<int>(nowMicros() - submitted);
+    if (isMedium)
+    {
+      mediumWork();
+    }
+    latch.countDown();
+  }
+
+  CountDownLatch latch;
+  std::vector<int> delays;
+  const bool isMedium;
+};
+
+template<typename Pool>
+void submitOne(Pool& pool, Round& round, int begin, int end, bool batch)
+{
+  if (batch)
+  {
+    const int kBatch = 64;
+    std::vector<std::function<void ()>> tasks;
+    for (int i = begin; i < end; i += kBatch)
+    {
+      tasks.clear();
+      int64_t now = nowMicros();
+      for (int j = i; j < std::min(i + kBatch, end); ++j)
+      {
+        tasks.push_back(std::bind(&Round::task, &round, j, now));
+      }
+      pool.runAll(std::move(tasks));
+    }
+  }
+  else
+  {
+    for (int i = begin; i < end; ++i)
+    {
+      pool.run(std::bind(&Round::task, &round, i, nowMicros()));
+    }
+  }
+}
+
+// ThreadPool has no runAll()
+void submitOne(ThreadPool& pool, Round& round, int begin, int end, bool)
+{
+  for (int i = begin; i < end; ++i)
+  {
+    pool.run(std::bind(&Round::task, &round, i, nowMicros()));
+  }
+}
+
+template<typename Pool>
+void bench(const char* name, int numThreads, bool medium, bool batch)
+{
+  Pool pool("bench");
+  pool.setMaxQueueSize(64*1024);
+  pool.start(numThreads);
+
+  Round round(g_numTasks, medium);
+  Timestamp start(Timestamp::now());
+  std::vector<std::unique_ptr<Thread>> producers;
+  const int perProducer = g_numTasks / g_numProducers;
+  for (int p = 0; p < g_numProducers; ++p)
+  {
+    int begin = p * perProducer;
+    int end = p == g_numProducers - 1 ? g_numTasks : begin + perProducer;
+    producers.emplace_back(new Thread([&pool, &round, begin, end, batch] {
+      submitOne(pool, round, begin, end, batch);
+    }));
+    producers.back()->start();
+  }
+  for (auto& thr : producers)
+  {
+    thr->join();
+  }
+  round.latch.wait();
+  double seconds = timeDifference(Timestamp::now(), start);
+  pool.stop();
+
+  std::vector<int>& d = round.delays;
+  std::sort(d.begin(), d.end());
+  printf("%-8s %-6s threads %2d  %10.0f tasks/s  latency us p50 %6d p99 %7d max %7d\n",
+         name, medium ? "medium" : "tiny", numThreads,
+         g_numTasks / seconds,
+         d[d.size() / 2], d[d.size() * 99 / 100], d.back());
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc > 1)
+  {
+    g_numTasks = atoi(argv[1]);
+  }
+  if (argc > 2)
+  {
+    g_numProducers = std::max(1, atoi(argv[2]));
+  }
+  printf("%d tasks per round, %d producers\n", g_numTasks, g_numProducers);
+
+  for (int medium = 0; medium < 2; ++medium)
+  {
+    for (int threads = 1; threads <= 64; threads *= 2)
+    {
+      bench<ThreadPool>("mutex", threads, medium, false);
+      bench<WorkStealingThreadPool>("steal", threads, medium, false);
+      bench<WorkStealingThreadPool>("runAll", threads, medium, true);
+    }
+  }
+}
@@ -1,8 +1,11 @@
 #include "muduo/base/ThreadPool.h"
+#include "muduo/base/Clock.h"
 #include "muduo/base/CountDownLatch.h"
 #include "muduo/base/CurrentThread.h"
 #include "muduo/base/Logging.h"
 
+#include <vector>
+
 #include <stdio.h>
 #include <unistd.h>  // usleep
 
@@ -81,11 +84,57 @@ void test2()
   pool.stop();  // early stop
 
   thread1.join();
-  // run() after stop()
-  pool.run(print);
+  // run() after stop() drops the task
+  if (pool.run(print))
+  {
+    LOG_FATAL << "run() after stop() is queued";
+  }
   LOG_WARN << "test2 Done";
 }
 
+void append(std::vector<int>* order, int x)
+{
+  order->push_back(x);
+}
+
+void test3()
+{
+  LOG_WARN << "Test ThreadPool with priorities and deadlines.";
+  muduo::ThreadPool pool("PriorityPool");
+  pool.setPriorityLevels(3);
+  pool.setWaitStats(true);
+  pool.start(1);
+
+  // block the only thread, so that following tasks queue up
+  muduo::CountDownLatch blocker(1);
+  pool.run(std::bind(&muduo::CountDownLatch::wait, &blocker));
+  muduo::CurrentThread::sleepUsec(100*1000);
+
+  std::vector<int> order;
+  muduo::Timestamp past = muduo::addTime(muduo::Clock::monotonic(), -1.0);
+  muduo::Timestamp future = muduo::addTime(muduo::Clock::monotonic(), 60.0);
+  pool.run(std::bind(append, &order, 0));
+  pool.run(std::bind(append, &order, 1), 1);
+  pool.run(std::bind(append, &order, 2), 2, future);
+  pool.run(std::bind(append, &order, 20), 2, past, std::bind(append, &order, -20));
+  pool.run(std::bind(append, &order, 21), 2);
+  pool.run(std::bind(append, &order, 10), 1);
+
+  muduo::CountDownLatch latch(1);
+  pool.run(std::bind(&muduo::CountDownLatch::countDown, &latch));
+  blocker.countDown();
+  latch.wait();
+
+  const int expected[] = { 2, -20, 21, 1, 10, 0 };
+  if (order != std::vector<int>(expected, expected + 6))
+  {
+    printf("FAILED priority order\n");
+    abort();
+  }
+  printf("%s", pool.report().c_str());
+  pool.stop();
+}
+
 int main()
 {
   test(0);
@@ -94,4 +143,5 @@ int main()
   test(10);
   test(50);
   test2();
+  test3();
 }
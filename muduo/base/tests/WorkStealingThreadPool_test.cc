@@ -0,0 +1,123 @@
+#include "muduo/base/WorkStealingThreadPool.h"
+#include "muduo/base/CountDownLatch.h"
+#include "muduo/base/CurrentThread.h"
+#include "muduo/base/Logging.h"
+
+#include <atomic>
+
+#include <stdio.h>
+
+std::atomic<int> g_count(0);
+
+void check(bool ok, const char* msg)
+{
+  if (!ok)
+  {
+    printf("FAILED %s\n", msg);
+    abort();
+  }
+}
+
+void inc(muduo::CountDownLatch* latch)
+{
+  ++g_count;
+  latch->countDown();
+}
+
+void test(int numThreads, int maxSize)
+{
+  LOG_WARN << "Test WorkStealingThreadPool with " << numThreads
+           << " threads, max queue size = " << maxSize;
+  muduo::WorkStealingThreadPool pool("MainThreadPool");
+  pool.setMaxQueueSize(maxSize);
+  pool.start(numThreads);
+
+  const int kTasks = 10000;
+  g_count = 0;
+  muduo::CountDownLatch latch(kTasks * 3);
+  for (int i = 0; i < kTasks; ++i)
+  {
+    pool.run(std::bind(inc, &latch));
+  }
+  for (int i = 0; i < kTasks; ++i)
+  {
+    pool.run(std::bind(inc, &latch), i);
+  }
+  std::vector<muduo::WorkStealingThreadPool::Task> tasks;
+  for (int i = 0; i < kTasks; ++i)
+  {
+    tasks.push_back(std::bind(inc, &latch));
+  }
+  pool.runAll(std::move(tasks));
+  latch.wait();
+  check(g_count == kTasks * 3, "count");
+  pool.stop();
+}
+
+// tasks spawning tasks go to the worker's own deque, and get stolen
+void spawn(muduo::WorkStealingThreadPool* pool, muduo::CountDownLatch* latch, int depth)
+{
+  if (depth > 0)
+  {
+    pool->run(std::bind(spawn, pool, latch, depth - 1));
+    pool->run(std::bind(spawn, pool, latch, depth - 1));
+  }
+  latch->countDown();
+}
+
+void testNested()
+{
+  LOG_WARN << "Test WorkStealingThreadPool nested run";
+  muduo::WorkStealingThreadPool pool;
+  pool.start(4);
+  const int kDepth = 14;
+  muduo::CountDownLatch latch((1 << (kDepth + 1)) - 1);
+  pool.run(std::bind(spawn, &pool, &latch, kDepth));
+  latch.wait();
+  LOG_WARN << "steals " << pool.numSteals();
+  pool.stop();
+}
+
+void longTask(int num)
+{
+  LOG_INFO << "longTask " << num;
+  muduo::CurrentThread::sleepUsec(300000);
+}
+
+void testStopEarly()
+{
+  LOG_WARN << "Test WorkStealingThreadPool by stoping early.";
+  muduo::WorkStealingThreadPool pool("ThreadPool");
+  pool.setMaxQueueSize(5);
+  pool.start(3);
+
+  muduo::Thread thread1([&pool]()
+  {
+    for (int i = 0; i < 20; ++i)
+    {
+      pool.run(std::bind(longTask, i));
+    }
+  }, "thread1");
+  thread1.start();
+
+  muduo::CurrentThread::sleepUsec(500000);
+  check(pool.queueSize() <= 5, "bounded");
+  LOG_WARN << "stop pool";
+  pool.stop();  // early stop
+  thread1.join();
+  // run() after stop()
+  pool.run(std::bind(longTask, -1));
+  LOG_WARN << "testStopEarly Done";
+}
+
+int main()
+{
+  test(0, 0);
+  test(1, 0);
+  test(4, 0);
+  test(4, 1);
+  test(8, 100);
+  testNested();
+  testStopEarly();
+  printf("PASSED\n");
+}
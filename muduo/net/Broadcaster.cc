@@ -0,0 +1,162 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include "muduo/net/Broadcaster.h"
+
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/TcpConnection.h"
+
+#include <atomic>
+
+#include <sys/uio.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+struct Broadcaster::Shard : noncopyable
+{
+  explicit Shard(EventLoop* ioLoop)
+    : loop(ioLoop),
+      numConnections(0),
+      scheduled(false)
+  {
+  }
+
+  EventLoop* const loop;
+  std::set<TcpConnectionPtr> connections;  // in loop only
+  std::atomic<size_t> numConnections;
+  MutexLock mutex;
+  std::vector<MessagePtr> pending GUARDED_BY(mutex);
+  bool scheduled GUARDED_BY(mutex);  // flush() is queued
+};
+
+Broadcaster::Broadcaster(double batchSeconds)
+  : batchSeconds_(batchSeconds),
+    shards_(new ShardList)
+{
+}
+
+Broadcaster::~Broadcaster() = default;
+
+void Broadcaster::add(const TcpConnectionPtr& conn)
+{
+  conn->getLoop()->assertInLoopThread();
+  Shard* shard = shardOf(conn->getLoop());
+  if (shard->connections.insert(conn).second)
+  {
+    ++shard->numConnections;
+  }
+}
+
+void Broadcaster::remove(const TcpConnectionPtr& conn)
+{
+  conn->getLoop()->assertInLoopThread();
+  Shard* shard = shardOf(conn->getLoop());
+  if (shard->connections.erase(conn) > 0)
+  {
+    --shard->numConnections;
+  }
+}
+
+void Broadcaster::broadcast(const StringPiece& message)
+{
+  broadcast(MessagePtr(new string(message.data(), message.size())));
+}
+
+void Broadcaster::broadcast(const MessagePtr& message)
+{
+  ShardListPtr shards = getShardList();
+  for (Shard* shard : *shards)
+  {
+    if (shard->numConnections == 0)
+    {
+      continue;
+    }
+    bool schedule = false;
+    {
+    MutexLockGuard lock(shard->mutex);
+    shard->pending.push_back(message);
+    if (!shard->scheduled)
+    {
+      shard->scheduled = schedule = true;
+    }
+    }
+    if (schedule)
+    {
+      if (batchSeconds_ > 0)
+      {
+        shard->loop->runAfter(batchSeconds_, std::bind(&Broadcaster::flush, this, shard));
+      }
+      else
+      {
+        shard->loop->queueInLoop(std::bind(&Broadcaster::flush, this, shard));
+      }
+    }
+  }
+}
+
+size_t Broadcaster::size() const
+{
+  ShardListPtr shards = getShardList();
+  size_t n = 0;
+  for (const Shard* shard : *shards)
+  {
+    n += shard->numConnections;
+  }
+  return n;
+}
+
+Broadcaster::Shard* Broadcaster::shardOf(EventLoop* loop)
+{
+  ShardListPtr shards = getShardList();
+  for (Shard* shard : *shards)
+  {
+    if (shard->loop == loop)
+    {
+      return shard;
+    }
+  }
+  // only this loop adds its own shard,
+  // drop the snapshot so the list is copied only if broadcast() holds it
+  shards.reset();
+  Shard* shard = new Shard(loop);
+  MutexLockGuard lock(mutex_);
+  if (!shards_.unique())
+  {
+    shards_.reset(new ShardList(*shards_));
+  }
+  assert(shards_.unique());
+  shards_->push_back(shard);
+  owned_.emplace_back(shard);
+  return shard;
+}
+
+Broadcaster::ShardListPtr Broadcaster::getShardList() const
+{
+  MutexLockGuard lock(mutex_);
+  return shards_;
+}
+
+void Broadcaster::flush(Shard* shard)
+{
+  shard->loop->assertInLoopThread();
+  std::shared_ptr<std::vector<MessagePtr>> batch(new std::vector<MessagePtr>);
+  {
+  MutexLockGuard lock(shard->mutex);
+  batch->swap(shard->pending);
+  shard->scheduled = false;
+  }
+  std::vector<struct iovec> iov(batch->size());
+  for (size_t i = 0; i < batch->size(); ++i)
+  {
+    iov[i].iov_base = const_cast<char*>((*batch)[i]->data());
+    iov[i].iov_len = (*batch)[i]->size();
+  }
+  // the batch keeps its messages alive until written to every connection
+  for (const TcpConnectionPtr& conn : shard->connections)
+  {
+    conn->send(iov.data(), static_cast<int>(iov.size()), batch);
+  }
+}
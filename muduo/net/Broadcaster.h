@@ -0,0 +1,76 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_BROADCASTER_H
+#define MUDUO_NET_BROADCASTER_H
+
+#include "muduo/base/Mutex.h"
+#include "muduo/base/StringPiece.h"
+#include "muduo/base/Types.h"
+#include "muduo/net/Callbacks.h"
+
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace muduo
+{
+namespace net
+{
+
+class EventLoop;
+
+///
+/// Sends the same message to many connections, in many loops.
+///
+/// A message is copied once into a block shared by the output queues of
+/// all connections.  Every loop gets at most one queued task per batch
+/// window, which writes all messages of the window to each of its
+/// connections with one writev(2).
+///
+/// Connections are added and removed in their own loops, eg. from the
+/// ConnectionCallback of TcpServer.  broadcast() is thread safe.
+/// It must outlive the loops.
+class Broadcaster : noncopyable
+{
+ public:
+  typedef std::shared_ptr<const string> MessagePtr;
+
+  /// batchSeconds of 0 gathers messages until the loop runs queued tasks.
+  explicit Broadcaster(double batchSeconds = 0.0);
+  ~Broadcaster();
+
+  void add(const TcpConnectionPtr& conn);
+  void remove(const TcpConnectionPtr& conn);
+
+  /// message is framed already, eg. with a length header
+  void broadcast(const StringPiece& message);
+  void broadcast(const MessagePtr& message);
+
+  /// connections of all loops, not exact if they are changing
+  size_t size() const;
+
+ private:
+  struct Shard;
+  typedef std::vector<Shard*> ShardList;
+  typedef std::shared_ptr<ShardList> ShardListPtr;
+
+  Shard* shardOf(EventLoop* loop);
+  ShardListPtr getShardList() const;
+  void flush(Shard* shard);
+
+  const double batchSeconds_;
+  mutable MutexLock mutex_;
+  // copy on write, broadcast() iterates a snapshot without locking
+  ShardListPtr shards_ GUARDED_BY(mutex_);
+  std::vector<std::unique_ptr<Shard>> owned_ GUARDED_BY(mutex_);
+};
+
+}  // namespace net
+}  // namespace muduo
+
+#endif  // MUDUO_NET_BROADCASTER_H
@@ -8,6 +8,7 @@
 
 #include "muduo/net/EventLoop.h"
 
+#include "muduo/base/Clock.h"
 #include "muduo/base/Logging.h"
 #include "muduo/base/Mutex.h"
 #include "muduo/net/Channel.h"
@@ -166,6 +167,16 @@ void EventLoop::loop()
   looping_ = false;
 }
 
+Timestamp EventLoop::now() const
+{
+  // pollReturnTime_ is only written in loop thread
+  if (pollReturnTime_.valid() && isInLoopThread())
+  {
+    return pollReturnTime_;
+  }
+  return Timestamp::now();
+}
+
 void EventLoop::quit()
 {
   quit_ = true;
@@ -230,19 +241,21 @@ size_t EventLoop::queueSize() const
 */
 TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
 {
-  return timerQueue_->addTimer(std::move(cb), time, 0.0); // 添加到定时器队列
+  // wall clock to monotonic, the timer won't follow later clock changes
+  double delay = timeDifference(time, Timestamp::now());
+  return runAfter(delay, std::move(cb));
 }
 
 TimerId EventLoop::runAfter(double delay, TimerCallback cb)
 {
-  Timestamp time(addTime(Timestamp::now(), delay));    // 当前时间戳增加一个时间
-  return runAt(time, std::move(cb));                   // 添加到定时器队列
+  Timestamp time(addTime(Clock::monotonic(), delay));  // 当前时间戳增加一个时间
+  return timerQueue_->addTimer(std::move(cb), time, 0.0); // 添加到定时器队列
 }
 
 
 TimerId EventLoop::runEvery(double interval, TimerCallback cb)
 {
-  Timestamp time(addTime(Timestamp::now(), interval));
+  Timestamp time(addTime(Clock::monotonic(), interval));
   return timerQueue_->addTimer(std::move(cb), time, interval);  // 循环执行
 }
 
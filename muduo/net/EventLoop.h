@@ -66,6 +66,15 @@ class EventLoop : noncopyable
   ///
   Timestamp pollReturnTime() const { return pollReturnTime_; }
 
+  ///
+  /// Wall clock time cached once per poll iteration, saves a
+  /// gettimeofday() per call for callbacks that don't need precision,
+  /// e.g. stamping messages or idle-connection bookkeeping.
+  /// Lags real time by the time spent handling this iteration's events.
+  /// Falls back to Timestamp::now() outside the loop thread or before loop().
+  ///
+  Timestamp now() const;
+
   /// 迭代器
   int64_t iteration() const { return iteration_; }
 
@@ -16,10 +16,63 @@
 #include "muduo/net/SocketsOps.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 using namespace muduo;
 using namespace muduo::net;
 
+namespace
+{
+const int kMaxIovec = 64;  // per writev, well below IOV_MAX
+const size_t kMaxSplice = 1024*1024;  // per splice, more than a pipe holds
+}
+
+struct TcpConnection::SplicePipe : noncopyable
+{
+  explicit SplicePipe(int size)
+    : bytes(0)
+  {
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+      LOG_SYSFATAL << "TcpConnection::SplicePipe";
+    }
+    if (size > 0 && ::fcntl(fds[1], F_SETPIPE_SZ, size) < 0)
+    {
+      // over /proc/sys/fs/pipe-max-size
+      LOG_SYSERR << "TcpConnection::SplicePipe F_SETPIPE_SZ " << size;
+    }
+  }
+
+  ~SplicePipe()
+  {
+    ::close(fds[0]);
+    ::close(fds[1]);
+  }
+
+  ssize_t fill(int sockfd)
+  {
+    ssize_t n = ::splice(sockfd, NULL, fds[1], NULL, kMaxSplice,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0)
+    {
+      bytes += static_cast<size_t>(n);
+    }
+    return n;
+  }
+
+  // bytes is taken off by TcpConnection::retrieveQueued()
+  ssize_t drain(int sockfd)
+  {
+    return ::splice(fds[0], NULL, sockfd, NULL, bytes,
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  }
+
+  int fds[2];
+  size_t bytes;
+};
+
 // 默认的连接已完成-回调函数
 void muduo::net::defaultConnectionCallback(const TcpConnectionPtr& conn)
 {
@@ -50,7 +103,11 @@ TcpConnection::TcpConnection(EventLoop* loop,
     channel_(new Channel(loop, sockfd)),  // 新建连接，会
     localAddr_(localAddr),
     peerAddr_(peerAddr),
-    highWaterMark_(64*1024*1024)
+    highWaterMark_(64*1024*1024),
+    readTarget_(NULL),
+    readTargetLen_(0),
+    readTargetFilled_(0),
+    piecesBytes_(0)
 {
 
   // ************ conn 和 channel 绑定 *********** //
@@ -175,7 +232,7 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
     return;
   }
   // if no thing in output queue, try writing directly
-  if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+  if (!channel_->isWriting() && queuedBytes() == 0)
   {
     nwrote = sockets::write(channel_->fd(), data, len);
     if (nwrote >= 0)
@@ -203,14 +260,93 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
   assert(remaining <= len);
   if (!faultError && remaining > 0)
   {
-    size_t oldLen = outputBuffer_.readableBytes();
+    size_t oldLen = queuedBytes();
+    if (oldLen + remaining >= highWaterMark_
+        && oldLen < highWaterMark_
+        && highWaterMarkCallback_)
+    {
+      loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+    }
+    if (outputPieces_.empty())
+    {
+      outputBuffer_.append(static_cast<const char*>(data)+nwrote, remaining);
+    }
+    else
+    {
+      // goes after the pieces
+      std::shared_ptr<string> copy(
+          new string(static_cast<const char*>(data)+nwrote, remaining));
+      Piece piece = { copy->data(), copy->size(), copy };
+      outputPieces_.push_back(piece);
+      piecesBytes_ += remaining;
+    }
+    if (!channel_->isWriting())
+    {
+      channel_->enableWriting();
+    }
+  }
+}
+
+void TcpConnection::send(const struct iovec* iov, int iovcnt, const std::shared_ptr<void>& owner)
+{
+  loop_->assertInLoopThread();
+  if (state_ != kConnected)
+  {
+    return;
+  }
+  size_t len = 0;
+  for (int i = 0; i < iovcnt; ++i)
+  {
+    len += iov[i].iov_len;
+  }
+
+  size_t nwrote = 0;
+  bool faultError = false;
+  // if no thing in output queue, try writing directly
+  if (!channel_->isWriting() && queuedBytes() == 0)
+  {
+    ssize_t n = sockets::writev(channel_->fd(), iov, std::min(iovcnt, kMaxIovec));
+    if (n >= 0)
+    {
+      nwrote = static_cast<size_t>(n);
+      if (nwrote == len && writeCompleteCallback_)
+      {
+        loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+      }
+    }
+    else if (errno != EWOULDBLOCK)
+    {
+      LOG_SYSERR << "TcpConnection::send";
+      if (errno == EPIPE || errno == ECONNRESET)
+      {
+        faultError = true;
+      }
+    }
+  }
+
+  if (!faultError && nwrote < len)
+  {
+    size_t oldLen = queuedBytes();
+    size_t remaining = len - nwrote;
     if (oldLen + remaining >= highWaterMark_
         && oldLen < highWaterMark_
         && highWaterMarkCallback_)
     {
       loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
     }
-    outputBuffer_.append(static_cast<const char*>(data)+nwrote, remaining);
+    for (int i = 0; i < iovcnt; ++i)
+    {
+      size_t skip = std::min(nwrote, iov[i].iov_len);
+      nwrote -= skip;
+      if (skip < iov[i].iov_len)
+      {
+        Piece piece = { static_cast<const char*>(iov[i].iov_base) + skip,
+                        iov[i].iov_len - skip,
+                        owner };
+        outputPieces_.push_back(piece);
+      }
+    }
+    piecesBytes_ += remaining;
     if (!channel_->isWriting())
     {
       channel_->enableWriting();
@@ -218,6 +354,65 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
   }
 }
 
+size_t TcpConnection::queuedBytes() const
+{
+  return outputBuffer_.readableBytes() + piecesBytes_
+      + (writePipe_ ? writePipe_->bytes : 0);
+}
+
+ssize_t TcpConnection::writeQueued()
+{
+  if (outputPieces_.empty())
+  {
+    if (outputBuffer_.readableBytes() == 0 && writePipe_)
+    {
+      return writePipe_->drain(channel_->fd());
+    }
+    return sockets::write(channel_->fd(),
+                          outputBuffer_.peek(),
+                          outputBuffer_.readableBytes());
+  }
+  struct iovec vec[kMaxIovec];
+  int n = 0;
+  if (outputBuffer_.readableBytes() > 0)
+  {
+    vec[n].iov_base = const_cast<char*>(outputBuffer_.peek());
+    vec[n].iov_len = outputBuffer_.readableBytes();
+    ++n;
+  }
+  for (auto it = outputPieces_.begin(); it != outputPieces_.end() && n < kMaxIovec; ++it, ++n)
+  {
+    vec[n].iov_base = const_cast<char*>(it->data);
+    vec[n].iov_len = it->len;
+  }
+  return sockets::writev(channel_->fd(), vec, n);
+}
+
+void TcpConnection::retrieveQueued(size_t n)
+{
+  if (outputBuffer_.readableBytes() + piecesBytes_ == 0)
+  {
+    // spliced from writePipe_
+    writePipe_->bytes -= n;
+    return;
+  }
+  size_t fromBuffer = std::min(n, outputBuffer_.readableBytes());
+  outputBuffer_.retrieve(fromBuffer);
+  n -= fromBuffer;
+  piecesBytes_ -= n;
+  while (n > 0)
+  {
+    Piece& piece = outputPieces_.front();
+    if (n < piece.len)
+    {
+      piece.data += n;
+      piece.len -= n;
+      break;
+    }
+    n -= piece.len;
+    outputPieces_.pop_front();
+  }
+}
 
 // 半关闭
 void TcpConnection::shutdown()
@@ -393,8 +588,21 @@ void TcpConnection::handleRead(Timestamp receiveTime)
   loop_->assertInLoopThread();
   int savedErrno = 0;
 
+  if (readPipe_ && readTargetLen_ == 0 && inputBuffer_.readableBytes() == 0)
+  {
+    TcpConnectionPtr target(spliceTarget_.lock());
+    if (target && target->connected())
+    {
+      handleSpliceRead(target);
+      return;
+    }
+    readPipe_.reset();  // the target drains what is left
+  }
+
   // buffer读取数据
-  ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+  ssize_t n = readTargetLen_ > 0 && inputBuffer_.readableBytes() == 0
+      ? readIntoTarget(&savedErrno)
+      : inputBuffer_.readFd(channel_->fd(), &savedErrno);
   if (n > 0)
   {
     messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
@@ -412,6 +620,105 @@ void TcpConnection::handleRead(Timestamp receiveTime)
   }
 }
 
+void TcpConnection::setReadTarget(void* data, size_t len)
+{
+  loop_->assertInLoopThread();
+  readTarget_ = static_cast<char*>(data);
+  readTargetLen_ = len;
+  readTargetFilled_ = 0;
+}
+
+ssize_t TcpConnection::readIntoTarget(int* savedErrno)
+{
+  struct iovec vec[2];
+  vec[0].iov_base = readTarget_;
+  vec[0].iov_len = readTargetLen_;
+  vec[1].iov_base = inputBuffer_.beginWrite();
+  vec[1].iov_len = inputBuffer_.writableBytes();
+  const ssize_t n = sockets::readv(channel_->fd(), vec, 2);
+  if (n < 0)
+  {
+    *savedErrno = errno;
+  }
+  else
+  {
+    const size_t filled = std::min(static_cast<size_t>(n), readTargetLen_);
+    readTarget_ += filled;
+    readTargetLen_ -= filled;
+    readTargetFilled_ += filled;
+    inputBuffer_.hasWritten(static_cast<size_t>(n) - filled);
+  }
+  return n;
+}
+
+void TcpConnection::spliceTo(const TcpConnectionPtr& dst, int pipeSize)
+{
+  loop_->assertInLoopThread();
+  assert(dst->getLoop() == loop_);
+  readPipe_.reset(new SplicePipe(pipeSize));
+  spliceTarget_ = dst;
+  dst->writePipe_ = readPipe_;
+  dst->spliceSource_ = shared_from_this();
+}
+
+void TcpConnection::handleSpliceRead(const TcpConnectionPtr& target)
+{
+  ssize_t n = readPipe_->fill(channel_->fd());
+  if (n > 0)
+  {
+    target->writePipe();
+  }
+  else if (n == 0)
+  {
+    handleClose();
+    return;
+  }
+  else if (errno != EAGAIN)
+  {
+    LOG_SYSERR << "TcpConnection::handleSpliceRead";
+    handleError();
+    return;
+  }
+  if (readPipe_->bytes > 0 && channel_->isReading())
+  {
+    // the target is slow, see resumeSpliceSource()
+    channel_->disableReading();
+  }
+}
+
+void TcpConnection::writePipe()
+{
+  loop_->assertInLoopThread();
+  // if no thing before the pipe, try writing directly
+  if (!channel_->isWriting() && outputBuffer_.readableBytes() + piecesBytes_ == 0)
+  {
+    ssize_t n = writePipe_->drain(channel_->fd());
+    if (n > 0)
+    {
+      retrieveQueued(static_cast<size_t>(n));
+    }
+    else if (n < 0 && errno != EWOULDBLOCK)
+    {
+      // handleClose() will wake up the source
+      LOG_SYSERR << "TcpConnection::writePipe";
+      return;
+    }
+  }
+  if (writePipe_->bytes > 0 && !channel_->isWriting())
+  {
+    channel_->enableWriting();
+  }
+}
+
+void TcpConnection::resumeSpliceSource()
+{
+  TcpConnectionPtr source(spliceSource_.lock());
+  if (source && source->state_ != kDisconnected
+      && source->reading_ && !source->channel_->isReading())
+  {
+    source->channel_->enableReading();
+  }
+}
 
 /**
  * 可写的时候调用
@@ -424,13 +731,11 @@ void TcpConnection::handleWrite()
 
   if (channel_->isWriting())
   {
-    ssize_t n = sockets::write(channel_->fd(),
-                               outputBuffer_.peek(),
-                               outputBuffer_.readableBytes());
+    ssize_t n = writeQueued();
     if (n > 0)
     {
-      outputBuffer_.retrieve(n);
-      if (outputBuffer_.readableBytes() == 0)
+      retrieveQueued(static_cast<size_t>(n));
+      if (queuedBytes() == 0)
       {
         channel_->disableWriting();
 
@@ -438,6 +743,10 @@ void TcpConnection::handleWrite()
         {
           loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
         }
+        if (writePipe_)
+        {
+          resumeSpliceSource();
+        }
         if (state_ == kDisconnecting)
         {
           shutdownInLoop();
@@ -470,6 +779,11 @@ void TcpConnection::handleClose()
   // we don't close fd, leave it to dtor, so we can find leaks easily.
   setState(kDisconnected);
   channel_->disableAll();
+  if (writePipe_)
+  {
+    // so that the source stops splicing to me
+    resumeSpliceSource();
+  }
 
   TcpConnectionPtr guardThis(shared_from_this());
 
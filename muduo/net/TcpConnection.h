@@ -18,10 +18,13 @@
 #include "muduo/net/Buffer.h"
 #include "muduo/net/InetAddress.h"
 
+#include <deque>
 #include <memory>
 
 #include <boost/any.hpp>
 
+// struct iovec is in <sys/uio.h>
+struct iovec;
 // struct tcp_info is in <netinet/tcp.h>
 struct tcp_info; // 各个字段解释说明: https://blog.csdn.net/dyingfair/article/details/95855952
 
@@ -73,6 +76,11 @@ class TcpConnection : noncopyable,
   // void send(Buffer&& message); // C++11
   void send(Buffer* message);  // this one will swap data
 
+  /// Sends iov without copying, owner keeps the bytes alive until
+  /// they are written or the connection is gone.
+  /// In the loop thread only.
+  void send(const struct iovec* iov, int iovcnt, const std::shared_ptr<void>& owner);
+
 
   /// ******** 关闭 ********** ///
   void shutdown(); // NOT thread safe, no simultaneous calling
@@ -124,6 +132,22 @@ class TcpConnection : noncopyable,
   Buffer* outputBuffer()
   { return &outputBuffer_; }
 
+  /// Bytes read while inputBuffer() is empty go to data, up to len, and
+  /// only the rest to inputBuffer(), e.g. to receive a large body in place.
+  /// readTargetFilled() counts them until the next call, len 0 stops it.
+  /// In the loop thread only, data must live until then.
+  void setReadTarget(void* data, size_t len);
+  size_t readTargetFilled() const { return readTargetFilled_; }
+
+  /// Bytes read from now on go to dst with splice(2) through a pipe,
+  /// never to inputBuffer() or user space, and no MessageCallback is called.
+  /// Reading pauses while the pipe can't drain into dst, as with stopRead().
+  /// pipeSize of 0 keeps the default of the kernel, usually 64KiB.
+  /// dst shall not send() otherwise meanwhile, and is not owned.
+  /// When dst is gone or not connected, reading goes on into inputBuffer().
+  /// Both in the same loop, in the loop thread only.
+  void spliceTo(const TcpConnectionPtr& dst, int pipeSize = 0);
+
   /// Internal use only.
   void setCloseCallback(const CloseCallback& cb)
   { closeCallback_ = cb; }
@@ -140,6 +164,7 @@ class TcpConnection : noncopyable,
   enum StateE { kDisconnected, kConnecting, kConnected, kDisconnecting };
 
   void handleRead(Timestamp receiveTime);
+  ssize_t readIntoTarget(int* savedErrno);
   void handleWrite();
   void handleClose();
   void handleError();
@@ -153,6 +178,13 @@ class TcpConnection : noncopyable,
   const char* stateToString() const;
   void startReadInLoop();
   void stopReadInLoop();
+  // outputBuffer_, outputPieces_, then writePipe_
+  size_t queuedBytes() const;
+  ssize_t writeQueued();
+  void retrieveQueued(size_t n);
+  void handleSpliceRead(const TcpConnectionPtr& target);
+  void writePipe();
+  void resumeSpliceSource();
 
   EventLoop* loop_;
   const string name_;
@@ -175,7 +207,28 @@ class TcpConnection : noncopyable,
 
   size_t highWaterMark_;
   Buffer inputBuffer_;
+  char* readTarget_;
+  size_t readTargetLen_;
+  size_t readTargetFilled_;
   Buffer outputBuffer_; // FIXME: use list<Buffer> as output buffer.
+
+  // bytes of send(iov), and of sends after them, queued behind outputBuffer_
+  struct Piece
+  {
+    const char* data;
+    size_t len;
+    std::shared_ptr<void> owner;
+  };
+  std::deque<Piece> outputPieces_;
+  size_t piecesBytes_;
+
+  // readPipe_ of the source is writePipe_ of spliceTarget_,
+  // it outlives either connection until drained
+  struct SplicePipe;
+  std::shared_ptr<SplicePipe> readPipe_;
+  std::weak_ptr<TcpConnection> spliceTarget_;
+  std::shared_ptr<SplicePipe> writePipe_;
+  std::weak_ptr<TcpConnection> spliceSource_;
   boost::any context_;
   // FIXME: creationTime_, lastReceiveTime_
   //        bytesReceived_, bytesSent_
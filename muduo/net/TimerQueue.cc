@@ -12,6 +12,7 @@
 
 #include "muduo/net/TimerQueue.h"
 
+#include "muduo/base/Clock.h"
 #include "muduo/base/Logging.h"
 #include "muduo/net/EventLoop.h"
 #include "muduo/net/Timer.h"
@@ -51,7 +52,7 @@ int createTimerfd()
 struct timespec howMuchTimeFromNow(Timestamp when)
 {
   int64_t microseconds = when.microSecondsSinceEpoch()
-                         - Timestamp::now().microSecondsSinceEpoch();
+                         - Clock::monotonicMicros();
   if (microseconds < 100)
   {
     microseconds = 100;
@@ -71,7 +72,7 @@ void readTimerfd(int timerfd, Timestamp now)
 {
   uint64_t howmany;
   ssize_t n = ::read(timerfd, &howmany, sizeof howmany);
-  LOG_TRACE << "TimerQueue::handleRead() " << howmany << " at " << now.toString();
+  LOG_TRACE << "TimerQueue::handleRead() " << howmany << " at " << now.microSecondsSinceEpoch();
   if (n != sizeof howmany)
   {
     LOG_ERROR << "TimerQueue::handleRead() reads " << n << " bytes instead of 8";
@@ -205,8 +206,8 @@ void TimerQueue::handleRead()
 {
   loop_->assertInLoopThread();
 
-  // 当前时间 
-  Timestamp now(Timestamp::now());
+  // 当前时间, 单调时钟
+  Timestamp now(Clock::monotonic());
   // 读取一下定时器的超时次数； 必须是0次; 否则报错
   readTimerfd(timerfd_, now);
 
@@ -31,6 +31,9 @@ class TimerId;
 ///
 /// A best efforts timer queue.
 /// No guarantee that the callback will be on time.
+///
+/// All Timestamps here are on CLOCK_MONOTONIC (see Clock::monotonic()),
+/// not wall clock, so timers don't jump when the system time is adjusted.
 /// 
 /// 10个函数
 /// 7个本地变量
@@ -41,7 +44,7 @@ class TimerQueue : noncopyable
   ~TimerQueue();
 
   ///
-  /// Schedules the callback to be run at given time,
+  /// Schedules the callback to be run at given monotonic time,
   /// repeats if @c interval > 0.0.
   ///
   /// Must be thread safe. Usually be called from other threads.
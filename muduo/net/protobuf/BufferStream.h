@@ -7,6 +7,7 @@
 //
 // This is a public header file, it must only include public header files.
 #pragma once
+#include "muduo/base/Logging.h"
 #include "muduo/net/Buffer.h"
 #include <google/protobuf/io/zero_copy_stream.h>
 namespace muduo
@@ -14,10 +15,59 @@ namespace muduo
 namespace net
 {
 
-// FIXME:
-// class BufferInputStream : google::protobuf::io::ZeroCopyInputStream
-// {
-// };
+// Reads the readable bytes of a Buffer in place, or the first limit bytes.
+// Doesn't retrieve(), the caller does after parsing.
+// Buffer is contiguous, so it is one chunk with no copy.
+class BufferInputStream : public google::protobuf::io::ZeroCopyInputStream
+{
+ public:
+  explicit BufferInputStream(const Buffer* buf, int limit = -1)
+    : buffer_(CHECK_NOTNULL(buf)),
+      size_(limit < 0 ? static_cast<int>(buf->readableBytes()) : limit),
+      position_(0)
+  {
+    assert(static_cast<size_t>(size_) <= buffer_->readableBytes());
+  }
+
+  virtual bool Next(const void** data, int* size) // override
+  {
+    if (position_ >= size_)
+    {
+      return false;
+    }
+    *data = buffer_->peek() + position_;
+    *size = size_ - position_;
+    position_ = size_;
+    return true;
+  }
+
+  virtual void BackUp(int count) // override
+  {
+    assert(0 <= count && count <= position_);
+    position_ -= count;
+  }
+
+  virtual bool Skip(int count) // override
+  {
+    if (count > size_ - position_)
+    {
+      position_ = size_;
+      return false;
+    }
+    position_ += count;
+    return true;
+  }
+
+  virtual int64_t ByteCount() const // override
+  {
+    return position_;
+  }
+
+ private:
+  const Buffer* buffer_;
+  const int size_;
+  int position_;
+};
 
 class BufferOutputStream : public google::protobuf::io::ZeroCopyOutputStream
 {
@@ -9,14 +9,20 @@
 #include "muduo/net/protobuf/ProtobufCodecLite.h"
 // #include <muduo/net/protobuf/BufferStream.h>
 
+#include "muduo/base/Checksum.h"
 #include "muduo/base/Logging.h"
+#include "muduo/base/ThreadPool.h"
 #include "muduo/net/Endian.h"
+#include "muduo/net/EventLoop.h"
 #include "muduo/net/TcpConnection.h"
 #include "muduo/net/protorpc/google-inl.h"
 
 #include <google/protobuf/message.h>
 #include <zlib.h>
 
+#include <atomic>
+#include <deque>
+
 using namespace muduo;
 using namespace muduo::net;
 
@@ -28,30 +34,246 @@ namespace
     return 0;
   }
   int __attribute__ ((unused)) dummy = ProtobufVersionCheck();
+
+  int byteSizeOf(const google::protobuf::Message& message)
+  {
+  #if GOOGLE_PROTOBUF_VERSION > 3009002
+    return google::protobuf::internal::ToIntSize(message.ByteSizeLong());
+  #else
+    return message.ByteSize();
+  #endif
+  }
+
+  // Runs tasks one at a time in a ThreadPool, in the order posted.
+  class SerialQueue : noncopyable,
+                      public std::enable_shared_from_this<SerialQueue>
+  {
+   public:
+    typedef std::function<void ()> Task;
+
+    SerialQueue()
+      : running_(false)
+    {
+    }
+
+    void post(ThreadPool* pool, Task task)
+    {
+      bool start = false;
+      {
+        MutexLockGuard lock(mutex_);
+        tasks_.push_back(std::move(task));
+        if (!running_)
+        {
+          running_ = start = true;
+        }
+      }
+      if (start)
+      {
+        pool->run(std::bind(&SerialQueue::drain, shared_from_this()));
+      }
+    }
+
+   private:
+    void drain()
+    {
+      while (true)
+      {
+        Task task;
+        {
+          MutexLockGuard lock(mutex_);
+          if (tasks_.empty())
+          {
+            running_ = false;
+            return;
+          }
+          task = std::move(tasks_.front());
+          tasks_.pop_front();
+        }
+        task();
+      }
+    }
+
+    MutexLock mutex_;
+    std::deque<Task> tasks_ GUARDED_BY(mutex_);
+    bool running_ GUARDED_BY(mutex_);
+  };
+}
+
+// outlives the codec, until its work in the pool and in the loop is done
+struct ProtobufCodecLite::Pipeline
+{
+  Pipeline(ProtobufCodecLite* codecArg, ThreadPool* poolArg, int minBytesArg)
+    : pool(poolArg),
+      minBytes(minBytesArg),
+      parsing(new SerialQueue),
+      serializing(new SerialQueue),
+      pendingSends(0),
+      pendingMessages(0),
+      failed(false),
+      idle(mutex),
+      codec(codecArg),
+      working(0)
+  {
+  }
+
+  // the codec, kept until leave(), or NULL if it is gone
+  ProtobufCodecLite* enter()
+  {
+    MutexLockGuard lock(mutex);
+    if (codec)
+    {
+      ++working;
+    }
+    return codec;
+  }
+
+  void leave()
+  {
+    MutexLockGuard lock(mutex);
+    if (--working == 0)
+    {
+      idle.notifyAll();
+    }
+  }
+
+  // in the IO thread, where the codec is destroyed too
+  ProtobufCodecLite* codecInLoop()
+  {
+    MutexLockGuard lock(mutex);
+    return codec;
+  }
+
+  // waits for a parse or serialize in progress, not for queued ones
+  void detach()
+  {
+    MutexLockGuard lock(mutex);
+    codec = NULL;
+    while (working > 0)
+    {
+      idle.wait();
+    }
+  }
+
+  ThreadPool* const pool;
+  const int minBytes;
+  std::shared_ptr<SerialQueue> parsing;
+  std::shared_ptr<SerialQueue> serializing;
+  // offloaded frames not yet handed to TcpConnection
+  std::atomic<int> pendingSends;
+  // offloaded frames not yet called back, in the IO thread
+  int pendingMessages;
+  // stops parsing after an error
+  std::atomic<bool> failed;
+
+  MutexLock mutex;
+  Condition idle GUARDED_BY(mutex);
+  ProtobufCodecLite* codec GUARDED_BY(mutex);
+  int working GUARDED_BY(mutex);
+};
+
+ProtobufCodecLite::~ProtobufCodecLite()
+{
+  if (pipeline_)
+  {
+    pipeline_->detach();
+  }
+}
+
+void ProtobufCodecLite::setThreadPool(ThreadPool* pool, int minBytes)
+{
+  assert(!pipeline_);
+  pipeline_.reset(new Pipeline(this, CHECK_NOTNULL(pool), minBytes));
+}
+
+bool ProtobufCodecLite::shouldOffload(const google::protobuf::Message& message) const
+{
+  // later frames go after the ones in flight
+  return pipeline_ && (pipeline_->pendingSends > 0
+                       || byteSizeOf(message) >= pipeline_->minBytes);
+}
+
+void ProtobufCodecLite::sendInPool(const TcpConnectionPtr& conn,
+                                   const FillBufferCallback& fill)
+{
+  assert(pipeline_);
+  ++pipeline_->pendingSends;
+  std::shared_ptr<Pipeline> pipeline(pipeline_);
+  pipeline_->serializing->post(pipeline_->pool, [pipeline, conn, fill] {
+    if (!pipeline->enter())
+    {
+      // fill may refer to the codec
+      --pipeline->pendingSends;
+      return;
+    }
+    std::shared_ptr<Buffer> buf(new Buffer);
+    fill(buf.get());
+    pipeline->leave();
+    conn->getLoop()->runInLoop(
+        std::bind(&ProtobufCodecLite::sendInLoop, pipeline, conn, buf));
+  });
+}
+
+void ProtobufCodecLite::sendInLoop(const std::shared_ptr<Pipeline>& pipeline,
+                                   const TcpConnectionPtr& conn,
+                                   const std::shared_ptr<Buffer>& buf)
+{
+  conn->send(get_pointer(buf));
+  --pipeline->pendingSends;
 }
 
 void ProtobufCodecLite::send(const TcpConnectionPtr& conn,
                              const ::google::protobuf::Message& message)
 {
+  if (shouldOffload(message))
+  {
+    MessagePtr copy(message.New());
+    copy->CopyFrom(message);
+    send(conn, copy);
+    return;
+  }
   // FIXME: serialize to TcpConnection::outputBuffer()
   muduo::net::Buffer buf;
   fillEmptyBuffer(&buf, message);
   conn->send(&buf);
 }
 
+void ProtobufCodecLite::send(const TcpConnectionPtr& conn,
+                             const MessagePtr& message)
+{
+  if (shouldOffload(*message))
+  {
+    sendInPool(conn, [this, message] (Buffer* buf) {
+      fillEmptyBuffer(buf, *message);
+    });
+  }
+  else
+  {
+    muduo::net::Buffer buf;
+    fillEmptyBuffer(&buf, *message);
+    conn->send(&buf);
+  }
+}
+
 void ProtobufCodecLite::fillEmptyBuffer(muduo::net::Buffer* buf,
                                         const google::protobuf::Message& message)
 {
   assert(buf->readableBytes() == 0);
-  // FIXME: can we move serialization & checksum to other thread?
+  // see setThreadPool() for serialization & checksum in other threads
   buf->append(tag_);
 
   int byte_size = serializeToBuffer(message, buf);
+  assert(buf->readableBytes() == tag_.size() + byte_size); (void) byte_size;
+  finishFrame(buf);
+}
 
-  int32_t checkSum = checksum(buf->peek(), static_cast<int>(buf->readableBytes()));
+void ProtobufCodecLite::finishFrame(muduo::net::Buffer* buf) const
+{
+  ChecksumType type = checksumTypeToSend();
+  int32_t checkSum = checksum(type, buf->peek(), static_cast<int>(buf->readableBytes()));
   buf->appendInt32(checkSum);
-  assert(buf->readableBytes() == tag_.size() + byte_size + kChecksumLen); (void) byte_size;
-  int32_t len = sockets::hostToNetwork32(static_cast<int32_t>(buf->readableBytes()));
+  uint32_t size = static_cast<uint32_t>(buf->readableBytes())
+                  | static_cast<uint32_t>(type) << kChecksumTypeShift;
+  int32_t len = sockets::hostToNetwork32(static_cast<int32_t>(size));
   buf->prepend(&len, sizeof len);
 }
 
@@ -59,14 +281,25 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
                                   Buffer* buf,
                                   Timestamp receiveTime)
 {
+  if (pipeline_ && pipeline_->failed)
+  {
+    return;
+  }
   while (buf->readableBytes() >= static_cast<uint32_t>(kMinMessageLen+kHeaderLen))
   {
-    const int32_t len = buf->peekInt32();
+    const uint32_t size = static_cast<uint32_t>(buf->peekInt32());
+    const int32_t len = static_cast<int32_t>(size & kSizeMask);
+    const ChecksumType type = static_cast<ChecksumType>(size >> kChecksumTypeShift);
     if (len > kMaxMessageLen || len < kMinMessageLen)
     {
       errorCallback_(conn, buf, receiveTime, kInvalidLength);
       break;
     }
+    else if (type == kNoChecksum && checksumType_ != kNoChecksum)
+    {
+      errorCallback_(conn, buf, receiveTime, kCheckSumError);
+      break;
+    }
     else if (buf->readableBytes() >= implicit_cast<size_t>(kHeaderLen+len))
     {
       if (rawCb_ && !rawCb_(conn, StringPiece(buf->peek(), kHeaderLen+len), receiveTime))
@@ -74,11 +307,21 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
         buf->retrieve(kHeaderLen+len);
         continue;
       }
-      MessagePtr message(prototype_->New());
-      // FIXME: can we move deserialization & callback to other thread?
-      ErrorCode errorCode = parse(buf->peek()+kHeaderLen, len, message.get());
+      // later frames go after the ones in flight
+      if (pipeline_ && (len >= pipeline_->minBytes || pipeline_->pendingMessages > 0))
+      {
+        std::shared_ptr<string> frame(new string(buf->peek()+kHeaderLen, len));
+        buf->retrieve(kHeaderLen+len);
+        ++pipeline_->pendingMessages;
+        pipeline_->parsing->post(pipeline_->pool,
+            std::bind(&ProtobufCodecLite::parseInPool, pipeline_, conn, frame, type, receiveTime));
+        continue;
+      }
+      MessagePtr message(newMessage());
+      ErrorCode errorCode = parse(buf->peek()+kHeaderLen, len, type, message.get());
       if (errorCode == kNoError)
       {
+        parsedInLoop();
         // FIXME: try { } catch (...) { }
         messageCallback_(conn, message, receiveTime);
         buf->retrieve(kHeaderLen+len);
@@ -96,6 +339,68 @@ void ProtobufCodecLite::onMessage(const TcpConnectionPtr& conn,
   }
 }
 
+void ProtobufCodecLite::parseInPool(const std::shared_ptr<Pipeline>& pipeline,
+                                    const TcpConnectionPtr& conn,
+                                    const std::shared_ptr<string>& frame,
+                                    ChecksumType type,
+                                    Timestamp receiveTime)
+{
+  MessagePtr message;
+  std::shared_ptr<void> state;
+  ErrorCode errorCode = kNoError;
+  if (!pipeline->failed)
+  {
+    ProtobufCodecLite* codec = pipeline->enter();
+    if (codec)
+    {
+      // not newMessage(), the IO thread may be parsing into the cached one
+      message.reset(codec->prototype_->New());
+      errorCode = codec->parse(frame->data(), static_cast<int>(frame->size()), type, message.get());
+      if (errorCode == kNoError)
+      {
+        state = codec->takeParseState();
+      }
+      else
+      {
+        pipeline->failed = true;
+      }
+      pipeline->leave();
+    }
+  }
+  // called back in order, frame lives until then
+  conn->getLoop()->queueInLoop([pipeline, conn, frame, message, state, errorCode, receiveTime] {
+    --pipeline->pendingMessages;
+    ProtobufCodecLite* codec = pipeline->codecInLoop();
+    if (!codec || !message)
+    {
+      return;
+    }
+    if (errorCode == kNoError)
+    {
+      codec->putParseState(state);
+      codec->messageCallback_(conn, message, receiveTime);
+    }
+    else
+    {
+      codec->errorCallback_(conn, conn->inputBuffer(), receiveTime, errorCode);
+    }
+  });
+}
+
+MessagePtr ProtobufCodecLite::newMessage()
+{
+  if (!reuseMessage_)
+  {
+    return MessagePtr(prototype_->New());
+  }
+  // parsing clears it
+  if (!cachedMessage_ || cachedMessage_.use_count() > 1)
+  {
+    cachedMessage_.reset(prototype_->New());
+  }
+  return cachedMessage_;
+}
+
 bool ProtobufCodecLite::parseFromBuffer(StringPiece buf, google::protobuf::Message* message)
 {
   return message->ParseFromArray(buf.data(), buf.size());
@@ -199,20 +504,48 @@ int32_t ProtobufCodecLite::checksum(const void* buf, int len)
 }
 
 bool ProtobufCodecLite::validateChecksum(const char* buf, int len)
+{
+  return validateChecksum(kAdler32, buf, len);
+}
+
+int32_t ProtobufCodecLite::checksum(ChecksumType type, const void* buf, int len)
+{
+  switch (type)
+  {
+   case kAdler32:
+     return checksum(buf, len);
+   case kCrc32c:
+     return static_cast<int32_t>(Checksum::crc32c(buf, len));
+   case kXxHash32:
+     return static_cast<int32_t>(Checksum::xxhash32(buf, len));
+   default:
+     return 0;
+  }
+}
+
+bool ProtobufCodecLite::validateChecksum(ChecksumType type, const char* buf, int len)
 {
   // check sum
   int32_t expectedCheckSum = asInt32(buf + len - kChecksumLen);
-  int32_t checkSum = checksum(buf, len - kChecksumLen);
+  int32_t checkSum = checksum(type, buf, len - kChecksumLen);
   return checkSum == expectedCheckSum;
 }
 
 ProtobufCodecLite::ErrorCode ProtobufCodecLite::parse(const char* buf,
                                                       int len,
                                                       ::google::protobuf::Message* message)
+{
+  return parse(buf, len, kAdler32, message);
+}
+
+ProtobufCodecLite::ErrorCode ProtobufCodecLite::parse(const char* buf,
+                                                      int len,
+                                                      ChecksumType type,
+                                                      ::google::protobuf::Message* message)
 {
   ErrorCode error = kNoError;
 
-  if (validateChecksum(buf, len))
+  if (validateChecksum(type, buf, len))
   {
     if (memcmp(buf, tag_.data(), tag_.size()) == 0)
     {
@@ -222,6 +555,7 @@ ProtobufCodecLite::ErrorCode ProtobufCodecLite::parse(const char* buf,
       if (parseFromBuffer(StringPiece(data, dataLen), message))
       {
         error = kNoError;
+        peerChecksumType_ = type;
       }
       else
       {
@@ -19,6 +19,7 @@
 #include "muduo/base/Timestamp.h"
 #include "muduo/net/Callbacks.h"
 
+#include <atomic>
 #include <memory>
 #include <type_traits>
 
@@ -32,6 +33,8 @@ class Message;
 
 namespace muduo
 {
+class ThreadPool;
+
 namespace net
 {
 
@@ -46,6 +49,9 @@ typedef std::shared_ptr<google::protobuf::Message> MessagePtr;
 // payload   N-byte
 // checksum  4-byte  adler32 of tag+payload
 //
+// The top 2 bits of size tell the checksum type, see setChecksumType(),
+// they are 0 for adler32, as older versions always send.
+//
 // This is an internal class, you should use ProtobufCodecT instead.
 class ProtobufCodecLite : noncopyable
 {
@@ -53,6 +59,18 @@ class ProtobufCodecLite : noncopyable
   const static int kHeaderLen = sizeof(int32_t);
   const static int kChecksumLen = sizeof(int32_t);
   const static int kMaxMessageLen = 64*1024*1024; // same as codec_stream.h kDefaultTotalBytesLimit
+  const static int kDefaultOffloadBytes = 64*1024;
+
+  // marked in the top 2 bits of size
+  enum ChecksumType
+  {
+    kAdler32 = 0,
+    kCrc32c = 1,     // SSE4.2 crc32 instruction if available
+    kXxHash32 = 2,
+    kNoChecksum = 3, // for trusted loopback
+  };
+  const static int kChecksumTypeShift = 30;
+  const static uint32_t kSizeMask = (1u << kChecksumTypeShift) - 1;
 
   enum ErrorCode
   {
@@ -78,6 +96,8 @@ class ProtobufCodecLite : noncopyable
                               Timestamp,
                               ErrorCode)> ErrorCallback;
 
+  typedef std::function<void (Buffer*)> FillBufferCallback;
+
   ProtobufCodecLite(const ::google::protobuf::Message* prototype,
                     StringPiece tagArg,
                     const ProtobufMessageCallback& messageCb,
@@ -88,16 +108,64 @@ class ProtobufCodecLite : noncopyable
       messageCallback_(messageCb),
       rawCb_(rawCb),
       errorCallback_(errorCb),
-      kMinMessageLen(tagArg.size() + kChecksumLen)
+      kMinMessageLen(tagArg.size() + kChecksumLen),
+      reuseMessage_(false),
+      checksumType_(kAdler32),
+      checksumFollowsPeer_(false),
+      peerChecksumType_(kAdler32)
   {
   }
 
-  virtual ~ProtobufCodecLite() = default;
+  // waits for its work in the thread pool, if any
+  virtual ~ProtobufCodecLite();
 
   const string& tag() const { return tag_; }
 
+  // Parses the next frame into the previous message if the callback
+  // didn't keep a reference to it, saving a New() and the allocations
+  // of its fields per message.
+  // Only when onMessage() is called in one thread, e.g. a codec per connection.
+  void setReuseMessage(bool on) { reuseMessage_ = on; }
+
+  // Checksum of frames sent, kAdler32 by default, the only one older
+  // versions understand.  Frames of any type are received, except
+  // kNoChecksum ones, which are only accepted if it is set here too.
+  void setChecksumType(ChecksumType type)
+  {
+    checksumType_ = type;
+    peerChecksumType_ = type;
+  }
+  // Sends frames with the checksum type of the last frame received,
+  // so that a server answers each client in the type it chose.
+  void setChecksumFollowsPeer(bool on) { checksumFollowsPeer_ = on; }
+  ChecksumType checksumTypeToSend() const
+  {
+    return checksumFollowsPeer_ ? static_cast<ChecksumType>(peerChecksumType_.load())
+                                : checksumType_;
+  }
+
+  // Moves parsing, serializing and checksum of messages of at least
+  // minBytes off the IO thread, framing stays there.
+  // Messages of a connection are still called back and sent in order:
+  // smaller ones queue up behind big ones in flight.
+  // Callbacks run in the IO thread, offloaded messages go back there
+  // once parsed.  Destruction waits for a parse or serialize in progress
+  // only, queued ones are dropped.
+  // Only for a codec per connection, call before the first message.
+  void setThreadPool(ThreadPool* pool, int minBytes = kDefaultOffloadBytes);
+
+  // copies message when offloaded, prefer the MessagePtr one for big messages
   void send(const TcpConnectionPtr& conn,
             const ::google::protobuf::Message& message);
+  // message must not be modified afterwards
+  void send(const TcpConnectionPtr& conn,
+            const MessagePtr& message);
+
+  // For derived codecs which frame messages their own way:
+  // true if message should be sent by sendInPool()
+  bool shouldOffload(const google::protobuf::Message& message) const;
+  // fill builds the frame in the pool, then it is sent in the IO thread
+  void sendInPool(const TcpConnectionPtr& conn, const FillBufferCallback& fill);
 
   void onMessage(const TcpConnectionPtr& conn,
                  Buffer* buf,
@@ -111,22 +179,57 @@ class ProtobufCodecLite : noncopyable
   // public for unit tests
   ErrorCode parse(const char* buf, int len, ::google::protobuf::Message* message);
   void fillEmptyBuffer(muduo::net::Buffer* buf, const google::protobuf::Message& message);
+  // appends checksum of tag+payload in buf, then prepends size
+  void finishFrame(muduo::net::Buffer* buf) const;
 
+  // adler32
   static int32_t checksum(const void* buf, int len);
   static bool validateChecksum(const char* buf, int len);
+  static int32_t checksum(ChecksumType type, const void* buf, int len);
+  static bool validateChecksum(ChecksumType type, const char* buf, int len);
   static int32_t asInt32(const char* buf);
   static void defaultErrorCallback(const TcpConnectionPtr&,
                                    Buffer*,
                                    Timestamp,
                                    ErrorCode);
 
+ protected:
+  // For codecs whose parseFromBuffer() leaves state for the message
+  // callback, eg. payload() of ZeroCopyRpcCodecLite: taken in the thread
+  // which parsed an offloaded frame, put back in the IO thread before
+  // its callback.  The frame outlives the callback.
+  virtual std::shared_ptr<void> takeParseState() { return std::shared_ptr<void>(); }
+  virtual void putParseState(const std::shared_ptr<void>&) {}
+  // A frame parsed in the IO thread, its state is for the callback as is.
+  virtual void parsedInLoop() {}
+
  private:
+  struct Pipeline;
+
+  MessagePtr newMessage();
+  ErrorCode parse(const char* buf, int len, ChecksumType type,
+                  ::google::protobuf::Message* message);
+  static void parseInPool(const std::shared_ptr<Pipeline>& pipeline,
+                          const TcpConnectionPtr& conn,
+                          const std::shared_ptr<string>& frame,
+                          ChecksumType type,
+                          Timestamp receiveTime);
+  static void sendInLoop(const std::shared_ptr<Pipeline>& pipeline,
+                         const TcpConnectionPtr& conn,
+                         const std::shared_ptr<Buffer>& buf);
+
   const ::google::protobuf::Message* prototype_;
   const string tag_;
   ProtobufMessageCallback messageCallback_;
   RawMessageCallback rawCb_;
   ErrorCallback errorCallback_;
   const int kMinMessageLen;
+  bool reuseMessage_;
+  MessagePtr cachedMessage_;
+  std::shared_ptr<Pipeline> pipeline_;
+  ChecksumType checksumType_;
+  bool checksumFollowsPeer_;
+  std::atomic<int> peerChecksumType_;
 };
 
 template<typename MSG, const char* TAG, typename CODEC=ProtobufCodecLite>  // TAG must be a variable with external linkage, not a string literal
@@ -155,6 +258,11 @@ class ProtobufCodecLiteT
 
   const string& tag() const { return codec_.tag(); }
 
+  CODEC& codec() { return codec_; }
+  const CODEC& codec() const { return codec_; }
+
+  void setReuseMessage(bool on) { codec_.setReuseMessage(on); }
+
   void send(const TcpConnectionPtr& conn,
             const MSG& message)
   {
@@ -0,0 +1,162 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include "muduo/net/protorpc/CallTable.h"
+
+#include <assert.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+const size_t kInitialSlots = 16;  // power of 2
+}
+
+CallTable::Shard::Shard()
+  : slots(kInitialSlots),
+    size(0)
+{
+}
+
+size_t CallTable::Shard::home(int64_t id) const
+{
+  // low bits picked the shard already, Fibonacci hashing spreads the rest
+  uint64_t h = static_cast<uint64_t>(id / kShards) * 0x9E3779B97F4A7C15ULL;
+  return static_cast<size_t>(h >> 32) & (slots.size() - 1);
+}
+
+CallTable::Slot* CallTable::Shard::find(int64_t id)
+{
+  const size_t mask = slots.size() - 1;
+  for (size_t i = home(id); ; i = (i + 1) & mask)
+  {
+    if (slots[i].id == id)
+    {
+      return &slots[i];
+    }
+    if (slots[i].id == 0)
+    {
+      return NULL;
+    }
+  }
+}
+
+void CallTable::Shard::erase(Slot* slot)
+{
+  // backward shift deletion, no tombstones
+  const size_t mask = slots.size() - 1;
+  size_t hole = static_cast<size_t>(slot - &slots[0]);
+  for (size_t i = (hole + 1) & mask; slots[i].id != 0; i = (i + 1) & mask)
+  {
+    size_t h = home(slots[i].id);
+    // moves slots[i] into hole if hole lies in [h, i) cyclically
+    if (((i - h) & mask) >= ((i - hole) & mask))
+    {
+      slots[hole] = slots[i];
+      hole = i;
+    }
+  }
+  slots[hole].id = 0;
+  --size;
+}
+
+void CallTable::Shard::grow()
+{
+  std::vector<Slot> old(slots.size() * 2);
+  old.swap(slots);
+  const size_t mask = slots.size() - 1;
+  for (const Slot& slot : old)
+  {
+    if (slot.id != 0)
+    {
+      size_t i = home(slot.id);
+      while (slots[i].id != 0)
+      {
+        i = (i + 1) & mask;
+      }
+      slots[i] = slot;
+    }
+  }
+}
+
+CallTable::CallTable()
+  : total_(0)
+{
+}
+
+void CallTable::insert(int64_t id, const Call& call)
+{
+  assert(id > 0);
+  Shard& shard = shardOf(id);
+  MutexLockGuard lock(shard.mutex);
+  // keeps load factor under 1/2
+  if ((shard.size + 1) * 2 > shard.slots.size())
+  {
+    shard.grow();
+  }
+  const size_t mask = shard.slots.size() - 1;
+  size_t i = shard.home(id);
+  while (shard.slots[i].id != 0)
+  {
+    assert(shard.slots[i].id != id);
+    i = (i + 1) & mask;
+  }
+  shard.slots[i].id = id;
+  shard.slots[i].call = call;
+  ++shard.size;
+  total_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool CallTable::take(int64_t id, Call* call)
+{
+  if (id <= 0)
+  {
+    return false;
+  }
+  Shard& shard = shardOf(id);
+  MutexLockGuard lock(shard.mutex);
+  Slot* slot = shard.find(id);
+  if (slot)
+  {
+    *call = slot->call;
+    shard.erase(slot);
+    total_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+bool CallTable::setTimer(int64_t id, TimerId timer)
+{
+  Shard& shard = shardOf(id);
+  MutexLockGuard lock(shard.mutex);
+  Slot* slot = shard.find(id);
+  if (slot)
+  {
+    slot->call.timer = timer;
+    slot->call.hasTimer = true;
+    return true;
+  }
+  return false;
+}
+
+void CallTable::takeAll(std::vector<Call>* calls)
+{
+  for (Shard& shard : shards_)
+  {
+    MutexLockGuard lock(shard.mutex);
+    for (Slot& slot : shard.slots)
+    {
+      if (slot.id != 0)
+      {
+        calls->push_back(slot.call);
+        slot.id = 0;
+      }
+    }
+    total_.fetch_sub(shard.size, std::memory_order_relaxed);
+    shard.size = 0;
+  }
+}
@@ -0,0 +1,104 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is an internal header file, you should not include this.
+
+#ifndef MUDUO_NET_PROTORPC_CALLTABLE_H
+#define MUDUO_NET_PROTORPC_CALLTABLE_H
+
+#include "muduo/base/Mutex.h"
+#include "muduo/net/TimerId.h"
+
+#include <atomic>
+#include <vector>
+
+namespace google
+{
+namespace protobuf
+{
+class Closure;
+class Message;
+class MethodDescriptor;
+}
+}
+
+namespace muduo
+{
+namespace net
+{
+
+class RpcController;
+
+///
+/// Outstanding calls of an RpcChannel, keyed by call id.
+///
+/// Ids come from a counter, consecutive calls land in different shards,
+/// so the caller inserting and the IO thread taking rarely meet on a lock.
+/// Each shard is an open addressing table with linear probing.
+///
+class CallTable : noncopyable
+{
+ public:
+  struct Call
+  {
+    const ::google::protobuf::MethodDescriptor* method;
+    ::google::protobuf::Message* response;
+    ::google::protobuf::Closure* done;
+    RpcController* controller;
+    TimerId timer;  // deadline
+    bool hasTimer;
+  };
+
+  CallTable();
+
+  /// @param id must be positive and not in the table
+  void insert(int64_t id, const Call& call);
+
+  /// Removes the call of id, returns false if it is not there,
+  /// e.g. completed by response, timeout or cancel already.
+  bool take(int64_t id, Call* call);
+
+  /// Sets timer of the call of id, returns false if it is not there.
+  bool setTimer(int64_t id, TimerId timer);
+
+  /// Removes all calls.
+  void takeAll(std::vector<Call>* calls);
+
+  /// Exact when no one is changing the table, cheap enough for load balancing.
+  size_t size() const { return total_.load(std::memory_order_relaxed); }
+
+ private:
+  static const int kShards = 16;
+
+  struct Slot
+  {
+    int64_t id;  // 0 for empty
+    Call call;
+  };
+
+  struct Shard
+  {
+    Shard();
+
+    Slot* find(int64_t id) REQUIRES(mutex);
+    void erase(Slot* slot) REQUIRES(mutex);
+    void grow() REQUIRES(mutex);
+    size_t home(int64_t id) const REQUIRES(mutex);
+
+    mutable MutexLock mutex;
+    std::vector<Slot> slots GUARDED_BY(mutex);
+    size_t size GUARDED_BY(mutex);
+  };
+
+  Shard& shardOf(int64_t id) { return shards_[id % kShards]; }
+
+  Shard shards_[kShards];
+  std::atomic<size_t> total_;
+};
+
+}  // namespace net
+}  // namespace muduo
+
+#endif  // MUDUO_NET_PROTORPC_CALLTABLE_H
@@ -0,0 +1,100 @@
+#undef NDEBUG
+#include "muduo/net/protorpc/CallTable.h"
+
+#include <map>
+#include <vector>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// the response pointer carries the id, to check what comes back
+CallTable::Call makeCall(int64_t id)
+{
+  CallTable::Call call = { NULL, reinterpret_cast<google::protobuf::Message*>(id),
+                           NULL, NULL, TimerId(), false };
+  return call;
+}
+
+void testBasic()
+{
+  CallTable table;
+  CallTable::Call call;
+  assert(!table.take(1, &call));
+  assert(!table.take(0, &call));
+  table.insert(1, makeCall(1));
+  assert(table.size() == 1);
+  assert(!table.take(17, &call));  // same shard
+  assert(table.take(1, &call));
+  assert(call.response == makeCall(1).response);
+  assert(!call.hasTimer);
+  assert(!table.take(1, &call));
+  assert(table.size() == 0);
+
+  table.insert(2, makeCall(2));
+  assert(table.setTimer(2, TimerId()));
+  assert(!table.setTimer(3, TimerId()));
+  assert(table.take(2, &call));
+  assert(call.hasTimer);
+}
+
+// random inserts and takes against std::map, ids growing like RpcChannel's
+void testRandom()
+{
+  CallTable table;
+  std::map<int64_t, CallTable::Call> expected;
+  std::vector<int64_t> live;
+  int64_t nextId = 0;
+  srand(42);
+  for (int i = 0; i < 1000 * 1000; ++i)
+  {
+    // drifts between a few and a few thousands outstanding
+    int insertPercent = (i / 100000) % 2 ? 70 : 40;
+    if (live.empty() || rand() % 100 < insertPercent)
+    {
+      int64_t id = ++nextId;
+      table.insert(id, makeCall(id));
+      expected[id] = makeCall(id);
+      live.push_back(id);
+    }
+    else
+    {
+      size_t idx = static_cast<size_t>(rand()) % live.size();
+      int64_t id = live[idx];
+      live[idx] = live.back();
+      live.pop_back();
+      CallTable::Call call;
+      assert(table.take(id, &call));
+      assert(call.response == expected[id].response);
+      expected.erase(id);
+      assert(!table.take(id, &call));
+    }
+  }
+  assert(table.size() == expected.size());
+  for (const auto& kv : expected)
+  {
+    CallTable::Call call;
+    assert(table.take(kv.first, &call));
+    assert(call.response == kv.second.response);
+  }
+  assert(table.size() == 0);
+
+  for (int64_t id = 1; id <= 1000; ++id)
+  {
+    table.insert(nextId + id, makeCall(id));
+  }
+  std::vector<CallTable::Call> all;
+  table.takeAll(&all);
+  assert(all.size() == 1000);
+  assert(table.size() == 0);
+}
+
+int main()
+{
+  testBasic();
+  testRandom();
+  printf("All pass!!!\n");
+}
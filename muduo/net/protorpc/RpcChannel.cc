@@ -9,39 +9,92 @@
 #include "muduo/net/protorpc/RpcChannel.h"
 
 #include "muduo/base/Logging.h"
+#include "muduo/base/ThreadPool.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/TcpConnection.h"
+#include "muduo/net/protorpc/CallTable.h"
+#include "muduo/net/protorpc/RpcMethodTable.h"
 #include "muduo/net/protorpc/rpc.pb.h"
 
 #include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
 
 using namespace muduo;
 using namespace muduo::net;
 
 RpcChannel::RpcChannel()
   : codec_(std::bind(&RpcChannel::onRpcMessage, this, _1, _2, _3)),
-    services_(NULL)
+    timeout_(0),
+    outstandings_(new CallTable),
+    useMethodIds_(true),
+    batching_(false),
+    batch_(new Batch),
+    services_(NULL),
+    methods_(NULL),
+    streamHighWaterMark_(kDefaultStreamHighWaterMark),
+    waitingForWriteComplete_(false)
 {
   LOG_INFO << "RpcChannel::ctor - " << this;
+  codec_.setReuseMessage(true);
 }
 
 RpcChannel::RpcChannel(const TcpConnectionPtr& conn)
   : codec_(std::bind(&RpcChannel::onRpcMessage, this, _1, _2, _3)),
     conn_(conn),
-    services_(NULL)
+    timeout_(0),
+    outstandings_(new CallTable),
+    useMethodIds_(true),
+    batching_(false),
+    batch_(new Batch),
+    services_(NULL),
+    methods_(NULL),
+    streamHighWaterMark_(kDefaultStreamHighWaterMark),
+    waitingForWriteComplete_(false)
 {
   LOG_INFO << "RpcChannel::ctor - " << this;
+  codec_.setReuseMessage(true);
 }
 
 RpcChannel::~RpcChannel()
 {
   LOG_INFO << "RpcChannel::dtor - " << this;
-  for (const auto& outstanding : outstandings_)
+  if (waitingForWriteComplete_ && conn_)
   {
-    OutstandingCall out = outstanding.second;
+    conn_->setWriteCompleteCallback(WriteCompleteCallback());
+  }
+  for (auto& streams : { &callerStreams_, &calleeStreams_ })
+  {
+    std::map<int64_t, RpcStreamPtr> closing;
+    closing.swap(*streams);
+    for (const auto& it : closing)
+    {
+      it.second->onClose(NO_CONNECTION);
+    }
+  }
+  std::vector<CallTable::Call> calls;
+  outstandings_->takeAll(&calls);
+  for (const CallTable::Call& out : calls)
+  {
+    if (out.hasTimer && conn_)
+    {
+      conn_->getLoop()->cancel(out.timer);
+    }
+    if (out.controller)
+    {
+      out.controller->clearCall();
+    }
     delete out.response;
     delete out.done;
   }
 }
 
+void RpcChannel::setConnection(const TcpConnectionPtr& conn)
+{
+  conn_ = conn;
+  MutexLockGuard lock(mutex_);
+  methodIds_.clear();
+}
+
   // Call the given method of the remote service.  The signature of this
   // procedure looks the same as Service::CallMethod(), but the requirements
   // are less strict in one important way:  the request and response objects
@@ -57,16 +110,369 @@ void RpcChannel::CallMethod(const ::google::protobuf::MethodDescriptor* method,
   message.set_type(REQUEST);
   int64_t id = id_.incrementAndGet();
   message.set_id(id);
-  message.set_service(method->service()->full_name());
-  message.set_method(method->name());
-  message.set_request(request->SerializeAsString()); // FIXME: error check
+  setMethod(method, &message);
+  addCall(id, method, controller, response, done);
+  if (batching_ && !codec_.codec().shouldOffload(*request))
+  {
+    Buffer frame;
+    codec_.codec().fillEmptyBuffer(&frame, message, RpcMessage::kRequestFieldNumber, *request);
+    bool first = false;
+    {
+      MutexLockGuard lock(batch_->mutex);
+      first = batch_->frames.readableBytes() == 0;
+      if (first)
+      {
+        batch_->frames.swap(frame);
+      }
+      else
+      {
+        batch_->frames.append(frame.peek(), frame.readableBytes());
+      }
+    }
+    if (first)
+    {
+      // after other events of this iteration, which may call more
+      conn_->getLoop()->queueInLoop(std::bind(&RpcChannel::flushBatch, batch_, conn_));
+    }
+  }
+  else
+  {
+    codec_.codec().send(conn_, message, RpcMessage::kRequestFieldNumber, *request);
+  }
+}
 
-  OutstandingCall out = { response, done };
+void RpcChannel::setMethod(const ::google::protobuf::MethodDescriptor* method,
+                           RpcMessage* message)
+{
+  uint32_t methodId = 0;
+  if (useMethodIds_)
   {
-  MutexLockGuard lock(mutex_);
-  outstandings_[id] = out;
+    MutexLockGuard lock(mutex_);
+    auto it = methodIds_.find(method);
+    if (it != methodIds_.end())
+    {
+      methodId = it->second;
+    }
+  }
+  if (methodId)
+  {
+    message->set_method_id(methodId);
   }
+  else
+  {
+    message->set_service(method->service()->full_name());
+    message->set_method(method->name());
+  }
+}
+
+void RpcChannel::addCall(int64_t id,
+                         const ::google::protobuf::MethodDescriptor* method,
+                         ::google::protobuf::RpcController* controller,
+                         ::google::protobuf::Message* response,
+                         ::google::protobuf::Closure* done)
+{
+  RpcController* rpcController = dynamic_cast<RpcController*>(controller);
+  double timeout = timeout_;
+  if (rpcController)
+  {
+    rpcController->setCall(shared_from_this(), id);
+    if (rpcController->timeout() > 0)
+    {
+      timeout = rpcController->timeout();
+    }
+  }
+
+  CallTable::Call out = { method, response, done, rpcController, TimerId(), false };
+  outstandings_->insert(id, out);
+  if (timeout > 0)
+  {
+    EventLoop* loop = conn_->getLoop();
+    std::weak_ptr<RpcChannel> wkChannel(shared_from_this());
+    TimerId timer = loop->runAfter(timeout, std::bind(&RpcChannel::completeIfAlive, wkChannel, id, TIMEOUT));
+    // answered already, by a fast server on another thread
+    if (!outstandings_->setTimer(id, timer))
+    {
+      loop->cancel(timer);
+    }
+  }
+  // after insert(), onDisconnected() either takes the call or
+  // it has marked the connection down before we look
+  failIfDisconnected(id);
+}
+
+void RpcChannel::failIfDisconnected(int64_t id)
+{
+  if (!conn_->connected())
+  {
+    std::weak_ptr<RpcChannel> wkChannel(shared_from_this());
+    conn_->getLoop()->queueInLoop(std::bind(&RpcChannel::completeIfAlive, wkChannel, id, NO_CONNECTION));
+  }
+}
+
+RpcStreamPtr RpcChannel::callServerStream(const ::google::protobuf::MethodDescriptor* method,
+                                          const ::google::protobuf::Message& request,
+                                          int window)
+{
+  conn_->getLoop()->assertInLoopThread();
+  RpcMessage message;
+  message.set_type(REQUEST);
+  int64_t id = id_.incrementAndGet();
+  message.set_id(id);
+  setMethod(method, &message);
+  message.set_server_stream(true);
+  message.set_credit(window);
+
+  const google::protobuf::Message* prototype =
+    google::protobuf::MessageFactory::generated_factory()->GetPrototype(method->output_type());
+  RpcStreamPtr stream(new RpcStream(this, id, true, 0, window, prototype));
+  stream->finished_ = true;  // the request is all we send
+  callerStreams_[id] = stream;
+  codec_.codec().send(conn_, message, RpcMessage::kRequestFieldNumber, request);
+  failIfDisconnected(id);
+  return stream;
+}
+
+RpcStreamPtr RpcChannel::callClientStream(const ::google::protobuf::MethodDescriptor* method,
+                                          ::google::protobuf::RpcController* controller,
+                                          ::google::protobuf::Message* response,
+                                          ::google::protobuf::Closure* done)
+{
+  conn_->getLoop()->assertInLoopThread();
+  RpcMessage message;
+  message.set_type(REQUEST);
+  int64_t id = id_.incrementAndGet();
+  message.set_id(id);
+  setMethod(method, &message);
+  message.set_client_stream(true);
+  addCall(id, method, controller, response, done);
+
+  RpcStreamPtr stream(new RpcStream(this, id, true, RpcStream::kDefaultWindow, 0, NULL));
+  stream->ended_ = true;  // the response comes as a unary one
+  callerStreams_[id] = stream;
   codec_.send(conn_, message);
+  return stream;
+}
+
+void RpcChannel::onWriteComplete(const TcpConnectionPtr& conn)
+{
+  // an empty one costs nothing on every send
+  conn->setWriteCompleteCallback(WriteCompleteCallback());
+  waitingForWriteComplete_ = false;
+  for (auto& streams : { &callerStreams_, &calleeStreams_ })
+  {
+    // callbacks may add or remove streams
+    std::vector<RpcStreamPtr> waiting;
+    for (const auto& it : *streams)
+    {
+      if (it.second->writableCallback_)
+      {
+        waiting.push_back(it.second);
+      }
+    }
+    for (const RpcStreamPtr& stream : waiting)
+    {
+      stream->onWritable();
+    }
+  }
+}
+
+void RpcChannel::onStreamFrame(const RpcMessage& message, StringPiece payload)
+{
+  std::map<int64_t, RpcStreamPtr>& streams =
+    message.type() == STREAM_REQUEST ? calleeStreams_ : callerStreams_;
+  auto it = streams.find(message.id());
+  if (it == streams.end())
+  {
+    // aborted already
+    return;
+  }
+  RpcStreamPtr stream(it->second);
+  if (message.has_request() || message.has_response())
+  {
+    stream->onData(payload);
+  }
+  if (message.credit() > 0)
+  {
+    stream->onCredit(static_cast<int>(message.credit()));
+  }
+  if (message.end())
+  {
+    stream->onEnd(message.error());
+  }
+}
+
+void RpcChannel::sendStreamFrame(RpcStream* stream,
+                                 const ::google::protobuf::Message* payload,
+                                 int credit,
+                                 bool end,
+                                 ErrorCode error)
+{
+  RpcMessage message;
+  message.set_type(stream->caller_ ? STREAM_REQUEST : STREAM_RESPONSE);
+  message.set_id(stream->id_);
+  if (credit > 0)
+  {
+    message.set_credit(credit);
+  }
+  if (end)
+  {
+    message.set_end(true);
+    if (error != NO_ERROR)
+    {
+      message.set_error(error);
+    }
+  }
+  if (payload)
+  {
+    int field = stream->caller_ ? RpcMessage::kRequestFieldNumber : RpcMessage::kResponseFieldNumber;
+    codec_.codec().send(conn_, message, field, *payload);
+  }
+  else
+  {
+    codec_.send(conn_, message);
+  }
+}
+
+bool RpcChannel::belowStreamHighWaterMark()
+{
+  if (!conn_)
+  {
+    return false;
+  }
+  if (conn_->outputBuffer()->readableBytes() < streamHighWaterMark_)
+  {
+    return true;
+  }
+  if (!waitingForWriteComplete_)
+  {
+    waitingForWriteComplete_ = true;
+    conn_->setWriteCompleteCallback(std::bind(&RpcChannel::onWriteComplete, this, _1));
+  }
+  return false;
+}
+
+void RpcChannel::closeStreamIfDone(RpcStream* stream)
+{
+  if (stream->finished_ && stream->ended_)
+  {
+    stream->channel_ = NULL;
+    (stream->caller_ ? callerStreams_ : calleeStreams_).erase(stream->id_);
+  }
+}
+
+void RpcChannel::closeStream(std::map<int64_t, RpcStreamPtr>* streams,
+                             int64_t id,
+                             ErrorCode error)
+{
+  if (!streams->empty())
+  {
+    auto it = streams->find(id);
+    if (it != streams->end())
+    {
+      RpcStreamPtr stream(it->second);
+      streams->erase(it);
+      stream->onClose(error);
+    }
+  }
+}
+
+void RpcChannel::flushBatch(const std::shared_ptr<Batch>& batch,
+                            const TcpConnectionPtr& conn)
+{
+  Buffer frames;
+  {
+    MutexLockGuard lock(batch->mutex);
+    frames.swap(batch->frames);
+  }
+  conn->send(&frames);
+}
+
+void RpcChannel::cancel(int64_t id)
+{
+  std::weak_ptr<RpcChannel> wkChannel(shared_from_this());
+  conn_->getLoop()->runInLoop(std::bind(&RpcChannel::completeIfAlive, wkChannel, id, CANCELED));
+}
+
+size_t RpcChannel::outstandings() const
+{
+  return outstandings_->size();
+}
+
+void RpcChannel::onDisconnected()
+{
+  conn_->getLoop()->assertInLoopThread();
+  if (waitingForWriteComplete_)
+  {
+    conn_->setWriteCompleteCallback(WriteCompleteCallback());
+    waitingForWriteComplete_ = false;
+  }
+  // streams first, as completeWithError() does
+  for (auto& streams : { &callerStreams_, &calleeStreams_ })
+  {
+    std::map<int64_t, RpcStreamPtr> closing;
+    closing.swap(*streams);
+    for (const auto& it : closing)
+    {
+      it.second->onClose(NO_CONNECTION);
+    }
+  }
+  std::vector<CallTable::Call> calls;
+  outstandings_->takeAll(&calls);
+  LOG_DEBUG << "RpcChannel::onDisconnected fails " << calls.size() << " calls";
+  for (const CallTable::Call& out : calls)
+  {
+    if (out.hasTimer)
+    {
+      conn_->getLoop()->cancel(out.timer);
+    }
+    std::unique_ptr<google::protobuf::Message> d(out.response);
+    if (out.controller)
+    {
+      out.controller->clearCall();
+      out.controller->setFailed(NO_CONNECTION, ErrorCode_Name(NO_CONNECTION));
+    }
+    if (out.done)
+    {
+      out.done->Run();
+    }
+  }
+}
+
+void RpcChannel::completeIfAlive(const std::weak_ptr<RpcChannel>& wkChannel,
+                                 int64_t id,
+                                 ErrorCode error)
+{
+  RpcChannelPtr channel(wkChannel.lock());
+  if (channel)
+  {
+    channel->completeWithError(id, error);
+  }
+}
+
+void RpcChannel::completeWithError(int64_t id, ErrorCode error)
+{
+  // a server stream has no call waiting
+  closeStream(&callerStreams_, id, error);
+  CallTable::Call out;
+  if (!outstandings_->take(id, &out))
+  {
+    return;
+  }
+  if (out.hasTimer && error != TIMEOUT)
+  {
+    conn_->getLoop()->cancel(out.timer);
+  }
+  LOG_DEBUG << "RpcChannel::completeWithError id " << id << " " << ErrorCode_Name(error);
+  std::unique_ptr<google::protobuf::Message> d(out.response);
+  if (out.controller)
+  {
+    out.controller->clearCall();
+    out.controller->setFailed(error, ErrorCode_Name(error));
+  }
+  if (out.done)
+  {
+    out.done->Run();
+  }
 }
 
 void RpcChannel::onMessage(const TcpConnectionPtr& conn,
@@ -83,29 +489,53 @@ void RpcChannel::onRpcMessage(const TcpConnectionPtr& conn,
   assert(conn == conn_);
   //printf("%s\n", message.DebugString().c_str());
   RpcMessage& message = *messagePtr;
+  // request or response, still in the input buffer
+  const StringPiece payload = codec_.codec().payload();
   if (message.type() == RESPONSE)
   {
     int64_t id = message.id();
     assert(message.has_response() || message.has_error());
 
-    OutstandingCall out = { NULL, NULL };
+    // answered before the client stream finished
+    closeStream(&callerStreams_, id, message.error());
 
+    CallTable::Call out;
+    // timed out or canceled already if not found
+    if (outstandings_->take(id, &out))
     {
-      MutexLockGuard lock(mutex_);
-      std::map<int64_t, OutstandingCall>::iterator it = outstandings_.find(id);
-      if (it != outstandings_.end())
+      if (out.hasTimer)
       {
-        out = it->second;
-        outstandings_.erase(it);
+        conn->getLoop()->cancel(out.timer);
+      }
+      if (useMethodIds_ && (message.has_method_id() || message.error() == NO_METHOD))
+      {
+        MutexLockGuard lock(mutex_);
+        if (message.has_method_id())
+        {
+          methodIds_[out.method] = message.method_id();
+        }
+        else
+        {
+          // stale id, names next time
+          methodIds_.erase(out.method);
+        }
       }
-    }
-
-    if (out.response)
-    {
       std::unique_ptr<google::protobuf::Message> d(out.response);
+      if (out.controller)
+      {
+        out.controller->clearCall();
+      }
       if (message.has_response())
       {
-        out.response->ParseFromString(message.response());
+        if (!out.response->ParseFromArray(payload.data(), payload.size())
+            && out.controller)
+        {
+          out.controller->setFailed(INVALID_RESPONSE, ErrorCode_Name(INVALID_RESPONSE));
+        }
+      }
+      else if (out.controller)
+      {
+        out.controller->setFailed(message.error(), ErrorCode_Name(message.error()));
       }
       if (out.done)
       {
@@ -115,70 +545,251 @@ void RpcChannel::onRpcMessage(const TcpConnectionPtr& conn,
   }
   else if (message.type() == REQUEST)
   {
-    // FIXME: extract to a function
-    ErrorCode error = WRONG_PROTO;
-    if (services_)
+    onRequest(message, payload);
+  }
+  else if (message.type() == STREAM_REQUEST || message.type() == STREAM_RESPONSE)
+  {
+    onStreamFrame(message, payload);
+  }
+  else if (message.type() == ERROR)
+  {
+  }
+}
+
+namespace
+{
+
+// NewCallback() binds at most two arguments
+class DoneClosure : public google::protobuf::Closure
+{
+ public:
+  DoneClosure(RpcChannel* channel,
+              void (RpcChannel::*done)(google::protobuf::Message*, int64_t, uint32_t),
+              google::protobuf::Message* response,
+              int64_t id,
+              uint32_t methodId,
+              const RpcChannelPtr& owner = RpcChannelPtr())
+    : channel_(channel),
+      done_(done),
+      response_(response),
+      id_(id),
+      methodId_(methodId),
+      owner_(owner)
+  {
+  }
+
+  void Run() override
+  {
+    (channel_->*done_)(response_, id_, methodId_);
+    delete this;
+  }
+
+ private:
+  RpcChannel* channel_;
+  void (RpcChannel::*done_)(google::protobuf::Message*, int64_t, uint32_t);
+  google::protobuf::Message* response_;
+  int64_t id_;
+  uint32_t methodId_;
+  RpcChannelPtr owner_;  // keeps channel_ if done runs in another thread
+};
+
+}  // namespace
+
+void RpcChannel::onRequest(const RpcMessage& message, StringPiece payload)
+{
+  ErrorCode error = NO_ERROR;
+  google::protobuf::Service* service = NULL;
+  const google::protobuf::MethodDescriptor* method = NULL;
+  const google::protobuf::Message* requestPrototype = NULL;
+  const google::protobuf::Message* responsePrototype = NULL;
+  uint32_t methodId = 0;  // to tell the client
+  const RpcMethodTable::Method* m = NULL;
+  if (methods_)
+  {
+    if (message.has_method_id())
     {
-      std::map<std::string, google::protobuf::Service*>::const_iterator it = services_->find(message.service());
-      if (it != services_->end())
+      m = methods_->find(message.method_id());
+      error = m ? NO_ERROR : NO_METHOD;
+    }
+    else
+    {
+      bool serviceFound = false;
+      m = methods_->find(message.service(), message.method(), &serviceFound);
+      error = m ? NO_ERROR : (serviceFound ? NO_METHOD : NO_SERVICE);
+      methodId = m ? m->wireId : 0;
+    }
+    if (m)
+    {
+      service = m->service;
+      method = m->method;
+      requestPrototype = m->requestPrototype;
+      responsePrototype = m->responsePrototype;
+    }
+  }
+  else if (services_)
+  {
+    std::map<std::string, google::protobuf::Service*>::const_iterator it = services_->find(message.service());
+    if (it != services_->end())
+    {
+      service = it->second;
+      assert(service != NULL);
+      method = service->GetDescriptor()->FindMethodByName(message.method());
+      if (method)
       {
-        google::protobuf::Service* service = it->second;
-        assert(service != NULL);
-        const google::protobuf::ServiceDescriptor* desc = service->GetDescriptor();
-        const google::protobuf::MethodDescriptor* method
-          = desc->FindMethodByName(message.method());
-        if (method)
-        {
-          std::unique_ptr<google::protobuf::Message> request(service->GetRequestPrototype(method).New());
-          if (request->ParseFromString(message.request()))
-          {
-            google::protobuf::Message* response = service->GetResponsePrototype(method).New();
-            // response is deleted in doneCallback
-            int64_t id = message.id();
-            service->CallMethod(method, NULL, get_pointer(request), response,
-                                NewCallback(this, &RpcChannel::doneCallback, response, id));
-            error = NO_ERROR;
-          }
-          else
-          {
-            error = INVALID_REQUEST;
-          }
-        }
-        else
+        requestPrototype = &service->GetRequestPrototype(method);
+        responsePrototype = &service->GetResponsePrototype(method);
+      }
+      else
+      {
+        error = NO_METHOD;
+      }
+    }
+    else
+    {
+      error = NO_SERVICE;
+    }
+  }
+  else
+  {
+    error = NO_SERVICE;
+  }
+
+  if (error == NO_ERROR && (message.server_stream() || message.client_stream()))
+  {
+    error = onStreamRequest(m, message, payload);
+  }
+  else if (error == NO_ERROR)
+  {
+    std::unique_ptr<google::protobuf::Message> request(requestPrototype->New());
+    if (request->ParseFromArray(payload.data(), payload.size()))
+    {
+      google::protobuf::Message* response = responsePrototype->New();
+      // response is deleted in doneCallback
+      if (m && m->executor)
+      {
+        // the channel lives until done is back in the IO thread
+        RpcChannelPtr self(shared_from_this());
+        MessagePtr req(request.release());
+        int64_t id = message.id();
+        m->stats->queued.increment();
+        if (!m->executor->run([self, m, req, response, id, methodId] {
+              self->callInExecutor(m, req, response, id, methodId);
+            }))
         {
-          error = NO_METHOD;
+          // stopped pool
+          m->stats->queued.decrement();
+          delete response;
+          error = NO_SERVICE;
         }
       }
       else
       {
-        error = NO_SERVICE;
+        service->CallMethod(method, NULL, get_pointer(request), response,
+                            new DoneClosure(this, &RpcChannel::doneCallback,
+                                            response, message.id(), methodId));
       }
     }
     else
     {
-      error = NO_SERVICE;
+      error = INVALID_REQUEST;
     }
-    if (error != NO_ERROR)
+  }
+  if (error != NO_ERROR)
+  {
+    RpcMessage response;
+    response.set_type(RESPONSE);
+    response.set_id(message.id());
+    response.set_error(error);
+    codec_.send(conn_, response);
+  }
+}
+
+ErrorCode RpcChannel::onStreamRequest(const RpcMethodTable::Method* m,
+                                      const RpcMessage& message,
+                                      StringPiece payload)
+{
+  const int64_t id = message.id();
+  if (message.server_stream())
+  {
+    if (!m || !m->serverStream)
+    {
+      return NO_METHOD;
+    }
+    MessagePtr request(m->requestPrototype->New());
+    if (!request->ParseFromArray(payload.data(), payload.size()))
     {
-      RpcMessage response;
-      response.set_type(RESPONSE);
-      response.set_id(message.id());
-      response.set_error(error);
-      codec_.send(conn_, response);
+      return INVALID_REQUEST;
     }
+    int credit = message.has_credit() ? static_cast<int>(message.credit()) : RpcStream::kDefaultWindow;
+    RpcStreamPtr stream(new RpcStream(this, id, false, credit, 0, NULL));
+    stream->ended_ = true;  // the request is all we get
+    calleeStreams_[id] = stream;
+    m->serverStream(request, stream);
   }
-  else if (message.type() == ERROR)
+  else
   {
+    if (!m || !m->clientStream)
+    {
+      return NO_METHOD;
+    }
+    RpcStreamPtr stream(new RpcStream(this, id, false, 0, RpcStream::kDefaultWindow,
+                                      m->requestPrototype));
+    stream->finished_ = true;  // we send credits and the response only
+    calleeStreams_[id] = stream;
+    google::protobuf::Message* response = m->responsePrototype->New();
+    // response is deleted in doneCallback
+    m->clientStream(stream, response,
+                    new DoneClosure(this, &RpcChannel::streamDoneCallback, response, id, 0));
   }
+  return NO_ERROR;
 }
 
-void RpcChannel::doneCallback(::google::protobuf::Message* response, int64_t id)
+void RpcChannel::callInExecutor(const RpcMethodTable::Method* m,
+                                const MessagePtr& request,
+                                ::google::protobuf::Message* response,
+                                int64_t id,
+                                uint32_t methodId)
 {
-  std::unique_ptr<google::protobuf::Message> d(response);
+  m->stats->queued.decrement();
+  m->stats->running.increment();
+  m->service->CallMethod(m->method, NULL, get_pointer(request), response,
+                         new DoneClosure(this, &RpcChannel::doneInExecutor,
+                                         response, id, methodId, shared_from_this()));
+  m->stats->running.decrement();
+  m->stats->completed.increment();
+}
+
+void RpcChannel::doneInExecutor(::google::protobuf::Message* response, int64_t id, uint32_t methodId)
+{
+  EventLoop* loop = conn_->getLoop();
+  if (loop->isInLoopThread())
+  {
+    doneCallback(response, id, methodId);
+  }
+  else
+  {
+    loop->queueInLoop(std::bind(&RpcChannel::doneCallback, shared_from_this(),
+                                response, id, methodId));
+  }
+}
+
+void RpcChannel::streamDoneCallback(::google::protobuf::Message* response, int64_t id, uint32_t methodId)
+{
+  // replied before the client finished its stream, stops reading it
+  closeStream(&calleeStreams_, id, NO_ERROR);
+  doneCallback(response, id, methodId);
+}
+
+void RpcChannel::doneCallback(::google::protobuf::Message* response, int64_t id, uint32_t methodId)
+{
+  MessagePtr d(response);
   RpcMessage message;
   message.set_type(RESPONSE);
   message.set_id(id);
-  message.set_response(response->SerializeAsString()); // FIXME: error check
-  codec_.send(conn_, message);
+  if (methodId)
+  {
+    message.set_method_id(methodId);
+  }
+  codec_.codec().send(conn_, message, RpcMessage::kResponseFieldNumber, d);
 }
 
@@ -13,11 +13,17 @@
 
 #include "muduo/base/Atomic.h"
 #include "muduo/base/Mutex.h"
+#include "muduo/net/Buffer.h"
 #include "muduo/net/protorpc/RpcCodec.h"
+#include "muduo/net/protorpc/RpcController.h"
+#include "muduo/net/protorpc/RpcMethodTable.h"
+#include "muduo/net/protorpc/RpcStream.h"
 
 #include <google/protobuf/service.h>
 
 #include <map>
+#include <memory>
+#include <unordered_map>
 
 // Service and RpcChannel classes are incorporated from
 // google/protobuf/service.h
@@ -79,6 +85,8 @@ namespace muduo
 namespace net
 {
 
+class CallTable;
+
 // Abstract interface for an RPC channel.  An RpcChannel represents a
 // communication line to a Service which can be used to call that Service's
 // methods.  The Service may be running on another machine.  Normally, you
@@ -88,7 +96,11 @@ namespace net
 //   RpcChannel* channel = new MyRpcChannel("remotehost.example.com:1234");
 //   MyService* service = new MyService::Stub(channel);
 //   service->MyMethod(request, &response, callback);
-class RpcChannel : public ::google::protobuf::RpcChannel
+//
+// Channels must be owned by a shared_ptr, deadlines, cancels and methods with
+// executors, see RpcServer::setExecutor(), refer to the channel through it.
+class RpcChannel : public ::google::protobuf::RpcChannel,
+                   public std::enable_shared_from_this<RpcChannel>
 {
  public:
   RpcChannel();
@@ -97,16 +109,64 @@ class RpcChannel : public ::google::protobuf::RpcChannel
 
   ~RpcChannel() override;
 
-  void setConnection(const TcpConnectionPtr& conn)
-  {
-    conn_ = conn;
-  }
+  // A new connection may go to another server, forgets its method ids.
+  void setConnection(const TcpConnectionPtr& conn);
 
   void setServices(const std::map<std::string, ::google::protobuf::Service*>* services)
   {
     services_ = services;
   }
 
+  // Dispatches requests by the table instead of services,
+  // and tells clients the method ids.
+  void setMethodTable(const RpcMethodTable* methods)
+  {
+    methods_ = methods;
+  }
+
+  // Sends method ids instead of names once the server tells them,
+  // on by default.
+  void setUseMethodIds(bool on)
+  {
+    useMethodIds_ = on;
+  }
+
+  // See ProtobufCodecLite::setChecksumType(), servers should use
+  // setChecksumFollowsPeer() too, to answer old clients with adler32.
+  void setChecksumType(ProtobufCodecLite::ChecksumType type)
+  {
+    codec_.codec().setChecksumType(type);
+  }
+
+  void setChecksumFollowsPeer(bool on)
+  {
+    codec_.codec().setChecksumFollowsPeer(on);
+  }
+
+  // See ProtobufCodecLite::setThreadPool(), call before the first message.
+  // Services and done callbacks still run in the IO thread.
+  void setCodecThreadPool(ThreadPool* pool,
+                          int minBytes = ProtobufCodecLite::kDefaultOffloadBytes)
+  {
+    codec_.codec().setThreadPool(pool, minBytes);
+  }
+
+  // Deadline of every call in seconds, 0 for none (the default).
+  // Calls not answered in time complete with TIMEOUT in the IO thread,
+  // see RpcController for per call deadlines and status.
+  void setTimeout(double seconds)
+  {
+    timeout_ = seconds;
+  }
+
+  // Coalesces requests issued in one loop iteration into one write,
+  // off by default.  Requests from other threads wait for the IO thread
+  // to pick them up, they go out together if the IO thread is busy.
+  void setBatching(bool on)
+  {
+    batching_ = on;
+  }
+
   // Call the given method of the remote service.  The signature of this
   // procedure looks the same as Service::CallMethod(), but the requirements
   // are less strict in one important way:  the request and response objects
@@ -118,31 +178,141 @@ class RpcChannel : public ::google::protobuf::RpcChannel
                   ::google::protobuf::Message* response,
                   ::google::protobuf::Closure* done) override;
 
+  // Streaming calls, in the IO thread only, not with setCodecThreadPool().
+  //
+  // Responses of a server streaming call come to callbacks of the returned
+  // stream, set them right away.  window is how many responses may be
+  // on the way.
+  RpcStreamPtr callServerStream(const ::google::protobuf::MethodDescriptor* method,
+                                const ::google::protobuf::Message& request,
+                                int window = RpcStream::kDefaultWindow);
+
+  // Write requests of a client streaming call to the returned stream and
+  // finish() it, the response comes as of CallMethod().
+  RpcStreamPtr callClientStream(const ::google::protobuf::MethodDescriptor* method,
+                                ::google::protobuf::RpcController* controller,
+                                ::google::protobuf::Message* response,
+                                ::google::protobuf::Closure* done);
+
+  static const size_t kDefaultStreamHighWaterMark = 1024 * 1024;
+
+  // Streams are not writable while the connection has more to send.
+  // Waiting for it to drain takes the write complete callback of the
+  // connection.
+  void setStreamHighWaterMark(size_t bytes)
+  {
+    streamHighWaterMark_ = bytes;
+  }
+
+  // Completes the call of id with CANCELED, if it is still outstanding.
+  // Thread safe, usually called by RpcController::StartCancel().
+  void cancel(int64_t id);
+
+  // Number of calls waiting for responses.
+  size_t outstandings() const;
+
+  // Fails calls and streams in flight with NO_CONNECTION, in the IO thread
+  // once the connection is down.  Calls made after it fail the same way,
+  // until setConnection() gives a new one.
+  void onDisconnected();
+
   void onMessage(const TcpConnectionPtr& conn,
                  Buffer* buf,
                  Timestamp receiveTime);
 
  private:
+  friend class RpcStream;
+
+  // service and method, or method id
+  void setMethod(const ::google::protobuf::MethodDescriptor* method, RpcMessage* message);
+  // waits for the response of id
+  void addCall(int64_t id,
+               const ::google::protobuf::MethodDescriptor* method,
+               ::google::protobuf::RpcController* controller,
+               ::google::protobuf::Message* response,
+               ::google::protobuf::Closure* done);
+
+  void onStreamFrame(const RpcMessage& message, StringPiece payload);
+  void sendStreamFrame(RpcStream* stream,
+                       const ::google::protobuf::Message* payload,
+                       int credit,
+                       bool end,
+                       ErrorCode error);
+  // if not, wakes up streams once the connection has drained,
+  // by taking the write complete callback of the connection meanwhile
+  bool belowStreamHighWaterMark();
+  void onWriteComplete(const TcpConnectionPtr& conn);
+  // forgets stream if both directions are done
+  void closeStreamIfDone(RpcStream* stream);
+  // closes the stream of id in streams, if any
+  static void closeStream(std::map<int64_t, RpcStreamPtr>* streams,
+                          int64_t id,
+                          ErrorCode error);
+
   void onRpcMessage(const TcpConnectionPtr& conn,
                     const RpcMessagePtr& messagePtr,
                     Timestamp receiveTime);
 
-  void doneCallback(::google::protobuf::Message* response, int64_t id);
+  void onRequest(const RpcMessage& message, StringPiece payload);
+  ErrorCode onStreamRequest(const RpcMethodTable::Method* m,
+                            const RpcMessage& message,
+                            StringPiece payload);
+
+  // request of m in its executor, done goes back to the IO thread
+  void callInExecutor(const RpcMethodTable::Method* m,
+                      const MessagePtr& request,
+                      ::google::protobuf::Message* response,
+                      int64_t id,
+                      uint32_t methodId);
+  void doneInExecutor(::google::protobuf::Message* response, int64_t id, uint32_t methodId);
 
-  struct OutstandingCall
+  // sends the response of service, method id is 0 for none
+  void doneCallback(::google::protobuf::Message* response, int64_t id, uint32_t methodId);
+  // done of a client streaming call, in the IO thread
+  void streamDoneCallback(::google::protobuf::Message* response, int64_t id, uint32_t methodId);
+
+  struct Batch
   {
-    ::google::protobuf::Message* response;
-    ::google::protobuf::Closure* done;
+    MutexLock mutex;
+    Buffer frames GUARDED_BY(mutex);
   };
 
-  RpcCodec codec_;
+  // batch is not a member, in case the channel is gone before the loop runs it
+  static void flushBatch(const std::shared_ptr<Batch>& batch,
+                         const TcpConnectionPtr& conn);
+
+  // completes the call of id with TIMEOUT, CANCELED or NO_CONNECTION,
+  // and closes its stream, in the IO thread
+  void completeWithError(int64_t id, ErrorCode error);
+  // fails calls and streams made after the connection is down
+  void failIfDisconnected(int64_t id);
+  // for timers and cancels, the channel may be gone before they run
+  static void completeIfAlive(const std::weak_ptr<RpcChannel>& wkChannel,
+                              int64_t id,
+                              ErrorCode error);
+
+  ZeroCopyRpcCodec codec_;
   TcpConnectionPtr conn_;
   AtomicInt64 id_;
+  double timeout_;
 
+  std::unique_ptr<CallTable> outstandings_;
+
+  bool useMethodIds_;
+  bool batching_;
+  std::shared_ptr<Batch> batch_;
   MutexLock mutex_;
-  std::map<int64_t, OutstandingCall> outstandings_ GUARDED_BY(mutex_);
+  std::unordered_map<const ::google::protobuf::MethodDescriptor*, uint32_t>
+    methodIds_ GUARDED_BY(mutex_);
 
   const std::map<std::string, ::google::protobuf::Service*>* services_;
+  const RpcMethodTable* methods_;
+
+  // in the IO thread
+  size_t streamHighWaterMark_;
+  bool waitingForWriteComplete_;
+  std::map<int64_t, RpcStreamPtr> callerStreams_;  // calls of ours
+  std::map<int64_t, RpcStreamPtr> calleeStreams_;  // calls of the peer
 };
 typedef std::shared_ptr<RpcChannel> RpcChannelPtr;
 
@@ -0,0 +1,175 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include "muduo/net/protorpc/RpcChannelPool.h"
+
+#include "muduo/base/Logging.h"
+#include "muduo/net/EventLoopThreadPool.h"
+#include "muduo/net/TcpClient.h"
+#include "muduo/net/protorpc/RpcController.h"
+
+#include <stdio.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+RpcChannelPool::RpcChannelPool(EventLoop* loop,
+                               const InetAddress& serverAddr,
+                               const string& name,
+                               int numConnections,
+                               EventLoopThreadPool* ioLoops)
+{
+  assert(numConnections > 0);
+  for (int i = 0; i < numConnections; ++i)
+  {
+    char buf[32];
+    snprintf(buf, sizeof buf, "#%d", i);
+    EventLoop* ioLoop = ioLoops ? ioLoops->getNextLoop() : loop;
+    std::unique_ptr<Connection> connection(new Connection);
+    connection->client.reset(new TcpClient(ioLoop, serverAddr, name + buf));
+    connection->channel.reset(new muduo::net::RpcChannel);
+    connection->connected = false;
+    Connection* c = get_pointer(connection);
+    connection->client->setConnectionCallback(
+        std::bind(&RpcChannelPool::onConnection, this, c, _1));
+    connection->client->setMessageCallback(
+        std::bind(&muduo::net::RpcChannel::onMessage, get_pointer(connection->channel), _1, _2, _3));
+    connection->client->enableRetry();
+    connections_.push_back(std::move(connection));
+  }
+}
+
+RpcChannelPool::~RpcChannelPool()
+{
+}
+
+void RpcChannelPool::setBatching(bool on)
+{
+  for (const auto& c : connections_)
+  {
+    c->channel->setBatching(on);
+  }
+}
+
+void RpcChannelPool::setTimeout(double seconds)
+{
+  for (const auto& c : connections_)
+  {
+    c->channel->setTimeout(seconds);
+  }
+}
+
+void RpcChannelPool::connect()
+{
+  for (const auto& c : connections_)
+  {
+    c->client->connect();
+  }
+}
+
+void RpcChannelPool::disconnect()
+{
+  for (const auto& c : connections_)
+  {
+    c->client->disconnect();
+  }
+}
+
+int RpcChannelPool::connectedCount() const
+{
+  int n = 0;
+  for (const auto& c : connections_)
+  {
+    if (c->connected.load(std::memory_order_acquire))
+    {
+      ++n;
+    }
+  }
+  return n;
+}
+
+size_t RpcChannelPool::outstandings() const
+{
+  size_t n = 0;
+  for (const auto& c : connections_)
+  {
+    n += c->channel->outstandings();
+  }
+  return n;
+}
+
+void RpcChannelPool::onConnection(Connection* connection, const TcpConnectionPtr& conn)
+{
+  if (conn->connected())
+  {
+    conn->setTcpNoDelay(true);
+    connection->channel->setConnection(conn);
+    connection->connected.store(true, std::memory_order_release);
+  }
+  else
+  {
+    connection->connected.store(false, std::memory_order_release);
+    // calls in flight fail with NO_CONNECTION, new ones go elsewhere
+    connection->channel->onDisconnected();
+  }
+  if (connectionCallback_)
+  {
+    connectionCallback_(conn);
+  }
+}
+
+muduo::net::RpcChannel* RpcChannelPool::pick()
+{
+  const size_t n = connections_.size();
+  const size_t start = static_cast<size_t>(next_.getAndAdd(1)) % n;
+  muduo::net::RpcChannel* best = NULL;
+  size_t least = 0;
+  for (size_t i = 0; i < n; ++i)
+  {
+    const Connection& c = *connections_[(start + i) % n];
+    if (c.connected.load(std::memory_order_acquire))
+    {
+      size_t outstandings = c.channel->outstandings();
+      if (!best || outstandings < least)
+      {
+        best = get_pointer(c.channel);
+        least = outstandings;
+        if (least == 0)
+        {
+          break;
+        }
+      }
+    }
+  }
+  return best;
+}
+
+void RpcChannelPool::CallMethod(const ::google::protobuf::MethodDescriptor* method,
+                                ::google::protobuf::RpcController* controller,
+                                const ::google::protobuf::Message* request,
+                                ::google::protobuf::Message* response,
+                                ::google::protobuf::Closure* done)
+{
+  muduo::net::RpcChannel* channel = pick();
+  if (channel)
+  {
+    channel->CallMethod(method, controller, request, response, done);
+  }
+  else
+  {
+    LOG_ERROR << "RpcChannelPool::CallMethod no connection";
+    // owned by the channel as in RpcChannel
+    std::unique_ptr<google::protobuf::Message> d(response);
+    RpcController* rpcController = dynamic_cast<RpcController*>(controller);
+    if (rpcController)
+    {
+      rpcController->setFailed(NO_CONNECTION, ErrorCode_Name(NO_CONNECTION));
+    }
+    if (done)
+    {
+      done->Run();
+    }
+  }
+}
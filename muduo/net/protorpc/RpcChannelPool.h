@@ -0,0 +1,94 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_PROTORPC_RPCCHANNELPOOL_H
+#define MUDUO_NET_PROTORPC_RPCCHANNELPOOL_H
+
+#include "muduo/base/Atomic.h"
+#include "muduo/net/Callbacks.h"
+#include "muduo/net/protorpc/RpcChannel.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace muduo
+{
+namespace net
+{
+
+class EventLoop;
+class EventLoopThreadPool;
+class InetAddress;
+class TcpClient;
+
+///
+/// Several connections to one server behind one RpcChannel.
+///
+/// Each call goes to the connected channel with the fewest outstanding
+/// calls, so a slow response on one connection doesn't hold up the rest.
+/// Calls fail with NO_CONNECTION when none is connected.
+/// Connections retry after being closed.
+///
+/// Configure before connect(), CallMethod() is thread safe.
+///
+class RpcChannelPool : public ::google::protobuf::RpcChannel,
+                       noncopyable
+{
+ public:
+  /// Connections run in loops of ioLoops if given, otherwise in loop.
+  RpcChannelPool(EventLoop* loop,
+                 const InetAddress& serverAddr,
+                 const string& name,
+                 int numConnections,
+                 EventLoopThreadPool* ioLoops = NULL);
+  ~RpcChannelPool() override;
+
+  /// See RpcChannel::setBatching()
+  void setBatching(bool on);
+  /// See RpcChannel::setTimeout()
+  void setTimeout(double seconds);
+
+  /// Called after the pool has taken or dropped the connection.
+  void setConnectionCallback(ConnectionCallback cb)
+  { connectionCallback_ = std::move(cb); }
+
+  void connect();
+  void disconnect();
+
+  int size() const { return static_cast<int>(connections_.size()); }
+  int connectedCount() const;
+  /// outstanding calls of every connection
+  size_t outstandings() const;
+
+  void CallMethod(const ::google::protobuf::MethodDescriptor* method,
+                  ::google::protobuf::RpcController* controller,
+                  const ::google::protobuf::Message* request,
+                  ::google::protobuf::Message* response,
+                  ::google::protobuf::Closure* done) override;
+
+ private:
+  struct Connection
+  {
+    RpcChannelPtr channel;
+    std::unique_ptr<TcpClient> client;  // goes first, uses channel
+    std::atomic<bool> connected;
+  };
+
+  void onConnection(Connection* connection, const TcpConnectionPtr& conn);
+  // least outstanding calls, NULL if none is connected
+  muduo::net::RpcChannel* pick();
+
+  std::vector<std::unique_ptr<Connection>> connections_;
+  ConnectionCallback connectionCallback_;
+  AtomicInt32 next_;  // where pick() starts, spreads ties
+};
+
+}  // namespace net
+}  // namespace muduo
+
+#endif  // MUDUO_NET_PROTORPC_RPCCHANNELPOOL_H
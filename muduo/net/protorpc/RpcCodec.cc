@@ -15,6 +15,9 @@
 #include "muduo/net/protorpc/rpc.pb.h"
 #include "muduo/net/protorpc/google-inl.h"
 
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
 using namespace muduo;
 using namespace muduo::net;
 
@@ -35,3 +38,157 @@ namespace net
 const char rpctag [] = "RPC0";
 }
 }
+
+using google::protobuf::internal::WireFormatLite;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+
+std::shared_ptr<void> ZeroCopyRpcCodecLite::takeParseState()
+{
+  return std::make_shared<StringPiece>(parsed_);
+}
+
+void ZeroCopyRpcCodecLite::putParseState(const std::shared_ptr<void>& state)
+{
+  payload_ = *static_cast<const StringPiece*>(state.get());
+}
+
+void ZeroCopyRpcCodecLite::parsedInLoop()
+{
+  payload_ = parsed_;
+}
+
+bool ZeroCopyRpcCodecLite::parseFromBuffer(StringPiece buf,
+                                           google::protobuf::Message* message)
+{
+  parsed_ = StringPiece();
+  int field = 0;
+  // [fieldBegin, fieldEnd) is the request or response field, tag included
+  int fieldBegin = buf.size();
+  int fieldEnd = buf.size();
+  {
+    CodedInputStream input(reinterpret_cast<const uint8_t*>(buf.data()), buf.size());
+    int position = 0;
+    uint32_t tag = 0;
+    while ((tag = input.ReadTag()) != 0)
+    {
+      int number = WireFormatLite::GetTagFieldNumber(tag);
+      if ((number == RpcMessage::kRequestFieldNumber
+           || number == RpcMessage::kResponseFieldNumber)
+          && WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED
+          && field == 0)
+      {
+        uint32_t len = 0;
+        if (!input.ReadVarint32(&len))
+        {
+          return false;
+        }
+        int offset = input.CurrentPosition();
+        if (!input.Skip(static_cast<int>(len)))
+        {
+          return false;
+        }
+        parsed_ = StringPiece(buf.data() + offset, static_cast<int>(len));
+        field = number;
+        fieldBegin = position;
+        fieldEnd = input.CurrentPosition();
+      }
+      else if (!WireFormatLite::SkipField(&input, tag))
+      {
+        return false;
+      }
+      position = input.CurrentPosition();
+    }
+    if (position != buf.size())
+    {
+      return false;
+    }
+  }
+
+  // parses the small fields around the payload, same as parsing them in one go
+  RpcMessage* rpc = ::google::protobuf::down_cast<RpcMessage*>(message);
+  CodedInputStream tail(reinterpret_cast<const uint8_t*>(buf.data()) + fieldEnd,
+                        buf.size() - fieldEnd);
+  if (!rpc->ParsePartialFromArray(buf.data(), fieldBegin)
+      || !rpc->MergePartialFromCodedStream(&tail)
+      || !rpc->IsInitialized())
+  {
+    return false;
+  }
+  // keeps has_request() and has_response() as they were on the wire
+  if (field == RpcMessage::kRequestFieldNumber)
+  {
+    rpc->mutable_request();
+  }
+  else if (field == RpcMessage::kResponseFieldNumber)
+  {
+    rpc->mutable_response();
+  }
+  return true;
+}
+
+void ZeroCopyRpcCodecLite::send(const TcpConnectionPtr& conn,
+                                const RpcMessage& header,
+                                int field,
+                                const google::protobuf::Message& payload)
+{
+  if (shouldOffload(payload))
+  {
+    MessagePtr copy(payload.New());
+    copy->CopyFrom(payload);
+    send(conn, header, field, copy);
+    return;
+  }
+  Buffer buf;
+  fillEmptyBuffer(&buf, header, field, payload);
+  conn->send(&buf);
+}
+
+void ZeroCopyRpcCodecLite::send(const TcpConnectionPtr& conn,
+                                const RpcMessage& header,
+                                int field,
+                                const MessagePtr& payload)
+{
+  if (shouldOffload(*payload))
+  {
+    std::shared_ptr<RpcMessage> h(new RpcMessage(header));
+    sendInPool(conn, [this, h, field, payload] (Buffer* buf) {
+      fillEmptyBuffer(buf, *h, field, *payload);
+    });
+  }
+  else
+  {
+    Buffer buf;
+    fillEmptyBuffer(&buf, header, field, *payload);
+    conn->send(&buf);
+  }
+}
+
+void ZeroCopyRpcCodecLite::fillEmptyBuffer(Buffer* buf,
+                                           const RpcMessage& header,
+                                           int field,
+                                           const google::protobuf::Message& payload)
+{
+  assert(buf->readableBytes() == 0);
+  assert(!header.has_request() && !header.has_response());
+  assert(field == RpcMessage::kRequestFieldNumber
+         || field == RpcMessage::kResponseFieldNumber);
+  buf->append(tag());
+  serializeToBuffer(header, buf);
+
+#if GOOGLE_PROTOBUF_VERSION > 3009002
+  int byte_size = google::protobuf::internal::ToIntSize(payload.ByteSizeLong());
+#else
+  int byte_size = payload.ByteSize();
+#endif
+  const int kMaxVarint32Bytes = 5;  // for tag and length each
+  buf->ensureWritableBytes(2 * kMaxVarint32Bytes + byte_size + kChecksumLen);
+  uint8_t* start = reinterpret_cast<uint8_t*>(buf->beginWrite());
+  uint8_t* end = WireFormatLite::WriteTagToArray(
+      field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED, start);
+  end = CodedOutputStream::WriteVarint32ToArray(static_cast<uint32_t>(byte_size), end);
+  end = payload.SerializeWithCachedSizesToArray(end);
+  buf->hasWritten(end - start);
+
+  finishFrame(buf);
+}
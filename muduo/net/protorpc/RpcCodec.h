@@ -39,6 +39,59 @@ extern const char rpctag[];// = "RPC0";
 
 typedef ProtobufCodecLiteT<RpcMessage, rpctag> RpcCodec;
 
+// Same wire format as RpcCodec, but the bytes of request or response
+// are neither copied into nor out of RpcMessage:
+// on receiving, they are left in the input Buffer, see payload(),
+// the parsed RpcMessage only has an empty request or response;
+// on sending, the payload message is serialized right after the header.
+//
+// Keeps per message state, one codec per connection.
+class ZeroCopyRpcCodecLite : public ProtobufCodecLite
+{
+ public:
+  using ProtobufCodecLite::ProtobufCodecLite;
+  using ProtobufCodecLite::send;
+  using ProtobufCodecLite::fillEmptyBuffer;
+
+  bool parseFromBuffer(StringPiece buf, google::protobuf::Message* message) override;
+
+  // request or response of the message being called back,
+  // points into the input Buffer, valid until the callback returns.
+  // In the IO thread only.
+  StringPiece payload() const { return payload_; }
+
+  // header must not have request or response,
+  // field is RpcMessage::kRequestFieldNumber or kResponseFieldNumber.
+  // Copies payload if offloaded to the thread pool.
+  void send(const TcpConnectionPtr& conn,
+            const RpcMessage& header,
+            int field,
+            const google::protobuf::Message& payload);
+  // payload must not be modified afterwards
+  void send(const TcpConnectionPtr& conn,
+            const RpcMessage& header,
+            int field,
+            const MessagePtr& payload);
+
+  void fillEmptyBuffer(Buffer* buf,
+                       const RpcMessage& header,
+                       int field,
+                       const google::protobuf::Message& payload);
+
+ protected:
+  std::shared_ptr<void> takeParseState() override;
+  void putParseState(const std::shared_ptr<void>& state) override;
+  void parsedInLoop() override;
+
+ private:
+  // frames are parsed one at a time, in the IO thread or in the pool,
+  // while the IO thread calls back the one parsed before
+  StringPiece parsed_;
+  StringPiece payload_;  // of the message being called back
+};
+
+typedef ProtobufCodecLiteT<RpcMessage, rpctag, ZeroCopyRpcCodecLite> ZeroCopyRpcCodec;
+
 }  // namespace net
 }  // namespace muduo
 
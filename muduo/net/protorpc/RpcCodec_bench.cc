@@ -0,0 +1,164 @@
+#include "muduo/net/protorpc/RpcCodec.h"
+#include "muduo/net/protorpc/rpc.pb.h"
+#include "muduo/net/Buffer.h"
+
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Usage: protobuf_rpc_wire_bench [messages]
+//
+// Encodes and decodes RpcMessage carrying a nested message of various
+// sizes, the old way (bytes copied into and out of RpcMessage, a new
+// message per frame) and with ZeroCopyRpcCodec, prints msgs/sec and
+// heap allocations per message.
+
+int64_t g_allocations = 0;
+
+void* operator new(size_t size)
+{
+  ++g_allocations;
+  void* p = ::malloc(size);
+  if (p == NULL)
+  {
+    abort();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  ::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  ::free(p);
+}
+
+int g_messages = 100*1000;
+RpcMessage g_inner;
+int64_t g_received = 0;
+
+void copyCallback(const TcpConnectionPtr&,
+                  const RpcMessagePtr& message,
+                  Timestamp)
+{
+  // what RpcChannel used to do
+  std::unique_ptr<google::protobuf::Message> request(g_inner.New());
+  request->ParseFromString(message->request());
+  ++g_received;
+}
+
+ZeroCopyRpcCodec* g_zeroCopyCodec;
+
+void zeroCopyCallback(const TcpConnectionPtr&,
+                      const RpcMessagePtr&,
+                      Timestamp)
+{
+  StringPiece payload = g_zeroCopyCodec->codec().payload();
+  std::unique_ptr<google::protobuf::Message> request(g_inner.New());
+  request->ParseFromArray(payload.data(), payload.size());
+  ++g_received;
+}
+
+void report(const char* name, int size, int n, Timestamp start, int64_t allocations)
+{
+  double seconds = timeDifference(Timestamp::now(), start);
+  printf("%-16s payload %6d  %10.0f msgs/s  %7.1f MiB/s  %5.2f allocs/msg\n",
+         name, size, n / seconds,
+         static_cast<double>(n) * size / seconds / 1024 / 1024,
+         static_cast<double>(allocations) / n);
+}
+
+void bench(int size)
+{
+  // keeps the input buffers under 2 * 64MiB
+  const int n = std::min(g_messages, 64*1024*1024 / (size + 64));
+  g_inner.Clear();
+  g_inner.set_type(RESPONSE);
+  g_inner.set_id(1);
+  g_inner.set_response(string(size, 'x'));
+
+  RpcMessage header;
+  header.set_type(REQUEST);
+  header.set_service("muduo.bench.Service");
+  header.set_method("Method");
+
+  RpcCodec codec(copyCallback);
+  ZeroCopyRpcCodec zcodec(zeroCopyCallback);
+  g_zeroCopyCodec = &zcodec;
+  zcodec.setReuseMessage(true);
+
+  Buffer input;
+  {
+    Timestamp start(Timestamp::now());
+    int64_t allocations = g_allocations;
+    for (int i = 0; i < n; ++i)
+    {
+      RpcMessage message(header);
+      message.set_id(i);
+      message.set_request(g_inner.SerializeAsString());
+      Buffer buf;
+      codec.fillEmptyBuffer(&buf, message);
+      if (i == 0)
+      {
+        input.append(buf.peek(), buf.readableBytes());
+      }
+    }
+    report("encode copy", size, n, start, g_allocations - allocations);
+  }
+  {
+    Timestamp start(Timestamp::now());
+    int64_t allocations = g_allocations;
+    for (int i = 0; i < n; ++i)
+    {
+      header.set_id(i);
+      Buffer buf;
+      zcodec.codec().fillEmptyBuffer(&buf, header, RpcMessage::kRequestFieldNumber, g_inner);
+    }
+    report("encode zerocopy", size, n, start, g_allocations - allocations);
+  }
+
+  // the same frame many times, decoded in one go
+  string frame = input.retrieveAllAsString();
+  for (int i = 0; i < n; ++i)
+  {
+    input.append(frame);
+  }
+  Buffer input2(input);
+
+  {
+    g_received = 0;
+    Timestamp start(Timestamp::now());
+    int64_t allocations = g_allocations;
+    codec.onMessage(TcpConnectionPtr(), &input, start);
+    report("decode copy", size, n, start, g_allocations - allocations);
+    assert(g_received == n);
+  }
+  {
+    g_received = 0;
+    Timestamp start(Timestamp::now());
+    int64_t allocations = g_allocations;
+    zcodec.onMessage(TcpConnectionPtr(), &input2, start);
+    report("decode zerocopy", size, n, start, g_allocations - allocations);
+    assert(g_received == n);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc > 1)
+  {
+    g_messages = atoi(argv[1]);
+  }
+  for (int size = 16; size <= 64*1024; size *= 4)
+  {
+    bench(size);
+  }
+  google::protobuf::ShutdownProtobufLibrary();
+}
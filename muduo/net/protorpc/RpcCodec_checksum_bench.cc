@@ -0,0 +1,108 @@
+#include "muduo/net/protorpc/RpcCodec.h"
+#include "muduo/net/protorpc/rpc.pb.h"
+
+#include "muduo/base/Checksum.h"
+#include "muduo/net/Buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Usage: protobuf_rpc_checksum_bench [MiB_per_run]
+//
+// For each checksum type of ProtobufCodecLite and payload sizes from
+// 64 bytes to 4 MiB, prints MiB/s of the checksum alone and of
+// a codec round trip (serialize, checksum, validate, parse).
+
+int g_mib = 256;
+int64_t g_received = 0;
+
+void messageCallback(const TcpConnectionPtr&,
+                     const MessagePtr&,
+                     Timestamp)
+{
+  ++g_received;
+}
+
+const char* typeName(ProtobufCodecLite::ChecksumType type)
+{
+  switch (type)
+  {
+   case ProtobufCodecLite::kAdler32:
+     return "adler32";
+   case ProtobufCodecLite::kCrc32c:
+     return Checksum::hasCrc32cInstruction() ? "crc32c" : "crc32c(sw)";
+   case ProtobufCodecLite::kXxHash32:
+     return "xxhash32";
+   default:
+     return "none";
+  }
+}
+
+void bench(ProtobufCodecLite::ChecksumType type, int size)
+{
+  const int64_t total = static_cast<int64_t>(g_mib) * 1024 * 1024;
+  const int n = static_cast<int>(std::max<int64_t>(1, total / size));
+  string data(size, 'x');
+  for (int i = 0; i < size; ++i)
+  {
+    data[i] = static_cast<char>(i * 31);
+  }
+
+  Timestamp start(Timestamp::now());
+  int32_t sink = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    sink += ProtobufCodecLite::checksum(type, data.data(), size);
+  }
+  double checksumSeconds = timeDifference(Timestamp::now(), start);
+
+  RpcMessage message;
+  message.set_type(REQUEST);
+  message.set_id(1);
+  message.set_request(data);
+  ProtobufCodecLite codec(&RpcMessage::default_instance(), "RPC0", messageCallback);
+  codec.setChecksumType(type);
+  codec.setReuseMessage(true);
+  g_received = 0;
+  start = Timestamp::now();
+  for (int i = 0; i < n; ++i)
+  {
+    Buffer buf;
+    codec.fillEmptyBuffer(&buf, message);
+    codec.onMessage(TcpConnectionPtr(), &buf, start);
+  }
+  double codecSeconds = timeDifference(Timestamp::now(), start);
+  assert(g_received == n);
+
+  const bool none = type == ProtobufCodecLite::kNoChecksum;
+  printf("%-10s payload %8d  checksum %8.0f MiB/s  codec %7.0f MiB/s %9.0f msgs/s%s\n",
+         typeName(type), size,
+         none ? 0 : static_cast<double>(n) * size / checksumSeconds / 1024 / 1024,
+         static_cast<double>(n) * size / codecSeconds / 1024 / 1024,
+         n / codecSeconds, sink == 42 ? " " : "");
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc > 1)
+  {
+    g_mib = atoi(argv[1]);
+  }
+  const ProtobufCodecLite::ChecksumType types[] = {
+    ProtobufCodecLite::kAdler32,
+    ProtobufCodecLite::kCrc32c,
+    ProtobufCodecLite::kXxHash32,
+    ProtobufCodecLite::kNoChecksum,
+  };
+  for (int size = 64; size <= 4*1024*1024; size *= 8)
+  {
+    for (ProtobufCodecLite::ChecksumType type : types)
+    {
+      bench(type, size);
+    }
+  }
+  google::protobuf::ShutdownProtobufLibrary();
+}
@@ -0,0 +1,217 @@
+#include "muduo/net/protorpc/RpcCodec.h"
+#include "muduo/net/protorpc/rpc.pb.h"
+
+#include "muduo/base/Clock.h"
+#include "muduo/base/CountDownLatch.h"
+#include "muduo/base/Logging.h"
+#include "muduo/base/ThreadPool.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/EventLoopThread.h"
+#include "muduo/net/TcpClient.h"
+#include "muduo/net/TcpServer.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// Usage: protobuf_rpc_offload_bench [messages] [bytes] [pool_threads]
+//
+// An echo server of RpcMessage on the main loop, a client in another
+// loop keeps a few big messages in flight.  A 1ms timer on the server
+// loop measures how late it fires, i.e. how long the IO thread is
+// stalled by parsing, serializing and checksum, with and without
+// ProtobufCodecLite::setThreadPool().
+
+int g_messages = 200;
+int g_bytes = 1024*1024;
+int g_poolThreads = 2;
+const int kWindow = 4;
+
+typedef std::shared_ptr<RpcCodec> RpcCodecPtr;
+
+class EchoServer
+{
+ public:
+  EchoServer(EventLoop* loop, const InetAddress& addr, ThreadPool* pool)
+    : server_(loop, addr, "EchoServer"),
+      pool_(pool)
+  {
+    server_.setConnectionCallback(
+        std::bind(&EchoServer::onConnection, this, _1));
+  }
+
+  void start() { server_.start(); }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      RpcCodecPtr codec(new RpcCodec(
+          std::bind(&EchoServer::onRpcMessage, this, _1, _2, _3)));
+      if (pool_)
+      {
+        codec->codec().setThreadPool(pool_);
+      }
+      conn->setMessageCallback(
+          std::bind(&RpcCodec::onMessage, get_pointer(codec), _1, _2, _3));
+      conn->setContext(codec);
+    }
+  }
+
+  void onRpcMessage(const TcpConnectionPtr& conn,
+                    const RpcMessagePtr& message,
+                    Timestamp)
+  {
+    message->set_type(RESPONSE);
+    const RpcCodecPtr& codec = boost::any_cast<const RpcCodecPtr&>(conn->getContext());
+    codec->codec().send(conn, message);
+  }
+
+  TcpServer server_;
+  ThreadPool* pool_;
+};
+
+class EchoClient
+{
+ public:
+  EchoClient(EventLoop* loop, const InetAddress& addr, ThreadPool* pool)
+    : client_(loop, addr, "EchoClient"),
+      codec_(std::bind(&EchoClient::onRpcMessage, this, _1, _2, _3)),
+      latch_(1),
+      sent_(0),
+      received_(0)
+  {
+    if (pool)
+    {
+      codec_.codec().setThreadPool(pool);
+    }
+    client_.setConnectionCallback(
+        std::bind(&EchoClient::onConnection, this, _1));
+    client_.setMessageCallback(
+        std::bind(&RpcCodec::onMessage, &codec_, _1, _2, _3));
+    RpcMessagePtr request(new RpcMessage);
+    request->set_type(REQUEST);
+    request->set_id(0);
+    request->set_request(string(g_bytes, 'x'));
+    request_ = request;
+  }
+
+  void connect() { client_.connect(); }
+  void wait() { latch_.wait(); }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      for (int i = 0; i < kWindow; ++i)
+      {
+        sendOne(conn);
+      }
+    }
+  }
+
+  void sendOne(const TcpConnectionPtr& conn)
+  {
+    if (sent_ < g_messages)
+    {
+      ++sent_;
+      codec_.codec().send(conn, request_);
+    }
+  }
+
+  void onRpcMessage(const TcpConnectionPtr& conn,
+                    const RpcMessagePtr&,
+                    Timestamp)
+  {
+    // in the pool if offloaded, one message at a time per connection
+    if (++received_ == g_messages)
+    {
+      conn->shutdown();
+      latch_.countDown();
+    }
+    else
+    {
+      sendOne(conn);
+    }
+  }
+
+  TcpClient client_;
+  RpcCodec codec_;
+  CountDownLatch latch_;
+  MessagePtr request_;
+  int sent_;
+  int received_;
+};
+
+void run(bool offload, uint16_t port)
+{
+  ThreadPool pool("codec");
+  if (offload)
+  {
+    pool.start(g_poolThreads);
+  }
+
+  EventLoop loop;
+  InetAddress addr(port);
+  EchoServer server(&loop, addr, offload ? &pool : NULL);
+  server.start();
+
+  // how late each 1ms tick is
+  std::vector<int> lateness;
+  lateness.reserve(100*1000);
+  int64_t expected = Clock::monotonicMicros() + 1000;
+  loop.runEvery(0.001, [&] {
+    int64_t now = Clock::monotonicMicros();
+    lateness.push_back(static_cast<int>(std::max<int64_t>(0, now - expected)));
+    expected = now + 1000;
+  });
+
+  EventLoopThread clientThread;
+  EchoClient client(clientThread.startLoop(), addr, offload ? &pool : NULL);
+  Timestamp start(Timestamp::now());
+  client.connect();
+
+  Thread waiter([&] {
+    client.wait();
+    loop.queueInLoop([&] { loop.quit(); });
+  });
+  waiter.start();
+  loop.loop();
+  waiter.join();
+  double seconds = timeDifference(Timestamp::now(), start);
+
+  std::sort(lateness.begin(), lateness.end());
+  size_t n = lateness.size();
+  printf("%-8s %4d x %7d bytes  %7.1f MiB/s  loop stall us p50 %5d p99 %6d max %6d\n",
+         offload ? "offload" : "inline", g_messages, g_bytes,
+         2.0 * g_messages * g_bytes / seconds / 1024 / 1024,
+         n ? lateness[n / 2] : 0, n ? lateness[n * 99 / 100] : 0, n ? lateness.back() : 0);
+  pool.stop();
+}
+
+int main(int argc, char* argv[])
+{
+  Logger::setLogLevel(Logger::WARN);
+  if (argc > 1)
+  {
+    g_messages = atoi(argv[1]);
+  }
+  if (argc > 2)
+  {
+    g_bytes = atoi(argv[2]);
+  }
+  if (argc > 3)
+  {
+    g_poolThreads = atoi(argv[3]);
+  }
+  run(false, 19981);
+  run(true, 19982);
+  google::protobuf::ShutdownProtobufLibrary();
+}
@@ -1,6 +1,7 @@
 #undef NDEBUG
 #include "muduo/net/protorpc/RpcCodec.h"
 #include "muduo/net/protorpc/rpc.pb.h"
+#include "muduo/net/protobuf/BufferStream.h"
 #include "muduo/net/protobuf/ProtobufCodecLite.h"
 #include "muduo/net/Buffer.h"
 
@@ -36,6 +37,197 @@ void print(const Buffer& buf)
 
 char rpctag[] = "RPC0";
 
+RpcMessagePtr g_rpcptr;
+string g_payload;
+ZeroCopyRpcCodec* g_zeroCopyCodec;
+void zeroCopyCallback(const TcpConnectionPtr&,
+                      const RpcMessagePtr& msg,
+                      Timestamp)
+{
+  g_rpcptr = msg;
+  g_payload = g_zeroCopyCodec->codec().payload().as_string();
+}
+
+void testZeroCopy()
+{
+  RpcMessage inner;
+  inner.set_type(RESPONSE);
+  inner.set_id(42);
+  inner.set_response(string(1000, 'x'));
+
+  RpcMessage message;
+  message.set_type(REQUEST);
+  message.set_id(3);
+  message.set_service("muduo.Echo");
+  message.set_method("Echo");
+
+  // zero copy encoding is readable by RpcCodec
+  Buffer buf;
+  ZeroCopyRpcCodec zcodec(zeroCopyCallback);
+  g_zeroCopyCodec = &zcodec;
+  zcodec.codec().fillEmptyBuffer(&buf, message, RpcMessage::kRequestFieldNumber, inner);
+  Buffer copy(buf);
+  ProtobufCodecLite codec(&RpcMessage::default_instance(), "RPC0", messageCallback);
+  codec.onMessage(TcpConnectionPtr(), &copy, Timestamp::now());
+  assert(g_msgptr);
+  RpcMessage expected(message);
+  expected.set_request(inner.SerializeAsString());
+  assert(g_msgptr->DebugString() == expected.DebugString());
+  g_msgptr.reset();
+
+  // and RpcCodec encoding is readable by zero copy codec
+  Buffer buf2;
+  RpcCodec rpcCodec(rpcMessageCallback);
+  rpcCodec.fillEmptyBuffer(&buf2, expected);
+  zcodec.setReuseMessage(true);
+  buf2.append(buf.peek(), buf.readableBytes());
+  zcodec.onMessage(TcpConnectionPtr(), &buf2, Timestamp::now());
+  assert(buf2.readableBytes() == 0);
+  assert(g_rpcptr);
+  assert(g_rpcptr->has_request() && g_rpcptr->request().empty());
+  assert(g_rpcptr->service() == "muduo.Echo");
+  RpcMessage parsed;
+  assert(parsed.ParseFromString(g_payload));
+  assert(parsed.DebugString() == inner.DebugString());
+
+  // reuses the message which nobody else holds
+  RpcMessage* last = get_pointer(g_rpcptr);
+  g_rpcptr.reset();
+  zcodec.fillEmptyBuffer(&buf2, message);
+  zcodec.onMessage(TcpConnectionPtr(), &buf2, Timestamp::now());
+  assert(get_pointer(g_rpcptr) == last);
+  assert(!g_rpcptr->has_request());
+  assert(g_payload.empty());
+  g_rpcptr.reset();
+}
+
+// the callback of one codec has another parse a frame before
+// it looks at its own payload, as nested dispatch in one loop does
+ZeroCopyRpcCodec* g_innerCodec;
+Buffer* g_innerBuf;
+string g_innerPayload;
+void innerCallback(const TcpConnectionPtr&,
+                   const RpcMessagePtr&,
+                   Timestamp)
+{
+  g_innerPayload = g_innerCodec->codec().payload().as_string();
+}
+
+ZeroCopyRpcCodec* g_outerCodec;
+string g_outerPayload;
+void outerCallback(const TcpConnectionPtr& conn,
+                   const RpcMessagePtr&,
+                   Timestamp receiveTime)
+{
+  g_innerCodec->onMessage(conn, g_innerBuf, receiveTime);
+  g_outerPayload = g_outerCodec->codec().payload().as_string();
+}
+
+void testPayloadPerCodec()
+{
+  RpcMessage header;
+  header.set_type(RESPONSE);
+  header.set_id(7);
+  RpcMessage outer(header);
+  outer.set_response(string(100, 'a'));
+  RpcMessage inner(header);
+  inner.set_response(string(200, 'b'));
+
+  ZeroCopyRpcCodec outerCodec(outerCallback);
+  ZeroCopyRpcCodec innerCodec(innerCallback);
+  g_outerCodec = &outerCodec;
+  g_innerCodec = &innerCodec;
+  Buffer outerBuf;
+  Buffer innerBuf;
+  g_innerBuf = &innerBuf;
+  outerCodec.codec().fillEmptyBuffer(&outerBuf, header, RpcMessage::kResponseFieldNumber, outer);
+  innerCodec.codec().fillEmptyBuffer(&innerBuf, header, RpcMessage::kResponseFieldNumber, inner);
+  outerCodec.onMessage(TcpConnectionPtr(), &outerBuf, Timestamp::now());
+  assert(innerBuf.readableBytes() == 0);
+  assert(g_innerPayload == inner.SerializeAsString());
+  assert(g_outerPayload == outer.SerializeAsString());
+}
+
+int g_errors = 0;
+void errorCallback(const TcpConnectionPtr&,
+                   Buffer*,
+                   Timestamp,
+                   ProtobufCodecLite::ErrorCode)
+{
+  ++g_errors;
+}
+
+void testChecksumTypes()
+{
+  RpcMessage message;
+  message.set_type(REQUEST);
+  message.set_id(5);
+  message.set_request(string(300, 'z'));
+  const ProtobufCodecLite::ChecksumType types[] = {
+    ProtobufCodecLite::kAdler32,
+    ProtobufCodecLite::kCrc32c,
+    ProtobufCodecLite::kXxHash32,
+    ProtobufCodecLite::kNoChecksum,
+  };
+  for (ProtobufCodecLite::ChecksumType type : types)
+  {
+    ProtobufCodecLite sender(&RpcMessage::default_instance(), "RPC0", messageCallback);
+    sender.setChecksumType(type);
+    Buffer buf;
+    sender.fillEmptyBuffer(&buf, message);
+    uint32_t size = static_cast<uint32_t>(buf.peekInt32());
+    assert(size >> ProtobufCodecLite::kChecksumTypeShift == static_cast<uint32_t>(type));
+    assert((size & ProtobufCodecLite::kSizeMask) == buf.readableBytes() - 4);
+
+    // a server following its peer, accepts all but kNoChecksum
+    ProtobufCodecLite receiver(&RpcMessage::default_instance(), "RPC0", messageCallback,
+                               ProtobufCodecLite::RawMessageCallback(), errorCallback);
+    receiver.setChecksumFollowsPeer(true);
+    g_errors = 0;
+    Buffer copy(buf);
+    receiver.onMessage(TcpConnectionPtr(), &copy, Timestamp::now());
+    if (type == ProtobufCodecLite::kNoChecksum)
+    {
+      assert(g_errors == 1);
+      assert(!g_msgptr);
+      receiver.setChecksumType(ProtobufCodecLite::kNoChecksum);
+      receiver.onMessage(TcpConnectionPtr(), &copy, Timestamp::now());
+    }
+    assert(g_errors == (type == ProtobufCodecLite::kNoChecksum ? 1 : 0));
+    assert(g_msgptr && g_msgptr->DebugString() == message.DebugString());
+    g_msgptr.reset();
+    assert(receiver.checksumTypeToSend() == type);
+
+    // corrupted payload
+    if (type != ProtobufCodecLite::kNoChecksum)
+    {
+      Buffer bad(buf);
+      const_cast<char*>(bad.peek())[20] ^= 1;
+      receiver.onMessage(TcpConnectionPtr(), &bad, Timestamp::now());
+      assert(g_errors == 1);
+      assert(!g_msgptr);
+    }
+  }
+}
+
+void testBufferStream()
+{
+  RpcMessage message;
+  message.set_type(RESPONSE);
+  message.set_id(7);
+  message.set_response(string(10000, 'y'));
+  Buffer buf;
+  {
+  BufferOutputStream os(&buf);
+  assert(message.SerializeToZeroCopyStream(&os));
+  }
+  buf.appendInt32(0);  // trailing bytes not parsed
+  RpcMessage parsed;
+  BufferInputStream is(&buf, static_cast<int>(buf.readableBytes() - sizeof(int32_t)));
+  assert(parsed.ParseFromZeroCopyStream(&is));
+  assert(parsed.DebugString() == message.DebugString());
+}
+
 int main()
 {
   RpcMessage message;
@@ -77,5 +269,10 @@ int main()
   assert(g_msgptr->DebugString() == message.DebugString());
   }
 
+  testZeroCopy();
+  testPayloadPerCodec();
+  testBufferStream();
+  testChecksumTypes();
+
   google::protobuf::ShutdownProtobufLibrary();
 }
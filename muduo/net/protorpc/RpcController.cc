@@ -0,0 +1,99 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include "muduo/net/protorpc/RpcController.h"
+
+#include "muduo/net/protorpc/RpcChannel.h"
+
+using namespace muduo;
+using namespace muduo::net;
+
+RpcController::RpcController()
+  : timeout_(0),
+    error_(NO_ERROR),
+    canceled_(false),
+    cancelCallback_(NULL),
+    id_(0)
+{
+}
+
+RpcController::~RpcController()
+{
+  delete cancelCallback_;
+}
+
+void RpcController::Reset()
+{
+  timeout_ = 0;
+  error_ = NO_ERROR;
+  reason_.clear();
+  canceled_ = false;
+  delete cancelCallback_;
+  cancelCallback_ = NULL;
+  clearCall();
+}
+
+void RpcController::StartCancel()
+{
+  RpcChannelPtr channel;
+  int64_t id = 0;
+  {
+    MutexLockGuard lock(mutex_);
+    channel = channel_.lock();
+    id = id_;
+  }
+  if (channel)
+  {
+    channel->cancel(id);
+  }
+}
+
+void RpcController::setCall(const std::weak_ptr<RpcChannel>& channel, int64_t id)
+{
+  MutexLockGuard lock(mutex_);
+  channel_ = channel;
+  id_ = id;
+}
+
+void RpcController::clearCall()
+{
+  MutexLockGuard lock(mutex_);
+  channel_.reset();
+  id_ = 0;
+}
+
+void RpcController::SetFailed(const std::string& reason)
+{
+  setFailed(INVALID_RESPONSE, reason);
+}
+
+void RpcController::NotifyOnCancel(::google::protobuf::Closure* callback)
+{
+  if (canceled_)
+  {
+    callback->Run();
+  }
+  else
+  {
+    delete cancelCallback_;
+    cancelCallback_ = callback;
+  }
+}
+
+void RpcController::setFailed(ErrorCode error, const std::string& reason)
+{
+  error_ = error;
+  reason_ = reason;
+  if (error == CANCELED && !canceled_)
+  {
+    canceled_ = true;
+    if (cancelCallback_)
+    {
+      ::google::protobuf::Closure* callback = cancelCallback_;
+      cancelCallback_ = NULL;
+      callback->Run();
+    }
+  }
+}
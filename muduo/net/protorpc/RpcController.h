@@ -0,0 +1,83 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_PROTORPC_RPCCONTROLLER_H
+#define MUDUO_NET_PROTORPC_RPCCONTROLLER_H
+
+#include "muduo/base/Mutex.h"
+#include "muduo/net/protorpc/rpc.pb.h"
+
+#include <google/protobuf/service.h>
+
+#include <memory>
+
+namespace muduo
+{
+namespace net
+{
+
+class RpcChannel;
+
+///
+/// Per call settings and status of RpcChannel::CallMethod().
+///
+/// Pass one to the stub to get a deadline or to cancel the call.
+/// Status is valid in the done callback, done runs exactly once,
+/// whether the call succeeds, fails, times out or is canceled.
+/// Reuse it for another call after Reset().
+///
+class RpcController : public ::google::protobuf::RpcController
+{
+ public:
+  RpcController();
+  ~RpcController() override;
+
+  // client side
+  void Reset() override;
+  bool Failed() const override { return error_ != NO_ERROR; }
+  std::string ErrorText() const override { return reason_; }
+
+  /// Completes the call with CANCELED, if it is still outstanding.
+  /// Thread safe, done runs in the IO thread of the channel.
+  void StartCancel() override;
+
+  // server side, RpcServer doesn't pass controllers to services yet
+  void SetFailed(const std::string& reason) override;
+  bool IsCanceled() const override { return canceled_; }
+  void NotifyOnCancel(::google::protobuf::Closure* callback) override;
+
+  /// Deadline of the call in seconds, overrides RpcChannel::setTimeout().
+  /// 0 for the channel default.
+  void setTimeout(double seconds) { timeout_ = seconds; }
+  double timeout() const { return timeout_; }
+
+  ErrorCode errorCode() const { return error_; }
+  void setFailed(ErrorCode error, const std::string& reason);
+
+ private:
+  friend class RpcChannel;
+
+  // by RpcChannel, maybe in the IO thread while StartCancel() runs in another
+  void setCall(const std::weak_ptr<RpcChannel>& channel, int64_t id);
+  void clearCall();
+
+  double timeout_;
+  ErrorCode error_;
+  std::string reason_;
+  bool canceled_;
+  ::google::protobuf::Closure* cancelCallback_;
+
+  // set by RpcChannel::CallMethod(), cleared when the call completes
+  MutexLock mutex_;
+  std::weak_ptr<RpcChannel> channel_ GUARDED_BY(mutex_);
+  int64_t id_ GUARDED_BY(mutex_);
+};
+
+}  // namespace net
+}  // namespace muduo
+
+#endif  // MUDUO_NET_PROTORPC_RPCCONTROLLER_H
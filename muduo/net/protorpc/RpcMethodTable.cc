@@ -0,0 +1,118 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include "muduo/net/protorpc/RpcMethodTable.h"
+
+#include "muduo/base/Checksum.h"
+#include "muduo/base/Logging.h"
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/service.h>
+
+using namespace muduo;
+using namespace muduo::net;
+
+void RpcMethodTable::registerService(google::protobuf::Service* service)
+{
+  const google::protobuf::ServiceDescriptor* desc = service->GetDescriptor();
+  MethodIndex& index = services_[desc->full_name()];
+  if (!index.empty() && methods_[index.begin()->second].method->service() == desc)
+  {
+    // same methods, clients keep their ids
+    for (const auto& it : index)
+    {
+      Method& m = methods_[it.second];
+      m.service = service;
+      m.requestPrototype = &service->GetRequestPrototype(m.method);
+      m.responsePrototype = &service->GetResponsePrototype(m.method);
+    }
+    return;
+  }
+  // other methods of the same name, ids of the old ones are stale now
+  for (const auto& it : index)
+  {
+    methods_[it.second].service = NULL;
+  }
+  index.clear();
+  for (int i = 0; i < desc->method_count(); ++i)
+  {
+    const google::protobuf::MethodDescriptor* method = desc->method(i);
+    if (methods_.size() >= kMaxMethods)
+    {
+      LOG_FATAL << "RpcMethodTable::registerService too many methods";
+    }
+    const std::string& name = method->full_name();
+    uint32_t tag = Checksum::xxhash32(name.data(), name.size()) & ~(kMaxMethods - 1);
+    Method m = { service, method,
+                 &service->GetRequestPrototype(method),
+                 &service->GetResponsePrototype(method),
+                 tag | static_cast<uint32_t>(methods_.size()),
+                 NULL, new Stats, ServerStreamHandler(), ClientStreamHandler() };
+    index[method->name()] = methods_.size();
+    methods_.push_back(m);
+    stats_.emplace_back(m.stats);
+  }
+}
+
+const RpcMethodTable::Method* RpcMethodTable::find(const std::string& service,
+                                                   const std::string& method,
+                                                   bool* serviceFound) const
+{
+  auto it = services_.find(service);
+  *serviceFound = it != services_.end();
+  if (*serviceFound)
+  {
+    auto m = it->second.find(method);
+    if (m != it->second.end())
+    {
+      return &methods_[m->second];
+    }
+  }
+  return NULL;
+}
+
+int RpcMethodTable::setExecutor(const std::string& name, ThreadPool* executor)
+{
+  int changed = 0;
+  for (Method& m : methods_)
+  {
+    if (m.service && (m.method->service()->full_name() == name || m.method->full_name() == name))
+    {
+      m.executor = executor;
+      ++changed;
+    }
+  }
+  return changed;
+}
+
+bool RpcMethodTable::setServerStreamHandler(const std::string& method,
+                                            const ServerStreamHandler& handler)
+{
+  bool found = false;
+  for (Method& m : methods_)
+  {
+    if (m.service && m.method->full_name() == method)
+    {
+      m.serverStream = handler;
+      found = true;
+    }
+  }
+  return found;
+}
+
+bool RpcMethodTable::setClientStreamHandler(const std::string& method,
+                                            const ClientStreamHandler& handler)
+{
+  bool found = false;
+  for (Method& m : methods_)
+  {
+    if (m.service && m.method->full_name() == method)
+    {
+      m.clientStream = handler;
+      found = true;
+    }
+  }
+  return found;
+}
@@ -0,0 +1,126 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_PROTORPC_RPCMETHODTABLE_H
+#define MUDUO_NET_PROTORPC_RPCMETHODTABLE_H
+
+#include "muduo/base/Atomic.h"
+#include "muduo/net/protorpc/RpcStream.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+namespace google
+{
+namespace protobuf
+{
+class Message;
+class MethodDescriptor;
+class Service;
+}
+}
+
+namespace muduo
+{
+class ThreadPool;
+
+namespace net
+{
+
+///
+/// Methods of registered services, resolved once.
+///
+/// Dispatching a request is a hash lookup by service and method name,
+/// or an array index by wire id.  A wire id is the index of the method
+/// tagged with a hash of its full name, so a stale id (server restarted
+/// with other services, or a balancer in between) is rejected rather than
+/// calling the wrong method.
+///
+/// Not thread safe for registering, register all services before start.
+///
+class RpcMethodTable : noncopyable
+{
+ public:
+  /// Requests of methods running in executors.
+  struct Stats
+  {
+    AtomicInt64 queued;     // waiting for a thread of the executor
+    AtomicInt64 running;    // in CallMethod()
+    AtomicInt64 completed;  // returned from CallMethod()
+  };
+
+  struct Method
+  {
+    ::google::protobuf::Service* service;  // NULL once replaced
+    const ::google::protobuf::MethodDescriptor* method;
+    const ::google::protobuf::Message* requestPrototype;
+    const ::google::protobuf::Message* responsePrototype;
+    uint32_t wireId;
+    ThreadPool* executor;  // NULL to run in the IO thread
+    Stats* stats;
+    // for streaming calls of the method, which always run in the IO thread
+    ServerStreamHandler serverStream;
+    ClientStreamHandler clientStream;
+  };
+
+  static const uint32_t kMaxMethods = 1 << 16;
+
+  /// Replaces the service of the same name, if any.  Its methods keep
+  /// their wire ids if they are of the same descriptor, otherwise the old
+  /// methods are left unused and their ids are rejected.
+  void registerService(::google::protobuf::Service* service);
+
+  /// Returns NULL if id is unknown or stale.
+  const Method* find(uint32_t wireId) const
+  {
+    size_t index = wireId & (kMaxMethods - 1);
+    if (index < methods_.size() && methods_[index].wireId == wireId
+        && methods_[index].service)
+    {
+      return &methods_[index];
+    }
+    return NULL;
+  }
+
+  /// Returns NULL if not found, *serviceFound tells which name is unknown.
+  const Method* find(const std::string& service,
+                     const std::string& method,
+                     bool* serviceFound) const;
+
+  ///
+  /// Runs methods of name in executor, NULL for the IO thread.
+  /// name is a service ("echo.EchoService") for all its methods,
+  /// or a method ("echo.EchoService.Echo").
+  /// Returns number of methods changed, 0 if name is unknown.
+  ///
+  int setExecutor(const std::string& name, ThreadPool* executor);
+
+  /// Handles streaming calls of method, e.g. "echo.EchoService.Echo".
+  /// Returns false if method is unknown.
+  bool setServerStreamHandler(const std::string& method, const ServerStreamHandler& handler);
+  bool setClientStreamHandler(const std::string& method, const ClientStreamHandler& handler);
+
+  size_t size() const { return methods_.size(); }
+  const Method& method(size_t index) const { return methods_[index]; }
+
+ private:
+  // by method name
+  typedef std::unordered_map<std::string, size_t> MethodIndex;
+
+  std::vector<Method> methods_;
+  std::vector<std::unique_ptr<Stats>> stats_;  // of methods_
+  std::unordered_map<std::string, MethodIndex> services_;
+};
+
+}  // namespace net
+}  // namespace muduo
+
+#endif  // MUDUO_NET_PROTORPC_RPCMETHODTABLE_H
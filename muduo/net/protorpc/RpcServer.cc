@@ -9,17 +9,23 @@
 #include "muduo/net/protorpc/RpcServer.h"
 
 #include "muduo/base/Logging.h"
+#include "muduo/base/ThreadPool.h"
 #include "muduo/net/protorpc/RpcChannel.h"
 
 #include <google/protobuf/descriptor.h>
-#include <google/protobuf/service.h>
+
+#include <inttypes.h>
+#include <stdio.h>
 
 using namespace muduo;
 using namespace muduo::net;
 
 RpcServer::RpcServer(EventLoop* loop,
                      const InetAddress& listenAddr)
-  : server_(loop, listenAddr, "RpcServer")
+  : codecPool_(NULL),
+    codecOffloadBytes_(ProtobufCodecLite::kDefaultOffloadBytes),
+    checksumType_(ProtobufCodecLite::kAdler32),
+    server_(loop, listenAddr, "RpcServer")
 {
   server_.setConnectionCallback(
       std::bind(&RpcServer::onConnection, this, _1));
@@ -27,10 +33,70 @@ RpcServer::RpcServer(EventLoop* loop,
 //       std::bind(&RpcServer::onMessage, this, _1, _2, _3));
 }
 
+RpcServer::~RpcServer()
+{
+}
+
 void RpcServer::registerService(google::protobuf::Service* service)
 {
-  const google::protobuf::ServiceDescriptor* desc = service->GetDescriptor();
-  services_[desc->full_name()] = service;
+  methods_.registerService(service);
+}
+
+void RpcServer::setExecutor(const string& name, ThreadPool* pool)
+{
+  if (methods_.setExecutor(name, pool) == 0)
+  {
+    LOG_ERROR << "RpcServer::setExecutor - no service or method " << name;
+  }
+}
+
+void RpcServer::setDedicatedExecutor(const string& name, int numThreads)
+{
+  std::unique_ptr<ThreadPool> pool(new ThreadPool(name));
+  pool->start(numThreads);
+  setExecutor(name, get_pointer(pool));
+  dedicatedPools_.push_back(std::move(pool));
+}
+
+void RpcServer::setServerStreamHandler(const string& method,
+                                       const ServerStreamHandler& handler)
+{
+  if (!methods_.setServerStreamHandler(method, handler))
+  {
+    LOG_ERROR << "RpcServer::setServerStreamHandler - no method " << method;
+  }
+}
+
+void RpcServer::setClientStreamHandler(const string& method,
+                                       const ClientStreamHandler& handler)
+{
+  if (!methods_.setClientStreamHandler(method, handler))
+  {
+    LOG_ERROR << "RpcServer::setClientStreamHandler - no method " << method;
+  }
+}
+
+string RpcServer::executorStats() const
+{
+  string result;
+  for (size_t i = 0; i < methods_.size(); ++i)
+  {
+    const RpcMethodTable::Method& m = methods_.method(i);
+    if (m.executor && m.service)
+    {
+      char buf[256];
+      snprintf(buf, sizeof buf, "%s %s queue %zd queued %" PRId64 " running %" PRId64
+               " completed %" PRId64 "\n",
+               m.method->full_name().c_str(),
+               m.executor->name().c_str(),
+               m.executor->queueSize(),
+               m.stats->queued.get(),
+               m.stats->running.get(),
+               m.stats->completed.get());
+      result += buf;
+    }
+  }
+  return result;
 }
 
 void RpcServer::start()
@@ -46,15 +112,26 @@ void RpcServer::onConnection(const TcpConnectionPtr& conn)
   if (conn->connected())
   {
     RpcChannelPtr channel(new RpcChannel(conn));
-    channel->setServices(&services_);
+    channel->setMethodTable(&methods_);
+    channel->setChecksumType(checksumType_);
+    channel->setChecksumFollowsPeer(true);
+    if (codecPool_)
+    {
+      channel->setCodecThreadPool(codecPool_, codecOffloadBytes_);
+    }
     conn->setMessageCallback(
         std::bind(&RpcChannel::onMessage, get_pointer(channel), _1, _2, _3));
     conn->setContext(channel);
   }
   else
   {
+    // an executor may keep the channel, its streams are done now
+    RpcChannelPtr* channel = boost::any_cast<RpcChannelPtr>(conn->getMutableContext());
+    if (channel && *channel)
+    {
+      (*channel)->onDisconnected();
+    }
     conn->setContext(RpcChannelPtr());
-    // FIXME:
   }
 }
 
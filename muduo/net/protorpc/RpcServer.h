@@ -12,6 +12,8 @@
 #define MUDUO_NET_PROTORPC_RPCSERVER_H
 
 #include "muduo/net/TcpServer.h"
+#include "muduo/net/protobuf/ProtobufCodecLite.h"
+#include "muduo/net/protorpc/RpcMethodTable.h"
 
 namespace google {
 namespace protobuf {
@@ -31,13 +33,57 @@ class RpcServer
  public:
   RpcServer(EventLoop* loop,
             const InetAddress& listenAddr);
+  ~RpcServer();  // force out-line dtor, for std::unique_ptr members.
 
   void setThreadNum(int numThreads)
   {
     server_.setThreadNum(numThreads);
   }
 
+  // Parses and serializes messages of at least minBytes in pool,
+  // see ProtobufCodecLite::setThreadPool().  Call before start().
+  void setCodecThreadPool(ThreadPool* pool,
+                          int minBytes = ProtobufCodecLite::kDefaultOffloadBytes)
+  {
+    codecPool_ = pool;
+    codecOffloadBytes_ = minBytes;
+  }
+
+  // Each connection is answered in the checksum type its client uses.
+  // Set kNoChecksum here to accept unchecked frames of trusted clients.
+  void setChecksumType(ProtobufCodecLite::ChecksumType type)
+  {
+    checksumType_ = type;
+  }
+
+  // Resolves methods of the service once, call before start().
   void registerService(::google::protobuf::Service*);
+
+  ///
+  /// Runs requests of a service ("echo.EchoService") or a method
+  /// ("echo.EchoService.Echo") in pool instead of the IO thread,
+  /// so slow ones don't hold up other connections of the loop.
+  /// A pool may be shared by several services, NULL runs them in the IO
+  /// thread again.  The method's done callback may run in any thread,
+  /// the response is sent from the IO thread of the connection.
+  /// A full pool (see ThreadPool::setMaxQueueSize()) blocks the IO thread.
+  /// Call after registerService() and before start().
+  ///
+  void setExecutor(const string& name, ThreadPool* pool);
+
+  /// Same as above, with a pool of numThreads owned by the server.
+  void setDedicatedExecutor(const string& name, int numThreads);
+
+  /// Handles streaming calls of method, e.g. "echo.EchoService.Echo",
+  /// in the IO thread.  The method is declared as a unary one in .proto,
+  /// unary calls of it still go to the service.
+  /// Call after registerService() and before start().
+  void setServerStreamHandler(const string& method, const ServerStreamHandler& handler);
+  void setClientStreamHandler(const string& method, const ClientStreamHandler& handler);
+
+  /// One line per method with an executor: name, queue size of
+  /// the executor, requests queued, running and completed.
+  string executorStats() const;
   void start();
 
  private:
@@ -47,8 +93,13 @@ class RpcServer
   //                Buffer* buf,
   //                Timestamp time);
 
+  // outlive server_, its channels run methods in the pools
+  RpcMethodTable methods_;
+  std::vector<std::unique_ptr<ThreadPool>> dedicatedPools_;
+  ThreadPool* codecPool_;
+  int codecOffloadBytes_;
+  ProtobufCodecLite::ChecksumType checksumType_;
   TcpServer server_;
-  std::map<std::string, ::google::protobuf::Service*> services_;
 };
 
 }  // namespace net
@@ -0,0 +1,159 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+
+#include "muduo/net/protorpc/RpcStream.h"
+
+#include "muduo/base/Logging.h"
+#include "muduo/net/protorpc/RpcChannel.h"
+
+using namespace muduo;
+using namespace muduo::net;
+
+const int RpcStream::kDefaultWindow;
+
+RpcStream::RpcStream(RpcChannel* channel,
+                     int64_t id,
+                     bool caller,
+                     int credit,
+                     int window,
+                     const ::google::protobuf::Message* receivePrototype)
+  : channel_(channel),
+    id_(id),
+    caller_(caller),
+    credit_(credit),
+    window_(window),
+    consumed_(0),
+    finished_(false),
+    ended_(false),
+    received_(receivePrototype ? receivePrototype->New() : NULL)
+{
+}
+
+bool RpcStream::write(const ::google::protobuf::Message& message)
+{
+  if (!channel_ || finished_)
+  {
+    return false;
+  }
+  --credit_;
+  channel_->sendStreamFrame(this, &message, 0, false, NO_ERROR);
+  return true;
+}
+
+bool RpcStream::writable() const
+{
+  return channel_ && !finished_ && credit_ > 0 && channel_->belowStreamHighWaterMark();
+}
+
+void RpcStream::finish(ErrorCode error)
+{
+  if (!channel_ || finished_)
+  {
+    return;
+  }
+  RpcStreamPtr guard(shared_from_this());  // channel may drop the last one
+  finished_ = true;
+  if (error != NO_ERROR)
+  {
+    ended_ = true;
+  }
+  RpcChannel* channel = channel_;
+  channel->sendStreamFrame(this, NULL, 0, true, error);
+  channel->closeStreamIfDone(this);
+}
+
+void RpcStream::abort(ErrorCode error)
+{
+  if (!channel_ || (finished_ && ended_))
+  {
+    return;
+  }
+  RpcStreamPtr guard(shared_from_this());
+  finished_ = true;
+  ended_ = true;
+  RpcChannel* channel = channel_;
+  channel->sendStreamFrame(this, NULL, 0, true, error);
+  channel->closeStreamIfDone(this);
+}
+
+void RpcStream::onData(StringPiece payload)
+{
+  if (ended_ || !received_)
+  {
+    return;
+  }
+  RpcStreamPtr guard(shared_from_this());
+  if (!received_->ParseFromArray(payload.data(), payload.size()))
+  {
+    LOG_ERROR << "RpcStream::onData - bad message of stream " << id_;
+    ErrorCode error = caller_ ? INVALID_RESPONSE : INVALID_REQUEST;
+    abort(error);
+    if (endCallback_)
+    {
+      endCallback_(error);
+    }
+    return;
+  }
+  if (messageCallback_)
+  {
+    messageCallback_(*received_);
+  }
+  // the callback may have aborted the stream
+  if (++consumed_ >= window_ / 2 && !ended_ && channel_)
+  {
+    channel_->sendStreamFrame(this, NULL, consumed_, false, NO_ERROR);
+    consumed_ = 0;
+  }
+}
+
+void RpcStream::onCredit(int credit)
+{
+  bool wasWritable = writable();
+  credit_ += credit;
+  if (!wasWritable)
+  {
+    onWritable();
+  }
+}
+
+void RpcStream::onEnd(ErrorCode error)
+{
+  RpcStreamPtr guard(shared_from_this());
+  // an error aborts the writer too
+  bool notify = !ended_ || (error != NO_ERROR && !finished_);
+  ended_ = true;
+  if (error != NO_ERROR)
+  {
+    finished_ = true;
+  }
+  if (notify && endCallback_)
+  {
+    endCallback_(error);
+  }
+  if (channel_)
+  {
+    channel_->closeStreamIfDone(this);
+  }
+}
+
+void RpcStream::onWritable()
+{
+  if (writableCallback_ && writable())
+  {
+    writableCallback_();
+  }
+}
+
+void RpcStream::onClose(ErrorCode error)
+{
+  bool notify = !(finished_ && ended_);
+  channel_ = NULL;
+  finished_ = true;
+  ended_ = true;
+  if (notify && endCallback_)
+  {
+    endCallback_(error);
+  }
+}
@@ -0,0 +1,135 @@
+// Use of this source code is governed by a BSD-style license
+// that can be found in the License file.
+//
+// Author: Shuo Chen (chenshuo at chenshuo dot com)
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef MUDUO_NET_PROTORPC_RPCSTREAM_H
+#define MUDUO_NET_PROTORPC_RPCSTREAM_H
+
+#include "muduo/base/StringPiece.h"
+#include "muduo/base/noncopyable.h"
+#include "muduo/net/protorpc/rpc.pb.h"
+
+#include <functional>
+#include <memory>
+
+namespace google
+{
+namespace protobuf
+{
+class Closure;
+class Message;
+}
+}
+
+namespace muduo
+{
+namespace net
+{
+
+class RpcChannel;
+class RpcStream;
+typedef std::shared_ptr<RpcStream> RpcStreamPtr;
+typedef std::shared_ptr<google::protobuf::Message> MessagePtr;
+
+/// Server side of a server streaming call, writes responses to stream.
+typedef std::function<void (const MessagePtr& request,
+                            const RpcStreamPtr& stream)> ServerStreamHandler;
+/// Server side of a client streaming call, reads requests from stream,
+/// then fills response and runs done as a unary method does.
+typedef std::function<void (const RpcStreamPtr& stream,
+                            ::google::protobuf::Message* response,
+                            ::google::protobuf::Closure* done)> ClientStreamHandler;
+
+///
+/// One direction of messages of a streaming call, plus credits and
+/// end of stream going the other way.
+///
+/// The receiver grants credits as its callback consumes messages,
+/// a writer should stop when writable() is false and carry on in the
+/// writable callback.  writable() is also false while the connection
+/// has more than RpcChannel::setStreamHighWaterMark() bytes to send,
+/// so a fast writer doesn't fill memory of either side.
+///
+/// Used in the IO thread of the channel only.  The channel keeps the
+/// stream until both directions are done, callbacks of it shouldn't hold
+/// an RpcStreamPtr, or they keep each other alive.
+///
+class RpcStream : noncopyable,
+                  public std::enable_shared_from_this<RpcStream>
+{
+ public:
+  typedef std::function<void (const ::google::protobuf::Message&)> MessageCallback;
+  typedef std::function<void (ErrorCode)> EndCallback;
+  typedef std::function<void ()> WritableCallback;
+
+  /// Credits a writer starts with, unless the reader tells otherwise.
+  static const int kDefaultWindow = 16;
+
+  int64_t id() const { return id_; }
+
+  // writer
+
+  /// Returns false if the stream is finished or aborted.
+  /// Sends even without credits, check writable() first.
+  bool write(const ::google::protobuf::Message& message);
+  bool writable() const;
+  void setWritableCallback(WritableCallback cb)
+  { writableCallback_ = std::move(cb); }
+  /// No more messages, error other than NO_ERROR aborts the stream.
+  void finish(ErrorCode error = NO_ERROR);
+
+  // reader
+
+  /// message is reused for the next one, copy what you need.
+  void setMessageCallback(MessageCallback cb)
+  { messageCallback_ = std::move(cb); }
+  /// The writer finished or the stream is aborted,
+  /// NO_CONNECTION if the channel is gone.
+  void setEndCallback(EndCallback cb)
+  { endCallback_ = std::move(cb); }
+
+  /// Ends both directions, e.g. a client is not interested in more
+  /// responses of a server stream.  Callbacks are not called.
+  void abort(ErrorCode error = CANCELED);
+
+  bool finished() const { return finished_; }
+  bool ended() const { return ended_; }
+
+ private:
+  friend class RpcChannel;
+
+  RpcStream(RpcChannel* channel,
+            int64_t id,
+            bool caller,
+            int credit,
+            int window,
+            const ::google::protobuf::Message* receivePrototype);
+
+  // called by RpcChannel
+  void onData(StringPiece payload);
+  void onCredit(int credit);
+  void onEnd(ErrorCode error);
+  void onWritable();
+  void onClose(ErrorCode error);
+
+  RpcChannel* channel_;  // NULL once closed
+  const int64_t id_;
+  const bool caller_;  // sends STREAM_REQUEST, else STREAM_RESPONSE
+  int credit_;         // messages we may send
+  const int window_;   // credits we grant
+  int consumed_;       // messages received but not granted again
+  bool finished_;      // sending direction is done
+  bool ended_;         // receiving direction is done
+  std::unique_ptr<::google::protobuf::Message> received_;
+  MessageCallback messageCallback_;
+  EndCallback endCallback_;
+  WritableCallback writableCallback_;
+};
+
+}  // namespace net
+}  // namespace muduo
+
+#endif  // MUDUO_NET_PROTORPC_RPCSTREAM_H
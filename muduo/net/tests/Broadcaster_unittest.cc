@@ -0,0 +1,232 @@
+#include "muduo/net/Broadcaster.h"
+
+#include "muduo/base/CountDownLatch.h"
+#include "muduo/base/Thread.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/InetAddress.h"
+#include "muduo/net/TcpConnection.h"
+#include "muduo/net/TcpServer.h"
+
+//#define BOOST_TEST_MODULE BroadcasterTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using muduo::string;
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+const uint16_t kPort = 2312;
+const int kLoops = 3;
+const int kClients = 6;  // two in each loop
+
+// Boost.Test checks are for the main thread, clients abort instead
+int connectServer()
+{
+  int sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memZero(&addr, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (sockfd < 0 || ::connect(sockfd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+  {
+    perror("connect");
+    abort();
+  }
+  return sockfd;
+}
+
+struct Received
+{
+  Received() : reads(0) {}
+
+  string data;
+  int reads;
+  Timestamp firstArrival;
+};
+
+std::vector<string> makeMessages(const char* prefix, int count)
+{
+  std::vector<string> messages;
+  for (int i = 0; i < count; ++i)
+  {
+    char buf[64];
+    snprintf(buf, sizeof buf, "%s %d\n", prefix, i);
+    messages.push_back(buf);
+  }
+  return messages;
+}
+
+// Broadcasts the messages from its own thread once all clients are added,
+// each client reads until it has got every message, then closes.
+class BroadcastTest : noncopyable
+{
+ public:
+  BroadcastTest(double batchSeconds, const std::vector<string>& messages)
+    : broadcaster_(batchSeconds),
+      messages_(messages),
+      clientsAdded_(kClients),
+      sizeWhenAdded_(0),
+      received_(kClients)
+  {
+    for (const string& message : messages_)
+    {
+      expected_ += message;
+    }
+  }
+
+  void run()
+  {
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(kPort), "BroadcastTest");
+    server.setThreadNum(kLoops);
+    server.setConnectionCallback(
+        std::bind(&BroadcastTest::onConnection, this, _1));
+    server.start();
+
+    CountDownLatch clientsDone(kClients);
+    std::vector<std::unique_ptr<Thread>> clients;
+    for (int i = 0; i < kClients; ++i)
+    {
+      clients.emplace_back(new Thread([this, i, &clientsDone] {
+        int sockfd = connectServer();
+        Received& r = received_[i];
+        char buf[65536];
+        while (r.data.size() < expected_.size())
+        {
+          ssize_t n = ::read(sockfd, buf, sizeof buf);
+          if (n <= 0)
+          {
+            perror("read");
+            abort();
+          }
+          if (r.reads++ == 0)
+          {
+            r.firstArrival = Timestamp::now();
+          }
+          r.data.append(buf, static_cast<size_t>(n));
+        }
+        ::close(sockfd);
+        clientsDone.countDown();
+      }, "client"));
+    }
+
+    Thread broadcaster([&] {
+      clientsAdded_.wait();
+      sizeWhenAdded_ = broadcaster_.size();
+      start_ = Timestamp::now();
+      for (size_t i = 0; i < messages_.size(); ++i)
+      {
+        // both overloads keep the order
+        if (i % 2 == 0)
+        {
+          broadcaster_.broadcast(messages_[i]);
+        }
+        else
+        {
+          broadcaster_.broadcast(Broadcaster::MessagePtr(new string(messages_[i])));
+        }
+      }
+      clientsDone.wait();
+      loop.quit();
+    }, "broadcaster");
+
+    broadcaster.start();
+    for (const auto& client : clients)
+    {
+      client->start();
+    }
+    loop.loop();
+    broadcaster.join();
+    for (const auto& client : clients)
+    {
+      client->join();
+    }
+  }
+
+  const string& expected() const { return expected_; }
+  const std::vector<Received>& received() const { return received_; }
+  size_t sizeWhenAdded() const { return sizeWhenAdded_; }
+  size_t numLoops() const
+  {
+    MutexLockGuard lock(mutex_);
+    return loops_.size();
+  }
+  Timestamp start() const { return start_; }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    if (conn->connected())
+    {
+      broadcaster_.add(conn);
+      {
+      MutexLockGuard lock(mutex_);
+      loops_.insert(conn->getLoop());
+      }
+      clientsAdded_.countDown();
+    }
+    else
+    {
+      broadcaster_.remove(conn);
+    }
+  }
+
+  // outlives the loops of the server
+  Broadcaster broadcaster_;
+  const std::vector<string> messages_;
+  CountDownLatch clientsAdded_;
+  mutable MutexLock mutex_;
+  std::set<EventLoop*> loops_ GUARDED_BY(mutex_);
+  size_t sizeWhenAdded_;
+  string expected_;  // all messages in order
+  std::vector<Received> received_;
+  Timestamp start_;
+};
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(testBroadcastOrderInManyLoops)
+{
+  // loops flush while messages are still coming
+  BroadcastTest test(0.0, makeMessages("message", 1000));
+  test.run();
+
+  BOOST_CHECK_EQUAL(test.numLoops(), kLoops);
+  BOOST_CHECK_EQUAL(test.sizeWhenAdded(), kClients);
+  for (const Received& r : test.received())
+  {
+    BOOST_CHECK_EQUAL(r.data.size(), test.expected().size());
+    BOOST_CHECK(r.data == test.expected());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(testBroadcastBatchWindow)
+{
+  const double kBatchSeconds = 0.2;
+  BroadcastTest test(kBatchSeconds, makeMessages("batched", 10));
+  test.run();
+
+  BOOST_CHECK_EQUAL(test.numLoops(), kLoops);
+  for (const Received& r : test.received())
+  {
+    BOOST_CHECK(r.data == test.expected());
+    // held back until the window closes, then written with one writev
+    BOOST_CHECK_EQUAL(r.reads, 1);
+    BOOST_CHECK_GE(timeDifference(r.firstArrival, test.start()), kBatchSeconds * 0.9);
+  }
+}
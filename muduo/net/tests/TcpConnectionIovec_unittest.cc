@@ -0,0 +1,241 @@
+#include "muduo/net/TcpConnection.h"
+
+#include "muduo/base/Thread.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/InetAddress.h"
+#include "muduo/net/TcpServer.h"
+
+//#define BOOST_TEST_MODULE TcpConnectionIovecTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using muduo::string;
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+const uint16_t kPort = 2311;
+
+string makeData(size_t len, int seed)
+{
+  string data(len, '\0');
+  for (size_t i = 0; i < len; ++i)
+  {
+    data[i] = static_cast<char>(i * 131 + (i >> 12) + seed);
+  }
+  return data;
+}
+
+// Boost.Test checks are for the main thread, the client aborts instead
+int connectServer(int rcvbuf)
+{
+  int sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (sockfd < 0)
+  {
+    perror("socket");
+    abort();
+  }
+  // before connect(), so the window stays small
+  if (rcvbuf > 0)
+  {
+    ::setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+  }
+  struct sockaddr_in addr;
+  memZero(&addr, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(sockfd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+  {
+    perror("connect");
+    abort();
+  }
+  return sockfd;
+}
+
+// Sends to the client once it connects, then shuts down.
+// The client waits for delayUs before reading everything.
+class IovecTest : noncopyable
+{
+ public:
+  typedef std::function<void (const TcpConnectionPtr&, string* expected)> SendFunc;
+
+  explicit IovecTest(const SendFunc& sendFunc)
+    : sendFunc_(sendFunc),
+      highWaterMarks_(0),
+      highWaterMarkBytes_(0),
+      writeCompletes_(0),
+      ownersReleased_(false)
+  {
+  }
+
+  // checked when the connection becomes idle
+  void watchOwner(const std::weak_ptr<void>& owner) { owners_.push_back(owner); }
+
+  void run(int rcvbuf, int delayUs, size_t highWaterMark)
+  {
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(kPort), "IovecTest");
+    server.setConnectionCallback([this, highWaterMark](const TcpConnectionPtr& conn) {
+      if (conn->connected())
+      {
+        conn->setHighWaterMarkCallback(
+            std::bind(&IovecTest::onHighWaterMark, this, _1, _2), highWaterMark);
+        conn->setWriteCompleteCallback(
+            std::bind(&IovecTest::onWriteComplete, this, _1));
+        sendFunc_(conn, &expected_);
+        conn->shutdown();
+      }
+    });
+    server.start();
+
+    Thread client([&] {
+      int sockfd = connectServer(rcvbuf);
+      ::usleep(delayUs);
+      char buf[65536];
+      ssize_t n = 0;
+      while ((n = ::read(sockfd, buf, sizeof buf)) > 0)
+      {
+        received_.append(buf, static_cast<size_t>(n));
+      }
+      ::close(sockfd);
+      loop.quit();
+    }, "client");
+    client.start();
+    loop.loop();
+    client.join();
+  }
+
+  const string& expected() const { return expected_; }
+  const string& received() const { return received_; }
+  int highWaterMarks() const { return highWaterMarks_; }
+  size_t highWaterMarkBytes() const { return highWaterMarkBytes_; }
+  int writeCompletes() const { return writeCompletes_; }
+  bool ownersReleasedOnWriteComplete() const { return ownersReleased_; }
+
+ private:
+  void onHighWaterMark(const TcpConnectionPtr&, size_t bytes)
+  {
+    ++highWaterMarks_;
+    highWaterMarkBytes_ = bytes;
+  }
+
+  void onWriteComplete(const TcpConnectionPtr&)
+  {
+    ++writeCompletes_;
+    ownersReleased_ = true;
+    for (const auto& owner : owners_)
+    {
+      ownersReleased_ = ownersReleased_ && owner.expired();
+    }
+  }
+
+  SendFunc sendFunc_;
+  string expected_;
+  string received_;
+  int highWaterMarks_;
+  size_t highWaterMarkBytes_;
+  int writeCompletes_;
+  std::vector<std::weak_ptr<void>> owners_;
+  bool ownersReleased_;
+};
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(testSendIovecQueued)
+{
+  const int kPieces = 200;  // more than kMaxIovec in one writev
+  const size_t kHighWaterMark = 64 * 1024;
+  size_t firstBytes = 0;
+  bool ownerQueued = false;
+  IovecTest test([&](const TcpConnectionPtr& conn, string* expected) {
+    std::shared_ptr<string> blob(new string(makeData(9 * 1024 * 1024, 0)));
+    std::vector<struct iovec> iov;
+    size_t offset = 0;
+    for (int i = 0; i < kPieces; ++i)
+    {
+      // lengths vary, so a writev stops in the middle of some piece
+      size_t len = 20000 + (static_cast<size_t>(i) * 7919) % 20000;
+      struct iovec vec = { &(*blob)[offset], len };
+      iov.push_back(vec);
+      expected->append(*blob, offset, len);
+      offset += len + 13;
+      firstBytes += len;
+    }
+    conn->send(iov.data(), static_cast<int>(iov.size()), blob);
+    std::weak_ptr<void> owner(blob);
+    test.watchOwner(owner);
+    blob.reset();
+    ownerQueued = !owner.expired();
+
+    // plain sends go after the queued pieces
+    const string plain = "plain send after pieces\n";
+    conn->send(plain);
+    expected->append(plain);
+
+    // pieces are sent in iov order, not in memory order
+    std::shared_ptr<string> blob2(new string(makeData(3000, 1)));
+    struct iovec iov2[] = {
+      { &(*blob2)[2000], 1000 },
+      { &(*blob2)[0], 1000 },
+      { &(*blob2)[1000], 1000 },
+    };
+    conn->send(iov2, 3, blob2);
+    test.watchOwner(blob2);
+    expected->append(*blob2, 2000, 1000);
+    expected->append(*blob2, 0, 2000);
+
+    Buffer buf;
+    buf.append("buffer send at the end\n");
+    expected->append(buf.peek(), buf.readableBytes());
+    conn->send(&buf);
+  });
+  test.run(4096, 100 * 1000, kHighWaterMark);
+
+  BOOST_CHECK_EQUAL(test.received().size(), test.expected().size());
+  BOOST_CHECK(test.received() == test.expected());
+  // the first writev was partial, the rest of the pieces waits
+  BOOST_CHECK(ownerQueued);
+  // queued pieces count towards the high water mark, once crossed
+  // the following sends don't cross it again
+  BOOST_CHECK_EQUAL(test.highWaterMarks(), 1);
+  BOOST_CHECK_GE(test.highWaterMarkBytes(), kHighWaterMark);
+  BOOST_CHECK_LT(test.highWaterMarkBytes(), firstBytes);
+  BOOST_CHECK_EQUAL(test.writeCompletes(), 1);
+  // written pieces don't hold their owners
+  BOOST_CHECK(test.ownersReleasedOnWriteComplete());
+}
+
+BOOST_AUTO_TEST_CASE(testSendIovecWrittenAtOnce)
+{
+  bool ownerKept = true;
+  IovecTest test([&](const TcpConnectionPtr& conn, string* expected) {
+    std::shared_ptr<string> blob(new string("0123456789"));
+    struct iovec iov[] = {
+      { &(*blob)[5], 5 },
+      { &(*blob)[0], 5 },
+    };
+    conn->send(iov, 2, blob);
+    ownerKept = blob.use_count() > 1;
+    expected->append("5678901234");
+  });
+  test.run(0, 0, 64 * 1024);
+
+  BOOST_CHECK_EQUAL(test.received(), test.expected());
+  BOOST_CHECK(!ownerKept);
+  BOOST_CHECK_EQUAL(test.highWaterMarks(), 0);
+  BOOST_CHECK_EQUAL(test.writeCompletes(), 1);
+}
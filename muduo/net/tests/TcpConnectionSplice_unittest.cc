@@ -0,0 +1,201 @@
+#include "muduo/net/TcpConnection.h"
+
+#include "muduo/base/CountDownLatch.h"
+#include "muduo/base/Thread.h"
+#include "muduo/net/EventLoop.h"
+#include "muduo/net/InetAddress.h"
+#include "muduo/net/TcpServer.h"
+
+//#define BOOST_TEST_MODULE TcpConnectionSpliceTest
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using muduo::string;
+using namespace muduo;
+using namespace muduo::net;
+
+namespace
+{
+
+const uint16_t kPort = 2310;
+
+// The first byte tells the role of a connection: 'R' for the reader,
+// then 'W' for the writer, whose bytes are spliced to the reader.
+class SpliceRelay : noncopyable
+{
+ public:
+  SpliceRelay(EventLoop* loop, const InetAddress& listenAddr)
+    : server_(loop, listenAddr, "SpliceRelay"),
+      readerConnected_(1)
+  {
+    server_.setConnectionCallback(
+        std::bind(&SpliceRelay::onConnection, this, _1));
+    server_.setMessageCallback(
+        std::bind(&SpliceRelay::onMessage, this, _1, _2, _3));
+  }
+
+  void start() { server_.start(); }
+
+  void waitForReader() { readerConnected_.wait(); }
+
+ private:
+  void onConnection(const TcpConnectionPtr& conn)
+  {
+    // the writer is gone, the reader gets what is left in the pipe, then EOF
+    if (!conn->connected() && conn == source_)
+    {
+      sink_->shutdown();
+    }
+  }
+
+  void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp)
+  {
+    BOOST_REQUIRE(conn != sink_ && conn != source_);
+    char role = buf->peek()[0];
+    buf->retrieve(1);
+    if (role == 'R')
+    {
+      sink_ = conn;
+      readerConnected_.countDown();
+    }
+    else
+    {
+      BOOST_REQUIRE(sink_);
+      source_ = conn;
+      sink_->send(buf);
+      conn->spliceTo(sink_);
+    }
+  }
+
+  TcpServer server_;
+  CountDownLatch readerConnected_;
+  TcpConnectionPtr sink_;
+  TcpConnectionPtr source_;
+};
+
+// Boost.Test checks are for the main thread, clients abort instead
+int connectRelay()
+{
+  int sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memZero(&addr, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (sockfd < 0 || ::connect(sockfd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) < 0)
+  {
+    perror("connectRelay");
+    abort();
+  }
+  return sockfd;
+}
+
+void writeAll(int sockfd, const char* data, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t n = ::write(sockfd, data, len);
+    if (n <= 0)
+    {
+      perror("writeAll");
+      abort();
+    }
+    data += n;
+    len -= static_cast<size_t>(n);
+  }
+}
+
+string makeData(size_t len)
+{
+  string data(len, '\0');
+  for (size_t i = 0; i < len; ++i)
+  {
+    // not periodic in the pipe or block sizes, a lost or repeated block shows
+    data[i] = static_cast<char>(i * 131 + (i >> 12));
+  }
+  return data;
+}
+
+// Relays data from a writer to a reader, which waits for delayUs before
+// reading anything, then sleeps pauseUs after each read of at most readSize.
+string relay(const string& data, int delayUs, size_t readSize, int pauseUs)
+{
+  EventLoop loop;
+  SpliceRelay relay(&loop, InetAddress(kPort));
+  relay.start();
+
+  string received;
+  ssize_t lastRead = -1;
+  Thread reader([&] {
+    int sockfd = connectRelay();
+    writeAll(sockfd, "R", 1);
+    if (delayUs > 0)
+    {
+      ::usleep(delayUs);
+    }
+    std::unique_ptr<char[]> buf(new char[readSize]);
+    while ((lastRead = ::read(sockfd, buf.get(), readSize)) > 0)
+    {
+      received.append(buf.get(), static_cast<size_t>(lastRead));
+      if (pauseUs > 0)
+      {
+        ::usleep(pauseUs);
+      }
+    }
+    ::close(sockfd);
+    loop.quit();
+  }, "reader");
+
+  Thread writer([&] {
+    relay.waitForReader();
+    int sockfd = connectRelay();
+    writeAll(sockfd, "W", 1);
+    const size_t kBlock = 16 * 1024;
+    for (size_t i = 0; i < data.size(); i += kBlock)
+    {
+      writeAll(sockfd, data.data() + i, std::min(kBlock, data.size() - i));
+    }
+    ::close(sockfd);
+  }, "writer");
+
+  reader.start();
+  writer.start();
+  loop.loop();
+  writer.join();
+  reader.join();
+  // EOF, not an error
+  BOOST_CHECK_EQUAL(lastRead, 0);
+  return received;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(testSpliceSlowReader)
+{
+  // much more than the pipe and the socket buffers hold,
+  // so the source pauses and resumes many times
+  const string data = makeData(8 * 1024 * 1024);
+  string received = relay(data, 0, 4096, 100);
+  BOOST_CHECK_EQUAL(received.size(), data.size());
+  BOOST_CHECK(received == data);
+}
+
+BOOST_AUTO_TEST_CASE(testSpliceSourceClosesEarly)
+{
+  // the writer closes while its bytes are still in the pipe or in the
+  // sockets, none of them is read yet
+  const string data = makeData(200 * 1000);
+  string received = relay(data, 300 * 1000, 1000, 0);
+  BOOST_CHECK_EQUAL(received.size(), data.size());
+  BOOST_CHECK(received == data);
+}